@@ -0,0 +1,88 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Corpora and timing shared by the benchmarks
+
+#ifndef __CCUNICODE_BENCH_COMMON__
+#define __CCUNICODE_BENCH_COMMON__
+
+#include "../include/ccunicode.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+typedef struct
+{
+    const char *name;
+    int mean_run_length;  // Mean number of consecutive characters of the same UTF8 length
+    int weights[4];       // Relative frequencies of the 1, 2, 3 and 4 bytes characters
+    uint32_t ranges[4][2]; // Codepoints drawn for each length, or {0, 0} for the defaults of ccunicode_InitCorpusGenerator
+} TCorpusSpec;
+
+// Corpora stay free of null characters, which end the strings of the nm functions
+static const TCorpusSpec Corpora[] =
+{
+    {"ascii", 1, {1, 0, 0, 0}, {{0, 0}}},
+    {"latin", 6, {8, 2, 0, 0}, {{0, 0}, {0xC0, 0x17F}}},
+    {"cyrillic", 6, {2, 8, 0, 0}, {{0x20, 0x40}, {0x410, 0x44F}}},
+    {"cjk", 8, {1, 0, 9, 0}, {{0x20, 0x40}, {0, 0}, {0x4E00, 0x9FFF}}},
+    {"emoji", 3, {5, 0, 0, 5}, {{0, 0}, {0, 0}, {0, 0}, {0x1F300, 0x1F64F}}},
+    {"mixed", 5, {4, 2, 2, 2}, {{0, 0}, {0x400, 0x4FF}, {0x4E00, 0x9FFF}, {0x1F600, 0x1F64F}}},
+    // Every character has a random length, which defeats branch prediction
+    {"adversarial", 1, {1, 1, 1, 1}, {{0, 0}}}
+};
+
+static double GetTime(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER Counter, Frequency;
+    QueryPerformanceCounter(&Counter);
+    QueryPerformanceFrequency(&Frequency);
+    return (double)Counter.QuadPart / (double)Frequency.QuadPart;
+#else
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (double)Time.tv_sec + (double)Time.tv_nsec * 1e-9;
+#endif
+}
+
+// Generates exactly Utf8Size bytes of UTF8 text, always the same for a given corpus and size
+static int GenerateCorpus(const TCorpusSpec *Spec, int Utf8Size, uint8_t *Utf8)
+{
+    TCCUnicode_CorpusGenerator Generator;
+    ccunicode_InitCorpusGenerator(&Generator, 0x9E3779B9u ^ (uint32_t)Utf8Size);
+    Generator.mean_run_length = Spec->mean_run_length;
+    for (int i = 0; i < 4; ++i)
+    {
+        Generator.weights[i] = Spec->weights[i];
+        if (Spec->ranges[i][1])
+        {
+            Generator.ranges[i][0] = Spec->ranges[i][0];
+            Generator.ranges[i][1] = Spec->ranges[i][1];
+        }
+    }
+    return ccunicode_GenerateUtf8(&Generator, Utf8, Utf8Size);
+}
+
+#endif // __CCUNICODE_BENCH_COMMON__
@@ -0,0 +1,267 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// ccunicode_compare: converts the benchmark corpora between UTF8 and UTF16 with ccunicode, iconv and std::codecvt,
+// checks that every implementation gives the same output and reports their throughputs.
+
+// The MSVC standard library rejects <codecvt> under C++17 unless this is defined before it is included
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+
+#include "common.h"
+#include <codecvt>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <locale>
+#include <string>
+#include <vector>
+#ifdef CCUNICODE_COMPARE_ICONV
+#include <iconv.h>
+#endif
+
+// std::wstring_convert and std::codecvt_utf8_utf16 are deprecated since C++17 but still shipped.
+// Their warnings are only silenced in this wrapper.
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#elif defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4996)
+#endif
+class TCodecvtConverter
+{
+public:
+    std::u16string FromBytes(const char *First, const char *Last) { return Converter.from_bytes(First, Last); }
+    std::string ToBytes(const std::u16string &Wide) { return Converter.to_bytes(Wide); }
+
+private:
+    std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t> Converter;
+};
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#elif defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+static const int CompareSizes[] = {4096, 65536, 1 << 20, 16 << 20};
+
+// Calls Func in batches for at least MinTime seconds and returns the fastest time per call in ns
+template <typename TFunc>
+static double Measure(TFunc Func, double MinTime)
+{
+    double Best = 0.0;
+    double Spent = 0.0;
+    int Calls = 1;
+    for (int Batch = 0; Spent < MinTime || Batch < 3; ++Batch)
+    {
+        double Start = GetTime();
+        for (int i = 0; i < Calls; ++i)
+            Func();
+        double Elapsed = GetTime() - Start;
+        Spent += Elapsed;
+        if (!Batch || Elapsed / Calls < Best)
+            Best = Elapsed / Calls;
+        if (Elapsed < MinTime / 10 && Calls < (1 << 28))
+            Calls *= 2;
+    }
+    return Best * 1e9;
+}
+
+#ifdef CCUNICODE_COMPARE_ICONV
+// Converts the whole input with iconv, returns the number of output bytes or -1 on error
+static long long ConvertWithIconv(iconv_t Converter, const void *Input, size_t InputSize, void *Output, size_t OutputSize)
+{
+    iconv(Converter, NULL, NULL, NULL, NULL);
+    char *In = (char*)Input;
+    char *Out = (char*)Output;
+    size_t InLeft = InputSize;
+    size_t OutLeft = OutputSize;
+    if (iconv(Converter, &In, &InLeft, &Out, &OutLeft) == (size_t)-1)
+        return -1;
+    return (long long)(OutputSize - OutLeft);
+}
+#endif
+
+static void PrintResult(const char *Corpus, int Size, const char *Direction, const char *Implementation, double NsPerCall, double Bytes, double Reference)
+{
+    printf("%-12s %10d %-10s %-12s %14.1f %10.3f %10.2fx\n", Corpus, Size, Direction, Implementation, NsPerCall, Bytes / NsPerCall, Reference / NsPerCall);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    const char *CorpusFilter = NULL;
+    int MaxSize = 16 << 20;
+    double MinTime = 0.1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if ((!strcmp(argv[i], "--corpus") || !strcmp(argv[i], "--max-size") || !strcmp(argv[i], "--time")) && i + 1 < argc)
+        {
+            const char *Value = argv[++i];
+            if (argv[i-1][2] == 'c')
+                CorpusFilter = Value;
+            else if (argv[i-1][2] == 'm')
+                MaxSize = atoi(Value);
+            else
+                MinTime = atof(Value);
+        }
+        else
+        {
+            printf("Usage: ccunicode_compare [--corpus NAME] [--max-size BYTES] [--time SECONDS]\n"
+                   "Speedups are given relative to ccunicode, converting the string as a single row of a column.\n"
+                   "ccunicode_nm is the string conversion (ccunicode_Utf8ToUtf16_nm and ccunicode_Utf16ToUtf8_nm).\n");
+            return strcmp(argv[i], "-h") && strcmp(argv[i], "--help") ? 2 : 0;
+        }
+    }
+
+#if defined(__GNUC__) && !defined(__OPTIMIZE__)
+    fprintf(stderr, "ccunicode_compare: built without optimizations, configure with CMAKE_BUILD_TYPE=Release for meaningful numbers\n");
+#endif
+
+#ifdef CCUNICODE_COMPARE_ICONV
+    iconv_t ToUtf16 = iconv_open("UTF-16LE", "UTF-8");
+    iconv_t ToUtf8 = iconv_open("UTF-8", "UTF-16LE");
+    if (ToUtf16 == (iconv_t)-1 || ToUtf8 == (iconv_t)-1)
+    {
+        fprintf(stderr, "ccunicode_compare: iconv does not support UTF-8 and UTF-16LE\n");
+        return 2;
+    }
+#else
+    fprintf(stderr, "ccunicode_compare: built without iconv\n");
+#endif
+    TCodecvtConverter Converter;
+
+    printf("%-12s %10s %-10s %-12s %14s %10s %11s\n", "corpus", "size", "direction", "library", "ns/call", "GB/s", "speedup");
+    int Status = 0;
+    for (size_t c = 0; c < sizeof(Corpora)/sizeof(*Corpora); ++c)
+    {
+        const TCorpusSpec *Spec = &Corpora[c];
+        if (CorpusFilter && strcmp(CorpusFilter, Spec->name))
+            continue;
+
+        for (size_t s = 0; s < sizeof(CompareSizes)/sizeof(*CompareSizes) && CompareSizes[s] <= MaxSize; ++s)
+        {
+            const int Size = CompareSizes[s];
+            std::vector<uint8_t> Utf8(Size + 1);
+            GenerateCorpus(Spec, Size, Utf8.data());
+
+            // ccunicode gives the reference outputs, every UTF8 byte gives at most one UTF16 short.
+            // The capacities given to the nm functions do not count the final 0.
+            std::vector<uint16_t> Utf16(Size + 1);
+            int Utf16Size = ccunicode_Utf8ToUtf16_nm(Utf8.data(), Size, Utf16.data(), Size);
+            if (Utf16Size < 0)
+            {
+                fprintf(stderr, "ccunicode_compare: error %d converting the %s corpus\n", Utf16Size, Spec->name);
+                return 2;
+            }
+
+            std::vector<uint16_t> Utf16Out(Size + 1);
+            std::vector<uint8_t> Utf8Out(Size + 1);
+            const double Utf8Bytes = Size;
+            const double Utf16Bytes = 2.0 * Utf16Size;
+
+            // The reference is the conversion of the string as a single row of a column: it copies ASCII runs 8 bytes at a time
+            // and encodes straight into the output, where the string functions go through a buffer of codepoints
+            const int32_t Utf8Offsets[2] = {0, Size};
+            const int32_t Utf16Offsets[2] = {0, Utf16Size};
+            int32_t OutOffsets[2];
+
+            // UTF8 to UTF16
+            if (ccunicode_Utf8ToUtf16Column_m(Utf8.data(), Utf8Offsets, 1, Utf16Out.data(), Size, OutOffsets, NULL) != CCUNICODE_NO_ERROR ||
+                OutOffsets[1] != Utf16Size || memcmp(Utf16Out.data(), Utf16.data(), (size_t)Utf16Bytes))
+            {
+                fprintf(stderr, "ccunicode_compare: the column conversion gives a different UTF16 output on %s/%d\n", Spec->name, Size);
+                Status = 1;
+            }
+            double Reference = Measure([&]() { ccunicode_Utf8ToUtf16Column_m(Utf8.data(), Utf8Offsets, 1, Utf16Out.data(), Size, OutOffsets, NULL); }, MinTime);
+            PrintResult(Spec->name, Size, "utf8>utf16", "ccunicode", Reference, Utf8Bytes, Reference);
+            double NsPerCall = Measure([&]() { ccunicode_Utf8ToUtf16_nm(Utf8.data(), Size, Utf16Out.data(), Size); }, MinTime);
+            PrintResult(Spec->name, Size, "utf8>utf16", "ccunicode_nm", NsPerCall, Utf8Bytes, Reference);
+
+#ifdef CCUNICODE_COMPARE_ICONV
+            // Our UTF16 strings are in host order, so iconv only matches on little endian hosts
+            long long IconvBytes = ConvertWithIconv(ToUtf16, Utf8.data(), Size, Utf16Out.data(), 2 * (size_t)(Size + 1));
+            if (IconvBytes != Utf16Bytes || memcmp(Utf16Out.data(), Utf16.data(), (size_t)Utf16Bytes))
+            {
+                fprintf(stderr, "ccunicode_compare: iconv gives a different UTF16 output on %s/%d\n", Spec->name, Size);
+                Status = 1;
+            }
+            NsPerCall = Measure([&]() { ConvertWithIconv(ToUtf16, Utf8.data(), Size, Utf16Out.data(), 2 * (size_t)(Size + 1)); }, MinTime);
+            PrintResult(Spec->name, Size, "utf8>utf16", "iconv", NsPerCall, Utf8Bytes, Reference);
+#endif
+
+            std::u16string Wide = Converter.FromBytes((const char*)Utf8.data(), (const char*)Utf8.data() + Size);
+            if (Wide.size() != (size_t)Utf16Size || memcmp(Wide.data(), Utf16.data(), (size_t)Utf16Bytes))
+            {
+                fprintf(stderr, "ccunicode_compare: std::codecvt gives a different UTF16 output on %s/%d\n", Spec->name, Size);
+                Status = 1;
+            }
+            NsPerCall = Measure([&]() { Wide = Converter.FromBytes((const char*)Utf8.data(), (const char*)Utf8.data() + Size); }, MinTime);
+            PrintResult(Spec->name, Size, "utf8>utf16", "codecvt", NsPerCall, Utf8Bytes, Reference);
+
+            // UTF16 to UTF8
+            if (ccunicode_Utf16ToUtf8_nm(Utf16.data(), Utf16Size, Utf8Out.data(), Size) != Size || memcmp(Utf8Out.data(), Utf8.data(), Size))
+            {
+                fprintf(stderr, "ccunicode_compare: ccunicode does not give the corpus back on %s/%d\n", Spec->name, Size);
+                Status = 1;
+            }
+            if (ccunicode_Utf16ToUtf8Column_m(Utf16.data(), Utf16Offsets, 1, Utf8Out.data(), Size, OutOffsets, NULL) != CCUNICODE_NO_ERROR ||
+                OutOffsets[1] != Size || memcmp(Utf8Out.data(), Utf8.data(), Size))
+            {
+                fprintf(stderr, "ccunicode_compare: the column conversion does not give the corpus back on %s/%d\n", Spec->name, Size);
+                Status = 1;
+            }
+            Reference = Measure([&]() { ccunicode_Utf16ToUtf8Column_m(Utf16.data(), Utf16Offsets, 1, Utf8Out.data(), Size, OutOffsets, NULL); }, MinTime);
+            PrintResult(Spec->name, Size, "utf16>utf8", "ccunicode", Reference, Utf16Bytes, Reference);
+            NsPerCall = Measure([&]() { ccunicode_Utf16ToUtf8_nm(Utf16.data(), Utf16Size, Utf8Out.data(), Size); }, MinTime);
+            PrintResult(Spec->name, Size, "utf16>utf8", "ccunicode_nm", NsPerCall, Utf16Bytes, Reference);
+
+#ifdef CCUNICODE_COMPARE_ICONV
+            IconvBytes = ConvertWithIconv(ToUtf8, Utf16.data(), (size_t)Utf16Bytes, Utf8Out.data(), Size);
+            if (IconvBytes != Size || memcmp(Utf8Out.data(), Utf8.data(), Size))
+            {
+                fprintf(stderr, "ccunicode_compare: iconv gives a different UTF8 output on %s/%d\n", Spec->name, Size);
+                Status = 1;
+            }
+            NsPerCall = Measure([&]() { ConvertWithIconv(ToUtf8, Utf16.data(), (size_t)Utf16Bytes, Utf8Out.data(), Size); }, MinTime);
+            PrintResult(Spec->name, Size, "utf16>utf8", "iconv", NsPerCall, Utf16Bytes, Reference);
+#endif
+
+            std::u16string Input((const char16_t*)Utf16.data(), (size_t)Utf16Size);
+            std::string Narrow = Converter.ToBytes(Input);
+            if (Narrow.size() != (size_t)Size || memcmp(Narrow.data(), Utf8.data(), Size))
+            {
+                fprintf(stderr, "ccunicode_compare: std::codecvt gives a different UTF8 output on %s/%d\n", Spec->name, Size);
+                Status = 1;
+            }
+            NsPerCall = Measure([&]() { Narrow = Converter.ToBytes(Input); }, MinTime);
+            PrintResult(Spec->name, Size, "utf16>utf8", "codecvt", NsPerCall, Utf16Bytes, Reference);
+        }
+    }
+
+#ifdef CCUNICODE_COMPARE_ICONV
+    iconv_close(ToUtf16);
+    iconv_close(ToUtf8);
+#endif
+    return Status;
+}
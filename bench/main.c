@@ -0,0 +1,604 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// ccunicode_bench: measures the throughput of the conversion functions on synthetic corpora.
+// Every kernel is timed on every corpus and size, and the results can be written as JSON and compared with a previous run.
+
+#include "common.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define BENCH_MAX_RESULTS 1024
+
+static const int DefaultSizes[] = {16, 256, 4096, 65536, 1 << 20, 16 << 20, 256 << 20};
+
+typedef struct
+{
+    int malloc_count;
+} TCountingContext;
+
+static void *CountingMalloc(void *Ctx, size_t Size)
+{
+    ((TCountingContext*)Ctx)->malloc_count++;
+    return malloc(Size);
+}
+
+static void CountingFree(void *Ctx, void *Ptr)
+{
+    (void)Ctx;
+    free(Ptr);
+}
+
+typedef struct
+{
+    const uint8_t *utf8;
+    int utf8_size;
+    const uint16_t *utf16;
+    int utf16_size;
+    const uint32_t *codepoints;
+    int codepoint_count;
+    uint8_t *utf8_out;
+    uint16_t *utf16_out;
+    uint32_t *codepoints_out;
+    TCCUnicode_CtxMallocPtr allocator;
+    TCountingContext counter;
+} TBenchData;
+
+typedef struct
+{
+    const char *name;
+    int input;       // 0: UTF8, 1: UTF16, 2: codepoints, used to count the bytes processed
+    int (*run)(TBenchData *Data);
+} TKernel;
+
+static int RunCountUtf8(TBenchData *Data)
+{
+    return ccunicode_CountCodepointsInUtf8_n(Data->utf8, Data->utf8_size);
+}
+
+static int RunCountUtf16(TBenchData *Data)
+{
+    return ccunicode_CountCodepointsInUtf16_n(Data->utf16, Data->utf16_size);
+}
+
+static int RunUtf8Size(TBenchData *Data)
+{
+    return ccunicode_GetUtf8SizeFromCodepoints_n(Data->codepoints, Data->codepoint_count);
+}
+
+static int RunUtf16Size(TBenchData *Data)
+{
+    return ccunicode_GetUtf16SizeFromCodepoints_n(Data->codepoints, Data->codepoint_count);
+}
+
+static int RunDecodeUtf8(TBenchData *Data)
+{
+    return ccunicode_Utf8ToCodepoints_nm(Data->utf8, Data->utf8_size, Data->codepoints_out, Data->codepoint_count+1);
+}
+
+static int RunDecodeUtf16(TBenchData *Data)
+{
+    return ccunicode_Utf16ToCodepoints_nm(Data->utf16, Data->utf16_size, Data->codepoints_out, Data->codepoint_count+1);
+}
+
+static int RunEncodeUtf8(TBenchData *Data)
+{
+    return ccunicode_CodepointsToUtf8_nm(Data->codepoints, Data->codepoint_count, Data->utf8_out, Data->utf8_size+1);
+}
+
+static int RunEncodeUtf16(TBenchData *Data)
+{
+    return ccunicode_CodepointsToUtf16_nm(Data->codepoints, Data->codepoint_count, Data->utf16_out, Data->utf16_size+1);
+}
+
+static int RunUtf8ToUtf16_na(TBenchData *Data)
+{
+    uint16_t *Utf16Str = NULL;
+    int Res = ccunicode_Utf8ToUtf16_na(Data->utf8, Data->utf8_size, &Utf16Str, &Data->allocator.malloc_ptr);
+    // The output comes from the counting allocator, so it goes back through it
+    if (Res >= 0)
+        Data->allocator.ctx_free_func(Data->allocator.ctx, Utf16Str);
+    return Res;
+}
+
+static int RunUtf8ToUtf16_nma(TBenchData *Data)
+{
+    return ccunicode_Utf8ToUtf16_nma(Data->utf8, Data->utf8_size, Data->utf16_out, Data->utf16_size+1, &Data->allocator.malloc_ptr);
+}
+
+static int RunUtf16ToUtf8_na(TBenchData *Data)
+{
+    uint8_t *Utf8Str = NULL;
+    int Res = ccunicode_Utf16ToUtf8_na(Data->utf16, Data->utf16_size, &Utf8Str, &Data->allocator.malloc_ptr);
+    if (Res >= 0)
+        Data->allocator.ctx_free_func(Data->allocator.ctx, Utf8Str);
+    return Res;
+}
+
+static int RunUtf16ToUtf8_nma(TBenchData *Data)
+{
+    return ccunicode_Utf16ToUtf8_nma(Data->utf16, Data->utf16_size, Data->utf8_out, Data->utf8_size+1, &Data->allocator.malloc_ptr);
+}
+
+static const TKernel Kernels[] =
+{
+    {"count_utf8", 0, &RunCountUtf8},
+    {"count_utf16", 1, &RunCountUtf16},
+    {"size_utf8", 2, &RunUtf8Size},
+    {"size_utf16", 2, &RunUtf16Size},
+    {"decode_utf8_nm", 0, &RunDecodeUtf8},
+    {"decode_utf16_nm", 1, &RunDecodeUtf16},
+    {"encode_utf8_nm", 2, &RunEncodeUtf8},
+    {"encode_utf16_nm", 2, &RunEncodeUtf16},
+    {"utf8_to_utf16_na", 0, &RunUtf8ToUtf16_na},
+    {"utf8_to_utf16_nma", 0, &RunUtf8ToUtf16_nma},
+    {"utf16_to_utf8_na", 1, &RunUtf16ToUtf8_na},
+    {"utf16_to_utf8_nma", 1, &RunUtf16ToUtf8_nma}
+};
+
+typedef struct
+{
+    char corpus[32];
+    int size;
+    char kernel[32];
+    double ns_per_call;
+    double gb_per_s;
+    double allocs_per_call;
+    double counters[4];   // Hardware counters per input byte, negative when unavailable
+} TResult;
+
+// Hardware counters read around the kernels with --counters (Linux only)
+#define BENCH_CYCLES 0
+#define BENCH_INSTRUCTIONS 1
+#define BENCH_BRANCH_MISSES 2
+#define BENCH_L1D_MISSES 3
+
+typedef struct
+{
+    int fds[4];  // File descriptors of the counters, -1 when a counter is unavailable
+} TCounters;
+
+// Opens the counters that the kernel and the permissions allow, returns how many were opened
+static int OpenCounters(TCounters *Counters)
+{
+    int Count = 0;
+    for (int i = 0; i < 4; ++i)
+        Counters->fds[i] = -1;
+
+#ifdef __linux__
+    const uint32_t Types[4] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE};
+    const uint64_t Configs[4] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES,
+                                 PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+    for (int i = 0; i < 4; ++i)
+    {
+        struct perf_event_attr Attr;
+        memset(&Attr, 0, sizeof(Attr));
+        Attr.size = sizeof(Attr);
+        Attr.type = Types[i];
+        Attr.config = Configs[i];
+        Attr.disabled = 1;
+        // User space only, which is allowed with the default perf_event_paranoid setting
+        Attr.exclude_kernel = 1;
+        Attr.exclude_hv = 1;
+        Attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        Counters->fds[i] = (int)syscall(__NR_perf_event_open, &Attr, 0, -1, -1, 0);
+        if (Counters->fds[i] >= 0)
+            ++Count;
+    }
+#endif
+    return Count;
+}
+
+static void CloseCounters(TCounters *Counters)
+{
+#ifdef __linux__
+    for (int i = 0; i < 4; ++i)
+    {
+        if (Counters->fds[i] >= 0)
+            close(Counters->fds[i]);
+    }
+#else
+    (void)Counters;
+#endif
+}
+
+// Runs the kernel Calls times with the counters enabled, Values receives the counts per call (negative when unavailable)
+static void CountKernel(const TKernel *Kernel, TBenchData *Data, TCounters *Counters, int Calls, double *Values)
+{
+    for (int i = 0; i < 4; ++i)
+        Values[i] = -1.0;
+
+#ifdef __linux__
+    for (int i = 0; i < 4; ++i)
+    {
+        if (Counters->fds[i] >= 0)
+        {
+            ioctl(Counters->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(Counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    for (int i = 0; i < Calls; ++i)
+        Kernel->run(Data);
+    for (int i = 0; i < 4; ++i)
+    {
+        if (Counters->fds[i] >= 0)
+            ioctl(Counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        // Counts are scaled when the counters were multiplexed
+        uint64_t Read[3];
+        if (Counters->fds[i] < 0 || read(Counters->fds[i], Read, sizeof(Read)) != (ssize_t)sizeof(Read) || !Read[2])
+            continue;
+        Values[i] = (double)Read[0] * ((double)Read[1] / (double)Read[2]) / Calls;
+    }
+#else
+    (void)Kernel;
+    (void)Data;
+    (void)Counters;
+    (void)Calls;
+#endif
+}
+
+static void PrintUsage(FILE *Out)
+{
+    fprintf(Out,
+            "Usage: ccunicode_bench [options]\n"
+            "\n"
+            "  --corpus NAME     only run this corpus (ascii, latin, cyrillic, cjk, emoji, mixed, adversarial)\n"
+            "  --kernel NAME     only run kernels whose name starts with NAME\n"
+            "  --max-size BYTES  largest corpus size (default 16777216, up to 268435456)\n"
+            "  --size BYTES      only run this corpus size\n"
+            "  --time SECONDS    minimum measured time per result (default 0.1)\n"
+            "  --json FILE       write the results as JSON\n"
+            "  --baseline FILE   compare with the results of a previous --json run\n"
+            "  --counters        also report hardware counters per byte (Linux perf_event_open)\n"
+            "  -h, --help        show this help\n");
+}
+
+// Reads the results written by WriteJson (one result per line)
+static int ReadBaseline(const char *Path, TResult *Results, int MaxCount)
+{
+    FILE *File = fopen(Path, "r");
+    if (!File)
+        return -1;
+
+    int Count = 0;
+    char Line[512];
+    while (Count < MaxCount && fgets(Line, sizeof(Line), File))
+    {
+        TResult *Result = &Results[Count];
+        if (sscanf(Line, " {\"corpus\": \"%31[^\"]\", \"size\": %d, \"kernel\": \"%31[^\"]\", \"ns_per_call\": %lf, \"gb_per_s\": %lf, \"allocs_per_call\": %lf",
+                   Result->corpus, &Result->size, Result->kernel, &Result->ns_per_call, &Result->gb_per_s, &Result->allocs_per_call) == 6)
+            ++Count;
+    }
+    fclose(File);
+    return Count;
+}
+
+static int WriteJson(const char *Path, const TResult *Results, int Count)
+{
+    FILE *File = fopen(Path, "w");
+    if (!File)
+        return -1;
+
+    fprintf(File, "{\n  \"results\": [\n");
+    for (int i = 0; i < Count; ++i)
+    {
+        const TResult *Result = &Results[i];
+        fprintf(File, "    {\"corpus\": \"%s\", \"size\": %d, \"kernel\": \"%s\", \"ns_per_call\": %.3f, \"gb_per_s\": %.4f, \"allocs_per_call\": %.3f",
+                Result->corpus, Result->size, Result->kernel, Result->ns_per_call, Result->gb_per_s, Result->allocs_per_call);
+
+        // Unavailable counters are left out
+        const char *CounterNames[4] = {"cycles_per_byte", "instructions_per_byte", "branch_misses_per_kb", "l1d_misses_per_kb"};
+        for (int j = 0; j < 4; ++j)
+        {
+            if (Result->counters[j] >= 0)
+                fprintf(File, ", \"%s\": %.4f", CounterNames[j], Result->counters[j]);
+        }
+        fprintf(File, "}%s\n", (i + 1 < Count) ? "," : "");
+    }
+    fprintf(File, "  ]\n}\n");
+    return fclose(File);
+}
+
+static const TResult *FindResult(const TResult *Results, int Count, const TResult *Key)
+{
+    for (int i = 0; i < Count; ++i)
+    {
+        if (Results[i].size == Key->size && !strcmp(Results[i].corpus, Key->corpus) && !strcmp(Results[i].kernel, Key->kernel))
+            return &Results[i];
+    }
+    return NULL;
+}
+
+// Calls the kernel in batches until MinTime is spent, and keeps the fastest batch
+static int MeasureKernel(const TKernel *Kernel, TBenchData *Data, double MinTime, double *NsPerCall, double *AllocsPerCall)
+{
+    int Res = Kernel->run(Data);
+    if (Res < 0)
+        return Res;
+
+    int Calls = 1;
+    double Best = 0.0;
+    double Spent = 0.0;
+    int Batches = 0;
+    Data->counter.malloc_count = 0;
+    long long TotalCalls = 0;
+    while (Spent < MinTime || Batches < 3)
+    {
+        double Start = GetTime();
+        for (int i = 0; i < Calls; ++i)
+            Kernel->run(Data);
+        double Elapsed = GetTime() - Start;
+
+        Spent += Elapsed;
+        TotalCalls += Calls;
+        double PerCall = Elapsed / Calls;
+        if (!Batches || PerCall < Best)
+            Best = PerCall;
+        ++Batches;
+
+        // Batches grow until they last about a tenth of the measurement
+        if (Elapsed < MinTime / 10 && Calls < (1 << 28))
+            Calls *= 2;
+    }
+
+    *NsPerCall = Best * 1e9;
+    *AllocsPerCall = (double)Data->counter.malloc_count / (double)TotalCalls;
+    return Res;
+}
+
+int main(int argc, char **argv)
+{
+    const char *CorpusFilter = NULL;
+    const char *KernelFilter = NULL;
+    const char *JsonPath = NULL;
+    const char *BaselinePath = NULL;
+    int MaxSize = 16 << 20;
+    int OnlySize = 0;
+    double MinTime = 0.1;
+    int UseCounters = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *Arg = argv[i];
+        const char *Value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (!strcmp(Arg, "-h") || !strcmp(Arg, "--help"))
+        {
+            PrintUsage(stdout);
+            return 0;
+        }
+        if (!strcmp(Arg, "--counters"))
+        {
+            UseCounters = 1;
+            continue;
+        }
+        if (!Value)
+        {
+            PrintUsage(stderr);
+            return 2;
+        }
+        ++i;
+        if (!strcmp(Arg, "--corpus"))
+            CorpusFilter = Value;
+        else if (!strcmp(Arg, "--kernel"))
+            KernelFilter = Value;
+        else if (!strcmp(Arg, "--max-size"))
+            MaxSize = atoi(Value);
+        else if (!strcmp(Arg, "--size"))
+            OnlySize = atoi(Value);
+        else if (!strcmp(Arg, "--time"))
+            MinTime = atof(Value);
+        else if (!strcmp(Arg, "--json"))
+            JsonPath = Value;
+        else if (!strcmp(Arg, "--baseline"))
+            BaselinePath = Value;
+        else
+        {
+            PrintUsage(stderr);
+            return 2;
+        }
+    }
+
+    static TResult Baseline[BENCH_MAX_RESULTS];
+    int BaselineCount = 0;
+    if (BaselinePath)
+    {
+        BaselineCount = ReadBaseline(BaselinePath, Baseline, BENCH_MAX_RESULTS);
+        if (BaselineCount < 0)
+        {
+            fprintf(stderr, "ccunicode_bench: cannot read %s\n", BaselinePath);
+            return 2;
+        }
+    }
+
+    int Sizes[sizeof(DefaultSizes)/sizeof(*DefaultSizes)];
+    int SizeCount = 0;
+    if (OnlySize > 0)
+    {
+        Sizes[SizeCount++] = OnlySize;
+    }
+    else
+    {
+        for (size_t s = 0; s < sizeof(DefaultSizes)/sizeof(*DefaultSizes) && DefaultSizes[s] <= MaxSize; ++s)
+            Sizes[SizeCount++] = DefaultSizes[s];
+    }
+    if (!SizeCount)
+    {
+        fprintf(stderr, "ccunicode_bench: no corpus size selected\n");
+        return 2;
+    }
+
+    // Buffers are sized once for the largest corpus: at most one codepoint per byte
+    int LargestSize = Sizes[SizeCount - 1];
+
+    size_t Capacity = (size_t)LargestSize + 1;
+    uint32_t *Codepoints = (uint32_t*)malloc(Capacity * sizeof(uint32_t));
+    uint32_t *CodepointsOut = (uint32_t*)malloc(Capacity * sizeof(uint32_t));
+    uint8_t *Utf8 = (uint8_t*)malloc(Capacity);
+    uint8_t *Utf8Out = (uint8_t*)malloc(Capacity);
+    uint16_t *Utf16 = (uint16_t*)malloc(Capacity * sizeof(uint16_t));
+    uint16_t *Utf16Out = (uint16_t*)malloc(Capacity * sizeof(uint16_t));
+    if (!Codepoints || !CodepointsOut || !Utf8 || !Utf8Out || !Utf16 || !Utf16Out)
+    {
+        fprintf(stderr, "ccunicode_bench: out of memory\n");
+        return 2;
+    }
+
+    TCounters Counters;
+    int CounterCount = UseCounters ? OpenCounters(&Counters) : 0;
+    if (UseCounters && !CounterCount)
+    {
+        fprintf(stderr, "ccunicode_bench: hardware counters are unavailable (see /proc/sys/kernel/perf_event_paranoid), running without them\n");
+        UseCounters = 0;
+    }
+
+    static TResult Results[BENCH_MAX_RESULTS];
+    int ResultCount = 0;
+
+    printf("%-12s %10s %-20s %14s %10s %12s", "corpus", "size", "kernel", "ns/call", "GB/s", "allocs/call");
+    if (UseCounters)
+        printf(" %8s %8s %6s %11s %11s", "cyc/B", "ins/B", "IPC", "brmiss/KB", "L1miss/KB");
+    if (BaselineCount)
+        printf(" %10s", "speedup");
+    printf("\n");
+
+    for (size_t c = 0; c < sizeof(Corpora)/sizeof(*Corpora); ++c)
+    {
+        const TCorpusSpec *Spec = &Corpora[c];
+        if (CorpusFilter && strcmp(CorpusFilter, Spec->name))
+            continue;
+
+        for (int s = 0; s < SizeCount; ++s)
+        {
+            int Size = Sizes[s];
+            TBenchData Data;
+            memset(&Data, 0, sizeof(Data));
+            Data.utf8_size = GenerateCorpus(Spec, Size, Utf8);
+            Data.codepoint_count = ccunicode_Utf8ToCodepoints_nm(Utf8, Data.utf8_size, Codepoints, (int)Capacity);
+            Data.codepoints = Codepoints;
+            Data.utf16_size = ccunicode_CodepointsToUtf16_nm(Codepoints, Data.codepoint_count, Utf16, (int)Capacity);
+            if (Data.utf8_size < 0 || Data.codepoint_count < 0 || Data.utf16_size < 0)
+            {
+                fprintf(stderr, "ccunicode_bench: could not encode the %s corpus\n", Spec->name);
+                return 2;
+            }
+            Data.utf8 = Utf8;
+            Data.utf16 = Utf16;
+            Data.utf8_out = Utf8Out;
+            Data.utf16_out = Utf16Out;
+            Data.codepoints_out = CodepointsOut;
+            ccunicode_InitCtxMallocPtr(&Data.allocator, &Data.counter, &CountingMalloc, &CountingFree);
+
+            for (size_t k = 0; k < sizeof(Kernels)/sizeof(*Kernels); ++k)
+            {
+                const TKernel *Kernel = &Kernels[k];
+                if (KernelFilter && strncmp(KernelFilter, Kernel->name, strlen(KernelFilter)))
+                    continue;
+                if (ResultCount == BENCH_MAX_RESULTS)
+                    break;
+
+                TResult *Result = &Results[ResultCount];
+                double NsPerCall = 0.0;
+                double AllocsPerCall = 0.0;
+                int Res = MeasureKernel(Kernel, &Data, MinTime, &NsPerCall, &AllocsPerCall);
+                if (Res < 0)
+                {
+                    fprintf(stderr, "ccunicode_bench: %s failed on %s/%d with error %d\n", Kernel->name, Spec->name, Size, Res);
+                    return 1;
+                }
+
+                int64_t Bytes = (Kernel->input == 0) ? Data.utf8_size : (Kernel->input == 1) ? 2*(int64_t)Data.utf16_size : 4*(int64_t)Data.codepoint_count;
+                snprintf(Result->corpus, sizeof(Result->corpus), "%s", Spec->name);
+                snprintf(Result->kernel, sizeof(Result->kernel), "%s", Kernel->name);
+                Result->size = Size;
+                Result->ns_per_call = NsPerCall;
+                Result->gb_per_s = (double)Bytes / NsPerCall;
+                Result->allocs_per_call = AllocsPerCall;
+                for (int i = 0; i < 4; ++i)
+                    Result->counters[i] = -1.0;
+                ++ResultCount;
+
+                printf("%-12s %10d %-20s %14.1f %10.3f %12.2f", Result->corpus, Size, Result->kernel, NsPerCall, Result->gb_per_s, AllocsPerCall);
+                if (UseCounters)
+                {
+                    // The counted run lasts about a tenth of the measurement
+                    double Calls = MinTime * 1e8 / NsPerCall;
+                    double PerCall[4];
+                    CountKernel(Kernel, &Data, &Counters, Calls < 1 ? 1 : Calls > (1 << 28) ? (1 << 28) : (int)Calls, PerCall);
+
+                    // Cycles and instructions per byte, misses per KB of input
+                    const double Scales[4] = {1.0, 1.0, 1024.0, 1024.0};
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        if (PerCall[i] >= 0 && Bytes > 0)
+                            Result->counters[i] = PerCall[i] * Scales[i] / (double)Bytes;
+                    }
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        if (i == 2)
+                        {
+                            if (Result->counters[BENCH_CYCLES] > 0 && Result->counters[BENCH_INSTRUCTIONS] >= 0)
+                                printf(" %6.2f", Result->counters[BENCH_INSTRUCTIONS] / Result->counters[BENCH_CYCLES]);
+                            else
+                                printf(" %6s", "-");
+                        }
+                        if (Result->counters[i] >= 0)
+                            printf(i < 2 ? " %8.3f" : " %11.3f", Result->counters[i]);
+                        else
+                            printf(i < 2 ? " %8s" : " %11s", "-");
+                    }
+                }
+                const TResult *Previous = FindResult(Baseline, BaselineCount, Result);
+                if (Previous)
+                    printf(" %9.2fx", Previous->ns_per_call / NsPerCall);
+                printf("\n");
+                fflush(stdout);
+            }
+        }
+    }
+
+    if (UseCounters)
+        CloseCounters(&Counters);
+    free(Codepoints);
+    free(CodepointsOut);
+    free(Utf8);
+    free(Utf8Out);
+    free(Utf16);
+    free(Utf16Out);
+
+    if (JsonPath && WriteJson(JsonPath, Results, ResultCount) != 0)
+    {
+        fprintf(stderr, "ccunicode_bench: cannot write %s\n", JsonPath);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,205 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Differential fuzz target of the encoders: every function writing UTF8 or UTF16 from codepoints is compared with
+// ccunicode_CodepointsToUtf8_nm and ccunicode_CodepointsToUtf16_nm, and their output is decoded back.
+// The input is read as little endian 32 bits values, mapped so that most of them are valid codepoints.
+
+#define CCUNICODE_SMALL_STRING_CODEPOINTS 8
+#define CCUNICODE_PARALLEL_MIN_CHUNK 16
+#define __CCUNICODE_IMPL__
+#include "../include/ccunicode.h"
+#include "common.h"
+
+#define CHECK_OUTPUT(Result, Out, ExpectedResult, Expected, Name)                                                      \
+    do                                                                                                                \
+    {                                                                                                                 \
+        FUZZ_FEATURE(FuzzClass(Result));                                                                              \
+        FUZZ_CHECK((Result) == (ExpectedResult), Name);                                                               \
+        FUZZ_CHECK((Result) < 0 || (!memcmp(Out, Expected, (size_t)(Result) * sizeof(*(Out))) && !(Out)[Result]), Name); \
+    } while (0)
+
+// The two top bits choose ASCII, the BMP (surrogates included), any codepoint or the values around 0x10FFFF
+static uint32_t GetCodepoint(uint32_t Value)
+{
+    switch (Value >> 30)
+    {
+    case 0: return Value & 0x7F;
+    case 1: return Value & 0xFFFF;
+    case 2: return (Value & 0x3FFFFFFF) % 0x110000;
+    default: return 0x10FFF0 + (Value & 0x1F);
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t DataSize)
+{
+    if (DataSize > FUZZ_MAX_INPUT_SIZE)
+        return 0;
+    int Count = (int)(DataSize / 4);
+    uint64_t Params = FuzzHash(Data, DataSize);
+
+    uint32_t *Codepoints = (uint32_t*)malloc((size_t)(Count + 1) * sizeof(uint32_t));
+    uint32_t *Decoded = (uint32_t*)malloc((size_t)(Count + 1) * sizeof(uint32_t));
+    uint8_t *Utf8 = (uint8_t*)malloc((size_t)(Count + 1) * 4);
+    uint8_t *Utf8Out = (uint8_t*)malloc((size_t)(Count + 1) * 4);
+    uint8_t *Utf8Loop = (uint8_t*)malloc((size_t)(Count + 1) * 4);
+    uint16_t *Utf16 = (uint16_t*)malloc((size_t)(Count + 1) * 2 * sizeof(uint16_t));
+    uint16_t *Utf16Out = (uint16_t*)malloc((size_t)(Count + 1) * 2 * sizeof(uint16_t));
+    uint16_t *Utf16Loop = (uint16_t*)malloc((size_t)(Count + 1) * 2 * sizeof(uint16_t));
+    uint8_t *Source = (uint8_t*)malloc((size_t)(Count + 1) * 4);
+    uint8_t *ExpectedBytes = (uint8_t*)calloc((size_t)(Count + 1), 4);
+    uint8_t *OutBytes = (uint8_t*)malloc((size_t)(Count + 1) * 4 + 16);
+    if (!Codepoints || !Decoded || !Utf8 || !Utf8Out || !Utf8Loop || !Utf16 || !Utf16Out || !Utf16Loop || !Source || !ExpectedBytes || !OutBytes)
+        abort();
+    int StringCount = Count, ValidCount = Count;
+    for (int i = 0; i < Count; ++i)
+    {
+        Codepoints[i] = GetCodepoint((uint32_t)(Data[4*i] | Data[4*i + 1] << 8 | Data[4*i + 2] << 16) | (uint32_t)Data[4*i + 3] << 24);
+        if (!Codepoints[i] && StringCount == Count)
+            StringCount = i;
+        if (!FuzzIsValidCodepoint(Codepoints[i]) && ValidCount == Count)
+            ValidCount = i;
+        FUZZ_FEATURE((Data[4*i + 3] >> 6) * 2 + FuzzIsValidCodepoint(Codepoints[i]));
+    }
+    Codepoints[Count] = 0;
+
+    // References
+    int Utf8Count = ccunicode_CodepointsToUtf8_nm(Codepoints, Count, Utf8, 4 * Count);
+    int Utf16Count = ccunicode_CodepointsToUtf16_nm(Codepoints, Count, Utf16, 2 * Count);
+    FUZZ_FEATURE(FuzzClass(Utf8Count));
+    FUZZ_FEATURE(FuzzClass(Utf16Count));
+    FUZZ_CHECK(ValidCount < StringCount ? Utf8Count == CCUNICODE_INVALID_CODEPOINT : Utf8Count >= 0, "ccunicode_CodepointsToUtf8_nm");
+    FUZZ_CHECK(ValidCount < StringCount ? Utf16Count == CCUNICODE_INVALID_CODEPOINT : Utf16Count >= 0, "ccunicode_CodepointsToUtf16_nm");
+
+    // Codepoints encoded one by one, into an output that may be too small
+    int Utf8Limit = Params & 3 ? 4 * Count : (int)((Params >> 2) % (uint64_t)(4 * Count + 1));
+    int Utf16Limit = Params & 3 ? 2 * Count : Utf8Limit / 2;
+    int Utf8Pos = 0, Utf16Pos = 0, Utf8Result = 0, Utf16Result = 0;
+    for (int i = 0; i < StringCount && Utf8Result >= 0; ++i)
+    {
+        Utf8Result = ccunicode_EncodeUtf8(Codepoints[i], Utf8Loop + Utf8Pos, Utf8Limit - Utf8Pos);
+        Utf8Pos += Utf8Result < 0 ? 0 : Utf8Result;
+    }
+    for (int i = 0; i < StringCount && Utf16Result >= 0; ++i)
+    {
+        Utf16Result = ccunicode_EncodeUtf16(Codepoints[i], Utf16Loop + Utf16Pos, Utf16Limit - Utf16Pos);
+        Utf16Pos += Utf16Result < 0 ? 0 : Utf16Result;
+    }
+    Utf8Loop[Utf8Pos] = 0;
+    Utf16Loop[Utf16Pos] = 0;
+    // An invalid codepoint that would not fit either can be reported as BUFFER_TOO_SMALL by the references,
+    // which check the room left first
+    int Result = ccunicode_CodepointsToUtf8_nm(Codepoints, Count, Utf8Out, Utf8Limit);
+    if (Utf8Result == CCUNICODE_INVALID_CODEPOINT && Result == CCUNICODE_BUFFER_TOO_SMALL && Utf8Limit - Utf8Pos < 4)
+        Utf8Result = CCUNICODE_BUFFER_TOO_SMALL;
+    CHECK_OUTPUT(Result, Utf8Out, Utf8Result < 0 ? Utf8Result : Utf8Pos, Utf8Loop, "ccunicode_EncodeUtf8");
+    Result = ccunicode_CodepointsToUtf16_nm(Codepoints, Count, Utf16Out, Utf16Limit);
+    if (Utf16Result == CCUNICODE_INVALID_CODEPOINT && Result == CCUNICODE_BUFFER_TOO_SMALL && Utf16Limit - Utf16Pos < 2)
+        Utf16Result = CCUNICODE_BUFFER_TOO_SMALL;
+    CHECK_OUTPUT(Result, Utf16Out, Utf16Result < 0 ? Utf16Result : Utf16Pos, Utf16Loop, "ccunicode_EncodeUtf16");
+
+    Result = ccunicode_GetUtf8SizeFromCodepoints_n(Codepoints, Count);
+    FUZZ_CHECK(Utf8Count < 0 ? Result < 0 : Result == Utf8Count, "ccunicode_GetUtf8SizeFromCodepoints_n");
+    Result = ccunicode_GetUtf16SizeFromCodepoints_n(Codepoints, Count);
+    FUZZ_CHECK(Utf16Count < 0 ? Result < 0 : Result == Utf16Count, "ccunicode_GetUtf16SizeFromCodepoints_n");
+
+    uint8_t *AllocatedUtf8 = NULL;
+    uint16_t *AllocatedUtf16 = NULL;
+    Result = ccunicode_CodepointsToUtf8_na(Codepoints, Count, &AllocatedUtf8, NULL);
+    CHECK_OUTPUT(Result, AllocatedUtf8, Utf8Count, Utf8, "ccunicode_CodepointsToUtf8_na");
+    free(AllocatedUtf8);
+    Result = ccunicode_CodepointsToUtf16_na(Codepoints, Count, &AllocatedUtf16, NULL);
+    CHECK_OUTPUT(Result, AllocatedUtf16, Utf16Count, Utf16, "ccunicode_CodepointsToUtf16_na");
+    free(AllocatedUtf16);
+
+    TCCUnicode_Context Context;
+    ccunicode_InitContext(&Context, CCUNICODE_ERROR_POLICY_STOP, NULL);
+    Result = ccunicode_CodepointsToUtf8_nc(&Context, Codepoints, Count, &AllocatedUtf8);
+    CHECK_OUTPUT(Result, AllocatedUtf8, Utf8Count, Utf8, "ccunicode_CodepointsToUtf8_nc");
+    Result = ccunicode_CodepointsToUtf16_nc(&Context, Codepoints, Count, &AllocatedUtf16);
+    CHECK_OUTPUT(Result, AllocatedUtf16, Utf16Count, Utf16, "ccunicode_CodepointsToUtf16_nc");
+    ccunicode_DestroyContext(&Context);
+
+    memcpy(Decoded, Codepoints, (size_t)(Count + 1) * sizeof(uint32_t));
+    Result = ccunicode_CodepointsToUtf8InPlace_n(Decoded, Count, &AllocatedUtf8);
+    CHECK_OUTPUT(Result, AllocatedUtf8, Utf8Count, Utf8, "ccunicode_CodepointsToUtf8InPlace_n");
+    memcpy(Decoded, Codepoints, (size_t)(Count + 1) * sizeof(uint32_t));
+    Result = ccunicode_CodepointsToUtf16InPlace_n(Decoded, Count, &AllocatedUtf16);
+    CHECK_OUTPUT(Result, AllocatedUtf16, Utf16Count, Utf16, "ccunicode_CodepointsToUtf16InPlace_n");
+
+    // The output decodes back to the codepoints, and converts to the output of the other encoder
+    if (Utf8Count >= 0)
+    {
+        Result = ccunicode_Utf8ToCodepoints_nm(Utf8, Utf8Count, Decoded, Count);
+        CHECK_OUTPUT(Result, Decoded, StringCount, Codepoints, "ccunicode_Utf8ToCodepoints_nm");
+        Result = ccunicode_Utf8ToUtf16_nm(Utf8, Utf8Count, Utf16Out, 2 * Count);
+        CHECK_OUTPUT(Result, Utf16Out, Utf16Count, Utf16, "ccunicode_Utf8ToUtf16_nm");
+        Result = ccunicode_Utf16ToCodepoints_nm(Utf16, Utf16Count, Decoded, Count);
+        CHECK_OUTPUT(Result, Decoded, StringCount, Codepoints, "ccunicode_Utf16ToCodepoints_nm");
+        Result = ccunicode_Utf16ToUtf8_nm(Utf16, Utf16Count, Utf8Out, 4 * Count);
+        CHECK_OUTPUT(Result, Utf8Out, Utf8Count, Utf8, "ccunicode_Utf16ToUtf8_nm");
+    }
+
+    // Streams carry null characters
+    int SourceSize = FuzzStoreUnits(Codepoints, Count, CCUNICODE_ENCODING_UTF32LE, Source);
+    int DataError = ValidCount < Count ? CCUNICODE_INVALID_CODEPOINT : CCUNICODE_NO_ERROR;
+    int ExpectedSize = FuzzEncodeUtf8(Codepoints, ValidCount, ExpectedBytes);
+    FuzzCheckTranscode("ccunicode_Transcode_m (UTF32LE to UTF8)", CCUNICODE_ENCODING_UTF32LE, CCUNICODE_ENCODING_UTF8, Source, SourceSize,
+                       Params >> 24, ExpectedBytes, ExpectedSize, DataError, 4 * (int64_t)ValidCount, OutBytes);
+    SourceSize = FuzzStoreUnits(Codepoints, Count, CCUNICODE_ENCODING_UTF32BE, Source);
+    ExpectedSize = FuzzStoreUnits(Utf16Loop, FuzzEncodeUtf16(Codepoints, ValidCount, Utf16Loop), CCUNICODE_ENCODING_UTF16BE, ExpectedBytes);
+    FuzzCheckTranscode("ccunicode_Transcode_m (UTF32BE to UTF16BE)", CCUNICODE_ENCODING_UTF32BE, CCUNICODE_ENCODING_UTF16BE, Source, SourceSize,
+                       Params >> 40, ExpectedBytes, ExpectedSize, DataError, 4 * (int64_t)ValidCount, OutBytes);
+
+    free(Codepoints);
+    free(Decoded);
+    free(Utf8);
+    free(Utf8Out);
+    free(Utf8Loop);
+    free(Utf16);
+    free(Utf16Out);
+    free(Utf16Loop);
+    free(Source);
+    free(ExpectedBytes);
+    free(OutBytes);
+    return 0;
+}
+
+#ifndef CCUNICODE_FUZZ_LIBFUZZER
+size_t FuzzGenerate(uint32_t Seed, uint8_t *Data, size_t MaxSize)
+{
+    TCCUnicode_CorpusGenerator Generator;
+    uint32_t State = FuzzInitGenerator(&Generator, Seed);
+    int Count = (int)(FuzzRandomSize(&State, MaxSize) / 4);
+    uint32_t *Codepoints = (uint32_t*)malloc((size_t)(Count + 1) * sizeof(uint32_t));
+    if (!Codepoints)
+        abort();
+    ccunicode_GenerateCodepoints(&Generator, Codepoints, Count);
+    // Stored with the top bits choosing the range that maps them back to themselves
+    for (int i = 0; i < Count; ++i)
+        Codepoints[i] |= Codepoints[i] < 0x80 ? 0 : Codepoints[i] < 0x10000 ? 0x40000000u : 0x80000000u;
+    FuzzStoreUnits(Codepoints, Count, CCUNICODE_ENCODING_UTF32LE, Data);
+    free(Codepoints);
+    FuzzMutate(&State, Data, 4 * (size_t)Count);
+    return 4 * (size_t)Count;
+}
+#endif
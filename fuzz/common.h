@@ -0,0 +1,231 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Checks shared by the differential fuzz targets
+//
+// Each target defines LLVMFuzzerTestOneInput, which compares every variant of a family of functions with the nm reference
+// on the same input. It is called by libFuzzer when built with CCUNICODE_FUZZ_LIBFUZZER, or by driver.c otherwise.
+// The targets include their own copy of the implementation with tiny windows and parallel chunks,
+// so that short inputs already go through the windowed and split code paths.
+
+#ifndef __CCUNICODE_FUZZ_COMMON__
+#define __CCUNICODE_FUZZ_COMMON__
+
+#include "../include/ccunicode.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Larger inputs are ignored: they only make the checks slower
+#define FUZZ_MAX_INPUT_SIZE (1 << 20)
+
+int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size);
+
+#ifdef CCUNICODE_FUZZ_LIBFUZZER
+#define FUZZ_FAIL() abort()
+#define FUZZ_FEATURE(Value) ((void)(Value))
+#else
+// Saves the current input to crash-HASH and aborts (driver.c)
+void FuzzFail(void);
+// Records that the current input reached Value at a site, for the corpus minimizer (driver.c)
+void FuzzFeature(int Site, int Value);
+// Writes a random input of at most MaxSize bytes and returns its size (each target)
+size_t FuzzGenerate(uint32_t Seed, uint8_t *Data, size_t MaxSize);
+#define FUZZ_FAIL() FuzzFail()
+#define FUZZ_FEATURE(Value) FuzzFeature(__LINE__, (Value))
+#endif
+
+// Reports a variant disagreeing with its reference
+#define FUZZ_CHECK(Condition, Name)                                                         \
+    do                                                                                      \
+    {                                                                                       \
+        if (!(Condition))                                                                   \
+        {                                                                                   \
+            fprintf(stderr, "%s:%d: %s: mismatch (%s)\n", __FILE__, __LINE__, Name, #Condition); \
+            FUZZ_FAIL();                                                                    \
+        }                                                                                   \
+    } while (0)
+
+// FNV-1a, naming the saved inputs and choosing the sizes used by the checks
+static inline uint64_t FuzzHash(const uint8_t *Data, size_t Size)
+{
+    uint64_t Hash = 14695981039346656037ull;
+    for (size_t i = 0; i < Size; ++i)
+        Hash = (Hash ^ Data[i]) * 1099511628211ull;
+    return Hash;
+}
+
+// Error codes are kept apart, counts go by powers of two
+static inline int FuzzClass(int Result)
+{
+    int Class = 1;
+    if (Result <= 0)
+        return Result;
+    while (Result >>= 1)
+        ++Class;
+    return Class;
+}
+
+static inline int FuzzIsValidCodepoint(uint32_t Codepoint)
+{
+    return Codepoint <= 0x10FFFF && (Codepoint < 0xD800 || Codepoint > 0xDFFF);
+}
+
+// Encodes codepoints with the nm references, null characters included
+static inline int FuzzEncodeUtf8(const uint32_t *Codepoints, int Count, uint8_t *Utf8)
+{
+    int Size = 0, Start = 0;
+    for (int i = 0; i <= Count; ++i)
+    {
+        if (i < Count && Codepoints[i])
+            continue;
+        int Result = ccunicode_CodepointsToUtf8_nm(Codepoints + Start, i - Start, Utf8 + Size, 4 * (i - Start));
+        if (Result < 0)
+            return Result;
+        Size += Result + (i < Count);
+        Start = i + 1;
+    }
+    return Size;
+}
+
+static inline int FuzzEncodeUtf16(const uint32_t *Codepoints, int Count, uint16_t *Utf16)
+{
+    int Size = 0, Start = 0;
+    for (int i = 0; i <= Count; ++i)
+    {
+        if (i < Count && Codepoints[i])
+            continue;
+        int Result = ccunicode_CodepointsToUtf16_nm(Codepoints + Start, i - Start, Utf16 + Size, 2 * (i - Start));
+        if (Result < 0)
+            return Result;
+        Size += Result + (i < Count);
+        Start = i + 1;
+    }
+    return Size;
+}
+
+// Writes code units as bytes of the given encoding
+static inline int FuzzStoreUnits(const void *Units, int Count, int Encoding, uint8_t *Bytes)
+{
+    for (int i = 0; i < Count; ++i)
+    {
+        switch (Encoding)
+        {
+        case CCUNICODE_ENCODING_UTF8:
+            Bytes[i] = ((const uint8_t*)Units)[i];
+            break;
+        case CCUNICODE_ENCODING_UTF16LE:
+        case CCUNICODE_ENCODING_UTF16BE:
+        {
+            uint16_t Unit = ((const uint16_t*)Units)[i];
+            int Swap = Encoding == CCUNICODE_ENCODING_UTF16BE;
+            Bytes[2*i + Swap] = (uint8_t)Unit;
+            Bytes[2*i + 1 - Swap] = (uint8_t)(Unit >> 8);
+            break;
+        }
+        default:
+        {
+            uint32_t Unit = ((const uint32_t*)Units)[i];
+            for (int j = 0; j < 4; ++j)
+                Bytes[4*i + (Encoding == CCUNICODE_ENCODING_UTF32BE ? 3 - j : j)] = (uint8_t)(Unit >> (8*j));
+            break;
+        }
+        }
+    }
+    return Count * (Encoding == CCUNICODE_ENCODING_UTF8 ? 1 : Encoding <= CCUNICODE_ENCODING_UTF16BE ? 2 : 4);
+}
+
+// Transcodes Source in pieces of varying size into a small output window, and checks the output, the error and its offset.
+// Out must hold ExpectedSize + 16 bytes.
+static inline void FuzzCheckTranscode(const char *Name, int SourceEncoding, int TargetEncoding, const uint8_t *Source, int SourceSize,
+                                      uint64_t Params, const uint8_t *Expected, int ExpectedSize, int ExpectedError, int64_t ExpectedOffset,
+                                      uint8_t *Out)
+{
+    TCCUnicode_Transcoder Transcoder;
+    ccunicode_InitTranscoder(&Transcoder, SourceEncoding, TargetEncoding, CCUNICODE_ERROR_POLICY_STOP);
+    int Piece = 1 + (int)(Params % 17);
+    int Room = 4 + (int)((Params >> 8) % 13);
+    int Read = 0, Written = 0, End = 0, Result;
+    for (;;)
+    {
+        End = (End > Read ? End : Read) + Piece;
+        if (End > SourceSize)
+            End = SourceSize;
+        int IsLast = End == SourceSize, PieceRead = 0, PieceWritten = 0;
+        Result = ccunicode_Transcode_m(&Transcoder, Source + Read, End - Read, IsLast, Out + Written, Room, &PieceRead, &PieceWritten);
+        Read += PieceRead;
+        Written += PieceWritten;
+        if (Result < 0 || (IsLast && Read == SourceSize))
+            break;
+        FUZZ_CHECK(!IsLast || PieceRead || PieceWritten, Name);
+        FUZZ_CHECK(Written <= ExpectedSize, Name);
+    }
+    FUZZ_FEATURE(Result);
+    FUZZ_CHECK(Result == ExpectedError, Name);
+    FUZZ_CHECK(Written == ExpectedSize && !memcmp(Out, Expected, (size_t)Written), Name);
+    FUZZ_CHECK(Read == (Result < 0 ? ExpectedOffset : SourceSize), Name);
+    FUZZ_CHECK(Transcoder.source_offset == Read && Transcoder.target_offset == Written, Name);
+}
+
+#ifndef CCUNICODE_FUZZ_LIBFUZZER
+static inline uint32_t FuzzRandom(uint32_t *State)
+{
+    *State ^= *State << 13;
+    *State ^= *State >> 17;
+    *State ^= *State << 5;
+    return *State;
+}
+
+// Draws the parameters of a generator, errors and null characters included, and returns the state of a random generator
+static inline uint32_t FuzzInitGenerator(TCCUnicode_CorpusGenerator *Generator, uint32_t Seed)
+{
+    uint32_t State = Seed | 1;
+    ccunicode_InitCorpusGenerator(Generator, Seed);
+    for (int i = 0; i < 4; ++i)
+        Generator->weights[i] = (int)(FuzzRandom(&State) % 4);
+    Generator->weights[FuzzRandom(&State) % 4] += 1;
+    if (FuzzRandom(&State) % 2)
+        Generator->ranges[0][0] = 0;
+    Generator->mean_run_length = 1 + (int)(FuzzRandom(&State) % 8);
+    Generator->errors_per_million = FuzzRandom(&State) % 2 ? 0 : (int)(FuzzRandom(&State) % 100000);
+    Generator->nulls_per_million = FuzzRandom(&State) % 2 ? 0 : (int)(FuzzRandom(&State) % 100000);
+    return State;
+}
+
+// Short inputs are the most frequent
+static inline size_t FuzzRandomSize(uint32_t *State, size_t MaxSize)
+{
+    size_t Size = MaxSize >> (FuzzRandom(State) % 10);
+    return FuzzRandom(State) % (Size + 1);
+}
+
+// Overwrites a few bytes with random ones
+static inline void FuzzMutate(uint32_t *State, uint8_t *Data, size_t Size)
+{
+    int Count = Size ? (int)(FuzzRandom(State) % 4) : 0;
+    for (int i = 0; i < Count; ++i)
+        Data[FuzzRandom(State) % Size] = (uint8_t)FuzzRandom(State);
+}
+#endif
+
+#endif // __CCUNICODE_FUZZ_COMMON__
@@ -0,0 +1,354 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Standalone driver of the fuzz targets, for builds without libFuzzer.
+// It replays files and directories of inputs (a libFuzzer corpus or crash files), runs generated inputs,
+// and minimizes corpora offline: the smallest inputs covering every feature are kept, so the corpus replays as fast as possible.
+
+#include "common.h"
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+
+// Number of bits of the feature map, features are hashed into it
+#define FUZZ_FEATURE_BITS (1 << 16)
+
+typedef struct
+{
+    char *path;
+    uint8_t *data;
+    size_t size;
+    uint32_t *features; // Sorted indices of the features reached
+    int feature_count;
+    int kept;
+    double time;        // Time taken by the checks in seconds
+} TInput;
+
+static uint64_t Features[FUZZ_FEATURE_BITS / 64];
+static const uint8_t *CurrentData;
+static size_t CurrentSize;
+
+void FuzzFeature(int Site, int Value)
+{
+    uint32_t Bit = ((uint32_t)Site * 2654435761u ^ (uint32_t)Value * 40503u) % FUZZ_FEATURE_BITS;
+    Features[Bit / 64] |= 1ull << (Bit % 64);
+}
+
+void FuzzFail(void)
+{
+    char Path[64];
+    snprintf(Path, sizeof(Path), "crash-%016llx", (unsigned long long)FuzzHash(CurrentData, CurrentSize));
+    FILE *File = fopen(Path, "wb");
+    if (File)
+    {
+        fwrite(CurrentData, 1, CurrentSize, File);
+        fclose(File);
+        fprintf(stderr, "ccunicode_fuzz: input of %zu bytes saved to %s\n", CurrentSize, Path);
+    }
+    abort();
+}
+
+static void RunInput(const uint8_t *Data, size_t Size)
+{
+    CurrentData = Data;
+    CurrentSize = Size;
+    LLVMFuzzerTestOneInput(Data, Size);
+}
+
+static double GetTime(void)
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (double)Time.tv_sec + (double)Time.tv_nsec * 1e-9;
+}
+
+static int CountFeatures(void)
+{
+    int Count = 0;
+    for (int i = 0; i < FUZZ_FEATURE_BITS / 64; ++i)
+        Count += __builtin_popcountll(Features[i]);
+    return Count;
+}
+
+static void PrintUsage(FILE *Out)
+{
+    fprintf(Out,
+            "Usage: ccunicode_fuzz_TARGET [options] [PATH...]\n"
+            "Runs the differential checks of the target on each input file and on every file of each directory,\n"
+            "or on generated inputs if no path is given. A failing input is saved to crash-HASH.\n"
+            "\n"
+            "  -r RUNS    number of generated inputs (default 100000)\n"
+            "  -s SIZE    maximum size of the generated inputs in bytes (default 4096)\n"
+            "  -S SEED    seed of the generated inputs (default 1)\n"
+            "  -m OUTDIR  minimize the inputs of the PATHs: copy to OUTDIR the smallest set covering all their features\n"
+            "  -h         show this help\n");
+}
+
+static int LoadFile(const char *Path, TInput **Inputs, int *InputCount, int *InputCapacity)
+{
+    FILE *File = fopen(Path, "rb");
+    if (!File)
+    {
+        fprintf(stderr, "ccunicode_fuzz: cannot open %s\n", Path);
+        return -1;
+    }
+    size_t Capacity = 4096, Size = 0;
+    uint8_t *Data = (uint8_t*)malloc(Capacity);
+    while (Data)
+    {
+        Size += fread(Data + Size, 1, Capacity - Size, File);
+        if (Size < Capacity || Size > FUZZ_MAX_INPUT_SIZE)
+            break;
+        Capacity *= 2;
+        uint8_t *Grown = (uint8_t*)realloc(Data, Capacity);
+        if (!Grown)
+            free(Data);
+        Data = Grown;
+    }
+    fclose(File);
+    if (!Data)
+    {
+        fprintf(stderr, "ccunicode_fuzz: out of memory\n");
+        return -1;
+    }
+    if (*InputCount == *InputCapacity)
+    {
+        *InputCapacity = *InputCapacity ? 2 * *InputCapacity : 256;
+        *Inputs = (TInput*)realloc(*Inputs, (size_t)*InputCapacity * sizeof(TInput));
+    }
+    TInput *Input = &(*Inputs)[(*InputCount)++];
+    memset(Input, 0, sizeof(TInput));
+    Input->path = strdup(Path);
+    Input->data = Data;
+    Input->size = Size;
+    return 0;
+}
+
+// Loads a file, or every regular file of a directory (not recursively)
+static int LoadPath(const char *Path, TInput **Inputs, int *InputCount, int *InputCapacity)
+{
+    struct stat Info;
+    if (stat(Path, &Info))
+    {
+        fprintf(stderr, "ccunicode_fuzz: cannot open %s\n", Path);
+        return -1;
+    }
+    if (!S_ISDIR(Info.st_mode))
+        return LoadFile(Path, Inputs, InputCount, InputCapacity);
+
+    DIR *Dir = opendir(Path);
+    if (!Dir)
+    {
+        fprintf(stderr, "ccunicode_fuzz: cannot open %s\n", Path);
+        return -1;
+    }
+    struct dirent *Entry;
+    while ((Entry = readdir(Dir)))
+    {
+        char FilePath[4096];
+        snprintf(FilePath, sizeof(FilePath), "%s/%s", Path, Entry->d_name);
+        if (Entry->d_name[0] != '.' && !stat(FilePath, &Info) && S_ISREG(Info.st_mode) &&
+            LoadFile(FilePath, Inputs, InputCount, InputCapacity))
+        {
+            closedir(Dir);
+            return -1;
+        }
+    }
+    closedir(Dir);
+    return 0;
+}
+
+// Smallest first, the content breaking ties so that the result does not depend on the order of the directory
+static int CompareInputs(const void *A, const void *B)
+{
+    const TInput *InputA = (const TInput*)A, *InputB = (const TInput*)B;
+    if (InputA->size != InputB->size)
+        return InputA->size < InputB->size ? -1 : 1;
+    return memcmp(InputA->data, InputB->data, InputA->size);
+}
+
+// Greedy set cover: each input, smallest first, is kept if it reaches a feature the kept inputs do not,
+// then the kept inputs whose features are all reached by the other kept ones are dropped, largest first.
+static int Minimize(TInput *Inputs, int InputCount, const char *OutDir)
+{
+    static int Covered[FUZZ_FEATURE_BITS];
+    qsort(Inputs, (size_t)InputCount, sizeof(TInput), CompareInputs);
+
+    size_t TotalSize = 0;
+    double TotalTime = 0;
+    for (int i = 0; i < InputCount; ++i)
+    {
+        TInput *Input = &Inputs[i];
+        memset(Features, 0, sizeof(Features));
+        double Start = GetTime();
+        RunInput(Input->data, Input->size);
+        Input->time = GetTime() - Start;
+        TotalSize += Input->size;
+        TotalTime += Input->time;
+        Input->features = (uint32_t*)malloc((size_t)CountFeatures() * sizeof(uint32_t) + 1);
+        if (!Input->features)
+        {
+            fprintf(stderr, "ccunicode_fuzz: out of memory\n");
+            return 2;
+        }
+        for (int Word = 0; Word < FUZZ_FEATURE_BITS / 64; ++Word)
+        {
+            for (uint64_t Bits = Features[Word]; Bits; Bits &= Bits - 1)
+            {
+                uint32_t Bit = (uint32_t)Word * 64 + (uint32_t)__builtin_ctzll(Bits);
+                Input->features[Input->feature_count++] = Bit;
+                if (!Covered[Bit])
+                    Input->kept = 1;
+            }
+        }
+        for (int j = 0; Input->kept && j < Input->feature_count; ++j)
+            ++Covered[Input->features[j]];
+    }
+
+    for (int i = InputCount - 1; i >= 0; --i)
+    {
+        TInput *Input = &Inputs[i];
+        int Redundant = Input->kept;
+        for (int j = 0; Redundant && j < Input->feature_count; ++j)
+            Redundant = Covered[Input->features[j]] > 1;
+        if (!Redundant)
+            continue;
+        Input->kept = 0;
+        for (int j = 0; j < Input->feature_count; ++j)
+            --Covered[Input->features[j]];
+    }
+
+    int KeptCount = 0, FeatureCount = 0;
+    size_t KeptSize = 0;
+    double KeptTime = 0;
+    for (int i = 0; i < FUZZ_FEATURE_BITS; ++i)
+        FeatureCount += Covered[i] > 0;
+    for (int i = 0; i < InputCount; ++i)
+    {
+        if (!Inputs[i].kept)
+            continue;
+        char Path[4096];
+        snprintf(Path, sizeof(Path), "%s/%016llx", OutDir, (unsigned long long)FuzzHash(Inputs[i].data, Inputs[i].size));
+        FILE *File = fopen(Path, "wb");
+        if (!File || fwrite(Inputs[i].data, 1, Inputs[i].size, File) != Inputs[i].size)
+        {
+            fprintf(stderr, "ccunicode_fuzz: cannot write %s\n", Path);
+            if (File)
+                fclose(File);
+            return 1;
+        }
+        fclose(File);
+        ++KeptCount;
+        KeptSize += Inputs[i].size;
+        KeptTime += Inputs[i].time;
+    }
+    printf("ccunicode_fuzz: kept %d of %d inputs (%zu of %zu bytes) covering %d features, replayed in %.2f ms instead of %.2f ms\n",
+           KeptCount, InputCount, KeptSize, TotalSize, FeatureCount, KeptTime * 1e3, TotalTime * 1e3);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    long long Runs = 100000;
+    size_t MaxSize = 4096;
+    uint32_t Seed = 1;
+    const char *OutDir = NULL;
+    TInput *Inputs = NULL;
+    int InputCount = 0, InputCapacity = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *Arg = argv[i];
+        if (!strcmp(Arg, "-h") || !strcmp(Arg, "--help"))
+        {
+            PrintUsage(stdout);
+            return 0;
+        }
+        if (Arg[0] != '-')
+        {
+            if (LoadPath(Arg, &Inputs, &InputCount, &InputCapacity))
+                return 2;
+            continue;
+        }
+        if (!Arg[1] || Arg[2] || i + 1 == argc)
+        {
+            PrintUsage(stderr);
+            return 2;
+        }
+
+        const char *Value = argv[++i];
+        switch (Arg[1])
+        {
+        case 'r': Runs = atoll(Value); break;
+        case 's': MaxSize = (size_t)atoll(Value); break;
+        case 'S': Seed = (uint32_t)strtoul(Value, NULL, 0); break;
+        case 'm': OutDir = Value; break;
+        default:
+            PrintUsage(stderr);
+            return 2;
+        }
+    }
+
+    if (OutDir)
+    {
+        if (mkdir(OutDir, 0777) && errno != EEXIST)
+        {
+            fprintf(stderr, "ccunicode_fuzz: cannot create %s\n", OutDir);
+            return 2;
+        }
+        return Minimize(Inputs, InputCount, OutDir);
+    }
+
+    double Start = GetTime();
+    size_t TotalSize = 0;
+    if (InputCount)
+    {
+        for (int i = 0; i < InputCount; ++i)
+        {
+            RunInput(Inputs[i].data, Inputs[i].size);
+            TotalSize += Inputs[i].size;
+        }
+        Runs = InputCount;
+    }
+    else
+    {
+        if (MaxSize > FUZZ_MAX_INPUT_SIZE)
+            MaxSize = FUZZ_MAX_INPUT_SIZE;
+        uint8_t *Data = (uint8_t*)malloc(MaxSize + 1);
+        if (!Data)
+        {
+            fprintf(stderr, "ccunicode_fuzz: out of memory\n");
+            return 2;
+        }
+        for (long long i = 0; i < Runs; ++i)
+        {
+            size_t Size = FuzzGenerate(Seed * 0x9E3779B9u + (uint32_t)i * 0x85EBCA6Bu, Data, MaxSize);
+            RunInput(Data, Size);
+            TotalSize += Size;
+        }
+        free(Data);
+    }
+    double Elapsed = GetTime() - Start;
+    printf("ccunicode_fuzz: %lld inputs (%zu bytes) checked in %.2f s, %d features\n", Runs, TotalSize, Elapsed, CountFeatures());
+    return 0;
+}
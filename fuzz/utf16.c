@@ -0,0 +1,235 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Differential fuzz target of the UTF16 decoders: every function reading UTF16 is compared with ccunicode_Utf16ToCodepoints_nm,
+// and with ccunicode_DecodeNextUtf16 for the functions where null characters are regular characters.
+// The input is read as little endian shorts.
+
+#define CCUNICODE_SMALL_STRING_CODEPOINTS 8
+#define CCUNICODE_PARALLEL_MIN_CHUNK 16
+#define __CCUNICODE_IMPL__
+#include "../include/ccunicode.h"
+#include "common.h"
+
+#define CHECK_UTF8(Result, Out, ExpectedResult, Expected, Name)                                      \
+    do                                                                                              \
+    {                                                                                               \
+        FUZZ_FEATURE(FuzzClass(Result));                                                            \
+        FUZZ_CHECK((Result) == (ExpectedResult), Name);                                             \
+        FUZZ_CHECK((Result) < 0 || (!memcmp(Out, Expected, (size_t)(Result)) && !(Out)[Result]), Name); \
+    } while (0)
+
+// Ranges of shorts telling the decoders apart, for the pairs recorded as features
+static int GetUnitClass(uint16_t Unit)
+{
+    return !Unit ? 0 : Unit < 0x80 ? 1 : Unit < 0x800 ? 2 : Unit < 0xD800 ? 3 : Unit < 0xDC00 ? 4 : Unit < 0xE000 ? 5 : 6;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t DataSize)
+{
+    if (DataSize > FUZZ_MAX_INPUT_SIZE)
+        return 0;
+    int Size = (int)(DataSize / 2);
+    uint64_t Params = FuzzHash(Data, DataSize);
+
+    // The short after the input is never written, it stays 0
+    uint16_t *Utf16 = (uint16_t*)calloc((size_t)Size + 1, sizeof(uint16_t));
+    uint8_t *Swapped = (uint8_t*)malloc((size_t)(Size + 1) * sizeof(uint16_t));
+    uint32_t *Codepoints = (uint32_t*)malloc((size_t)(Size + 1) * sizeof(uint32_t));
+    uint32_t *Stream = (uint32_t*)malloc((size_t)(Size + 1) * sizeof(uint32_t));
+    int *Offsets = (int*)malloc((size_t)(Size + 1) * sizeof(int));
+    uint8_t *Expected = (uint8_t*)malloc((size_t)(Size + 1) * 3);
+    uint8_t *Out = (uint8_t*)malloc((size_t)(Size + 1) * 3);
+    uint8_t *ExpectedBytes = (uint8_t*)malloc((size_t)(Size + 1) * 4);
+    uint8_t *OutBytes = (uint8_t*)malloc((size_t)(Size + 1) * 4 + 16);
+    if (!Utf16 || !Swapped || !Codepoints || !Stream || !Offsets || !Expected || !Out || !ExpectedBytes || !OutBytes)
+        abort();
+    for (int i = 0; i < Size; ++i)
+    {
+        Utf16[i] = (uint16_t)(Data[2*i] | Data[2*i + 1] << 8);
+        if (i)
+            FUZZ_FEATURE(GetUnitClass(Utf16[i - 1]) * 8 + GetUnitClass(Utf16[i]));
+    }
+    FuzzStoreUnits(Utf16, Size, CCUNICODE_ENCODING_UTF16BE, Swapped);
+
+    // Reference
+    int Count = ccunicode_Utf16ToCodepoints_nm(Utf16, Size, Codepoints, Size);
+    FUZZ_FEATURE(FuzzClass(Count));
+
+    // The input decoded as a stream, null characters included
+    int StreamCount = 0, StreamError = CCUNICODE_NO_ERROR, StringCount = -1, Pos = 0;
+    while (Pos < Size)
+    {
+        int Length = ccunicode_DecodeNextUtf16(Utf16, Size, Pos, &Stream[StreamCount]);
+        if (Length < 0)
+        {
+            StreamError = Length;
+            break;
+        }
+        if (!Utf16[Pos] && StringCount < 0)
+            StringCount = StreamCount;
+        Offsets[StreamCount++] = Pos;
+        Pos += Length;
+    }
+    Offsets[StreamCount] = Pos;
+    FUZZ_FEATURE(StreamError);
+
+    // The string stops at the first null short, unless an error comes first
+    int StringResult = StringCount >= 0 ? StringCount : StreamError ? StreamError : StreamCount;
+    FUZZ_CHECK(Count == StringResult, "ccunicode_DecodeNextUtf16");
+    FUZZ_CHECK(Count < 0 || (!memcmp(Codepoints, Stream, (size_t)Count * sizeof(uint32_t)) && !Codepoints[Count]), "ccunicode_DecodeNextUtf16");
+
+    if (!StreamError)
+    {
+        for (int i = StreamCount; i > 0; --i)
+        {
+            uint32_t Codepoint;
+            int Length = ccunicode_DecodePrevUtf16(Utf16, Offsets[i], &Codepoint);
+            FUZZ_CHECK(Length == Offsets[i] - Offsets[i - 1] && Codepoint == Stream[i - 1], "ccunicode_DecodePrevUtf16");
+        }
+    }
+
+    int CountResult = ccunicode_CountCodepointsInUtf16_n(Utf16, Size);
+    FUZZ_CHECK(CountResult < 0 ? Count < 0 : CountResult == Count, "ccunicode_CountCodepointsInUtf16_n");
+    // The allocating conversions report the error of the count
+    int ExpectedError = CountResult < 0 ? CountResult : Count;
+
+    uint32_t *Allocated = NULL;
+    int Result = ccunicode_Utf16ToCodepoints_na(Utf16, Size, &Allocated, NULL);
+    FUZZ_CHECK(Result == ExpectedError, "ccunicode_Utf16ToCodepoints_na");
+    FUZZ_CHECK(Result < 0 || (!memcmp(Allocated, Codepoints, (size_t)Count * sizeof(uint32_t)) && !Allocated[Count]), "ccunicode_Utf16ToCodepoints_na");
+    free(Allocated);
+
+    TCCUnicode_Context Context;
+    ccunicode_InitContext(&Context, CCUNICODE_ERROR_POLICY_STOP, NULL);
+    Result = ccunicode_Utf16ToCodepoints_nc(&Context, Utf16, Size, &Allocated);
+    FUZZ_CHECK(Result == ExpectedError, "ccunicode_Utf16ToCodepoints_nc");
+    FUZZ_CHECK(Result < 0 || (!memcmp(Allocated, Codepoints, (size_t)Count * sizeof(uint32_t)) && !Allocated[Count]), "ccunicode_Utf16ToCodepoints_nc");
+
+    // UTF8 never takes more than 3 bytes per short; smaller limits are drawn from the input
+    int Limit = Params & 3 ? 3 * Size : (int)((Params >> 2) % (uint64_t)(3 * Size + 1));
+    int Utf8Count = Count < 0 ? ExpectedError : ccunicode_CodepointsToUtf8_nm(Codepoints, Count, Expected, 3 * Size);
+    int LimitedCount = Count < 0 ? ExpectedError : ccunicode_CodepointsToUtf8_nm(Codepoints, Count, Out, Limit);
+
+    Result = ccunicode_Utf16ToUtf8_nm(Utf16, Size, Out, Limit);
+    CHECK_UTF8(Result, Out, LimitedCount, Expected, "ccunicode_Utf16ToUtf8_nm");
+    Result = ccunicode_Utf16ToUtf8_nma(Utf16, Size, Out, Limit, NULL);
+    CHECK_UTF8(Result, Out, LimitedCount, Expected, "ccunicode_Utf16ToUtf8_nma");
+
+    // The string alone in a buffer ending with its null character, given a maximum size past the end of the buffer:
+    // nothing after the null character may be read. A maximum size of 1 short past it can no longer cut a surrogate pair,
+    // so the result is the one of the same string padded with a null character.
+    int TerminatedSize = 0;
+    while (TerminatedSize < Size && Utf16[TerminatedSize])
+        ++TerminatedSize;
+    int HasNull = TerminatedSize < Size;
+    ++TerminatedSize;
+    int MaxSize = TerminatedSize + 1 + (int)((Params >> 24) % 64);
+    uint16_t *Padded = (uint16_t*)calloc((size_t)TerminatedSize + 1, sizeof(uint16_t));
+    uint16_t *Terminated = (uint16_t*)malloc((size_t)TerminatedSize * sizeof(uint16_t));
+    uint8_t *TerminatedOut = (uint8_t*)malloc((size_t)Limit + 1);
+    if (!Padded || !Terminated || !TerminatedOut)
+        abort();
+    if (TerminatedSize > 1)
+        memcpy(Padded, Utf16, ((size_t)TerminatedSize - 1) * sizeof(uint16_t));
+    memcpy(Terminated, Padded, (size_t)TerminatedSize * sizeof(uint16_t));
+    int TerminatedCount = ccunicode_Utf16ToUtf8_nm(Padded, TerminatedSize + 1, TerminatedOut, Limit);
+    FUZZ_CHECK(!HasNull || Size < TerminatedSize + 1 || TerminatedCount == LimitedCount, "ccunicode_Utf16ToUtf8_nm");
+    Result = ccunicode_Utf16ToUtf8_nm(Terminated, MaxSize, Out, Limit);
+    CHECK_UTF8(Result, Out, TerminatedCount, TerminatedOut, "ccunicode_Utf16ToUtf8_nm");
+    Result = ccunicode_Utf16ToUtf8_nma(Terminated, MaxSize, Out, Limit, NULL);
+    CHECK_UTF8(Result, Out, TerminatedCount, TerminatedOut, "ccunicode_Utf16ToUtf8_nma");
+    free(Padded);
+    free(Terminated);
+    free(TerminatedOut);
+
+    TCCUnicode_ThreadPool Pool = {1 + (int)((Params >> 16) % 4), NULL, NULL};
+    Result = ccunicode_Utf16ToUtf8_nmp(Utf16, Size, Out, Limit, &Pool);
+    FUZZ_FEATURE(FuzzClass(Result));
+    FUZZ_CHECK(Result == LimitedCount, "ccunicode_Utf16ToUtf8_nmp");
+    FUZZ_CHECK(Result < 0 || (!memcmp(Out, Expected, (size_t)Result) && !Out[Result]), "ccunicode_Utf16ToUtf8_nmp");
+
+    uint8_t *AllocatedUtf8 = NULL;
+    Result = ccunicode_Utf16ToUtf8_na(Utf16, Size, &AllocatedUtf8, NULL);
+    CHECK_UTF8(Result, AllocatedUtf8, Utf8Count, Expected, "ccunicode_Utf16ToUtf8_na");
+    free(AllocatedUtf8);
+    Result = ccunicode_Utf16ToUtf8_nc(&Context, Utf16, Size, &AllocatedUtf8);
+    CHECK_UTF8(Result, AllocatedUtf8, Utf8Count, Expected, "ccunicode_Utf16ToUtf8_nc");
+    ccunicode_DestroyContext(&Context);
+
+    // Functions where null characters are regular characters: a high surrogate followed by a null short is invalid
+    // instead of ending the string
+    int ValidCount = 0;
+    while (ValidCount < StreamCount && FuzzIsValidCodepoint(Stream[ValidCount]))
+        ++ValidCount;
+    int DataError = ValidCount < StreamCount ? CCUNICODE_INVALID_CODEPOINT : StreamError;
+    if (DataError == CCUNICODE_STRING_ENDED_IN_CHARACTER && Offsets[StreamCount] + 1 < Size)
+        DataError = CCUNICODE_INVALID_UTF16_CHARACTER;
+    int64_t ErrorOffset = DataError ? Offsets[ValidCount] : -1;
+    int StreamUtf8Count = FuzzEncodeUtf8(Stream, ValidCount, Expected);
+    FUZZ_FEATURE(DataError);
+
+    int32_t Utf16Offsets[2] = {0, Size}, Utf8Offsets[2] = {-1, -1};
+    int64_t ErrorRow = -2;
+    Result = ccunicode_ValidateUtf16Column(Utf16, Utf16Offsets, 1, &ErrorRow);
+    FUZZ_CHECK(Result == DataError && (!DataError || ErrorRow == 0), "ccunicode_ValidateUtf16Column");
+    ErrorRow = -2;
+    Result = ccunicode_Utf16ToUtf8Column_m(Utf16, Utf16Offsets, 1, Out, 3 * Size, Utf8Offsets, &ErrorRow);
+    FUZZ_CHECK(Result == DataError && (!DataError || ErrorRow == 0), "ccunicode_Utf16ToUtf8Column_m");
+    FUZZ_CHECK(Result < 0 || (Utf8Offsets[0] == 0 && Utf8Offsets[1] == StreamUtf8Count &&
+                              !memcmp(Out, Expected, (size_t)StreamUtf8Count)), "ccunicode_Utf16ToUtf8Column_m");
+
+    // A trailing odd byte is left out, as it is of the shorts
+    FuzzCheckTranscode("ccunicode_Transcode_m (UTF16LE to UTF8)", CCUNICODE_ENCODING_UTF16LE, CCUNICODE_ENCODING_UTF8, Data, 2 * Size,
+                       Params >> 24, Expected, StreamUtf8Count, DataError, 2 * ErrorOffset, OutBytes);
+    int ExpectedSize = FuzzStoreUnits(Stream, ValidCount, CCUNICODE_ENCODING_UTF32LE, ExpectedBytes);
+    FuzzCheckTranscode("ccunicode_Transcode_m (UTF16BE to UTF32LE)", CCUNICODE_ENCODING_UTF16BE, CCUNICODE_ENCODING_UTF32LE, Swapped, 2 * Size,
+                       Params >> 40, ExpectedBytes, ExpectedSize, DataError, 2 * ErrorOffset, OutBytes);
+
+    free(Utf16);
+    free(Swapped);
+    free(Codepoints);
+    free(Stream);
+    free(Offsets);
+    free(Expected);
+    free(Out);
+    free(ExpectedBytes);
+    free(OutBytes);
+    return 0;
+}
+
+#ifndef CCUNICODE_FUZZ_LIBFUZZER
+size_t FuzzGenerate(uint32_t Seed, uint8_t *Data, size_t MaxSize)
+{
+    TCCUnicode_CorpusGenerator Generator;
+    uint32_t State = FuzzInitGenerator(&Generator, Seed);
+    int Size = (int)(FuzzRandomSize(&State, MaxSize) / 2);
+    uint16_t *Utf16 = (uint16_t*)malloc((size_t)(Size + 1) * sizeof(uint16_t));
+    if (!Utf16)
+        abort();
+    ccunicode_GenerateUtf16(&Generator, Utf16, Size);
+    FuzzStoreUnits(Utf16, Size, CCUNICODE_ENCODING_UTF16LE, Data);
+    free(Utf16);
+    FuzzMutate(&State, Data, 2 * (size_t)Size);
+    return 2 * (size_t)Size;
+}
+#endif
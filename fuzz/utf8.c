@@ -0,0 +1,221 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// Differential fuzz target of the UTF8 decoders: every function reading UTF8 is compared with ccunicode_Utf8ToCodepoints_nm,
+// and with ccunicode_DecodeNextUtf8 for the functions where null characters are regular characters.
+
+#define CCUNICODE_SMALL_STRING_CODEPOINTS 8
+#define CCUNICODE_PARALLEL_MIN_CHUNK 16
+#define __CCUNICODE_IMPL__
+#include "../include/ccunicode.h"
+#include "common.h"
+
+#define CHECK_UTF16(Result, Out, ExpectedResult, Expected, Name)                                         \
+    do                                                                                                  \
+    {                                                                                                   \
+        FUZZ_FEATURE(FuzzClass(Result));                                                                \
+        FUZZ_CHECK((Result) == (ExpectedResult), Name);                                                 \
+        FUZZ_CHECK((Result) < 0 || (!memcmp(Out, Expected, (size_t)(Result) * 2) && !(Out)[Result]), Name); \
+    } while (0)
+
+// Ranges of bytes telling the decoders apart, for the byte pairs recorded as features
+static int GetByteClass(uint8_t Byte)
+{
+    static const uint8_t Bounds[] = {0x01, 0x80, 0xC0, 0xC2, 0xE0, 0xE1, 0xED, 0xEE, 0xF0, 0xF1, 0xF4, 0xF5, 0xF8};
+    int Class = 0;
+    while (Class < (int)sizeof(Bounds) && Byte >= Bounds[Class])
+        ++Class;
+    return Class;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t DataSize)
+{
+    if (DataSize > FUZZ_MAX_INPUT_SIZE)
+        return 0;
+    int Size = (int)DataSize;
+    uint64_t Params = FuzzHash(Data, DataSize);
+    for (int i = 1; i < Size; ++i)
+        FUZZ_FEATURE(GetByteClass(Data[i - 1]) * 16 + GetByteClass(Data[i]));
+
+    uint32_t *Codepoints = (uint32_t*)malloc((size_t)(Size + 1) * sizeof(uint32_t));
+    uint32_t *Stream = (uint32_t*)malloc((size_t)(Size + 1) * sizeof(uint32_t));
+    int *Offsets = (int*)malloc((size_t)(Size + 1) * sizeof(int));
+    uint16_t *Expected = (uint16_t*)malloc((size_t)(Size + 1) * sizeof(uint16_t));
+    uint16_t *Out = (uint16_t*)malloc((size_t)(Size + 1) * sizeof(uint16_t));
+    uint8_t *ExpectedBytes = (uint8_t*)malloc((size_t)(Size + 1) * 4);
+    uint8_t *OutBytes = (uint8_t*)malloc((size_t)(Size + 1) * 4 + 16);
+    if (!Codepoints || !Stream || !Offsets || !Expected || !Out || !ExpectedBytes || !OutBytes)
+        abort();
+
+    // Reference
+    int Count = ccunicode_Utf8ToCodepoints_nm(Data, Size, Codepoints, Size);
+    FUZZ_FEATURE(FuzzClass(Count));
+
+    // The input decoded as a stream, null characters included
+    int StreamCount = 0, StreamError = CCUNICODE_NO_ERROR, StringCount = -1, Pos = 0;
+    while (Pos < Size)
+    {
+        int Length = ccunicode_DecodeNextUtf8(Data, Size, Pos, &Stream[StreamCount]);
+        if (Length < 0)
+        {
+            StreamError = Length;
+            break;
+        }
+        if (!Data[Pos] && StringCount < 0)
+            StringCount = StreamCount;
+        Offsets[StreamCount++] = Pos;
+        Pos += Length;
+    }
+    Offsets[StreamCount] = Pos;
+    FUZZ_FEATURE(StreamError);
+
+    // The string stops at the first null byte (not at an overlong null), unless an error comes first
+    int StringResult = StringCount >= 0 ? StringCount : StreamError ? StreamError : StreamCount;
+    FUZZ_CHECK(Count == StringResult, "ccunicode_DecodeNextUtf8");
+    FUZZ_CHECK(Count < 0 || (!memcmp(Codepoints, Stream, (size_t)Count * sizeof(uint32_t)) && !Codepoints[Count]), "ccunicode_DecodeNextUtf8");
+
+    if (!StreamError)
+    {
+        for (int i = StreamCount; i > 0; --i)
+        {
+            uint32_t Codepoint;
+            int Length = ccunicode_DecodePrevUtf8(Data, Offsets[i], &Codepoint);
+            FUZZ_CHECK(Length == Offsets[i] - Offsets[i - 1] && Codepoint == Stream[i - 1], "ccunicode_DecodePrevUtf8");
+        }
+    }
+
+    int CountResult = ccunicode_CountCodepointsInUtf8_n(Data, Size);
+    FUZZ_CHECK(CountResult < 0 ? Count < 0 : CountResult == Count, "ccunicode_CountCodepointsInUtf8_n");
+    // The conversions report the error of the count
+    int ExpectedError = CountResult < 0 ? CountResult : Count;
+
+    uint32_t *Allocated = NULL;
+    int Result = ccunicode_Utf8ToCodepoints_na(Data, Size, &Allocated, NULL);
+    FUZZ_CHECK(Result == ExpectedError, "ccunicode_Utf8ToCodepoints_na");
+    FUZZ_CHECK(Result < 0 || (!memcmp(Allocated, Codepoints, (size_t)Count * sizeof(uint32_t)) && !Allocated[Count]), "ccunicode_Utf8ToCodepoints_na");
+    free(Allocated);
+
+    TCCUnicode_Context Context;
+    ccunicode_InitContext(&Context, CCUNICODE_ERROR_POLICY_STOP, NULL);
+    Result = ccunicode_Utf8ToCodepoints_nc(&Context, Data, Size, &Allocated);
+    FUZZ_CHECK(Result == ExpectedError, "ccunicode_Utf8ToCodepoints_nc");
+    FUZZ_CHECK(Result < 0 || (!memcmp(Allocated, Codepoints, (size_t)Count * sizeof(uint32_t)) && !Allocated[Count]), "ccunicode_Utf8ToCodepoints_nc");
+
+    // UTF16 never takes more shorts than UTF8 takes bytes, so Size is enough; smaller limits are drawn from the input
+    int Limit = Params & 3 ? Size : (int)((Params >> 2) % (uint64_t)(Size + 1));
+    int Utf16Count = Count < 0 ? ExpectedError : ccunicode_CodepointsToUtf16_nm(Codepoints, Count, Expected, Size);
+    int LimitedCount = Count < 0 ? ExpectedError : ccunicode_CodepointsToUtf16_nm(Codepoints, Count, Out, Limit);
+
+    Result = ccunicode_Utf8ToUtf16_nm(Data, Size, Out, Limit);
+    CHECK_UTF16(Result, Out, LimitedCount, Expected, "ccunicode_Utf8ToUtf16_nm");
+    Result = ccunicode_Utf8ToUtf16_nma(Data, Size, Out, Limit, NULL);
+    CHECK_UTF16(Result, Out, LimitedCount, Expected, "ccunicode_Utf8ToUtf16_nma");
+
+    // The string alone in a buffer ending with its null character, given a maximum size past the end of the buffer:
+    // nothing after the null character may be read. A maximum size of 3 bytes past it can no longer cut a character,
+    // so the result is the one of the same string padded with null characters.
+    const uint8_t *Null = Size ? (const uint8_t*)memchr(Data, 0, (size_t)Size) : NULL;
+    int TerminatedSize = (Null ? (int)(Null - Data) : Size) + 1;
+    int MaxSize = TerminatedSize + 3 + (int)((Params >> 24) % 64);
+    uint8_t *Padded = (uint8_t*)calloc((size_t)TerminatedSize + 3, 1);
+    uint8_t *Terminated = (uint8_t*)malloc((size_t)TerminatedSize);
+    uint16_t *TerminatedOut = (uint16_t*)malloc((size_t)(Limit + 1) * sizeof(uint16_t));
+    if (!Padded || !Terminated || !TerminatedOut)
+        abort();
+    if (TerminatedSize > 1)
+        memcpy(Padded, Data, (size_t)TerminatedSize - 1);
+    memcpy(Terminated, Padded, (size_t)TerminatedSize);
+    int TerminatedCount = ccunicode_Utf8ToUtf16_nm(Padded, TerminatedSize + 3, TerminatedOut, Limit);
+    FUZZ_CHECK(!Null || Size < TerminatedSize + 3 || TerminatedCount == LimitedCount, "ccunicode_Utf8ToUtf16_nm");
+    Result = ccunicode_Utf8ToUtf16_nm(Terminated, MaxSize, Out, Limit);
+    CHECK_UTF16(Result, Out, TerminatedCount, TerminatedOut, "ccunicode_Utf8ToUtf16_nm");
+    Result = ccunicode_Utf8ToUtf16_nma(Terminated, MaxSize, Out, Limit, NULL);
+    CHECK_UTF16(Result, Out, TerminatedCount, TerminatedOut, "ccunicode_Utf8ToUtf16_nma");
+    free(Padded);
+    free(Terminated);
+    free(TerminatedOut);
+
+    TCCUnicode_ThreadPool Pool = {1 + (int)((Params >> 16) % 4), NULL, NULL};
+    Result = ccunicode_Utf8ToUtf16_nmp(Data, Size, Out, Limit, &Pool);
+    FUZZ_FEATURE(FuzzClass(Result));
+    FUZZ_CHECK(Result == LimitedCount, "ccunicode_Utf8ToUtf16_nmp");
+    FUZZ_CHECK(Result < 0 || (!memcmp(Out, Expected, (size_t)Result * 2) && !Out[Result]), "ccunicode_Utf8ToUtf16_nmp");
+
+    uint16_t *AllocatedUtf16 = NULL;
+    Result = ccunicode_Utf8ToUtf16_na(Data, Size, &AllocatedUtf16, NULL);
+    CHECK_UTF16(Result, AllocatedUtf16, Utf16Count, Expected, "ccunicode_Utf8ToUtf16_na");
+    free(AllocatedUtf16);
+    Result = ccunicode_Utf8ToUtf16_nc(&Context, Data, Size, &AllocatedUtf16);
+    CHECK_UTF16(Result, AllocatedUtf16, Utf16Count, Expected, "ccunicode_Utf8ToUtf16_nc");
+    ccunicode_DestroyContext(&Context);
+
+    // Functions where null characters are regular characters also check that the codepoints can be encoded
+    int ValidCount = 0;
+    while (ValidCount < StreamCount && FuzzIsValidCodepoint(Stream[ValidCount]))
+        ++ValidCount;
+    int DataError = ValidCount < StreamCount ? CCUNICODE_INVALID_CODEPOINT : StreamError;
+    int64_t ErrorOffset = DataError ? Offsets[ValidCount] : -1;
+    int StreamUtf16Count = FuzzEncodeUtf16(Stream, ValidCount, Expected);
+    FUZZ_FEATURE(DataError);
+
+    int64_t Offset = -2;
+    Result = ccunicode_ValidateUtf8Data(Data, Size, &Offset);
+    FUZZ_CHECK(Result == DataError && Offset == ErrorOffset, "ccunicode_ValidateUtf8Data");
+
+    int32_t Utf8Offsets[2] = {0, Size}, Utf16Offsets[2] = {-1, -1};
+    int64_t ErrorRow = -2;
+    Result = ccunicode_ValidateUtf8Column(Data, Utf8Offsets, 1, &ErrorRow);
+    FUZZ_CHECK(Result == DataError && (!DataError || ErrorRow == 0), "ccunicode_ValidateUtf8Column");
+    ErrorRow = -2;
+    Result = ccunicode_Utf8ToUtf16Column_m(Data, Utf8Offsets, 1, Out, Size, Utf16Offsets, &ErrorRow);
+    FUZZ_CHECK(Result == DataError && (!DataError || ErrorRow == 0), "ccunicode_Utf8ToUtf16Column_m");
+    FUZZ_CHECK(Result < 0 || (Utf16Offsets[0] == 0 && Utf16Offsets[1] == StreamUtf16Count &&
+                              !memcmp(Out, Expected, (size_t)StreamUtf16Count * 2)), "ccunicode_Utf8ToUtf16Column_m");
+
+    int ExpectedSize = FuzzStoreUnits(Expected, StreamUtf16Count, CCUNICODE_ENCODING_UTF16LE, ExpectedBytes);
+    FuzzCheckTranscode("ccunicode_Transcode_m (UTF8 to UTF16LE)", CCUNICODE_ENCODING_UTF8, CCUNICODE_ENCODING_UTF16LE, Data, Size,
+                       Params >> 24, ExpectedBytes, ExpectedSize, DataError, ErrorOffset, OutBytes);
+    ExpectedSize = FuzzStoreUnits(Stream, ValidCount, CCUNICODE_ENCODING_UTF32BE, ExpectedBytes);
+    FuzzCheckTranscode("ccunicode_Transcode_m (UTF8 to UTF32BE)", CCUNICODE_ENCODING_UTF8, CCUNICODE_ENCODING_UTF32BE, Data, Size,
+                       Params >> 40, ExpectedBytes, ExpectedSize, DataError, ErrorOffset, OutBytes);
+
+    free(Codepoints);
+    free(Stream);
+    free(Offsets);
+    free(Expected);
+    free(Out);
+    free(ExpectedBytes);
+    free(OutBytes);
+    return 0;
+}
+
+#ifndef CCUNICODE_FUZZ_LIBFUZZER
+size_t FuzzGenerate(uint32_t Seed, uint8_t *Data, size_t MaxSize)
+{
+    TCCUnicode_CorpusGenerator Generator;
+    uint32_t State = FuzzInitGenerator(&Generator, Seed);
+    size_t Size = FuzzRandomSize(&State, MaxSize);
+    ccunicode_GenerateUtf8(&Generator, Data, (int)Size);
+    FuzzMutate(&State, Data, Size);
+    return Size;
+}
+#endif
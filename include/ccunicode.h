@@ -51,7 +51,8 @@ extern "C"
         CCUNICODE_BAD_ALLOCATION            = -9,   ///< Error while allocating memory
         CCUNICODE_OVERFLOW                  = -10,  ///< Integer overflow
         CCUNICODE_INVALID_PARAMETER         = -11,  ///< Invalid parameter (usually negative sizes)
-        CCUNICODE_BUFFER_TOO_SMALL          = -12   ///< Temporary or destination buffer too small to hold the result
+        CCUNICODE_BUFFER_TOO_SMALL          = -12,  ///< Temporary or destination buffer too small to hold the result
+        CCUNICODE_IO_ERROR                  = -13   ///< A file could not be opened, mapped or written
     };
 
     /// \brief Allocator structure to hold pointers to user-defined malloc and free
@@ -61,6 +62,440 @@ extern "C"
         void (*free_func)(void*);     ///< Pointer to a user-defined free function
     } TCCUnicode_MallocPtr;
 
+    /// \brief Allocator structure to hold pointers to user-defined allocation functions taking a context
+    ///
+    /// The functions receive ctx, so that allocations can be routed to an arena or a pool without globals.
+    /// The struct must be set up by ccunicode_InitCtxMallocPtr, which marks malloc_ptr as the head of a context allocator:
+    /// &malloc_ptr is then given to any function with an 'a' suffix. ctx_realloc_func and ctx_aligned_alloc_func are optional
+    /// and can be set after the initialization: without them, ccunicode falls back on ctx_malloc_func and ctx_free_func.
+    /// Any memory returned to the user must be freed with ctx_free_func.
+    typedef struct
+    {
+        TCCUnicode_MallocPtr malloc_ptr; ///< Head of the allocator, to give to the a suffix functions (do not change it)
+        void *ctx;                       ///< User context given to the functions
+        void *(*ctx_malloc_func)(void *ctx, size_t size);                                   ///< Pointer to a user-defined malloc function taking a context
+        void *(*ctx_realloc_func)(void *ctx, void *ptr, size_t old_size, size_t new_size);  ///< Pointer to a user-defined realloc function taking a context, keeping the first old_size bytes (optional)
+        void (*ctx_free_func)(void *ctx, void *ptr);                                        ///< Pointer to a user-defined free function taking a context
+        void *(*ctx_aligned_alloc_func)(void *ctx, size_t alignment, size_t size);          ///< Pointer to a user-defined aligned malloc function taking a context (optional)
+    } TCCUnicode_CtxMallocPtr;
+
+    /// \brief Maximum number of tasks a parallel (p suffix) conversion is split into
+    ///
+    /// Per-task bookkeeping lives on the stack, so this bounds the stack usage of the parallel functions.
+    /// It can be redefined before including ccunicode.h (in the implementation file).
+#ifndef CCUNICODE_MAX_THREADS
+#   define CCUNICODE_MAX_THREADS 64
+#endif
+
+    /// \brief Minimum number of code units handled by a single task of a parallel (p suffix) conversion
+    ///
+    /// Smaller inputs use fewer tasks (down to a single one) as thread synchronization would cost more than the conversion itself.
+    /// It can be redefined before including ccunicode.h (in the implementation file).
+#ifndef CCUNICODE_PARALLEL_MIN_CHUNK
+#   define CCUNICODE_PARALLEL_MIN_CHUNK 65536
+#endif
+
+    /// \brief Maximum number of codepoints the ma suffix conversions decode on the stack instead of allocating
+    ///
+    /// Longer strings are converted through the same buffer, one window of at most that many codepoints at a time.
+    /// The stack usage is 4 bytes per codepoint.
+    /// It can be redefined before including ccunicode.h (in the implementation file) and must be at least 4.
+#ifndef CCUNICODE_SMALL_STRING_CODEPOINTS
+#   define CCUNICODE_SMALL_STRING_CODEPOINTS 256
+#endif
+
+    /// \brief Size in bytes of the output window of ccunicode_TranscodeFile
+    ///
+    /// The converted text is written out each time the window fills up, so this bounds the memory used for the output.
+    /// It can be redefined before including ccunicode.h (in the implementation file) and must be at least 8192.
+#ifndef CCUNICODE_TRANSCODE_WINDOW
+#   define CCUNICODE_TRANSCODE_WINDOW 1048576
+#endif
+
+    /// \brief Set to 1 when the file functions (mmap and file descriptors) are available
+#ifndef CCUNICODE_HAS_POSIX_FILES
+#   if defined(__unix__) || defined(__APPLE__)
+#       define CCUNICODE_HAS_POSIX_FILES 1
+#   else
+#       define CCUNICODE_HAS_POSIX_FILES 0
+#   endif
+#endif
+
+    /// \brief Thread pool structure used by the parallel (p suffix) conversion functions
+    ///
+    /// run_func must call task_func(task_data, i) exactly once for each i in [0, task_count) and only return
+    /// once every call has returned. Calls may happen concurrently and in any order.
+    /// If run_func is NULL, the tasks are run on threads created for the call if ccunicode was compiled with
+    /// __CCUNICODE_PTHREADS__, or one after the other on the calling thread otherwise.
+    typedef struct
+    {
+        int thread_count; ///< Number of tasks the conversion is split into (1 or less means no splitting)
+        void (*run_func)(void *pool_data, void (*task_func)(void*, int), void *task_data, int task_count); ///< Pointer to a user-defined function running the tasks, or NULL
+        void *pool_data;  ///< User pointer given back as first parameter of run_func
+    } TCCUnicode_ThreadPool;
+
+    /// \brief UTF8 string given with its size, as used by the batch functions
+    typedef struct
+    {
+        const uint8_t *str; ///< Pointer to the UTF8 string
+        int size;           ///< Maximum number of bytes to process (processing also stops on a null character)
+    } TCCUnicode_Utf8Span;
+
+    /// \brief UTF16 string given with its size, as used by the batch functions
+    typedef struct
+    {
+        const uint16_t *str; ///< Pointer to the UTF16 string
+        int size;            ///< Maximum number of shorts to process (processing also stops on a null character)
+    } TCCUnicode_Utf16Span;
+
+    /// \brief Default minimum size in bytes of the chunks a TCCUnicode_Arena takes from its backing allocator
+    ///
+    /// It can be redefined before including ccunicode.h (in the implementation file).
+#ifndef CCUNICODE_ARENA_CHUNK_SIZE
+#   define CCUNICODE_ARENA_CHUNK_SIZE 65536
+#endif
+
+    /// \brief Chunk of memory owned by a TCCUnicode_Arena (opaque)
+    typedef struct TCCUnicode_ArenaChunk TCCUnicode_ArenaChunk;
+
+    /// \brief Growth statistics of a TCCUnicode_Arena
+    typedef struct
+    {
+        size_t chunk_count;   ///< Number of chunks owned by the arena
+        size_t reserved_size; ///< Total number of bytes in these chunks
+        size_t used_size;     ///< Number of bytes handed out since the last reset (alignment padding included)
+        size_t peak_size;     ///< Highest used_size reached since the arena was initialized
+        size_t alloc_count;   ///< Number of allocations served since the arena was initialized
+        size_t grow_count;    ///< Number of times the arena had to take a new chunk from its backing allocator
+    } TCCUnicode_ArenaStats;
+
+    /// \brief Bump allocator handing out memory from large chunks
+    ///
+    /// Allocations only move a pointer forward. Freeing is a no-op, except for the latest allocation which is given back.
+    /// All the memory is reclaimed at once by ccunicode_ResetArena (or partially by ccunicode_RewindArena) while the chunks are kept,
+    /// so that a loop resetting the arena once per iteration stops allocating from the backing allocator once warmed up.
+    /// The allocator field is set by ccunicode_InitArena and &allocator.malloc_ptr can be given to any function with an 'a' suffix.
+    /// It points back to the arena, so an initialized arena must not be moved or copied.
+    /// An arena is not thread-safe: use one arena per thread (see ccunicode_GetThreadArena).
+    typedef struct
+    {
+        TCCUnicode_CtxMallocPtr allocator; ///< Allocator serving memory from this arena, to give to the a suffix functions
+        TCCUnicode_CtxMallocPtr backing;   ///< Allocator the chunks are taken from
+        TCCUnicode_ArenaChunk *first;    ///< First chunk of the arena
+        TCCUnicode_ArenaChunk *current;  ///< Chunk allocations are currently served from
+        size_t offset;                   ///< Number of bytes used in the current chunk
+        size_t chunk_size;               ///< Minimum size of a new chunk
+        void *last;                      ///< Latest allocation, which can be grown or freed in place
+        TCCUnicode_ArenaStats stats;     ///< Growth statistics
+    } TCCUnicode_Arena;
+
+    /// \brief Position in a TCCUnicode_Arena, to rewind to with ccunicode_RewindArena
+    typedef struct
+    {
+        TCCUnicode_ArenaChunk *chunk; ///< Chunk at the time of the mark
+        size_t offset;                ///< Offset in the chunk at the time of the mark
+        size_t used_size;             ///< Used size of the arena at the time of the mark
+    } TCCUnicode_ArenaMark;
+
+    /// \brief Number of buckets in the size histogram of TCCUnicode_TrackingStats
+#define CCUNICODE_TRACKING_SIZE_BUCKETS 32
+
+    /// \brief Block handed out by a TCCUnicode_TrackingAllocator (opaque)
+    typedef struct TCCUnicode_TrackedBlock TCCUnicode_TrackedBlock;
+
+    /// \brief Statistics of a TCCUnicode_TrackingAllocator
+    typedef struct
+    {
+        size_t alloc_count;       ///< Number of blocks allocated
+        size_t free_count;        ///< Number of blocks freed
+        size_t failed_count;      ///< Number of allocations the backing allocator failed
+        size_t total_bytes;       ///< Number of bytes allocated in total
+        size_t current_bytes;     ///< Number of bytes in the outstanding blocks
+        size_t peak_bytes;        ///< Highest current_bytes reached
+        size_t outstanding_count; ///< Number of blocks allocated and not freed yet
+        size_t size_histogram[CCUNICODE_TRACKING_SIZE_BUCKETS]; ///< size_histogram[i] is the number of blocks of 2^i to 2^(i+1)-1 bytes (the first bucket also holds empty blocks, the last one the larger blocks)
+    } TCCUnicode_TrackingStats;
+
+    /// \brief Debug allocator recording the blocks going through it
+    ///
+    /// Each block is prefixed with a small header linking it to the list of outstanding blocks, so that leaks can be
+    /// listed with ccunicode_ReportTrackedBlocks. The allocator field is set by ccunicode_InitTrackingAllocator and &allocator.malloc_ptr
+    /// can be given to any function with an 'a' suffix, for instance to check that a conversion does not allocate or frees everything it allocates.
+    /// It points back to the tracker, so an initialized tracker must not be moved or copied.
+    /// A tracker is not thread-safe: use one tracker per thread.
+    typedef struct
+    {
+        TCCUnicode_CtxMallocPtr allocator; ///< Allocator recording the blocks, to give to the a suffix functions
+        TCCUnicode_CtxMallocPtr backing;   ///< Allocator the blocks are taken from
+        TCCUnicode_TrackedBlock *blocks; ///< Latest outstanding block
+        size_t next_sequence;            ///< Sequence number of the next block (the first block gets 0)
+        TCCUnicode_TrackingStats stats;  ///< Statistics
+    } TCCUnicode_TrackingAllocator;
+
+    /// \brief What the context (c suffix) conversions do with invalid input
+    enum TCCUnicode_ErrorPolicy
+    {
+        CCUNICODE_ERROR_POLICY_STOP    = 0, ///< Stop and return the error, as the other conversion functions do
+        CCUNICODE_ERROR_POLICY_REPLACE = 1  ///< Replace each invalid character or codepoint by the replacement codepoint and go on
+    };
+
+    /// \brief Converter context reused across the context (c suffix) conversion functions
+    ///
+    /// The allocator is checked once by ccunicode_InitContext. The output and scratch buffers only grow,
+    /// so that converting strings no longer than the ones already seen performs no allocation.
+    /// The result of a conversion lives in the output buffer and is overwritten by the next conversion using the same context,
+    /// so it cannot be given as input to a conversion using the same context.
+    /// A context is not thread-safe: use one context per thread.
+    typedef struct
+    {
+        TCCUnicode_CtxMallocPtr allocator; ///< Allocator of the buffers
+        int error_policy;               ///< TCCUnicode_ErrorPolicy used by the conversions
+        uint32_t replacement;           ///< Codepoint replacing invalid input with CCUNICODE_ERROR_POLICY_REPLACE (U+FFFD by default, see ccunicode_SetContextReplacement)
+        int replacement_count;          ///< Number of replacements done by the latest conversion
+        void *output;                   ///< Output buffer
+        size_t output_size;             ///< Size of the output buffer in bytes
+        void *scratch;                  ///< Codepoint buffer of the conversions between UTF8 and UTF16
+        size_t scratch_size;            ///< Size of the scratch buffer in bytes
+    } TCCUnicode_Context;
+
+    /// \brief Offsets of a codepoint recorded by a TCCUnicode_CodepointIndex
+    typedef struct
+    {
+        int utf8_offset;  ///< Byte offset of the codepoint in the UTF8 string
+        int utf16_offset; ///< Short offset the codepoint would have in the same string converted to UTF16
+    } TCCUnicode_CodepointIndexEntry;
+
+    /// \brief Sparse index of the codepoints of a UTF8 string
+    ///
+    /// Every stride codepoints, the index records their byte offset and UTF16 offset, so that reaching any codepoint
+    /// only scans at most stride characters from the previous entry. The memory overhead is 8 bytes per stride codepoints.
+    /// The index does not keep a pointer to the string: the lookups take the string it was built from.
+    typedef struct
+    {
+        TCCUnicode_CtxMallocPtr allocator;       ///< Allocator of the entries
+        int stride;                              ///< Number of codepoints between two entries
+        int codepoint_count;                     ///< Number of codepoints in the string
+        int utf8_size;                           ///< Number of bytes in the string (up to its first null byte)
+        int utf16_size;                          ///< Number of shorts in the string converted to UTF16
+        int entry_count;                         ///< Number of entries (codepoint_count/stride + 1)
+        TCCUnicode_CodepointIndexEntry *entries; ///< Entry i holds the offsets of codepoint i*stride
+    } TCCUnicode_CodepointIndex;
+
+    /// \brief Position in a text given as a line and a column counted in UTF16 shorts, as editors and language servers use them
+    typedef struct
+    {
+        int line;         ///< Line index, starting at 0
+        int utf16_column; ///< Number of UTF16 shorts between the start of the line and the position
+    } TCCUnicode_TextPosition;
+
+    /// \brief Byte offsets of the line starts of a UTF8 text
+    ///
+    /// Lines end with "\n", "\r\n" or "\r". The table makes finding a line O(1) and finding the line of an offset O(log n).
+    typedef struct
+    {
+        TCCUnicode_CtxMallocPtr allocator; ///< Allocator of the line starts
+        int line_count;                 ///< Number of lines (line terminators + 1)
+        int utf8_size;                  ///< Number of bytes in the text
+        int *line_starts;               ///< Byte offset of the start of each line
+    } TCCUnicode_LineTable;
+
+    /// \brief Maximum number of bytes held by a node of a TCCUnicode_Rope
+    ///
+    /// It can be redefined before including ccunicode.h (in the implementation file).
+#ifndef CCUNICODE_ROPE_CHUNK_SIZE
+#   define CCUNICODE_ROPE_CHUNK_SIZE 512
+#endif
+
+    /// \brief Units of the offsets given to the rope functions
+    enum TCCUnicode_TextUnit
+    {
+        CCUNICODE_UNIT_UTF8      = 0, ///< Bytes of the UTF8 text
+        CCUNICODE_UNIT_UTF16     = 1, ///< Shorts of the text converted to UTF16
+        CCUNICODE_UNIT_CODEPOINT = 2  ///< Codepoints
+    };
+
+    /// \brief Unicode metrics of a text held by a TCCUnicode_Rope
+    typedef struct
+    {
+        int utf8_size;       ///< Number of bytes
+        int codepoint_count; ///< Number of codepoints
+        int utf16_size;      ///< Number of shorts in UTF16
+        int line_count;      ///< Number of line ends ("\n", "\r\n" or "\r")
+    } TCCUnicode_RopeMetrics;
+
+    /// \brief Node of a TCCUnicode_Rope (opaque)
+    typedef struct TCCUnicode_RopeNode TCCUnicode_RopeNode;
+
+    /// \brief Editable UTF8 text keeping its Unicode metrics up to date
+    ///
+    /// The text is split in chunks of at most CCUNICODE_ROPE_CHUNK_SIZE bytes, cut between characters, held by the nodes of a balanced tree.
+    /// Each node caches the metrics of its chunk and of its subtree, so that an edit only validates and counts the inserted text
+    /// and the chunks it touches, and converting an offset between units or finding a line takes O(log n).
+    /// A rope is not thread-safe.
+    typedef struct
+    {
+        TCCUnicode_CtxMallocPtr allocator; ///< Allocator of the nodes
+        TCCUnicode_RopeNode *root;      ///< Root of the tree, NULL when the text is empty
+        uint32_t seed;                  ///< State of the generator balancing the tree
+        int node_count;                 ///< Number of nodes
+    } TCCUnicode_Rope;
+
+    /// \brief Synthetic text generator (see ccunicode_InitCorpusGenerator)
+    ///
+    /// Characters are drawn in runs of the same UTF8 length, the length of each run following weights.
+    /// The fields can be changed between calls. The output only depends on the seed, the fields and the sizes given to the successive calls.
+    typedef struct
+    {
+        int weights[4];            ///< Relative frequencies of the characters taking 1, 2, 3 and 4 bytes in UTF8
+        uint32_t ranges[4][2];     ///< First and last codepoints drawn for each length (printable ASCII and the whole ranges of the other lengths by default)
+        int mean_run_length;       ///< Mean number of consecutive characters of the same length (1 by default)
+        int errors_per_million;    ///< Number of invalid characters generated per million characters (0 by default)
+        int nulls_per_million;     ///< Number of null characters generated per million characters (0 by default)
+        uint32_t state;            ///< State of the pseudo-random generator
+        int run_left;              ///< Number of characters left in the current run
+        int run_class;             ///< Length of the characters of the current run minus one
+    } TCCUnicode_CorpusGenerator;
+
+    /// \brief Encodings of the byte streams handled by a TCCUnicode_Transcoder
+    enum TCCUnicode_Encoding
+    {
+        CCUNICODE_ENCODING_UTF8    = 0, ///< UTF8
+        CCUNICODE_ENCODING_UTF16LE = 1, ///< UTF16, little endian
+        CCUNICODE_ENCODING_UTF16BE = 2, ///< UTF16, big endian
+        CCUNICODE_ENCODING_UTF32LE = 3, ///< UTF32, little endian
+        CCUNICODE_ENCODING_UTF32BE = 4  ///< UTF32, big endian
+    };
+
+    /// \brief State of a conversion between two encodings done piece by piece (see ccunicode_Transcode_m)
+    ///
+    /// Unlike the string functions, null characters are ordinary characters in a transcoded stream.
+    typedef struct
+    {
+        int source_encoding;       ///< TCCUnicode_Encoding of the input
+        int target_encoding;       ///< TCCUnicode_Encoding of the output
+        int error_policy;          ///< TCCUnicode_ErrorPolicy applied to invalid input
+        uint32_t replacement;      ///< Codepoint replacing invalid input with CCUNICODE_ERROR_POLICY_REPLACE (U+FFFD by default)
+        int64_t source_offset;     ///< Number of input bytes consumed so far (the offset of the invalid character after an error)
+        int64_t target_offset;     ///< Number of output bytes produced so far
+        int64_t replacement_count; ///< Number of replacements done so far
+    } TCCUnicode_Transcoder;
+
+    /// \brief Identifiers of the conversion functions recorded by the runtime statistics
+    ///
+    /// Only the functions taking a size have their own identifier: the null-terminated versions are recorded as the n version they call.
+    enum TCCUnicode_Function
+    {
+        CCUNICODE_FUNCTION_UTF8_TO_CODEPOINTS_N           = 0,  ///< ccunicode_Utf8ToCodepoints_n
+        CCUNICODE_FUNCTION_UTF8_TO_CODEPOINTS_NA          = 1,  ///< ccunicode_Utf8ToCodepoints_na
+        CCUNICODE_FUNCTION_UTF8_TO_CODEPOINTS_NM          = 2,  ///< ccunicode_Utf8ToCodepoints_nm
+        CCUNICODE_FUNCTION_UTF8_TO_CODEPOINTS_NC          = 3,  ///< ccunicode_Utf8ToCodepoints_nc
+        CCUNICODE_FUNCTION_UTF16_TO_CODEPOINTS_N          = 4,  ///< ccunicode_Utf16ToCodepoints_n
+        CCUNICODE_FUNCTION_UTF16_TO_CODEPOINTS_NA         = 5,  ///< ccunicode_Utf16ToCodepoints_na
+        CCUNICODE_FUNCTION_UTF16_TO_CODEPOINTS_NM         = 6,  ///< ccunicode_Utf16ToCodepoints_nm
+        CCUNICODE_FUNCTION_UTF16_TO_CODEPOINTS_NC         = 7,  ///< ccunicode_Utf16ToCodepoints_nc
+        CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF8_N           = 8,  ///< ccunicode_CodepointsToUtf8_n
+        CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF8_NA          = 9,  ///< ccunicode_CodepointsToUtf8_na
+        CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF8_NM          = 10, ///< ccunicode_CodepointsToUtf8_nm
+        CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF8_NC          = 11, ///< ccunicode_CodepointsToUtf8_nc
+        CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF16_N          = 12, ///< ccunicode_CodepointsToUtf16_n
+        CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF16_NA         = 13, ///< ccunicode_CodepointsToUtf16_na
+        CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF16_NM         = 14, ///< ccunicode_CodepointsToUtf16_nm
+        CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF16_NC         = 15, ///< ccunicode_CodepointsToUtf16_nc
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_N                = 16, ///< ccunicode_Utf8ToUtf16_n
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_NM               = 17, ///< ccunicode_Utf8ToUtf16_nm
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_NL               = 18, ///< ccunicode_Utf8ToUtf16_nl
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_NA               = 19, ///< ccunicode_Utf8ToUtf16_na
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_NMA              = 20, ///< ccunicode_Utf8ToUtf16_nma
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_NLA              = 21, ///< ccunicode_Utf8ToUtf16_nla
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_NML              = 22, ///< ccunicode_Utf8ToUtf16_nml
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_NC               = 23, ///< ccunicode_Utf8ToUtf16_nc
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_NP               = 24, ///< ccunicode_Utf8ToUtf16_np
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_NAP              = 25, ///< ccunicode_Utf8ToUtf16_nap
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_NMP              = 26, ///< ccunicode_Utf8ToUtf16_nmp
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_N                = 27, ///< ccunicode_Utf16ToUtf8_n
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_NM               = 28, ///< ccunicode_Utf16ToUtf8_nm
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_NL               = 29, ///< ccunicode_Utf16ToUtf8_nl
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_NA               = 30, ///< ccunicode_Utf16ToUtf8_na
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_NMA              = 31, ///< ccunicode_Utf16ToUtf8_nma
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_NLA              = 32, ///< ccunicode_Utf16ToUtf8_nla
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_NML              = 33, ///< ccunicode_Utf16ToUtf8_nml
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_NC               = 34, ///< ccunicode_Utf16ToUtf8_nc
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_NP               = 35, ///< ccunicode_Utf16ToUtf8_np
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_NAP              = 36, ///< ccunicode_Utf16ToUtf8_nap
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_NMP              = 37, ///< ccunicode_Utf16ToUtf8_nmp
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_BATCH_NP         = 38, ///< ccunicode_Utf8ToUtf16Batch_np
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_BATCH_NAP        = 39, ///< ccunicode_Utf8ToUtf16Batch_nap
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_BATCH_NMP        = 40, ///< ccunicode_Utf8ToUtf16Batch_nmp
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_BATCH_NP         = 41, ///< ccunicode_Utf16ToUtf8Batch_np
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_BATCH_NAP        = 42, ///< ccunicode_Utf16ToUtf8Batch_nap
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_BATCH_NMP        = 43, ///< ccunicode_Utf16ToUtf8Batch_nmp
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_COLUMN           = 44, ///< ccunicode_Utf8ToUtf16Column
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_COLUMN_A         = 45, ///< ccunicode_Utf8ToUtf16Column_a
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_COLUMN_M         = 46, ///< ccunicode_Utf8ToUtf16Column_m
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_COLUMN64         = 47, ///< ccunicode_Utf8ToUtf16Column64
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_COLUMN64_A       = 48, ///< ccunicode_Utf8ToUtf16Column64_a
+        CCUNICODE_FUNCTION_UTF8_TO_UTF16_COLUMN64_M       = 49, ///< ccunicode_Utf8ToUtf16Column64_m
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_COLUMN           = 50, ///< ccunicode_Utf16ToUtf8Column
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_COLUMN_A         = 51, ///< ccunicode_Utf16ToUtf8Column_a
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_COLUMN_M         = 52, ///< ccunicode_Utf16ToUtf8Column_m
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_COLUMN64         = 53, ///< ccunicode_Utf16ToUtf8Column64
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_COLUMN64_A       = 54, ///< ccunicode_Utf16ToUtf8Column64_a
+        CCUNICODE_FUNCTION_UTF16_TO_UTF8_COLUMN64_M       = 55, ///< ccunicode_Utf16ToUtf8Column64_m
+        CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF8_IN_PLACE_N  = 56, ///< ccunicode_CodepointsToUtf8InPlace_n
+        CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF16_IN_PLACE_N = 57, ///< ccunicode_CodepointsToUtf16InPlace_n
+        CCUNICODE_FUNCTION_TRANSCODE_M                    = 58, ///< ccunicode_Transcode_m
+        CCUNICODE_FUNCTION_VALIDATE_UTF8_DATA             = 59, ///< ccunicode_ValidateUtf8Data
+        CCUNICODE_FUNCTION_COUNT                          = 60  ///< Number of function identifiers
+    };
+
+    /// \brief Number of error slots in TCCUnicode_FunctionStats
+#define CCUNICODE_STATS_ERROR_SLOTS 16
+
+    /// \brief Number of latency buckets in TCCUnicode_FunctionStats
+#define CCUNICODE_STATS_LATENCY_BUCKETS 32
+
+    /// \brief Runtime statistics of a conversion function (see ccunicode_GetStats)
+    ///
+    /// A call is recorded when it does not come from another recorded function: ccunicode_Utf8ToUtf16_na is recorded once, not
+    /// along with the ccunicode_Utf8ToCodepoints_na and ccunicode_CodepointsToUtf16_na calls it makes.
+    typedef struct
+    {
+        uint64_t calls;                                       ///< Number of calls
+        uint64_t input_units;                                 ///< Sum of the input sizes (code units, codepoints, rows for the column functions, strings for the batch functions)
+        uint64_t output_units;                                ///< Sum of the output sizes of the successful calls (code units or codepoints)
+        uint64_t errors[CCUNICODE_STATS_ERROR_SLOTS];         ///< errors[0] is the number of failed calls, errors[-Code] the number of calls that returned Code
+        uint64_t alloc_count;                                 ///< Number of blocks allocated during the calls
+        uint64_t alloc_bytes;                                 ///< Number of bytes allocated during the calls
+        uint64_t total_ns;                                    ///< Total time spent in the calls, in nanoseconds
+        uint64_t latency[CCUNICODE_STATS_LATENCY_BUCKETS];    ///< latency[i] is the number of calls that took 2^i to 2^(i+1)-1 ns (the last bucket also holds the longer calls)
+    } TCCUnicode_FunctionStats;
+
+    /// \brief Snapshot of the runtime statistics of every conversion function
+    typedef struct
+    {
+        int enabled;                                                  ///< 1 if ccunicode was compiled with __CCUNICODE_STATS__ (the counters are all 0 otherwise)
+        TCCUnicode_FunctionStats functions[CCUNICODE_FUNCTION_COUNT]; ///< Statistics of each function, indexed by TCCUnicode_Function
+    } TCCUnicode_Stats;
+
+    /// \brief Code paths reported by the exit tracepoint of the conversion functions
+    ///
+    /// The tracepoints are the CCUNICODE_TRACE_ENTRY(Function, InputUnits) and
+    /// CCUNICODE_TRACE_EXIT(Function, InputUnits, OutputUnits, Variant, Result) hooks, run at the entry and exit of the functions
+    /// listed in TCCUnicode_Function (nested calls included). Function is a TCCUnicode_Function, InputUnits and OutputUnits are
+    /// counted as in TCCUnicode_FunctionStats (OutputUnits is 0 on error), Variant is a TCCUnicode_Variant and Result the returned value.
+    /// If __CCUNICODE_TRACE__ is defined and sys/sdt.h is available, they are the ccunicode:entry and ccunicode:exit static
+    /// tracepoints (USDT) that bpftrace or perf can attach to. Otherwise they compile to nothing, unless they are defined
+    /// before including ccunicode.h (in the implementation file) to call your own code.
+    /// A function that delegates to another one reports the variant chosen by the callee.
+    enum TCCUnicode_Variant
+    {
+        CCUNICODE_VARIANT_SCALAR           = 0, ///< One character at a time
+        CCUNICODE_VARIANT_ASCII_BLOCKS     = 1, ///< ASCII runs skipped 16 bytes at a time
+        CCUNICODE_VARIANT_STACK_BUFFER     = 2, ///< Codepoints decoded in a buffer on the stack (short strings)
+        CCUNICODE_VARIANT_STACK_WINDOWS    = 3, ///< Codepoints decoded in a buffer on the stack, one window at a time (long strings)
+        CCUNICODE_VARIANT_PARALLEL         = 4  ///< Conversion split into several tasks
+    };
+
     /// \brief Utility function: counts the number of bytes in a UTF8 string until the terminal '\0'
     ///
     /// This functions works similarly to strlen. It is here to avoid using the standard library.
@@ -772,6 +1207,7 @@ extern "C"
     /// This version has a ma suffix. This means temporary memory is allocated dynamically using user-defined functions
     /// and the utf8 string is processed until a null character is encountered but the output is
     /// sent to preallocated buffer.
+    /// The codepoints are decoded on the stack (by windows of CCUNICODE_SMALL_STRING_CODEPOINTS) so the allocator is never called.
     ///
     /// Generally the following suffixes are possible:
     /// n: a maximum length for the source string is given
@@ -792,6 +1228,7 @@ extern "C"
     /// This version has a nma suffix. This means temporary memory is allocated dynamically using user-defined functions,
     /// and the utf8 string is processed until a null character is encountered or some maximum size is reached but the output is
     /// sent to preallocated buffer.
+    /// The codepoints are decoded on the stack (by windows of CCUNICODE_SMALL_STRING_CODEPOINTS) so the allocator is never called.
     ///
     /// Generally the following suffixes are possible:
     /// n: a maximum length for the source string is given
@@ -1054,6 +1491,7 @@ extern "C"
     /// This version has a ma suffix. This means temporary memory is allocated dynamically using user-defined functions
     /// and the utf16 string is processed until a null character is encountered but the output is
     /// sent to preallocated buffer.
+    /// The codepoints are decoded on the stack (by windows of CCUNICODE_SMALL_STRING_CODEPOINTS) so the allocator is never called.
     ///
     /// Generally the following suffixes are possible:
     /// n: a maximum length for the source string is given
@@ -1074,6 +1512,7 @@ extern "C"
     /// This version has a nma suffix. This means temporary memory is allocated dynamically using user-defined functions,
     /// and the utf16 string is processed until a null character is encountered or some maximum size is reached but the output is
     /// sent to preallocated buffer.
+    /// The codepoints are decoded on the stack (by windows of CCUNICODE_SMALL_STRING_CODEPOINTS) so the allocator is never called.
     ///
     /// Generally the following suffixes are possible:
     /// n: a maximum length for the source string is given
@@ -1176,1091 +1615,8319 @@ extern "C"
     /// \return The number of bytes outputed (except for the final 0) or a negative number on error.
     int ccunicode_Utf16ToUtf8_nml(const uint16_t *Utf16Str, int Utf16Size, uint8_t *Utf8Str, int Utf8Size, uint32_t *Codepoints, int MaxCodepointsCount);
 
-#   ifdef __CCUNICODE_IMPL__
-#include <limits.h>
+#ifndef __CCUNICODE_NOSTDALLOC__
+    /// \brief Converts an UTF8 string into an UTF16 one using several threads.
+    ///
+    /// This version has a np suffix. This means memory is allocated dynamically using the standard library,
+    /// the utf8 string is processed until a null character is encountered or some maximum size is reached,
+    /// and the work is split across the threads of a TCCUnicode_ThreadPool.
+    ///
+    /// The string is cut at character boundaries, each part is validated and sized by its own task,
+    /// the output offsets are computed with a prefix sum and each task then writes its own slice of the output.
+    /// No intermediate codepoint array is needed. The result and the returned error are the same as ccunicode_Utf8ToUtf16_n.
+    /// Unlike the serial version, the whole Utf8Size bytes must be readable even if a null character comes first.
+    ///
+    /// Generally the following suffixes are possible:
+    /// n: a maximum length for the source string is given
+    /// m: a maximum length for the output buffer is given
+    /// l: a temporary buffer and its size are given to avoid internal allocation (when applicable)
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    /// p: a TCCUnicode_ThreadPool struct is provided to split the work across several threads.
+    /// Lengths never include the final null character and so buffer should have 1 more byte, short or int available.
+    ///
+    /// \param Utf8Str Pointer to a UTF8 string.
+    /// \param Utf8Size Number of bytes to process.
+    /// \param Utf16Str Pointer to a pointer that will hold the address of the resulting string. The user is responsible for freeing the memory.
+    /// \param Pool Pointer to a TCCUnicode_ThreadPool struct or NULL to run on the calling thread only
+    /// \return The number of shorts outputed (except for the final 0) or a negative number on error.
+    int ccunicode_Utf8ToUtf16_np(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, const TCCUnicode_ThreadPool *Pool);
+#endif
+    /// \brief Converts an UTF8 string into an UTF16 one using several threads.
+    ///
+    /// This version has a nap suffix. This means memory is allocated dynamically using user-defined functions,
+    /// the utf8 string is processed until a null character is encountered or some maximum size is reached,
+    /// and the work is split across the threads of a TCCUnicode_ThreadPool.
+    ///
+    /// The string is cut at character boundaries, each part is validated and sized by its own task,
+    /// the output offsets are computed with a prefix sum and each task then writes its own slice of the output.
+    /// No intermediate codepoint array is needed. The result and the returned error are the same as ccunicode_Utf8ToUtf16_na.
+    /// Unlike the serial version, the whole Utf8Size bytes must be readable even if a null character comes first.
+    ///
+    /// Generally the following suffixes are possible:
+    /// n: a maximum length for the source string is given
+    /// m: a maximum length for the output buffer is given
+    /// l: a temporary buffer and its size are given to avoid internal allocation (when applicable)
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    /// p: a TCCUnicode_ThreadPool struct is provided to split the work across several threads.
+    /// Lengths never include the final null character and so buffer should have 1 more byte, short or int available.
+    ///
+    /// \param Utf8Str Pointer to a UTF8 string.
+    /// \param Utf8Size Number of bytes to process.
+    /// \param Utf16Str Pointer to a pointer that will hold the address of the resulting string. The user is responsible for freeing the memory.
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \param Pool Pointer to a TCCUnicode_ThreadPool struct or NULL to run on the calling thread only
+    /// \return The number of shorts outputed (except for the final 0) or a negative number on error.
+    int ccunicode_Utf8ToUtf16_nap(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr, const TCCUnicode_ThreadPool *Pool);
 
-#define CCUNICODE_INTERNAL_TEST(t) \
-    { \
-        int Res = t; \
-        if (Res) \
-            return Res; \
-    }
+    /// \brief Converts an UTF8 string into an UTF16 one using several threads.
+    ///
+    /// This version has a nmp suffix. This means no memory is allocated and the output is sent to a preallocated buffer,
+    /// the utf8 string is processed until a null character is encountered or some maximum size is reached,
+    /// and the work is split across the threads of a TCCUnicode_ThreadPool.
+    ///
+    /// The string is cut at character boundaries, each part is validated and sized by its own task,
+    /// the output offsets are computed with a prefix sum and each task then writes its own slice of the output.
+    /// No intermediate codepoint array is needed. The result and the returned error are the same as ccunicode_Utf8ToUtf16_nm.
+    /// On error, the content of the output buffer is unspecified.
+    /// Unlike the serial version, the whole Utf8Size bytes must be readable even if a null character comes first.
+    ///
+    /// Generally the following suffixes are possible:
+    /// n: a maximum length for the source string is given
+    /// m: a maximum length for the output buffer is given
+    /// l: a temporary buffer and its size are given to avoid internal allocation (when applicable)
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    /// p: a TCCUnicode_ThreadPool struct is provided to split the work across several threads.
+    /// Lengths never include the final null character and so buffer should have 1 more byte, short or int available.
+    ///
+    /// \param Utf8Str Pointer to a UTF8 string.
+    /// \param Utf8Size Number of bytes to process.
+    /// \param Utf16Str Pointer to a buffer that will hold the resulting UTF16 string.
+    /// \param Utf16Size Number of shorts that the buffer can hold (not counting the last 0).
+    /// \param Pool Pointer to a TCCUnicode_ThreadPool struct or NULL to run on the calling thread only
+    /// \return The number of shorts outputed (except for the final 0) or a negative number on error.
+    int ccunicode_Utf8ToUtf16_nmp(const uint8_t *Utf8Str, int Utf8Size, uint16_t *Utf16Str, int Utf16Size, const TCCUnicode_ThreadPool *Pool);
 
 #ifndef __CCUNICODE_NOSTDALLOC__
+    /// \brief Converts an UTF16 string into an UTF8 one using several threads.
+    ///
+    /// This version has a np suffix. This means memory is allocated dynamically using the standard library,
+    /// the utf16 string is processed until a null character is encountered or some maximum size is reached,
+    /// and the work is split across the threads of a TCCUnicode_ThreadPool.
+    ///
+    /// The string is cut at character boundaries, each part is validated and sized by its own task,
+    /// the output offsets are computed with a prefix sum and each task then writes its own slice of the output.
+    /// No intermediate codepoint array is needed. The result and the returned error are the same as ccunicode_Utf16ToUtf8_n.
+    /// Unlike the serial version, the whole Utf16Size shorts must be readable even if a null character comes first.
+    ///
+    /// Generally the following suffixes are possible:
+    /// n: a maximum length for the source string is given
+    /// m: a maximum length for the output buffer is given
+    /// l: a temporary buffer and its size are given to avoid internal allocation (when applicable)
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    /// p: a TCCUnicode_ThreadPool struct is provided to split the work across several threads.
+    /// Lengths never include the final null character and so buffer should have 1 more byte, short or int available.
+    ///
+    /// \param Utf16Str Pointer to a UTF16 string.
+    /// \param Utf16Size Number of shorts to process.
+    /// \param Utf8Str Pointer to a pointer that will hold the address of the resulting string. The user is responsible for freeing the memory.
+    /// \param Pool Pointer to a TCCUnicode_ThreadPool struct or NULL to run on the calling thread only
+    /// \return The number of bytes outputed (except for the final 0) or a negative number on error.
+    int ccunicode_Utf16ToUtf8_np(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, const TCCUnicode_ThreadPool *Pool);
+#endif
+    /// \brief Converts an UTF16 string into an UTF8 one using several threads.
+    ///
+    /// This version has a nap suffix. This means memory is allocated dynamically using user-defined functions,
+    /// the utf16 string is processed until a null character is encountered or some maximum size is reached,
+    /// and the work is split across the threads of a TCCUnicode_ThreadPool.
+    ///
+    /// The string is cut at character boundaries, each part is validated and sized by its own task,
+    /// the output offsets are computed with a prefix sum and each task then writes its own slice of the output.
+    /// No intermediate codepoint array is needed. The result and the returned error are the same as ccunicode_Utf16ToUtf8_na.
+    /// Unlike the serial version, the whole Utf16Size shorts must be readable even if a null character comes first.
+    ///
+    /// Generally the following suffixes are possible:
+    /// n: a maximum length for the source string is given
+    /// m: a maximum length for the output buffer is given
+    /// l: a temporary buffer and its size are given to avoid internal allocation (when applicable)
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    /// p: a TCCUnicode_ThreadPool struct is provided to split the work across several threads.
+    /// Lengths never include the final null character and so buffer should have 1 more byte, short or int available.
+    ///
+    /// \param Utf16Str Pointer to a UTF16 string.
+    /// \param Utf16Size Number of shorts to process.
+    /// \param Utf8Str Pointer to a pointer that will hold the address of the resulting string. The user is responsible for freeing the memory.
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \param Pool Pointer to a TCCUnicode_ThreadPool struct or NULL to run on the calling thread only
+    /// \return The number of bytes outputed (except for the final 0) or a negative number on error.
+    int ccunicode_Utf16ToUtf8_nap(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr, const TCCUnicode_ThreadPool *Pool);
 
-#include <stdlib.h>
+    /// \brief Converts an UTF16 string into an UTF8 one using several threads.
+    ///
+    /// This version has a nmp suffix. This means no memory is allocated and the output is sent to a preallocated buffer,
+    /// the utf16 string is processed until a null character is encountered or some maximum size is reached,
+    /// and the work is split across the threads of a TCCUnicode_ThreadPool.
+    ///
+    /// The string is cut at character boundaries, each part is validated and sized by its own task,
+    /// the output offsets are computed with a prefix sum and each task then writes its own slice of the output.
+    /// No intermediate codepoint array is needed. The result and the returned error are the same as ccunicode_Utf16ToUtf8_nm.
+    /// On error, the content of the output buffer is unspecified.
+    /// Unlike the serial version, the whole Utf16Size shorts must be readable even if a null character comes first.
+    ///
+    /// Generally the following suffixes are possible:
+    /// n: a maximum length for the source string is given
+    /// m: a maximum length for the output buffer is given
+    /// l: a temporary buffer and its size are given to avoid internal allocation (when applicable)
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    /// p: a TCCUnicode_ThreadPool struct is provided to split the work across several threads.
+    /// Lengths never include the final null character and so buffer should have 1 more byte, short or int available.
+    ///
+    /// \param Utf16Str Pointer to a UTF16 string.
+    /// \param Utf16Size Number of shorts to process.
+    /// \param Utf8Str Pointer to a buffer that will hold the resulting UTF8 string.
+    /// \param Utf8Size Number of bytes that the buffer can hold (not counting the last 0).
+    /// \param Pool Pointer to a TCCUnicode_ThreadPool struct or NULL to run on the calling thread only
+    /// \return The number of bytes outputed (except for the final 0) or a negative number on error.
+    int ccunicode_Utf16ToUtf8_nmp(const uint16_t *Utf16Str, int Utf16Size, uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_ThreadPool *Pool);
 
-static const TCCUnicode_MallocPtr ccunicode_DefaultAllocator =
-{
-    &malloc,
-    &free
-};
+#ifndef __CCUNICODE_NOSTDALLOC__
+    /// \brief Converts a batch of UTF8 strings into UTF16 strings packed in a single buffer.
+    ///
+    /// This version has a np suffix. This means the output buffer is allocated dynamically using the standard library,
+    /// each utf8 string is processed until a null character is encountered or its size is reached,
+    /// and the strings are dispatched to the threads of a TCCUnicode_ThreadPool.
+    ///
+    /// The strings are first sized, then written. Threads grab blocks of strings from a shared counter
+    /// so that a thread done with its strings takes over the remaining ones. The whole batch performs a single allocation.
+    /// Every string is converted as ccunicode_Utf8ToUtf16_n would do it, and is null-terminated in the output buffer.
+    /// A string failing to convert does not stop the batch: its error is reported in Results and it takes no room in the output.
+    ///
+    /// Generally the following suffixes are possible:
+    /// n: a maximum length for the source string is given
+    /// m: a maximum length for the output buffer is given
+    /// l: a temporary buffer and its size are given to avoid internal allocation (when applicable)
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    /// p: a TCCUnicode_ThreadPool struct is provided to split the work across several threads.
+    /// Lengths never include the final null character and so buffer should have 1 more byte, short or int available.
+    ///
+    /// \param Utf8Strs Array of StrCount UTF8 strings.
+    /// \param StrCount Number of strings in the batch.
+    /// \param Utf16Strs Pointer to a pointer that will hold the address of the output buffer. The user is responsible for freeing the memory.
+    /// \param Offsets Array of StrCount+1 integers receiving the position of each string in the output buffer. The last one is the size of the buffer in shorts.
+    /// \param Results Array of StrCount integers receiving the number of shorts of each string (except for the final 0) or a negative number on error.
+    /// \param Pool Pointer to a TCCUnicode_ThreadPool struct or NULL to run on the calling thread only
+    /// \return CCUNICODE_NO_ERROR or a negative number if the batch as a whole failed.
+    int ccunicode_Utf8ToUtf16Batch_np(const TCCUnicode_Utf8Span *Utf8Strs, int StrCount, uint16_t **Utf16Strs, int64_t *Offsets, int *Results, const TCCUnicode_ThreadPool *Pool);
+#endif
+    /// \brief Converts a batch of UTF8 strings into UTF16 strings packed in a single buffer.
+    ///
+    /// This version has a nap suffix. This means the output buffer is allocated dynamically using user-defined functions,
+    /// each utf8 string is processed until a null character is encountered or its size is reached,
+    /// and the strings are dispatched to the threads of a TCCUnicode_ThreadPool.
+    ///
+    /// The strings are first sized, then written. Threads grab blocks of strings from a shared counter
+    /// so that a thread done with its strings takes over the remaining ones. The whole batch performs a single allocation.
+    /// Every string is converted as ccunicode_Utf8ToUtf16_na would do it, and is null-terminated in the output buffer.
+    /// A string failing to convert does not stop the batch: its error is reported in Results and it takes no room in the output.
+    ///
+    /// Generally the following suffixes are possible:
+    /// n: a maximum length for the source string is given
+    /// m: a maximum length for the output buffer is given
+    /// l: a temporary buffer and its size are given to avoid internal allocation (when applicable)
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    /// p: a TCCUnicode_ThreadPool struct is provided to split the work across several threads.
+    /// Lengths never include the final null character and so buffer should have 1 more byte, short or int available.
+    ///
+    /// \param Utf8Strs Array of StrCount UTF8 strings.
+    /// \param StrCount Number of strings in the batch.
+    /// \param Utf16Strs Pointer to a pointer that will hold the address of the output buffer. The user is responsible for freeing the memory.
+    /// \param Offsets Array of StrCount+1 integers receiving the position of each string in the output buffer. The last one is the size of the buffer in shorts.
+    /// \param Results Array of StrCount integers receiving the number of shorts of each string (except for the final 0) or a negative number on error.
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \param Pool Pointer to a TCCUnicode_ThreadPool struct or NULL to run on the calling thread only
+    /// \return CCUNICODE_NO_ERROR or a negative number if the batch as a whole failed.
+    int ccunicode_Utf8ToUtf16Batch_nap(const TCCUnicode_Utf8Span *Utf8Strs, int StrCount, uint16_t **Utf16Strs, int64_t *Offsets, int *Results, const TCCUnicode_MallocPtr *AllocPtr, const TCCUnicode_ThreadPool *Pool);
 
-#endif // __CCUNICODE_NOSTDALLOC__
+    /// \brief Converts a batch of UTF8 strings into UTF16 strings packed in a single buffer.
+    ///
+    /// This version has a nmp suffix. This means no memory is allocated and the output is sent to a preallocated buffer,
+    /// each utf8 string is processed until a null character is encountered or its size is reached,
+    /// and the strings are dispatched to the threads of a TCCUnicode_ThreadPool.
+    ///
+    /// The strings are first sized, then written. Threads grab blocks of strings from a shared counter
+    /// so that a thread done with its strings takes over the remaining ones.
+    /// Every string is converted as ccunicode_Utf8ToUtf16_na would do it, and is null-terminated in the output buffer.
+    /// A string failing to convert does not stop the batch: its error is reported in Results and it takes no room in the output.
+    /// If the buffer is too small, nothing is written but Offsets and Results are still filled, so Offsets[StrCount] gives the needed size.
+    ///
+    /// Generally the following suffixes are possible:
+    /// n: a maximum length for the source string is given
+    /// m: a maximum length for the output buffer is given
+    /// l: a temporary buffer and its size are given to avoid internal allocation (when applicable)
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    /// p: a TCCUnicode_ThreadPool struct is provided to split the work across several threads.
+    /// Lengths never include the final null character and so buffer should have 1 more byte, short or int available.
+    ///
+    /// \param Utf8Strs Array of StrCount UTF8 strings.
+    /// \param StrCount Number of strings in the batch.
+    /// \param Utf16Strs Pointer to the output buffer. It can be NULL if Utf16Size is 0.
+    /// \param Utf16Size Number of shorts the output buffer can hold (including the null characters ending each string).
+    /// \param Offsets Array of StrCount+1 integers receiving the position of each string in the output buffer. The last one is the needed size in shorts.
+    /// \param Results Array of StrCount integers receiving the number of shorts of each string (except for the final 0) or a negative number on error.
+    /// \param Pool Pointer to a TCCUnicode_ThreadPool struct or NULL to run on the calling thread only
+    /// \return CCUNICODE_NO_ERROR or a negative number if the batch as a whole failed.
+    int ccunicode_Utf8ToUtf16Batch_nmp(const TCCUnicode_Utf8Span *Utf8Strs, int StrCount, uint16_t *Utf16Strs, int64_t Utf16Size, int64_t *Offsets, int *Results, const TCCUnicode_ThreadPool *Pool);
 
-static int ccunicode_CheckAllocator(const TCCUnicode_MallocPtr **AllocPtr)
-{
-    if (!(*AllocPtr))
-    {
 #ifndef __CCUNICODE_NOSTDALLOC__
-        *AllocPtr = &ccunicode_DefaultAllocator;
-#else
-        return CCUNICODE_NULL_ALLOCATOR;
+    /// \brief Converts a batch of UTF16 strings into UTF8 strings packed in a single buffer.
+    ///
+    /// This version has a np suffix. This means the output buffer is allocated dynamically using the standard library,
+    /// each utf16 string is processed until a null character is encountered or its size is reached,
+    /// and the strings are dispatched to the threads of a TCCUnicode_ThreadPool.
+    ///
+    /// The strings are first sized, then written. Threads grab blocks of strings from a shared counter
+    /// so that a thread done with its strings takes over the remaining ones. The whole batch performs a single allocation.
+    /// Every string is converted as ccunicode_Utf16ToUtf8_n would do it, and is null-terminated in the output buffer.
+    /// A string failing to convert does not stop the batch: its error is reported in Results and it takes no room in the output.
+    ///
+    /// Generally the following suffixes are possible:
+    /// n: a maximum length for the source string is given
+    /// m: a maximum length for the output buffer is given
+    /// l: a temporary buffer and its size are given to avoid internal allocation (when applicable)
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    /// p: a TCCUnicode_ThreadPool struct is provided to split the work across several threads.
+    /// Lengths never include the final null character and so buffer should have 1 more byte, short or int available.
+    ///
+    /// \param Utf16Strs Array of StrCount UTF16 strings.
+    /// \param StrCount Number of strings in the batch.
+    /// \param Utf8Strs Pointer to a pointer that will hold the address of the output buffer. The user is responsible for freeing the memory.
+    /// \param Offsets Array of StrCount+1 integers receiving the position of each string in the output buffer. The last one is the size of the buffer in bytes.
+    /// \param Results Array of StrCount integers receiving the number of bytes of each string (except for the final 0) or a negative number on error.
+    /// \param Pool Pointer to a TCCUnicode_ThreadPool struct or NULL to run on the calling thread only
+    /// \return CCUNICODE_NO_ERROR or a negative number if the batch as a whole failed.
+    int ccunicode_Utf16ToUtf8Batch_np(const TCCUnicode_Utf16Span *Utf16Strs, int StrCount, uint8_t **Utf8Strs, int64_t *Offsets, int *Results, const TCCUnicode_ThreadPool *Pool);
 #endif
-    }
+    /// \brief Converts a batch of UTF16 strings into UTF8 strings packed in a single buffer.
+    ///
+    /// This version has a nap suffix. This means the output buffer is allocated dynamically using user-defined functions,
+    /// each utf16 string is processed until a null character is encountered or its size is reached,
+    /// and the strings are dispatched to the threads of a TCCUnicode_ThreadPool.
+    ///
+    /// The strings are first sized, then written. Threads grab blocks of strings from a shared counter
+    /// so that a thread done with its strings takes over the remaining ones. The whole batch performs a single allocation.
+    /// Every string is converted as ccunicode_Utf16ToUtf8_na would do it, and is null-terminated in the output buffer.
+    /// A string failing to convert does not stop the batch: its error is reported in Results and it takes no room in the output.
+    ///
+    /// Generally the following suffixes are possible:
+    /// n: a maximum length for the source string is given
+    /// m: a maximum length for the output buffer is given
+    /// l: a temporary buffer and its size are given to avoid internal allocation (when applicable)
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    /// p: a TCCUnicode_ThreadPool struct is provided to split the work across several threads.
+    /// Lengths never include the final null character and so buffer should have 1 more byte, short or int available.
+    ///
+    /// \param Utf16Strs Array of StrCount UTF16 strings.
+    /// \param StrCount Number of strings in the batch.
+    /// \param Utf8Strs Pointer to a pointer that will hold the address of the output buffer. The user is responsible for freeing the memory.
+    /// \param Offsets Array of StrCount+1 integers receiving the position of each string in the output buffer. The last one is the size of the buffer in bytes.
+    /// \param Results Array of StrCount integers receiving the number of bytes of each string (except for the final 0) or a negative number on error.
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \param Pool Pointer to a TCCUnicode_ThreadPool struct or NULL to run on the calling thread only
+    /// \return CCUNICODE_NO_ERROR or a negative number if the batch as a whole failed.
+    int ccunicode_Utf16ToUtf8Batch_nap(const TCCUnicode_Utf16Span *Utf16Strs, int StrCount, uint8_t **Utf8Strs, int64_t *Offsets, int *Results, const TCCUnicode_MallocPtr *AllocPtr, const TCCUnicode_ThreadPool *Pool);
 
-    if (!(*AllocPtr)->malloc_func || !(*AllocPtr)->free_func)
-        return CCUNICODE_INVALID_ALLOCATOR;
+    /// \brief Converts a batch of UTF16 strings into UTF8 strings packed in a single buffer.
+    ///
+    /// This version has a nmp suffix. This means no memory is allocated and the output is sent to a preallocated buffer,
+    /// each utf16 string is processed until a null character is encountered or its size is reached,
+    /// and the strings are dispatched to the threads of a TCCUnicode_ThreadPool.
+    ///
+    /// The strings are first sized, then written. Threads grab blocks of strings from a shared counter
+    /// so that a thread done with its strings takes over the remaining ones.
+    /// Every string is converted as ccunicode_Utf16ToUtf8_na would do it, and is null-terminated in the output buffer.
+    /// A string failing to convert does not stop the batch: its error is reported in Results and it takes no room in the output.
+    /// If the buffer is too small, nothing is written but Offsets and Results are still filled, so Offsets[StrCount] gives the needed size.
+    ///
+    /// Generally the following suffixes are possible:
+    /// n: a maximum length for the source string is given
+    /// m: a maximum length for the output buffer is given
+    /// l: a temporary buffer and its size are given to avoid internal allocation (when applicable)
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    /// p: a TCCUnicode_ThreadPool struct is provided to split the work across several threads.
+    /// Lengths never include the final null character and so buffer should have 1 more byte, short or int available.
+    ///
+    /// \param Utf16Strs Array of StrCount UTF16 strings.
+    /// \param StrCount Number of strings in the batch.
+    /// \param Utf8Strs Pointer to the output buffer. It can be NULL if Utf8Size is 0.
+    /// \param Utf8Size Number of bytes the output buffer can hold (including the null characters ending each string).
+    /// \param Offsets Array of StrCount+1 integers receiving the position of each string in the output buffer. The last one is the needed size in bytes.
+    /// \param Results Array of StrCount integers receiving the number of bytes of each string (except for the final 0) or a negative number on error.
+    /// \param Pool Pointer to a TCCUnicode_ThreadPool struct or NULL to run on the calling thread only
+    /// \return CCUNICODE_NO_ERROR or a negative number if the batch as a whole failed.
+    int ccunicode_Utf16ToUtf8Batch_nmp(const TCCUnicode_Utf16Span *Utf16Strs, int StrCount, uint8_t *Utf8Strs, int64_t Utf8Size, int64_t *Offsets, int *Results, const TCCUnicode_ThreadPool *Pool);
+
+    /// \brief Validates a column of UTF8 strings stored in the Arrow layout: a data buffer and 32 bits offsets.
+    ///
+    /// Row i is made of the bytes from Utf8Offsets[i] to Utf8Offsets[i+1] (excluded) in Utf8Data, Utf8Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The whole column is checked as a single stream: ASCII runs are handled 8 bytes at a time regardless of the row boundaries.
+    /// A row is valid if ccunicode_Utf8ToUtf16Column_m would convert it: characters cannot cross row boundaries
+    /// and must decode to valid codepoints.
+    ///
+    /// \param Utf8Data Pointer to the data buffer of the column.
+    /// \param Utf8Offsets Array of RowCount+1 non-decreasing offsets into Utf8Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_ValidateUtf8Column(const uint8_t *Utf8Data, const int32_t *Utf8Offsets, int64_t RowCount, int64_t *ErrorRow);
+
+    /// \brief Computes the size of the data buffer needed to convert a column of UTF8 strings stored in the Arrow layout (32 bits offsets).
+    ///
+    /// Row i is made of the bytes from Utf8Offsets[i] to Utf8Offsets[i+1] (excluded) in Utf8Data, Utf8Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The whole column is checked as a single stream: ASCII runs are handled 8 bytes at a time regardless of the row boundaries.
+    ///
+    /// \param Utf8Data Pointer to the data buffer of the column.
+    /// \param Utf8Offsets Array of RowCount+1 non-decreasing offsets into Utf8Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf16Size Pointer receiving the number of shorts of the converted data buffer.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_GetUtf16SizeFromUtf8Column(const uint8_t *Utf8Data, const int32_t *Utf8Offsets, int64_t RowCount, int64_t *Utf16Size, int64_t *ErrorRow);
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+    /// \brief Converts a column of UTF8 strings into UTF16 strings, both stored in the Arrow layout (32 bits offsets).
+    ///
+    /// This version has no suffix. This means the output data buffer is allocated dynamically using the standard library.
+    /// It is sized for the worst case (one short per UTF8 byte) so that the column is read only once.
+    ///
+    /// Row i is made of the bytes from Utf8Offsets[i] to Utf8Offsets[i+1] (excluded) in Utf8Data, Utf8Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The column is converted as a single stream and the output offsets are written in the same pass:
+    /// ASCII runs are handled 8 bytes at a time regardless of the row boundaries. The output rows are not null-terminated either.
+    /// The conversion stops at the first invalid row.
+    ///
+    /// Generally the following suffixes are possible:
+    /// m: a maximum length for the output buffer is given
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    ///
+    /// \param Utf8Data Pointer to the data buffer of the column.
+    /// \param Utf8Offsets Array of RowCount+1 non-decreasing offsets into Utf8Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf16Data Pointer to a pointer that will hold the address of the output data buffer. The user is responsible for freeing the memory.
+    /// \param Utf16Offsets Array of RowCount+1 integers receiving the position of each row in the output data buffer. The first one is 0.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Utf8ToUtf16Column(const uint8_t *Utf8Data, const int32_t *Utf8Offsets, int64_t RowCount, uint16_t **Utf16Data, int32_t *Utf16Offsets, int64_t *ErrorRow);
+#endif
+
+    /// \brief Converts a column of UTF8 strings into UTF16 strings, both stored in the Arrow layout (32 bits offsets).
+    ///
+    /// This version has an a suffix. This means the output data buffer is allocated dynamically using user-defined functions.
+    /// It is sized for the worst case (one short per UTF8 byte) so that the column is read only once.
+    ///
+    /// Row i is made of the bytes from Utf8Offsets[i] to Utf8Offsets[i+1] (excluded) in Utf8Data, Utf8Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The column is converted as a single stream and the output offsets are written in the same pass:
+    /// ASCII runs are handled 8 bytes at a time regardless of the row boundaries. The output rows are not null-terminated either.
+    /// The conversion stops at the first invalid row.
+    ///
+    /// Generally the following suffixes are possible:
+    /// m: a maximum length for the output buffer is given
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    ///
+    /// \param Utf8Data Pointer to the data buffer of the column.
+    /// \param Utf8Offsets Array of RowCount+1 non-decreasing offsets into Utf8Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf16Data Pointer to a pointer that will hold the address of the output data buffer. The user is responsible for freeing the memory.
+    /// \param Utf16Offsets Array of RowCount+1 integers receiving the position of each row in the output data buffer. The first one is 0.
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Utf8ToUtf16Column_a(const uint8_t *Utf8Data, const int32_t *Utf8Offsets, int64_t RowCount, uint16_t **Utf16Data, int32_t *Utf16Offsets, const TCCUnicode_MallocPtr *AllocPtr, int64_t *ErrorRow);
+
+    /// \brief Converts a column of UTF8 strings into UTF16 strings, both stored in the Arrow layout (32 bits offsets).
+    ///
+    /// This version has a m suffix. This means no memory is allocated and the output is sent to a preallocated data buffer.
+    /// ccunicode_GetUtf16SizeFromUtf8Column gives the needed size.
+    ///
+    /// Row i is made of the bytes from Utf8Offsets[i] to Utf8Offsets[i+1] (excluded) in Utf8Data, Utf8Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The column is converted as a single stream and the output offsets are written in the same pass:
+    /// ASCII runs are handled 8 bytes at a time regardless of the row boundaries. The output rows are not null-terminated either.
+    /// The conversion stops at the first invalid row.
+    ///
+    /// Generally the following suffixes are possible:
+    /// m: a maximum length for the output buffer is given
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    ///
+    /// \param Utf8Data Pointer to the data buffer of the column.
+    /// \param Utf8Offsets Array of RowCount+1 non-decreasing offsets into Utf8Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf16Data Pointer to the output data buffer. It can be NULL if Utf16Size is 0.
+    /// \param Utf16Size Number of shorts the output data buffer can hold.
+    /// \param Utf16Offsets Array of RowCount+1 integers receiving the position of each row in the output data buffer. The first one is 0.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Utf8ToUtf16Column_m(const uint8_t *Utf8Data, const int32_t *Utf8Offsets, int64_t RowCount, uint16_t *Utf16Data, int64_t Utf16Size, int32_t *Utf16Offsets, int64_t *ErrorRow);
+
+    /// \brief Validates a column of UTF8 strings stored in the Arrow layout: a data buffer and 64 bits offsets.
+    ///
+    /// Row i is made of the bytes from Utf8Offsets[i] to Utf8Offsets[i+1] (excluded) in Utf8Data, Utf8Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The whole column is checked as a single stream: ASCII runs are handled 8 bytes at a time regardless of the row boundaries.
+    /// A row is valid if ccunicode_Utf8ToUtf16Column64_m would convert it: characters cannot cross row boundaries
+    /// and must decode to valid codepoints.
+    ///
+    /// \param Utf8Data Pointer to the data buffer of the column.
+    /// \param Utf8Offsets Array of RowCount+1 non-decreasing offsets into Utf8Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_ValidateUtf8Column64(const uint8_t *Utf8Data, const int64_t *Utf8Offsets, int64_t RowCount, int64_t *ErrorRow);
+
+    /// \brief Computes the size of the data buffer needed to convert a column of UTF8 strings stored in the Arrow layout (64 bits offsets).
+    ///
+    /// Row i is made of the bytes from Utf8Offsets[i] to Utf8Offsets[i+1] (excluded) in Utf8Data, Utf8Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The whole column is checked as a single stream: ASCII runs are handled 8 bytes at a time regardless of the row boundaries.
+    ///
+    /// \param Utf8Data Pointer to the data buffer of the column.
+    /// \param Utf8Offsets Array of RowCount+1 non-decreasing offsets into Utf8Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf16Size Pointer receiving the number of shorts of the converted data buffer.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_GetUtf16SizeFromUtf8Column64(const uint8_t *Utf8Data, const int64_t *Utf8Offsets, int64_t RowCount, int64_t *Utf16Size, int64_t *ErrorRow);
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+    /// \brief Converts a column of UTF8 strings into UTF16 strings, both stored in the Arrow layout (64 bits offsets).
+    ///
+    /// This version has no suffix. This means the output data buffer is allocated dynamically using the standard library.
+    /// It is sized for the worst case (one short per UTF8 byte) so that the column is read only once.
+    ///
+    /// Row i is made of the bytes from Utf8Offsets[i] to Utf8Offsets[i+1] (excluded) in Utf8Data, Utf8Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The column is converted as a single stream and the output offsets are written in the same pass:
+    /// ASCII runs are handled 8 bytes at a time regardless of the row boundaries. The output rows are not null-terminated either.
+    /// The conversion stops at the first invalid row.
+    ///
+    /// Generally the following suffixes are possible:
+    /// m: a maximum length for the output buffer is given
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    ///
+    /// \param Utf8Data Pointer to the data buffer of the column.
+    /// \param Utf8Offsets Array of RowCount+1 non-decreasing offsets into Utf8Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf16Data Pointer to a pointer that will hold the address of the output data buffer. The user is responsible for freeing the memory.
+    /// \param Utf16Offsets Array of RowCount+1 integers receiving the position of each row in the output data buffer. The first one is 0.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Utf8ToUtf16Column64(const uint8_t *Utf8Data, const int64_t *Utf8Offsets, int64_t RowCount, uint16_t **Utf16Data, int64_t *Utf16Offsets, int64_t *ErrorRow);
+#endif
+
+    /// \brief Converts a column of UTF8 strings into UTF16 strings, both stored in the Arrow layout (64 bits offsets).
+    ///
+    /// This version has an a suffix. This means the output data buffer is allocated dynamically using user-defined functions.
+    /// It is sized for the worst case (one short per UTF8 byte) so that the column is read only once.
+    ///
+    /// Row i is made of the bytes from Utf8Offsets[i] to Utf8Offsets[i+1] (excluded) in Utf8Data, Utf8Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The column is converted as a single stream and the output offsets are written in the same pass:
+    /// ASCII runs are handled 8 bytes at a time regardless of the row boundaries. The output rows are not null-terminated either.
+    /// The conversion stops at the first invalid row.
+    ///
+    /// Generally the following suffixes are possible:
+    /// m: a maximum length for the output buffer is given
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    ///
+    /// \param Utf8Data Pointer to the data buffer of the column.
+    /// \param Utf8Offsets Array of RowCount+1 non-decreasing offsets into Utf8Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf16Data Pointer to a pointer that will hold the address of the output data buffer. The user is responsible for freeing the memory.
+    /// \param Utf16Offsets Array of RowCount+1 integers receiving the position of each row in the output data buffer. The first one is 0.
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Utf8ToUtf16Column64_a(const uint8_t *Utf8Data, const int64_t *Utf8Offsets, int64_t RowCount, uint16_t **Utf16Data, int64_t *Utf16Offsets, const TCCUnicode_MallocPtr *AllocPtr, int64_t *ErrorRow);
+
+    /// \brief Converts a column of UTF8 strings into UTF16 strings, both stored in the Arrow layout (64 bits offsets).
+    ///
+    /// This version has a m suffix. This means no memory is allocated and the output is sent to a preallocated data buffer.
+    /// ccunicode_GetUtf16SizeFromUtf8Column64 gives the needed size.
+    ///
+    /// Row i is made of the bytes from Utf8Offsets[i] to Utf8Offsets[i+1] (excluded) in Utf8Data, Utf8Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The column is converted as a single stream and the output offsets are written in the same pass:
+    /// ASCII runs are handled 8 bytes at a time regardless of the row boundaries. The output rows are not null-terminated either.
+    /// The conversion stops at the first invalid row.
+    ///
+    /// Generally the following suffixes are possible:
+    /// m: a maximum length for the output buffer is given
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    ///
+    /// \param Utf8Data Pointer to the data buffer of the column.
+    /// \param Utf8Offsets Array of RowCount+1 non-decreasing offsets into Utf8Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf16Data Pointer to the output data buffer. It can be NULL if Utf16Size is 0.
+    /// \param Utf16Size Number of shorts the output data buffer can hold.
+    /// \param Utf16Offsets Array of RowCount+1 integers receiving the position of each row in the output data buffer. The first one is 0.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Utf8ToUtf16Column64_m(const uint8_t *Utf8Data, const int64_t *Utf8Offsets, int64_t RowCount, uint16_t *Utf16Data, int64_t Utf16Size, int64_t *Utf16Offsets, int64_t *ErrorRow);
+
+    /// \brief Validates a column of UTF16 strings stored in the Arrow layout: a data buffer and 32 bits offsets.
+    ///
+    /// Row i is made of the shorts from Utf16Offsets[i] to Utf16Offsets[i+1] (excluded) in Utf16Data, Utf16Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The whole column is checked as a single stream: ASCII runs are handled 4 shorts at a time regardless of the row boundaries.
+    /// A row is valid if ccunicode_Utf16ToUtf8Column_m would convert it: characters cannot cross row boundaries
+    /// and must decode to valid codepoints.
+    ///
+    /// \param Utf16Data Pointer to the data buffer of the column.
+    /// \param Utf16Offsets Array of RowCount+1 non-decreasing offsets into Utf16Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_ValidateUtf16Column(const uint16_t *Utf16Data, const int32_t *Utf16Offsets, int64_t RowCount, int64_t *ErrorRow);
+
+    /// \brief Computes the size of the data buffer needed to convert a column of UTF16 strings stored in the Arrow layout (32 bits offsets).
+    ///
+    /// Row i is made of the shorts from Utf16Offsets[i] to Utf16Offsets[i+1] (excluded) in Utf16Data, Utf16Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The whole column is checked as a single stream: ASCII runs are handled 4 shorts at a time regardless of the row boundaries.
+    ///
+    /// \param Utf16Data Pointer to the data buffer of the column.
+    /// \param Utf16Offsets Array of RowCount+1 non-decreasing offsets into Utf16Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf8Size Pointer receiving the number of bytes of the converted data buffer.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_GetUtf8SizeFromUtf16Column(const uint16_t *Utf16Data, const int32_t *Utf16Offsets, int64_t RowCount, int64_t *Utf8Size, int64_t *ErrorRow);
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+    /// \brief Converts a column of UTF16 strings into UTF8 strings, both stored in the Arrow layout (32 bits offsets).
+    ///
+    /// This version has no suffix. This means the output data buffer is allocated dynamically using the standard library.
+    /// It is sized for the worst case (three bytes per UTF16 short) so that the column is read only once.
+    ///
+    /// Row i is made of the shorts from Utf16Offsets[i] to Utf16Offsets[i+1] (excluded) in Utf16Data, Utf16Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The column is converted as a single stream and the output offsets are written in the same pass:
+    /// ASCII runs are handled 4 shorts at a time regardless of the row boundaries. The output rows are not null-terminated either.
+    /// The conversion stops at the first invalid row.
+    ///
+    /// Generally the following suffixes are possible:
+    /// m: a maximum length for the output buffer is given
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    ///
+    /// \param Utf16Data Pointer to the data buffer of the column.
+    /// \param Utf16Offsets Array of RowCount+1 non-decreasing offsets into Utf16Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf8Data Pointer to a pointer that will hold the address of the output data buffer. The user is responsible for freeing the memory.
+    /// \param Utf8Offsets Array of RowCount+1 integers receiving the position of each row in the output data buffer. The first one is 0.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Utf16ToUtf8Column(const uint16_t *Utf16Data, const int32_t *Utf16Offsets, int64_t RowCount, uint8_t **Utf8Data, int32_t *Utf8Offsets, int64_t *ErrorRow);
+#endif
+
+    /// \brief Converts a column of UTF16 strings into UTF8 strings, both stored in the Arrow layout (32 bits offsets).
+    ///
+    /// This version has an a suffix. This means the output data buffer is allocated dynamically using user-defined functions.
+    /// It is sized for the worst case (three bytes per UTF16 short) so that the column is read only once.
+    ///
+    /// Row i is made of the shorts from Utf16Offsets[i] to Utf16Offsets[i+1] (excluded) in Utf16Data, Utf16Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The column is converted as a single stream and the output offsets are written in the same pass:
+    /// ASCII runs are handled 4 shorts at a time regardless of the row boundaries. The output rows are not null-terminated either.
+    /// The conversion stops at the first invalid row.
+    ///
+    /// Generally the following suffixes are possible:
+    /// m: a maximum length for the output buffer is given
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    ///
+    /// \param Utf16Data Pointer to the data buffer of the column.
+    /// \param Utf16Offsets Array of RowCount+1 non-decreasing offsets into Utf16Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf8Data Pointer to a pointer that will hold the address of the output data buffer. The user is responsible for freeing the memory.
+    /// \param Utf8Offsets Array of RowCount+1 integers receiving the position of each row in the output data buffer. The first one is 0.
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Utf16ToUtf8Column_a(const uint16_t *Utf16Data, const int32_t *Utf16Offsets, int64_t RowCount, uint8_t **Utf8Data, int32_t *Utf8Offsets, const TCCUnicode_MallocPtr *AllocPtr, int64_t *ErrorRow);
+
+    /// \brief Converts a column of UTF16 strings into UTF8 strings, both stored in the Arrow layout (32 bits offsets).
+    ///
+    /// This version has a m suffix. This means no memory is allocated and the output is sent to a preallocated data buffer.
+    /// ccunicode_GetUtf8SizeFromUtf16Column gives the needed size.
+    ///
+    /// Row i is made of the shorts from Utf16Offsets[i] to Utf16Offsets[i+1] (excluded) in Utf16Data, Utf16Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The column is converted as a single stream and the output offsets are written in the same pass:
+    /// ASCII runs are handled 4 shorts at a time regardless of the row boundaries. The output rows are not null-terminated either.
+    /// The conversion stops at the first invalid row.
+    ///
+    /// Generally the following suffixes are possible:
+    /// m: a maximum length for the output buffer is given
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    ///
+    /// \param Utf16Data Pointer to the data buffer of the column.
+    /// \param Utf16Offsets Array of RowCount+1 non-decreasing offsets into Utf16Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf8Data Pointer to the output data buffer. It can be NULL if Utf8Size is 0.
+    /// \param Utf8Size Number of bytes the output data buffer can hold.
+    /// \param Utf8Offsets Array of RowCount+1 integers receiving the position of each row in the output data buffer. The first one is 0.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Utf16ToUtf8Column_m(const uint16_t *Utf16Data, const int32_t *Utf16Offsets, int64_t RowCount, uint8_t *Utf8Data, int64_t Utf8Size, int32_t *Utf8Offsets, int64_t *ErrorRow);
+
+    /// \brief Validates a column of UTF16 strings stored in the Arrow layout: a data buffer and 64 bits offsets.
+    ///
+    /// Row i is made of the shorts from Utf16Offsets[i] to Utf16Offsets[i+1] (excluded) in Utf16Data, Utf16Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The whole column is checked as a single stream: ASCII runs are handled 4 shorts at a time regardless of the row boundaries.
+    /// A row is valid if ccunicode_Utf16ToUtf8Column64_m would convert it: characters cannot cross row boundaries
+    /// and must decode to valid codepoints.
+    ///
+    /// \param Utf16Data Pointer to the data buffer of the column.
+    /// \param Utf16Offsets Array of RowCount+1 non-decreasing offsets into Utf16Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_ValidateUtf16Column64(const uint16_t *Utf16Data, const int64_t *Utf16Offsets, int64_t RowCount, int64_t *ErrorRow);
+
+    /// \brief Computes the size of the data buffer needed to convert a column of UTF16 strings stored in the Arrow layout (64 bits offsets).
+    ///
+    /// Row i is made of the shorts from Utf16Offsets[i] to Utf16Offsets[i+1] (excluded) in Utf16Data, Utf16Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The whole column is checked as a single stream: ASCII runs are handled 4 shorts at a time regardless of the row boundaries.
+    ///
+    /// \param Utf16Data Pointer to the data buffer of the column.
+    /// \param Utf16Offsets Array of RowCount+1 non-decreasing offsets into Utf16Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf8Size Pointer receiving the number of bytes of the converted data buffer.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_GetUtf8SizeFromUtf16Column64(const uint16_t *Utf16Data, const int64_t *Utf16Offsets, int64_t RowCount, int64_t *Utf8Size, int64_t *ErrorRow);
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+    /// \brief Converts a column of UTF16 strings into UTF8 strings, both stored in the Arrow layout (64 bits offsets).
+    ///
+    /// This version has no suffix. This means the output data buffer is allocated dynamically using the standard library.
+    /// It is sized for the worst case (three bytes per UTF16 short) so that the column is read only once.
+    ///
+    /// Row i is made of the shorts from Utf16Offsets[i] to Utf16Offsets[i+1] (excluded) in Utf16Data, Utf16Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The column is converted as a single stream and the output offsets are written in the same pass:
+    /// ASCII runs are handled 4 shorts at a time regardless of the row boundaries. The output rows are not null-terminated either.
+    /// The conversion stops at the first invalid row.
+    ///
+    /// Generally the following suffixes are possible:
+    /// m: a maximum length for the output buffer is given
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    ///
+    /// \param Utf16Data Pointer to the data buffer of the column.
+    /// \param Utf16Offsets Array of RowCount+1 non-decreasing offsets into Utf16Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf8Data Pointer to a pointer that will hold the address of the output data buffer. The user is responsible for freeing the memory.
+    /// \param Utf8Offsets Array of RowCount+1 integers receiving the position of each row in the output data buffer. The first one is 0.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Utf16ToUtf8Column64(const uint16_t *Utf16Data, const int64_t *Utf16Offsets, int64_t RowCount, uint8_t **Utf8Data, int64_t *Utf8Offsets, int64_t *ErrorRow);
+#endif
+
+    /// \brief Converts a column of UTF16 strings into UTF8 strings, both stored in the Arrow layout (64 bits offsets).
+    ///
+    /// This version has an a suffix. This means the output data buffer is allocated dynamically using user-defined functions.
+    /// It is sized for the worst case (three bytes per UTF16 short) so that the column is read only once.
+    ///
+    /// Row i is made of the shorts from Utf16Offsets[i] to Utf16Offsets[i+1] (excluded) in Utf16Data, Utf16Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The column is converted as a single stream and the output offsets are written in the same pass:
+    /// ASCII runs are handled 4 shorts at a time regardless of the row boundaries. The output rows are not null-terminated either.
+    /// The conversion stops at the first invalid row.
+    ///
+    /// Generally the following suffixes are possible:
+    /// m: a maximum length for the output buffer is given
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    ///
+    /// \param Utf16Data Pointer to the data buffer of the column.
+    /// \param Utf16Offsets Array of RowCount+1 non-decreasing offsets into Utf16Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf8Data Pointer to a pointer that will hold the address of the output data buffer. The user is responsible for freeing the memory.
+    /// \param Utf8Offsets Array of RowCount+1 integers receiving the position of each row in the output data buffer. The first one is 0.
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Utf16ToUtf8Column64_a(const uint16_t *Utf16Data, const int64_t *Utf16Offsets, int64_t RowCount, uint8_t **Utf8Data, int64_t *Utf8Offsets, const TCCUnicode_MallocPtr *AllocPtr, int64_t *ErrorRow);
+
+    /// \brief Converts a column of UTF16 strings into UTF8 strings, both stored in the Arrow layout (64 bits offsets).
+    ///
+    /// This version has a m suffix. This means no memory is allocated and the output is sent to a preallocated data buffer.
+    /// ccunicode_GetUtf8SizeFromUtf16Column64 gives the needed size.
+    ///
+    /// Row i is made of the shorts from Utf16Offsets[i] to Utf16Offsets[i+1] (excluded) in Utf16Data, Utf16Offsets[0] does not need to be 0.
+    /// Rows are not null-terminated and a null character inside a row is a regular character.
+    /// The column is converted as a single stream and the output offsets are written in the same pass:
+    /// ASCII runs are handled 4 shorts at a time regardless of the row boundaries. The output rows are not null-terminated either.
+    /// The conversion stops at the first invalid row.
+    ///
+    /// Generally the following suffixes are possible:
+    /// m: a maximum length for the output buffer is given
+    /// a: a TCCUnicode_MallocPtr struct is provided to enable user-defined allocation strategies.
+    ///
+    /// \param Utf16Data Pointer to the data buffer of the column.
+    /// \param Utf16Offsets Array of RowCount+1 non-decreasing offsets into Utf16Data.
+    /// \param RowCount Number of rows in the column.
+    /// \param Utf8Data Pointer to the output data buffer. It can be NULL if Utf8Size is 0.
+    /// \param Utf8Size Number of bytes the output data buffer can hold.
+    /// \param Utf8Offsets Array of RowCount+1 integers receiving the position of each row in the output data buffer. The first one is 0.
+    /// \param ErrorRow Pointer receiving the first invalid row on error (-1 if the error is not tied to a row). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Utf16ToUtf8Column64_m(const uint16_t *Utf16Data, const int64_t *Utf16Offsets, int64_t RowCount, uint8_t *Utf8Data, int64_t Utf8Size, int64_t *Utf8Offsets, int64_t *ErrorRow);
+
+    /// \brief Utility function: counts the number of codepoints in each string of a batch of short UTF8 strings
+    ///
+    /// Every string gets the result ccunicode_CountCodepointsInUtf8_n would give for it, so this also validates the strings.
+    /// Strings of at most 16 bytes are loaded into two 64 bits words and all their bytes are checked at once,
+    /// which is much faster than one call per string for short keys. Longer strings are counted as usual.
+    ///
+    /// \param Utf8Strs Array of StrCount UTF8 strings.
+    /// \param StrCount Number of strings in the batch.
+    /// \param Results Array of StrCount integers receiving the number of codepoints of each string or a negative number on error.
+    /// \return CCUNICODE_NO_ERROR or a negative number if the batch as a whole failed.
+    int ccunicode_CountCodepointsInUtf8Batch_n(const TCCUnicode_Utf8Span *Utf8Strs, int StrCount, int *Results);
+
+    /// \brief Initializes an allocator whose functions take a context
+    ///
+    /// ctx_realloc_func and ctx_aligned_alloc_func are cleared and can be set afterwards.
+    /// &Allocator->malloc_ptr can then be given to any function with an 'a' suffix.
+    ///
+    /// \param Allocator Pointer to the allocator to initialize.
+    /// \param Ctx User context given to the functions.
+    /// \param MallocFunc Pointer to a user-defined malloc function taking a context.
+    /// \param FreeFunc Pointer to a user-defined free function taking a context.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_InitCtxMallocPtr(TCCUnicode_CtxMallocPtr *Allocator, void *Ctx, void *(*MallocFunc)(void*, size_t), void (*FreeFunc)(void*, void*));
+
+    /// \brief Initializes an arena allocator
+    ///
+    /// No memory is allocated until the first allocation. &Arena->allocator.malloc_ptr can then be given to any function with an 'a' suffix.
+    ///
+    /// \param Arena Pointer to the arena to initialize. It must not be moved once initialized.
+    /// \param ChunkSize Minimum size in bytes of the chunks taken from the backing allocator. If 0, CCUNICODE_ARENA_CHUNK_SIZE is used.
+    /// \param AllocPtr Pointer to the backing allocator. If NULL, ccunicode will use the standard library malloc and free.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_InitArena(TCCUnicode_Arena *Arena, size_t ChunkSize, const TCCUnicode_MallocPtr *AllocPtr);
+
+    /// \brief Gives all the chunks of an arena back to its backing allocator
+    ///
+    /// Every pointer obtained from the arena becomes invalid. The arena can be used again afterwards.
+    ///
+    /// \param Arena Pointer to an initialized arena.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_DestroyArena(TCCUnicode_Arena *Arena);
+
+    /// \brief Reclaims all the memory handed out by an arena, keeping its chunks for later allocations
+    ///
+    /// Every pointer obtained from the arena becomes invalid.
+    ///
+    /// \param Arena Pointer to an initialized arena.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_ResetArena(TCCUnicode_Arena *Arena);
+
+    /// \brief Records the current position of an arena
+    ///
+    /// \param Arena Pointer to an initialized arena.
+    /// \param Mark Pointer receiving the position.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_GetArenaMark(const TCCUnicode_Arena *Arena, TCCUnicode_ArenaMark *Mark);
+
+    /// \brief Reclaims the memory handed out by an arena since a mark was taken
+    ///
+    /// Pointers obtained from the arena after the mark become invalid. The mark itself becomes invalid if the arena
+    /// is reset, destroyed or rewound to an earlier mark.
+    ///
+    /// \param Arena Pointer to an initialized arena.
+    /// \param Mark Pointer to a position obtained with ccunicode_GetArenaMark on this arena.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_RewindArena(TCCUnicode_Arena *Arena, const TCCUnicode_ArenaMark *Mark);
+
+    /// \brief Reads the growth statistics of an arena
+    ///
+    /// \param Arena Pointer to an initialized arena.
+    /// \param Stats Pointer receiving the statistics.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_GetArenaStats(const TCCUnicode_Arena *Arena, TCCUnicode_ArenaStats *Stats);
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+    /// \brief Returns an arena private to the calling thread
+    ///
+    /// The arena is initialized on first use with the standard library malloc and free and the default chunk size.
+    /// Its chunks must be given back with ccunicode_DestroyThreadArena before the thread exits.
+    ///
+    /// \return A pointer to the arena of the calling thread, or NULL if the compiler offers no thread-local storage.
+    TCCUnicode_Arena *ccunicode_GetThreadArena(void);
+
+    /// \brief Gives the chunks of the arena of the calling thread back to the standard library
+    ///
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_DestroyThreadArena(void);
+#endif
+
+    /// \brief Initializes a tracking allocator
+    ///
+    /// &Tracker->allocator.malloc_ptr can then be given to any function with an 'a' suffix.
+    ///
+    /// \param Tracker Pointer to the tracker to initialize. It must not be moved once initialized.
+    /// \param AllocPtr Pointer to the backing allocator. If NULL, ccunicode will use the standard library malloc and free.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_InitTrackingAllocator(TCCUnicode_TrackingAllocator *Tracker, const TCCUnicode_MallocPtr *AllocPtr);
+
+    /// \brief Gives the outstanding blocks of a tracking allocator back to its backing allocator
+    ///
+    /// Every pointer obtained from the tracker and not freed yet becomes invalid. The statistics are kept, except for
+    /// current_bytes and outstanding_count which go back to 0. The tracker can be used again afterwards.
+    ///
+    /// \param Tracker Pointer to an initialized tracker.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_DestroyTrackingAllocator(TCCUnicode_TrackingAllocator *Tracker);
+
+    /// \brief Reads the statistics of a tracking allocator
+    ///
+    /// \param Tracker Pointer to an initialized tracker.
+    /// \param Stats Pointer receiving the statistics.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_GetTrackingStats(const TCCUnicode_TrackingAllocator *Tracker, TCCUnicode_TrackingStats *Stats);
+
+    /// \brief Clears the counters of a tracking allocator, to measure the next calls on their own
+    ///
+    /// current_bytes and outstanding_count still describe the outstanding blocks, and peak_bytes starts again from current_bytes.
+    ///
+    /// \param Tracker Pointer to an initialized tracker.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_ResetTrackingStats(TCCUnicode_TrackingAllocator *Tracker);
+
+    /// \brief Lists the blocks of a tracking allocator that were not freed, from the latest one
+    ///
+    /// \param Tracker Pointer to an initialized tracker.
+    /// \param ReportFunc Function called with UserData, the pointer, the size and the sequence number of each outstanding block
+    ///                   (the sequence number of the first block allocated by the tracker is 0). Can be NULL to only count the blocks.
+    /// \param UserData User pointer given back to ReportFunc.
+    /// \return The number of outstanding blocks or a negative number on error.
+    int ccunicode_ReportTrackedBlocks(const TCCUnicode_TrackingAllocator *Tracker, void (*ReportFunc)(void *UserData, const void *Ptr, size_t Size, size_t Sequence), void *UserData);
+
+    /// \brief Initializes a converter context
+    ///
+    /// No memory is allocated until the first conversion.
+    ///
+    /// \param Context Pointer to the context to initialize.
+    /// \param ErrorPolicy TCCUnicode_ErrorPolicy used by the conversions. The replacement codepoint can be changed afterwards with ccunicode_SetContextReplacement.
+    /// \param AllocPtr Pointer to the allocator of the buffers. If NULL, ccunicode will use the standard library malloc and free.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_InitContext(TCCUnicode_Context *Context, int ErrorPolicy, const TCCUnicode_MallocPtr *AllocPtr);
+
+    /// \brief Frees the buffers of a converter context
+    ///
+    /// Every result obtained through the context becomes invalid. The context can be used again afterwards.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_DestroyContext(TCCUnicode_Context *Context);
+
+    /// \brief Sets the codepoint replacing invalid input in the conversions using a converter context
+    ///
+    /// The conversions of a context whose replacement was set to an invalid codepoint directly return CCUNICODE_INVALID_CODEPOINT.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Replacement Codepoint replacing invalid input. It must not be a surrogate nor be above U+10FFFF.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_SetContextReplacement(TCCUnicode_Context *Context, uint32_t Replacement);
+
+    /// \brief Converts a null-terminated UTF8 string to an array of codepoints using a converter context
+    ///
+    /// This version stops at the final null character.
+    /// The result is written to the output buffer of the context, which grows if needed. It stays valid until the next conversion using the context.
+    /// With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced by Context->replacement instead of stopping the conversion.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Utf8Str pointer to a null-terminated utf8 string
+    /// \param Codepoints Pointer receiving the address of the null-terminated array of codepoints in the output buffer of the context.
+    /// \return the number of codepoints written, excluding the final '\0'. The empty string returns 0 for instance.
+    ///         On error, return a negative number corresponding to a TCCUnicode_ErrorCode
+    int ccunicode_Utf8ToCodepoints_c(TCCUnicode_Context *Context, const uint8_t *Utf8Str, uint32_t **Codepoints);
+
+    /// \brief Converts a null-terminated UTF8 string to an array of codepoints using a converter context
+    ///
+    /// This version stops either at the final null character or if Utf8Size is reached.
+    /// The result is written to the output buffer of the context, which grows if needed. It stays valid until the next conversion using the context.
+    /// With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced by Context->replacement instead of stopping the conversion.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Utf8Str pointer to a null-terminated utf8 string
+    /// \param Utf8Size maximum number of bytes to process
+    /// \param Codepoints Pointer receiving the address of the null-terminated array of codepoints in the output buffer of the context.
+    /// \return the number of codepoints written, excluding the final '\0'. The empty string returns 0 for instance.
+    ///         On error, return a negative number corresponding to a TCCUnicode_ErrorCode
+    int ccunicode_Utf8ToCodepoints_nc(TCCUnicode_Context *Context, const uint8_t *Utf8Str, int Utf8Size, uint32_t **Codepoints);
+
+    /// \brief Converts a null-terminated UTF16 string to an array of codepoints using a converter context
+    ///
+    /// This version stops at the final null character.
+    /// The result is written to the output buffer of the context, which grows if needed. It stays valid until the next conversion using the context.
+    /// With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced by Context->replacement instead of stopping the conversion.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Utf16Str pointer to a null-terminated utf16 string
+    /// \param Codepoints Pointer receiving the address of the null-terminated array of codepoints in the output buffer of the context.
+    /// \return the number of codepoints written, excluding the final '\0'. The empty string returns 0 for instance.
+    ///         On error, return a negative number corresponding to a TCCUnicode_ErrorCode
+    int ccunicode_Utf16ToCodepoints_c(TCCUnicode_Context *Context, const uint16_t *Utf16Str, uint32_t **Codepoints);
+
+    /// \brief Converts a null-terminated UTF16 string to an array of codepoints using a converter context
+    ///
+    /// This version stops either at the final null character or if Utf16Size is reached.
+    /// The result is written to the output buffer of the context, which grows if needed. It stays valid until the next conversion using the context.
+    /// With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced by Context->replacement instead of stopping the conversion.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Utf16Str pointer to a null-terminated utf16 string
+    /// \param Utf16Size maximum number of shorts to process
+    /// \param Codepoints Pointer receiving the address of the null-terminated array of codepoints in the output buffer of the context.
+    /// \return the number of codepoints written, excluding the final '\0'. The empty string returns 0 for instance.
+    ///         On error, return a negative number corresponding to a TCCUnicode_ErrorCode
+    int ccunicode_Utf16ToCodepoints_nc(TCCUnicode_Context *Context, const uint16_t *Utf16Str, int Utf16Size, uint32_t **Codepoints);
+
+    /// \brief Converts a null-terminated array of codepoints to a UTF8 string using a converter context
+    ///
+    /// This version stops at the final null codepoint.
+    /// The result is written to the output buffer of the context, which grows if needed. It stays valid until the next conversion using the context.
+    /// With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced by Context->replacement instead of stopping the conversion.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Codepoints pointer to a null-terminated array of codepoints
+    /// \param Utf8Str Pointer receiving the address of the null-terminated UTF8 string in the output buffer of the context.
+    /// \return the number of bytes written, excluding the final '\0'. The empty string returns 0 for instance.
+    ///         On error, return a negative number corresponding to a TCCUnicode_ErrorCode
+    int ccunicode_CodepointsToUtf8_c(TCCUnicode_Context *Context, const uint32_t *Codepoints, uint8_t **Utf8Str);
+
+    /// \brief Converts a null-terminated array of codepoints to a UTF8 string using a converter context
+    ///
+    /// This version stops either at the final null codepoint or if CodepointCount is reached.
+    /// The result is written to the output buffer of the context, which grows if needed. It stays valid until the next conversion using the context.
+    /// With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced by Context->replacement instead of stopping the conversion.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Codepoints pointer to a null-terminated array of codepoints
+    /// \param CodepointCount maximum number of codepoints to process
+    /// \param Utf8Str Pointer receiving the address of the null-terminated UTF8 string in the output buffer of the context.
+    /// \return the number of bytes written, excluding the final '\0'. The empty string returns 0 for instance.
+    ///         On error, return a negative number corresponding to a TCCUnicode_ErrorCode
+    int ccunicode_CodepointsToUtf8_nc(TCCUnicode_Context *Context, const uint32_t *Codepoints, int CodepointCount, uint8_t **Utf8Str);
+
+    /// \brief Converts a null-terminated array of codepoints to a UTF16 string using a converter context
+    ///
+    /// This version stops at the final null codepoint.
+    /// The result is written to the output buffer of the context, which grows if needed. It stays valid until the next conversion using the context.
+    /// With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced by Context->replacement instead of stopping the conversion.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Codepoints pointer to a null-terminated array of codepoints
+    /// \param Utf16Str Pointer receiving the address of the null-terminated UTF16 string in the output buffer of the context.
+    /// \return the number of shorts written, excluding the final '\0'. The empty string returns 0 for instance.
+    ///         On error, return a negative number corresponding to a TCCUnicode_ErrorCode
+    int ccunicode_CodepointsToUtf16_c(TCCUnicode_Context *Context, const uint32_t *Codepoints, uint16_t **Utf16Str);
+
+    /// \brief Converts a null-terminated array of codepoints to a UTF16 string using a converter context
+    ///
+    /// This version stops either at the final null codepoint or if CodepointCount is reached.
+    /// The result is written to the output buffer of the context, which grows if needed. It stays valid until the next conversion using the context.
+    /// With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced by Context->replacement instead of stopping the conversion.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Codepoints pointer to a null-terminated array of codepoints
+    /// \param CodepointCount maximum number of codepoints to process
+    /// \param Utf16Str Pointer receiving the address of the null-terminated UTF16 string in the output buffer of the context.
+    /// \return the number of shorts written, excluding the final '\0'. The empty string returns 0 for instance.
+    ///         On error, return a negative number corresponding to a TCCUnicode_ErrorCode
+    int ccunicode_CodepointsToUtf16_nc(TCCUnicode_Context *Context, const uint32_t *Codepoints, int CodepointCount, uint16_t **Utf16Str);
+
+    /// \brief Converts a null-terminated UTF8 string to a UTF16 string using a converter context
+    ///
+    /// This version stops at the final null character.
+    /// The result is written to the output buffer of the context, which grows if needed. It stays valid until the next conversion using the context.
+    /// With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced by Context->replacement instead of stopping the conversion.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Utf8Str pointer to a null-terminated utf8 string
+    /// \param Utf16Str Pointer receiving the address of the null-terminated UTF16 string in the output buffer of the context.
+    /// \return the number of shorts written, excluding the final '\0'. The empty string returns 0 for instance.
+    ///         On error, return a negative number corresponding to a TCCUnicode_ErrorCode
+    int ccunicode_Utf8ToUtf16_c(TCCUnicode_Context *Context, const uint8_t *Utf8Str, uint16_t **Utf16Str);
+
+    /// \brief Converts a null-terminated UTF8 string to a UTF16 string using a converter context
+    ///
+    /// This version stops either at the final null character or if Utf8Size is reached.
+    /// The result is written to the output buffer of the context, which grows if needed. It stays valid until the next conversion using the context.
+    /// With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced by Context->replacement instead of stopping the conversion.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Utf8Str pointer to a null-terminated utf8 string
+    /// \param Utf8Size maximum number of bytes to process
+    /// \param Utf16Str Pointer receiving the address of the null-terminated UTF16 string in the output buffer of the context.
+    /// \return the number of shorts written, excluding the final '\0'. The empty string returns 0 for instance.
+    ///         On error, return a negative number corresponding to a TCCUnicode_ErrorCode
+    int ccunicode_Utf8ToUtf16_nc(TCCUnicode_Context *Context, const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str);
+
+    /// \brief Converts a null-terminated UTF16 string to a UTF8 string using a converter context
+    ///
+    /// This version stops at the final null character.
+    /// The result is written to the output buffer of the context, which grows if needed. It stays valid until the next conversion using the context.
+    /// With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced by Context->replacement instead of stopping the conversion.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Utf16Str pointer to a null-terminated utf16 string
+    /// \param Utf8Str Pointer receiving the address of the null-terminated UTF8 string in the output buffer of the context.
+    /// \return the number of bytes written, excluding the final '\0'. The empty string returns 0 for instance.
+    ///         On error, return a negative number corresponding to a TCCUnicode_ErrorCode
+    int ccunicode_Utf16ToUtf8_c(TCCUnicode_Context *Context, const uint16_t *Utf16Str, uint8_t **Utf8Str);
+
+    /// \brief Converts a null-terminated UTF16 string to a UTF8 string using a converter context
+    ///
+    /// This version stops either at the final null character or if Utf16Size is reached.
+    /// The result is written to the output buffer of the context, which grows if needed. It stays valid until the next conversion using the context.
+    /// With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced by Context->replacement instead of stopping the conversion.
+    ///
+    /// \param Context Pointer to an initialized context.
+    /// \param Utf16Str pointer to a null-terminated utf16 string
+    /// \param Utf16Size maximum number of shorts to process
+    /// \param Utf8Str Pointer receiving the address of the null-terminated UTF8 string in the output buffer of the context.
+    /// \return the number of bytes written, excluding the final '\0'. The empty string returns 0 for instance.
+    ///         On error, return a negative number corresponding to a TCCUnicode_ErrorCode
+    int ccunicode_Utf16ToUtf8_nc(TCCUnicode_Context *Context, const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str);
+
+    /// \brief Converts an array of codepoints into an UTF8 string written over the array itself
+    ///
+    /// The UTF8 form of a codepoint never takes more than its 4 bytes, so the string is written from the start of the array
+    /// while it is read, and no other buffer is needed. This version stops at the final null codepoint.
+    /// On error, the content of the array is unspecified.
+    ///
+    /// \param Codepoints Pointer to a null-terminated array of codepoints, overwritten by the UTF8 string.
+    /// \param Utf8Str Pointer receiving the address of the UTF8 string, which is Codepoints seen as bytes.
+    /// \return The number of bytes of the UTF8 string (except for the final 0) or a negative number on error.
+    int ccunicode_CodepointsToUtf8InPlace(uint32_t *Codepoints, uint8_t **Utf8Str);
+
+    /// \brief Converts an array of codepoints into an UTF8 string written over the array itself
+    ///
+    /// The UTF8 form of a codepoint never takes more than its 4 bytes, so the string is written from the start of the array
+    /// while it is read, and no other buffer is needed. This version stops either at the final null codepoint or
+    /// if CodepointCount codepoints have been processed. The array must then hold CodepointCount+1 codepoints for the final null byte.
+    /// On error, the content of the array is unspecified.
+    ///
+    /// \param Codepoints Pointer to an array of codepoints, overwritten by the UTF8 string.
+    /// \param CodepointCount Maximum number of codepoints to process.
+    /// \param Utf8Str Pointer receiving the address of the UTF8 string, which is Codepoints seen as bytes.
+    /// \return The number of bytes of the UTF8 string (except for the final 0) or a negative number on error.
+    int ccunicode_CodepointsToUtf8InPlace_n(uint32_t *Codepoints, int CodepointCount, uint8_t **Utf8Str);
+
+    /// \brief Converts an array of codepoints into an UTF16 string written over the array itself
+    ///
+    /// The UTF16 form of a codepoint never takes more than its 4 bytes, so the string is written from the start of the array
+    /// while it is read, and no other buffer is needed. This version stops at the final null codepoint.
+    /// On error, the content of the array is unspecified.
+    ///
+    /// \param Codepoints Pointer to a null-terminated array of codepoints, overwritten by the UTF16 string.
+    /// \param Utf16Str Pointer receiving the address of the UTF16 string, which is Codepoints seen as shorts.
+    /// \return The number of shorts of the UTF16 string (except for the final 0) or a negative number on error.
+    int ccunicode_CodepointsToUtf16InPlace(uint32_t *Codepoints, uint16_t **Utf16Str);
+
+    /// \brief Converts an array of codepoints into an UTF16 string written over the array itself
+    ///
+    /// The UTF16 form of a codepoint never takes more than its 4 bytes, so the string is written from the start of the array
+    /// while it is read, and no other buffer is needed. This version stops either at the final null codepoint or
+    /// if CodepointCount codepoints have been processed. The array must then hold CodepointCount+1 codepoints for the final null short.
+    /// On error, the content of the array is unspecified.
+    ///
+    /// \param Codepoints Pointer to an array of codepoints, overwritten by the UTF16 string.
+    /// \param CodepointCount Maximum number of codepoints to process.
+    /// \param Utf16Str Pointer receiving the address of the UTF16 string, which is Codepoints seen as shorts.
+    /// \return The number of shorts of the UTF16 string (except for the final 0) or a negative number on error.
+    int ccunicode_CodepointsToUtf16InPlace_n(uint32_t *Codepoints, int CodepointCount, uint16_t **Utf16Str);
+
+    /// \brief Storage of the single codepoint functions, which are defined in this header so that they can be inlined
+#ifndef CCUNICODE_INLINE
+#   if defined(_MSC_VER) && !defined(__cplusplus)
+#       define CCUNICODE_INLINE static __inline
+#   else
+#       define CCUNICODE_INLINE static inline
+#   endif
+#endif
+
+    /// \brief Decodes the UTF8 character starting at a given position
+    ///
+    /// Characters are validated with the same rules as ccunicode_Utf8ToCodepoints_nm. A null byte is decoded as the codepoint 0.
+    /// No pointer is checked, so that the function stays cheap in tight loops.
+    ///
+    /// \param Utf8Str Pointer to a UTF8 string.
+    /// \param Utf8Size Number of bytes in the string.
+    /// \param Pos Position of the first byte of the character.
+    /// \param Codepoint Pointer receiving the decoded codepoint.
+    /// \return The number of bytes of the character (1 to 4), 0 if Pos is at the end of the string or a negative number on error.
+    CCUNICODE_INLINE int ccunicode_DecodeNextUtf8(const uint8_t *Utf8Str, int Utf8Size, int Pos, uint32_t *Codepoint)
+    {
+        if (Pos >= Utf8Size)
+            return 0;
+
+        uint32_t Lead = Utf8Str[Pos];
+        if (Lead < 0x80)
+        {
+            *Codepoint = Lead;
+            return 1;
+        }
+        if (Lead < 0xC0 || Lead >= 0xF8)
+            return CCUNICODE_INVALID_UTF8_CHARACTER;
+
+        int Length = 2 + (Lead >= 0xE0) + (Lead >= 0xF0);
+        if (Length > Utf8Size - Pos)
+            return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+
+        // Extensions are checked all at once: any of them outside 0x80-0xBF leaves a bit in Invalid
+        uint32_t Value = Lead & (0x7F >> Length);
+        uint32_t Invalid = 0;
+        for (int j = 1; j < Length; ++j)
+        {
+            uint32_t Extension = Utf8Str[Pos+j];
+            Invalid |= (Extension & 0xC0) ^ 0x80;
+            Value = (Value << 6) | (Extension & 0x3F);
+        }
+        if (Invalid)
+            return CCUNICODE_INVALID_UTF8_CHARACTER;
+
+        *Codepoint = Value;
+        return Length;
+    }
+
+    /// \brief Decodes the UTF8 character ending just before a given position
+    ///
+    /// Characters are validated with the same rules as ccunicode_Utf8ToCodepoints_nm. A null byte is decoded as the codepoint 0.
+    /// No pointer is checked, so that the function stays cheap in tight loops.
+    ///
+    /// \param Utf8Str Pointer to a UTF8 string.
+    /// \param Pos Position just after the last byte of the character.
+    /// \param Codepoint Pointer receiving the decoded codepoint.
+    /// \return The number of bytes of the character (1 to 4), 0 if Pos is at the start of the string or a negative number on error.
+    CCUNICODE_INLINE int ccunicode_DecodePrevUtf8(const uint8_t *Utf8Str, int Pos, uint32_t *Codepoint)
+    {
+        if (Pos <= 0)
+            return 0;
+
+        uint32_t Last = Utf8Str[Pos-1];
+        if (Last < 0x80)
+        {
+            *Codepoint = Last;
+            return 1;
+        }
+
+        // Step back over at most 3 extensions, then the lead byte must announce exactly that many
+        int Start = Pos - 1;
+        while (Start > 0 && Pos - Start < 4 && (Utf8Str[Start] & 0xC0) == 0x80)
+            --Start;
+
+        int Length = ccunicode_DecodeNextUtf8(Utf8Str, Pos, Start, Codepoint);
+        if (Length >= 0 && Length != Pos - Start)
+            return CCUNICODE_INVALID_UTF8_CHARACTER;
+        return Length;
+    }
+
+    /// \brief Encodes a single codepoint as UTF8
+    ///
+    /// Codepoints are validated with the same rules as ccunicode_CodepointsToUtf8_nm. The codepoint 0 is encoded as a null byte.
+    /// No null character is added and no pointer is checked, so that the function stays cheap in tight loops.
+    ///
+    /// \param Codepoint Codepoint to encode.
+    /// \param Utf8Str Pointer to the buffer receiving the bytes.
+    /// \param Utf8Size Number of bytes the buffer can hold.
+    /// \return The number of bytes written (1 to 4) or a negative number on error.
+    CCUNICODE_INLINE int ccunicode_EncodeUtf8(uint32_t Codepoint, uint8_t *Utf8Str, int Utf8Size)
+    {
+        if (Codepoint > 0x10FFFF || (Codepoint >= 0xD800 && Codepoint <= 0xDFFF))
+            return CCUNICODE_INVALID_CODEPOINT;
+
+        int Length = 1 + (Codepoint >= 0x80) + (Codepoint >= 0x800) + (Codepoint >= 0x10000);
+        if (Length > Utf8Size)
+            return CCUNICODE_BUFFER_TOO_SMALL;
+        if (Length == 1)
+        {
+            Utf8Str[0] = (uint8_t)Codepoint;
+            return 1;
+        }
+
+        // Extensions are filled from the last one, the lead byte gets the length marker (0xC0, 0xE0 or 0xF0)
+        for (int j = Length-1; j > 0; --j)
+        {
+            Utf8Str[j] = (uint8_t)(0x80 | (Codepoint & 0x3F));
+            Codepoint >>= 6;
+        }
+        Utf8Str[0] = (uint8_t)((0xF00 >> Length) | Codepoint);
+        return Length;
+    }
+
+    /// \brief Decodes the UTF16 character starting at a given position
+    ///
+    /// Characters are validated with the same rules as ccunicode_Utf16ToCodepoints_nm. A null short is decoded as the codepoint 0.
+    /// No pointer is checked, so that the function stays cheap in tight loops.
+    ///
+    /// \param Utf16Str Pointer to a UTF16 string.
+    /// \param Utf16Size Number of shorts in the string.
+    /// \param Pos Position of the first short of the character.
+    /// \param Codepoint Pointer receiving the decoded codepoint.
+    /// \return The number of shorts of the character (1 or 2), 0 if Pos is at the end of the string or a negative number on error.
+    CCUNICODE_INLINE int ccunicode_DecodeNextUtf16(const uint16_t *Utf16Str, int Utf16Size, int Pos, uint32_t *Codepoint)
+    {
+        if (Pos >= Utf16Size)
+            return 0;
+
+        uint32_t First = Utf16Str[Pos];
+        if (First - 0xD800 >= 0x800)
+        {
+            *Codepoint = First;
+            return 1;
+        }
+        if (First >= 0xDC00)
+            return CCUNICODE_SURROGATE_PAIR_INVERSION;
+        if (Pos + 1 == Utf16Size || Utf16Str[Pos+1] == 0)
+            return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+
+        uint32_t Second = Utf16Str[Pos+1];
+        if (Second - 0xDC00 >= 0x400)
+            return CCUNICODE_INVALID_UTF16_CHARACTER;
+
+        *Codepoint = ((First - 0xD800) << 10) + (Second - 0xDC00) + 0x10000;
+        return 2;
+    }
+
+    /// \brief Decodes the UTF16 character ending just before a given position
+    ///
+    /// Characters are validated with the same rules as ccunicode_Utf16ToCodepoints_nm. A null short is decoded as the codepoint 0.
+    /// No pointer is checked, so that the function stays cheap in tight loops.
+    ///
+    /// \param Utf16Str Pointer to a UTF16 string.
+    /// \param Pos Position just after the last short of the character.
+    /// \param Codepoint Pointer receiving the decoded codepoint.
+    /// \return The number of shorts of the character (1 or 2), 0 if Pos is at the start of the string or a negative number on error.
+    CCUNICODE_INLINE int ccunicode_DecodePrevUtf16(const uint16_t *Utf16Str, int Pos, uint32_t *Codepoint)
+    {
+        if (Pos <= 0)
+            return 0;
+
+        uint32_t Last = Utf16Str[Pos-1];
+        if (Last - 0xD800 >= 0x800)
+        {
+            *Codepoint = Last;
+            return 1;
+        }
+        // A high surrogate can not end a character
+        if (Last < 0xDC00)
+            return CCUNICODE_INVALID_UTF16_CHARACTER;
+        if (Pos < 2 || Utf16Str[Pos-2] - 0xD800u >= 0x400)
+            return CCUNICODE_SURROGATE_PAIR_INVERSION;
+
+        *Codepoint = (((uint32_t)Utf16Str[Pos-2] - 0xD800) << 10) + (Last - 0xDC00) + 0x10000;
+        return 2;
+    }
+
+    /// \brief Encodes a single codepoint as UTF16
+    ///
+    /// Codepoints are validated with the same rules as ccunicode_CodepointsToUtf16_nm. The codepoint 0 is encoded as a null short.
+    /// No null character is added and no pointer is checked, so that the function stays cheap in tight loops.
+    ///
+    /// \param Codepoint Codepoint to encode.
+    /// \param Utf16Str Pointer to the buffer receiving the shorts.
+    /// \param Utf16Size Number of shorts the buffer can hold.
+    /// \return The number of shorts written (1 or 2) or a negative number on error.
+    CCUNICODE_INLINE int ccunicode_EncodeUtf16(uint32_t Codepoint, uint16_t *Utf16Str, int Utf16Size)
+    {
+        if (Codepoint > 0x10FFFF || (Codepoint >= 0xD800 && Codepoint <= 0xDFFF))
+            return CCUNICODE_INVALID_CODEPOINT;
+
+        if (Codepoint < 0x10000)
+        {
+            if (Utf16Size < 1)
+                return CCUNICODE_BUFFER_TOO_SMALL;
+            Utf16Str[0] = (uint16_t)Codepoint;
+            return 1;
+        }
+
+        if (Utf16Size < 2)
+            return CCUNICODE_BUFFER_TOO_SMALL;
+        Codepoint -= 0x10000;
+        Utf16Str[0] = (uint16_t)(0xD800 + (Codepoint >> 10));
+        Utf16Str[1] = (uint16_t)(0xDC00 + (Codepoint & 0x3FF));
+        return 2;
+    }
+
+    /// \brief Skips a number of codepoints in a UTF8 string
+    ///
+    /// Only the characters which are skipped are validated, with the same rules as ccunicode_CountCodepointsInUtf8_n.
+    /// Nothing is decoded: the characters are counted by their lead bytes, 8 bytes at a time.
+    ///
+    /// \param Utf8Str Pointer to a UTF8 string.
+    /// \param Utf8Size Number of bytes in the string. The string also ends at its first null byte.
+    /// \param Utf8Pos Byte position to start from. It must be the start of a character.
+    /// \param CodepointCount Number of codepoints to skip.
+    /// \return The byte position after the skipped codepoints or a negative number on error.
+    /// CCUNICODE_INVALID_PARAMETER is returned if the string ends before CodepointCount codepoints.
+    int ccunicode_AdvanceUtf8_n(const uint8_t *Utf8Str, int Utf8Size, int Utf8Pos, int CodepointCount);
+    /// \brief Skips a number of codepoints in a UTF16 string
+    ///
+    /// Only the characters which are skipped are validated, with the same rules as ccunicode_CountCodepointsInUtf16_n.
+    /// Nothing is decoded: runs of 4 shorts without surrogates are skipped at once.
+    ///
+    /// \param Utf16Str Pointer to a UTF16 string.
+    /// \param Utf16Size Number of shorts in the string. The string also ends at its first null short.
+    /// \param Utf16Pos Short position to start from. It must be the start of a character.
+    /// \param CodepointCount Number of codepoints to skip.
+    /// \return The short position after the skipped codepoints or a negative number on error.
+    /// CCUNICODE_INVALID_PARAMETER is returned if the string ends before CodepointCount codepoints.
+    int ccunicode_AdvanceUtf16_n(const uint16_t *Utf16Str, int Utf16Size, int Utf16Pos, int CodepointCount);
+
+    /// \brief Gives the byte offset of a codepoint in a UTF8 string
+    ///
+    /// This is ccunicode_AdvanceUtf8_n from the start of the string. An index equal to the number of codepoints gives the end of the string.
+    ///
+    /// \param Utf8Str Pointer to a UTF8 string.
+    /// \param Utf8Size Number of bytes in the string.
+    /// \param CodepointIndex Index of the codepoint.
+    /// \return The byte offset of the codepoint or a negative number on error.
+    int ccunicode_GetUtf8OffsetOfCodepoint_n(const uint8_t *Utf8Str, int Utf8Size, int CodepointIndex);
+    /// \brief Gives the short offset of a codepoint in a UTF16 string
+    ///
+    /// This is ccunicode_AdvanceUtf16_n from the start of the string. An index equal to the number of codepoints gives the end of the string.
+    ///
+    /// \param Utf16Str Pointer to a UTF16 string.
+    /// \param Utf16Size Number of shorts in the string.
+    /// \param CodepointIndex Index of the codepoint.
+    /// \return The short offset of the codepoint or a negative number on error.
+    int ccunicode_GetUtf16OffsetOfCodepoint_n(const uint16_t *Utf16Str, int Utf16Size, int CodepointIndex);
+
+    /// \brief Gives the index of the codepoint starting at a byte offset of a UTF8 string
+    ///
+    /// The characters before the offset are validated with the same rules as ccunicode_CountCodepointsInUtf8_n.
+    /// CCUNICODE_STRING_ENDED_IN_CHARACTER is returned if the offset is in the middle of a character
+    /// and CCUNICODE_INVALID_PARAMETER if the string ends (null byte or size) before the offset.
+    ///
+    /// \param Utf8Str Pointer to a UTF8 string.
+    /// \param Utf8Size Number of bytes in the string.
+    /// \param Utf8Offset Byte offset.
+    /// \return The number of codepoints before the offset or a negative number on error.
+    int ccunicode_GetCodepointIndexOfUtf8Offset_n(const uint8_t *Utf8Str, int Utf8Size, int Utf8Offset);
+    /// \brief Gives the index of the codepoint starting at a short offset of a UTF16 string
+    ///
+    /// The characters before the offset are validated with the same rules as ccunicode_CountCodepointsInUtf16_n.
+    /// CCUNICODE_STRING_ENDED_IN_CHARACTER is returned if the offset is in the middle of a surrogate pair
+    /// and CCUNICODE_INVALID_PARAMETER if the string ends (null short or size) before the offset.
+    ///
+    /// \param Utf16Str Pointer to a UTF16 string.
+    /// \param Utf16Size Number of shorts in the string.
+    /// \param Utf16Offset Short offset.
+    /// \return The number of codepoints before the offset or a negative number on error.
+    int ccunicode_GetCodepointIndexOfUtf16Offset_n(const uint16_t *Utf16Str, int Utf16Size, int Utf16Offset);
+
+    /// \brief Builds a sparse index of the codepoints of a UTF8 string
+    ///
+    /// The string is validated with the same rules as ccunicode_CountCodepointsInUtf8_n in a single pass.
+    /// The index must be destroyed by ccunicode_DestroyCodepointIndex, unless an error is returned.
+    ///
+    /// \param Index Pointer to the index to build.
+    /// \param Utf8Str Pointer to a UTF8 string.
+    /// \param Utf8Size Number of bytes in the string. The string also ends at its first null byte.
+    /// \param Stride Number of codepoints between two entries of the index (at least 1).
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \return The number of codepoints in the string or a negative number on error.
+    int ccunicode_BuildCodepointIndex_n(TCCUnicode_CodepointIndex *Index, const uint8_t *Utf8Str, int Utf8Size, int Stride, const TCCUnicode_MallocPtr *AllocPtr);
+    /// \brief Frees the entries of a codepoint index
+    ///
+    /// \param Index Pointer to the index.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_DestroyCodepointIndex(TCCUnicode_CodepointIndex *Index);
+
+    /// \brief Gives the byte offset of a codepoint using a codepoint index
+    ///
+    /// \param Index Pointer to the index.
+    /// \param Utf8Str Pointer to the UTF8 string the index was built from.
+    /// \param Utf8Size Number of bytes in the string. CCUNICODE_INVALID_PARAMETER is returned if it is below the size recorded by the index.
+    /// \param CodepointIndex Index of the codepoint (codepoint_count gives the end of the string).
+    /// \return The byte offset of the codepoint or a negative number on error.
+    int ccunicode_GetIndexedUtf8Offset(const TCCUnicode_CodepointIndex *Index, const uint8_t *Utf8Str, int Utf8Size, int CodepointIndex);
+    /// \brief Gives the UTF16 offset of a codepoint using a codepoint index
+    ///
+    /// \param Index Pointer to the index.
+    /// \param Utf8Str Pointer to the UTF8 string the index was built from.
+    /// \param Utf8Size Number of bytes in the string. CCUNICODE_INVALID_PARAMETER is returned if it is below the size recorded by the index.
+    /// \param CodepointIndex Index of the codepoint (codepoint_count gives the end of the string).
+    /// \return The offset in shorts the codepoint would have in the string converted to UTF16, or a negative number on error.
+    int ccunicode_GetIndexedUtf16Offset(const TCCUnicode_CodepointIndex *Index, const uint8_t *Utf8Str, int Utf8Size, int CodepointIndex);
+    /// \brief Gives the index of the codepoint starting at a byte offset using a codepoint index
+    ///
+    /// The entry before the offset is found by binary search.
+    /// CCUNICODE_STRING_ENDED_IN_CHARACTER is returned if the offset is in the middle of a character.
+    ///
+    /// \param Index Pointer to the index.
+    /// \param Utf8Str Pointer to the UTF8 string the index was built from.
+    /// \param Utf8Size Number of bytes in the string. CCUNICODE_INVALID_PARAMETER is returned if it is below the size recorded by the index.
+    /// \param Utf8Offset Byte offset (utf8_size gives the end of the string).
+    /// \return The number of codepoints before the offset or a negative number on error.
+    int ccunicode_GetIndexedCodepoint(const TCCUnicode_CodepointIndex *Index, const uint8_t *Utf8Str, int Utf8Size, int Utf8Offset);
+
+    /// \brief Gives the number of bytes ccunicode_SerializeCodepointIndex writes for an index
+    ///
+    /// \param Index Pointer to the index.
+    /// \return The number of bytes or a negative number on error.
+    int ccunicode_GetCodepointIndexSerializedSize(const TCCUnicode_CodepointIndex *Index);
+    /// \brief Writes a codepoint index to a buffer
+    ///
+    /// The format is a sequence of 32 bits little endian integers which does not depend on the platform:
+    /// the magic "CCUI", the version (1), the stride, codepoint_count, utf8_size, utf16_size, entry_count
+    /// and then the utf8_offset and utf16_offset of each entry.
+    ///
+    /// \param Index Pointer to the index.
+    /// \param Buffer Pointer to the buffer.
+    /// \param BufferSize Number of bytes in the buffer.
+    /// \return The number of bytes written or a negative number on error.
+    int ccunicode_SerializeCodepointIndex(const TCCUnicode_CodepointIndex *Index, uint8_t *Buffer, int BufferSize);
+    /// \brief Reads a codepoint index written by ccunicode_SerializeCodepointIndex
+    ///
+    /// The entries are checked to be consistent with each other, which does not prove they match a given string.
+    /// The index must be destroyed by ccunicode_DestroyCodepointIndex, unless an error is returned.
+    ///
+    /// \param Index Pointer to the index to fill.
+    /// \param Buffer Pointer to the serialized index.
+    /// \param BufferSize Number of bytes in the buffer.
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \return The number of bytes read or a negative number on error.
+    int ccunicode_DeserializeCodepointIndex(TCCUnicode_CodepointIndex *Index, const uint8_t *Buffer, int BufferSize, const TCCUnicode_MallocPtr *AllocPtr);
+
+    /// \brief Builds the line table of a UTF8 text
+    ///
+    /// The table must be destroyed by ccunicode_DestroyLineTable, unless an error is returned.
+    ///
+    /// \param Table Pointer to the table to build.
+    /// \param Utf8Str Pointer to a UTF8 text. Null bytes are ordinary characters in the position functions, the text only ends at its size.
+    /// \param Utf8Size Number of bytes in the text.
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \return The number of lines or a negative number on error.
+    int ccunicode_BuildLineTable_n(TCCUnicode_LineTable *Table, const uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_MallocPtr *AllocPtr);
+    /// \brief Frees the line starts of a line table
+    ///
+    /// \param Table Pointer to the table.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_DestroyLineTable(TCCUnicode_LineTable *Table);
+
+    /// \brief Converts a batch of (line, UTF16 column) positions to byte offsets in a UTF8 text
+    ///
+    /// A column past the end of its line gives the end of the line (before its terminator) and a column in the middle
+    /// of a surrogate pair gives the start of the character, as the language server protocol specifies.
+    /// The characters walked through are validated with the same rules as ccunicode_Utf8ToCodepoints_nm.
+    /// With a line table, each line is found directly. Without one, positions sorted by line are all converted
+    /// in a single pass over the text, and a position on an earlier line than the previous one restarts from the start of the text.
+    /// A position on the same line as the previous one and at or after its column resumes from it, so sorted positions walk each line once.
+    ///
+    /// \param Utf8Str Pointer to a UTF8 text.
+    /// \param Utf8Size Number of bytes in the text.
+    /// \param Table Pointer to the line table of the text, or NULL.
+    /// \param Positions Pointer to the positions to convert.
+    /// \param PositionCount Number of positions.
+    /// \param Utf8Offsets Pointer to an array of PositionCount ints receiving the byte offsets.
+    /// \param ErrorIndex Pointer receiving the first position which could not be converted on error (-1 if the error is not tied to a position). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error. CCUNICODE_INVALID_PARAMETER is returned for a line past the end of the text.
+    int ccunicode_Utf16PositionsToUtf8Offsets_n(const uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_LineTable *Table,
+                                                const TCCUnicode_TextPosition *Positions, int PositionCount, int *Utf8Offsets, int *ErrorIndex);
+    /// \brief Converts a batch of byte offsets in a UTF8 text to (line, UTF16 column) positions
+    ///
+    /// The characters walked through are validated with the same rules as ccunicode_Utf8ToCodepoints_nm.
+    /// With a line table, the line of each offset is found by binary search. Without one, sorted offsets are all converted
+    /// in a single pass over the text, and an offset before the line of the previous one restarts from the start of the text.
+    /// An offset on the same line as the previous one and at or after it resumes from it, so sorted offsets walk each line once.
+    ///
+    /// \param Utf8Str Pointer to a UTF8 text.
+    /// \param Utf8Size Number of bytes in the text.
+    /// \param Table Pointer to the line table of the text, or NULL.
+    /// \param Utf8Offsets Pointer to the byte offsets to convert.
+    /// \param OffsetCount Number of offsets.
+    /// \param Positions Pointer to an array of OffsetCount positions receiving the results.
+    /// \param ErrorIndex Pointer receiving the first offset which could not be converted on error (-1 if the error is not tied to an offset). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error. CCUNICODE_STRING_ENDED_IN_CHARACTER is returned for an offset in the middle of a character.
+    int ccunicode_Utf8OffsetsToUtf16Positions_n(const uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_LineTable *Table,
+                                                const int *Utf8Offsets, int OffsetCount, TCCUnicode_TextPosition *Positions, int *ErrorIndex);
+
+    /// \brief Initializes an empty rope
+    ///
+    /// \param Rope Pointer to the rope.
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_InitRope(TCCUnicode_Rope *Rope, const TCCUnicode_MallocPtr *AllocPtr);
+    /// \brief Frees all the nodes of a rope, leaving it empty
+    ///
+    /// \param Rope Pointer to the rope.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_DestroyRope(TCCUnicode_Rope *Rope);
+
+    /// \brief Inserts UTF8 text into a rope
+    ///
+    /// Only the inserted text is validated, with the same rules as ccunicode_CountCodepointsInUtf8_n.
+    /// On error, the rope is left unchanged.
+    ///
+    /// \param Rope Pointer to the rope.
+    /// \param Utf8Offset Byte offset of the insertion. It must be between two characters, or CCUNICODE_STRING_ENDED_IN_CHARACTER is returned.
+    /// \param Utf8Str Pointer to the UTF8 text to insert.
+    /// \param Utf8Size Number of bytes to insert. The text also ends at its first null byte.
+    /// \return The number of bytes inserted or a negative number on error.
+    int ccunicode_InsertIntoRope_n(TCCUnicode_Rope *Rope, int Utf8Offset, const uint8_t *Utf8Str, int Utf8Size);
+    /// \brief Removes a range of bytes from a rope
+    ///
+    /// On error, the rope is left unchanged.
+    ///
+    /// \param Rope Pointer to the rope.
+    /// \param Utf8Offset Byte offset of the range. It must be between two characters, or CCUNICODE_STRING_ENDED_IN_CHARACTER is returned.
+    /// \param Utf8Size Number of bytes to remove. The range must end between two characters as well.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_DeleteFromRope(TCCUnicode_Rope *Rope, int Utf8Offset, int Utf8Size);
+    /// \brief Copies a range of bytes of a rope, followed by a null byte
+    ///
+    /// \param Rope Pointer to the rope.
+    /// \param Utf8Offset Byte offset of the range.
+    /// \param Utf8Size Number of bytes to copy.
+    /// \param Utf8Str Pointer to the buffer receiving the bytes.
+    /// \param MaxUtf8Size Number of bytes the buffer can hold, which must include the null byte.
+    /// \return The number of bytes copied (without the null byte) or a negative number on error.
+    int ccunicode_CopyFromRope_m(const TCCUnicode_Rope *Rope, int Utf8Offset, int Utf8Size, uint8_t *Utf8Str, int MaxUtf8Size);
+
+    /// \brief Gives the metrics of the whole text of a rope in O(1)
+    ///
+    /// \param Rope Pointer to the rope.
+    /// \param Metrics Pointer receiving the metrics.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_GetRopeMetrics(const TCCUnicode_Rope *Rope, TCCUnicode_RopeMetrics *Metrics);
+    /// \brief Converts an offset in a rope from a unit to another in O(log n)
+    ///
+    /// \param Rope Pointer to the rope.
+    /// \param FromUnit TCCUnicode_TextUnit of Offset.
+    /// \param Offset Offset to convert.
+    /// \param ToUnit TCCUnicode_TextUnit of the result.
+    /// \return The converted offset or a negative number on error. CCUNICODE_STRING_ENDED_IN_CHARACTER is returned for an offset in the middle of a character.
+    int ccunicode_ConvertRopeOffset(const TCCUnicode_Rope *Rope, int FromUnit, int Offset, int ToUnit);
+    /// \brief Gives the offset of the start of a line of a rope in O(log n)
+    ///
+    /// Lines end with "\n", "\r\n" or "\r", as for ccunicode_BuildLineTable_n.
+    ///
+    /// \param Rope Pointer to the rope.
+    /// \param Line Line index, starting at 0.
+    /// \param Unit TCCUnicode_TextUnit of the result.
+    /// \return The offset of the line start or a negative number on error.
+    int ccunicode_GetRopeLineStart(const TCCUnicode_Rope *Rope, int Line, int Unit);
+    /// \brief Gives the line of an offset of a rope in O(log n)
+    ///
+    /// An offset between the "\r" and the "\n" of a line end belongs to the line they end.
+    ///
+    /// \param Rope Pointer to the rope.
+    /// \param Unit TCCUnicode_TextUnit of Offset.
+    /// \param Offset Offset in the text.
+    /// \return The index of the line holding the offset or a negative number on error.
+    int ccunicode_GetRopeLineOfOffset(const TCCUnicode_Rope *Rope, int Unit, int Offset);
+
+    /// \brief Initializes a transcoder
+    ///
+    /// \param Transcoder Pointer to the transcoder.
+    /// \param SourceEncoding TCCUnicode_Encoding of the input.
+    /// \param TargetEncoding TCCUnicode_Encoding of the output.
+    /// \param ErrorPolicy TCCUnicode_ErrorPolicy applied to invalid input.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_InitTranscoder(TCCUnicode_Transcoder *Transcoder, int SourceEncoding, int TargetEncoding, int ErrorPolicy);
+    /// \brief Converts the next piece of a stream
+    ///
+    /// The input is decoded by blocks of codepoints on the stack and encoded straight into the output, so no memory is allocated.
+    /// The conversion stops when the input is consumed, or when less than 4 bytes are left in the output.
+    /// A character cut by the end of the input is left unconsumed, to be given again at the start of the next piece, unless IsLast is set.
+    /// The input is validated with the same rules as ccunicode_Utf8ToCodepoints_nm or ccunicode_Utf16ToCodepoints_nm and
+    /// the codepoints with those of ccunicode_CodepointsToUtf8_nm. With CCUNICODE_ERROR_POLICY_REPLACE, invalid input is replaced as the context (c suffix) conversions do.
+    ///
+    /// \param Transcoder Pointer to the transcoder.
+    /// \param Source Pointer to the input bytes.
+    /// \param SourceSize Number of input bytes.
+    /// \param IsLast Non zero if this is the end of the stream.
+    /// \param Target Pointer to the output buffer.
+    /// \param MaxTargetSize Number of bytes the output buffer can hold.
+    /// \param SourceRead Pointer receiving the number of input bytes consumed (up to the invalid character on error).
+    /// \param TargetWritten Pointer receiving the number of output bytes written (also on error).
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_Transcode_m(TCCUnicode_Transcoder *Transcoder, const uint8_t *Source, int SourceSize, int IsLast,
+                              uint8_t *Target, int MaxTargetSize, int *SourceRead, int *TargetWritten);
+
+#if CCUNICODE_HAS_POSIX_FILES
+    /// \brief Converts a whole file, writing the result to a file descriptor
+    ///
+    /// The source is memory-mapped (with MADV_SEQUENTIAL) and released as it is consumed, and the output goes through a window of
+    /// CCUNICODE_TRANSCODE_WINDOW bytes written out in multiples of 4096 bytes. The memory used is fixed, whatever the size of the file.
+    /// On error, the output produced before the invalid character has been written and Transcoder->source_offset gives its offset.
+    ///
+    /// \param Transcoder Pointer to an initialized transcoder, whose offsets are updated.
+    /// \param SourcePath Path of the file to convert.
+    /// \param TargetFd File descriptor receiving the output.
+    /// \param AllocPtr Pointer to a TCCUnicode_MallocPtr struct or NULL to use the standard library (if __CCUNICODE_NOSTDALLOC__ is not defined)
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_TranscodeFile(TCCUnicode_Transcoder *Transcoder, const char *SourcePath, int TargetFd, const TCCUnicode_MallocPtr *AllocPtr);
+#endif
+
+    /// \brief Validates a UTF8 buffer whose size does not fit in an int
+    ///
+    /// The buffer is not null-terminated and a null character is a regular character. Characters are validated with the same rules
+    /// as ccunicode_ValidateUtf8Column. ASCII runs are skipped 16 bytes at a time.
+    /// A buffer can be split between threads just before any byte that is not in 0x80-0xBF: each part is then valid on its own if the buffer is.
+    ///
+    /// \param Utf8Data Pointer to the UTF8 data.
+    /// \param Utf8Size Number of bytes in Utf8Data.
+    /// \param ErrorOffset Pointer receiving the offset of the first invalid character on error (-1 if the error is not tied to a character). Can be NULL.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_ValidateUtf8Data(const uint8_t *Utf8Data, int64_t Utf8Size, int64_t *ErrorOffset);
+
+    /// \brief Initializes a corpus generator with default parameters
+    ///
+    /// By default the generator only draws printable ASCII characters, without errors nor null characters.
+    ///
+    /// \param Generator Pointer to the generator.
+    /// \param Seed Seed of the pseudo-random generator.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_InitCorpusGenerator(TCCUnicode_CorpusGenerator *Generator, uint32_t Seed);
+    /// \brief Generates codepoints
+    ///
+    /// Invalid characters are surrogates or values above 0x10FFFF. The array is not null-terminated.
+    ///
+    /// \param Generator Pointer to an initialized generator.
+    /// \param Codepoints Pointer to the output array.
+    /// \param CodepointCount Number of codepoints to generate.
+    /// \return The number of codepoints generated or a negative number on error.
+    int ccunicode_GenerateCodepoints(TCCUnicode_CorpusGenerator *Generator, uint32_t *Codepoints, int CodepointCount);
+    /// \brief Generates UTF8 text
+    ///
+    /// Invalid characters are isolated extension bytes, truncated characters, bytes above 0xF7, encoded surrogates or values above 0x10FFFF.
+    /// A character that does not fit at the end is replaced by ASCII characters, so the output is exactly Utf8Size bytes long. It is not null-terminated.
+    ///
+    /// \param Generator Pointer to an initialized generator.
+    /// \param Utf8Data Pointer to the output buffer.
+    /// \param Utf8Size Number of bytes to generate.
+    /// \return The number of bytes generated or a negative number on error.
+    int ccunicode_GenerateUtf8(TCCUnicode_CorpusGenerator *Generator, uint8_t *Utf8Data, int Utf8Size);
+    /// \brief Generates UTF16 text
+    ///
+    /// Invalid characters are unpaired surrogates. A character that does not fit at the end is replaced by an ASCII character,
+    /// so the output is exactly Utf16Size shorts long. It is not null-terminated.
+    ///
+    /// \param Generator Pointer to an initialized generator.
+    /// \param Utf16Data Pointer to the output buffer.
+    /// \param Utf16Size Number of shorts to generate.
+    /// \return The number of shorts generated or a negative number on error.
+    int ccunicode_GenerateUtf16(TCCUnicode_CorpusGenerator *Generator, uint16_t *Utf16Data, int Utf16Size);
+
+    /// \brief Reads the runtime statistics of the conversion functions
+    ///
+    /// The statistics are only collected if ccunicode was compiled with __CCUNICODE_STATS__ defined (in the implementation file).
+    /// Otherwise the conversion functions do not pay for them and the snapshot only holds zeros.
+    /// Counters are updated with relaxed atomic operations: each counter is exact, but a snapshot taken during conversions
+    /// can mix counters from before and after a call.
+    ///
+    /// \param Stats Pointer to the snapshot to fill.
+    /// \param Reset If not 0, each counter is set back to 0 as it is read, so that no call is lost between two snapshots.
+    /// \return CCUNICODE_NO_ERROR or a negative number on error.
+    int ccunicode_GetStats(TCCUnicode_Stats *Stats, int Reset);
+    /// \brief Sets the runtime statistics of the conversion functions back to 0
+    ///
+    /// \return CCUNICODE_NO_ERROR.
+    int ccunicode_ResetStats(void);
+    /// \brief Gives the name of a conversion function
+    ///
+    /// \param Function A TCCUnicode_Function.
+    /// \return The name of the function (for instance "ccunicode_Utf8ToUtf16_nma") or NULL if Function is not valid.
+    const char *ccunicode_GetFunctionName(int Function);
+
+#   ifdef __CCUNICODE_IMPL__
+#include <limits.h>
+#include <string.h>
+
+#if CCUNICODE_HAS_POSIX_FILES
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __CCUNICODE_PTHREADS__
+#include <pthread.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CCUNICODE_INTERNAL_FETCH_ADD(Ptr, Value) __atomic_fetch_add((Ptr), (Value), __ATOMIC_RELAXED)
+#define CCUNICODE_INTERNAL_EXCHANGE(Ptr, Value) __atomic_exchange_n((Ptr), (Value), __ATOMIC_RELAXED)
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#define CCUNICODE_INTERNAL_FETCH_ADD(Ptr, Value) _InterlockedExchangeAdd64((volatile __int64*)(Ptr), (Value))
+#define CCUNICODE_INTERNAL_EXCHANGE(Ptr, Value) _InterlockedExchange64((volatile __int64*)(Ptr), (Value))
+#endif
+
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define CCUNICODE_INTERNAL_THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define CCUNICODE_INTERNAL_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__) || defined(__clang__)
+#define CCUNICODE_INTERNAL_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define CCUNICODE_INTERNAL_THREAD_LOCAL __declspec(thread)
+#endif
+
+#define CCUNICODE_INTERNAL_TEST(t) \
+    { \
+        int Res = t; \
+        if (Res) \
+            return Res; \
+    }
+
+static const char *const ccunicode_FunctionNames[CCUNICODE_FUNCTION_COUNT] =
+{
+    "ccunicode_Utf8ToCodepoints_n",
+    "ccunicode_Utf8ToCodepoints_na",
+    "ccunicode_Utf8ToCodepoints_nm",
+    "ccunicode_Utf8ToCodepoints_nc",
+    "ccunicode_Utf16ToCodepoints_n",
+    "ccunicode_Utf16ToCodepoints_na",
+    "ccunicode_Utf16ToCodepoints_nm",
+    "ccunicode_Utf16ToCodepoints_nc",
+    "ccunicode_CodepointsToUtf8_n",
+    "ccunicode_CodepointsToUtf8_na",
+    "ccunicode_CodepointsToUtf8_nm",
+    "ccunicode_CodepointsToUtf8_nc",
+    "ccunicode_CodepointsToUtf16_n",
+    "ccunicode_CodepointsToUtf16_na",
+    "ccunicode_CodepointsToUtf16_nm",
+    "ccunicode_CodepointsToUtf16_nc",
+    "ccunicode_Utf8ToUtf16_n",
+    "ccunicode_Utf8ToUtf16_nm",
+    "ccunicode_Utf8ToUtf16_nl",
+    "ccunicode_Utf8ToUtf16_na",
+    "ccunicode_Utf8ToUtf16_nma",
+    "ccunicode_Utf8ToUtf16_nla",
+    "ccunicode_Utf8ToUtf16_nml",
+    "ccunicode_Utf8ToUtf16_nc",
+    "ccunicode_Utf8ToUtf16_np",
+    "ccunicode_Utf8ToUtf16_nap",
+    "ccunicode_Utf8ToUtf16_nmp",
+    "ccunicode_Utf16ToUtf8_n",
+    "ccunicode_Utf16ToUtf8_nm",
+    "ccunicode_Utf16ToUtf8_nl",
+    "ccunicode_Utf16ToUtf8_na",
+    "ccunicode_Utf16ToUtf8_nma",
+    "ccunicode_Utf16ToUtf8_nla",
+    "ccunicode_Utf16ToUtf8_nml",
+    "ccunicode_Utf16ToUtf8_nc",
+    "ccunicode_Utf16ToUtf8_np",
+    "ccunicode_Utf16ToUtf8_nap",
+    "ccunicode_Utf16ToUtf8_nmp",
+    "ccunicode_Utf8ToUtf16Batch_np",
+    "ccunicode_Utf8ToUtf16Batch_nap",
+    "ccunicode_Utf8ToUtf16Batch_nmp",
+    "ccunicode_Utf16ToUtf8Batch_np",
+    "ccunicode_Utf16ToUtf8Batch_nap",
+    "ccunicode_Utf16ToUtf8Batch_nmp",
+    "ccunicode_Utf8ToUtf16Column",
+    "ccunicode_Utf8ToUtf16Column_a",
+    "ccunicode_Utf8ToUtf16Column_m",
+    "ccunicode_Utf8ToUtf16Column64",
+    "ccunicode_Utf8ToUtf16Column64_a",
+    "ccunicode_Utf8ToUtf16Column64_m",
+    "ccunicode_Utf16ToUtf8Column",
+    "ccunicode_Utf16ToUtf8Column_a",
+    "ccunicode_Utf16ToUtf8Column_m",
+    "ccunicode_Utf16ToUtf8Column64",
+    "ccunicode_Utf16ToUtf8Column64_a",
+    "ccunicode_Utf16ToUtf8Column64_m",
+    "ccunicode_CodepointsToUtf8InPlace_n",
+    "ccunicode_CodepointsToUtf16InPlace_n",
+    "ccunicode_Transcode_m",
+    "ccunicode_ValidateUtf8Data",
+};
+
+#ifdef __CCUNICODE_STATS__
+
+#ifndef CCUNICODE_INTERNAL_THREAD_LOCAL
+#error "__CCUNICODE_STATS__ needs thread local storage"
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#ifdef CCUNICODE_INTERNAL_FETCH_ADD
+#define CCUNICODE_INTERNAL_STATS_ADD(Counter, Value) CCUNICODE_INTERNAL_FETCH_ADD(&(Counter), (uint64_t)(Value))
+#else
+#define CCUNICODE_INTERNAL_STATS_ADD(Counter, Value) ((Counter) += (uint64_t)(Value))
+#endif
+
+static TCCUnicode_FunctionStats ccunicode_Stats[CCUNICODE_FUNCTION_COUNT];
+
+// Number of recorded functions running on this thread, only the outermost call is recorded
+static CCUNICODE_INTERNAL_THREAD_LOCAL int ccunicode_StatsDepth;
+// Outermost recorded function running on this thread, allocations are attributed to it
+static CCUNICODE_INTERNAL_THREAD_LOCAL int ccunicode_StatsFunction;
+
+static uint64_t ccunicode_InternalGetTime(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER Counter, Frequency;
+    QueryPerformanceCounter(&Counter);
+    QueryPerformanceFrequency(&Frequency);
+    return (uint64_t)((double)Counter.QuadPart * 1e9 / (double)Frequency.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (uint64_t)Time.tv_sec * 1000000000u + (uint64_t)Time.tv_nsec;
+#elif defined(TIME_UTC)
+    struct timespec Time;
+    timespec_get(&Time, TIME_UTC);
+    return (uint64_t)Time.tv_sec * 1000000000u + (uint64_t)Time.tv_nsec;
+#else
+    // Strict C99 without POSIX: processor time, with a coarse resolution
+    return (uint64_t)((double)clock() * (1e9 / CLOCKS_PER_SEC));
+#endif
+}
+
+// Returns 1 if the call is recorded
+static int ccunicode_InternalStatsEnter(int Function, int64_t InputUnits)
+{
+    if (ccunicode_StatsDepth++)
+        return 0;
+
+    ccunicode_StatsFunction = Function;
+    TCCUnicode_FunctionStats *Stats = &ccunicode_Stats[Function];
+    CCUNICODE_INTERNAL_STATS_ADD(Stats->calls, 1);
+    if (InputUnits > 0)
+        CCUNICODE_INTERNAL_STATS_ADD(Stats->input_units, InputUnits);
+    return 1;
+}
+
+static void ccunicode_InternalStatsLeave(int Function, uint64_t Elapsed, int Result, int64_t OutputUnits)
+{
+    TCCUnicode_FunctionStats *Stats = &ccunicode_Stats[Function];
+    if (Result < 0)
+    {
+        CCUNICODE_INTERNAL_STATS_ADD(Stats->errors[0], 1);
+        if (-Result < CCUNICODE_STATS_ERROR_SLOTS)
+            CCUNICODE_INTERNAL_STATS_ADD(Stats->errors[-Result], 1);
+    }
+    else if (OutputUnits > 0)
+    {
+        CCUNICODE_INTERNAL_STATS_ADD(Stats->output_units, OutputUnits);
+    }
+
+    int Bucket = 0;
+    while (Bucket < CCUNICODE_STATS_LATENCY_BUCKETS-1 && (Elapsed >> (Bucket+1)))
+        ++Bucket;
+    CCUNICODE_INTERNAL_STATS_ADD(Stats->latency[Bucket], 1);
+    CCUNICODE_INTERNAL_STATS_ADD(Stats->total_ns, Elapsed);
+}
+
+static void ccunicode_InternalRecordAllocation(size_t Size)
+{
+    if (!ccunicode_StatsDepth)
+        return;
+
+    TCCUnicode_FunctionStats *Stats = &ccunicode_Stats[ccunicode_StatsFunction];
+    CCUNICODE_INTERNAL_STATS_ADD(Stats->alloc_count, 1);
+    CCUNICODE_INTERNAL_STATS_ADD(Stats->alloc_bytes, Size);
+}
+
+// Reads (and possibly resets) the counters, which are all uint64_t
+static void ccunicode_InternalCopyStats(TCCUnicode_FunctionStats *Target, int Reset)
+{
+    uint64_t *Counters = (uint64_t*)ccunicode_Stats;
+    uint64_t *Copy = (uint64_t*)Target;
+    const size_t CounterCount = CCUNICODE_FUNCTION_COUNT * (sizeof(TCCUnicode_FunctionStats)/sizeof(uint64_t));
+    for (size_t i = 0; i < CounterCount; ++i)
+    {
+#ifdef CCUNICODE_INTERNAL_FETCH_ADD
+        uint64_t Value = Reset ? (uint64_t)CCUNICODE_INTERNAL_EXCHANGE(&Counters[i], 0) : (uint64_t)CCUNICODE_INTERNAL_FETCH_ADD(&Counters[i], 0);
+#else
+        uint64_t Value = Counters[i];
+        if (Reset)
+            Counters[i] = 0;
+#endif
+        if (Copy)
+            Copy[i] = Value;
+    }
+}
+
+#endif // __CCUNICODE_STATS__
+
+// Tracepoints: the user hooks, or the USDT probes of sys/sdt.h
+#if defined(__CCUNICODE_TRACE__) && !defined(CCUNICODE_TRACE_ENTRY) && !defined(CCUNICODE_TRACE_EXIT)
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define CCUNICODE_TRACE_ENTRY(Function, InputUnits) \
+    DTRACE_PROBE2(ccunicode, entry, Function, InputUnits)
+#define CCUNICODE_TRACE_EXIT(Function, InputUnits, OutputUnits, Variant, Result) \
+    DTRACE_PROBE5(ccunicode, exit, Function, InputUnits, OutputUnits, Variant, Result)
+#endif
+#endif
+#endif
+
+#if defined(CCUNICODE_TRACE_ENTRY) || defined(CCUNICODE_TRACE_EXIT)
+#define CCUNICODE_INTERNAL_TRACING
+#ifndef CCUNICODE_TRACE_ENTRY
+#define CCUNICODE_TRACE_ENTRY(Function, InputUnits)
+#endif
+#ifndef CCUNICODE_TRACE_EXIT
+#define CCUNICODE_TRACE_EXIT(Function, InputUnits, OutputUnits, Variant, Result)
+#endif
+#endif
+
+#if defined(CCUNICODE_INTERNAL_TRACING) && defined(CCUNICODE_INTERNAL_THREAD_LOCAL)
+// TCCUnicode_Variant of the innermost traced function running on this thread
+static CCUNICODE_INTERNAL_THREAD_LOCAL int ccunicode_TraceVariant;
+#define CCUNICODE_INTERNAL_SET_VARIANT(Variant) { ccunicode_TraceVariant = (Variant); }
+#else
+#define CCUNICODE_INTERNAL_SET_VARIANT(Variant) {}
+#endif
+
+#if defined(__CCUNICODE_STATS__) || defined(CCUNICODE_INTERNAL_TRACING)
+
+typedef struct
+{
+    int Function;       // TCCUnicode_Function of the call
+    int64_t InputUnits; // Input size given to the function
+    int Recorded;       // 1 if the call is counted in the statistics (outermost call of the thread)
+    uint64_t Start;     // Start time in nanoseconds
+    int CallerVariant;  // Variant chosen by the calling function before the call
+} TCCUnicode_InternalCall;
+
+static void ccunicode_InternalEnter(TCCUnicode_InternalCall *Call, int Function, int64_t InputUnits)
+{
+    Call->Function = Function;
+    Call->InputUnits = InputUnits;
+#ifdef CCUNICODE_INTERNAL_TRACING
+    CCUNICODE_TRACE_ENTRY(Function, InputUnits);
+#ifdef CCUNICODE_INTERNAL_THREAD_LOCAL
+    Call->CallerVariant = ccunicode_TraceVariant;
+    ccunicode_TraceVariant = CCUNICODE_VARIANT_SCALAR;
+#endif
+#endif
+#ifdef __CCUNICODE_STATS__
+    Call->Recorded = ccunicode_InternalStatsEnter(Function, InputUnits);
+    if (Call->Recorded)
+        Call->Start = ccunicode_InternalGetTime();
+#endif
+}
+
+static void ccunicode_InternalLeave(const TCCUnicode_InternalCall *Call, int Result, int64_t OutputUnits)
+{
+#ifdef __CCUNICODE_STATS__
+    --ccunicode_StatsDepth;
+    if (Call->Recorded)
+        ccunicode_InternalStatsLeave(Call->Function, ccunicode_InternalGetTime() - Call->Start, Result, OutputUnits);
+#endif
+#ifdef CCUNICODE_INTERNAL_TRACING
+    int Variant = CCUNICODE_VARIANT_SCALAR;
+#ifdef CCUNICODE_INTERNAL_THREAD_LOCAL
+    // A caller that did not choose a variant reports the one of its callee (ccunicode_Utf8ToUtf16_nm reports the path of ccunicode_Utf8ToUtf16_nma)
+    Variant = ccunicode_TraceVariant;
+    if (Call->CallerVariant != CCUNICODE_VARIANT_SCALAR)
+        ccunicode_TraceVariant = Call->CallerVariant;
+#endif
+    CCUNICODE_TRACE_EXIT(Call->Function, Call->InputUnits, OutputUnits, Variant, Result);
+    (void)Variant;
+#endif
+}
+
+// Entry and exit of the public conversion functions, for the statistics and the tracepoints
+#define CCUNICODE_INTERNAL_ENTER(Function, InputUnits) \
+    TCCUnicode_InternalCall InternalCall; \
+    ccunicode_InternalEnter(&InternalCall, (Function), (int64_t)(InputUnits));
+#define CCUNICODE_INTERNAL_LEAVE(Result, OutputUnits) \
+    ccunicode_InternalLeave(&InternalCall, (Result), ((Result) >= 0) ? (int64_t)(OutputUnits) : 0);
+
+#else
+
+#define CCUNICODE_INTERNAL_ENTER(Function, InputUnits)
+#define CCUNICODE_INTERNAL_LEAVE(Result, OutputUnits)
+
+#endif
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+
+#include <stdlib.h>
+
+static const TCCUnicode_MallocPtr ccunicode_DefaultAllocator =
+{
+    &malloc,
+    &free
+};
+
+#endif // __CCUNICODE_NOSTDALLOC__
+
+// The head of a context allocator holds these functions, which are never called, so that it can be told from a plain allocator
+static void *ccunicode_InternalCtxMallocMarker(size_t Size)
+{
+    (void)Size;
+    return NULL;
+}
+
+static void ccunicode_InternalCtxFreeMarker(void *Ptr)
+{
+    (void)Ptr;
+}
+
+static const TCCUnicode_CtxMallocPtr *ccunicode_InternalGetCtxAllocator(const TCCUnicode_MallocPtr *AllocPtr)
+{
+    if (AllocPtr->malloc_func != &ccunicode_InternalCtxMallocMarker)
+        return NULL;
+    return (const TCCUnicode_CtxMallocPtr*)AllocPtr;
+}
+
+int ccunicode_InitCtxMallocPtr(TCCUnicode_CtxMallocPtr *Allocator, void *Ctx, void *(*MallocFunc)(void*, size_t), void (*FreeFunc)(void*, void*))
+{
+    if (!Allocator)
+        return CCUNICODE_NULL_POINTER;
+    if (!MallocFunc || !FreeFunc)
+        return CCUNICODE_INVALID_ALLOCATOR;
+
+    memset(Allocator, 0, sizeof(*Allocator));
+    Allocator->malloc_ptr.malloc_func = &ccunicode_InternalCtxMallocMarker;
+    Allocator->malloc_ptr.free_func = &ccunicode_InternalCtxFreeMarker;
+    Allocator->ctx = Ctx;
+    Allocator->ctx_malloc_func = MallocFunc;
+    Allocator->ctx_free_func = FreeFunc;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+// Structs keeping their allocator keep the whole context allocator, the head alone would not reach its functions
+static void ccunicode_InternalCopyAllocator(TCCUnicode_CtxMallocPtr *Dst, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    const TCCUnicode_CtxMallocPtr *CtxAlloc = ccunicode_InternalGetCtxAllocator(AllocPtr);
+    if (CtxAlloc)
+        *Dst = *CtxAlloc;
+    else
+    {
+        memset(Dst, 0, sizeof(*Dst));
+        Dst->malloc_ptr = *AllocPtr;
+    }
+}
+
+static int ccunicode_CheckAllocator(const TCCUnicode_MallocPtr **AllocPtr)
+{
+    if (!(*AllocPtr))
+    {
+#ifndef __CCUNICODE_NOSTDALLOC__
+        *AllocPtr = &ccunicode_DefaultAllocator;
+#else
+        return CCUNICODE_NULL_ALLOCATOR;
+#endif
+    }
+
+    const TCCUnicode_CtxMallocPtr *CtxAlloc = ccunicode_InternalGetCtxAllocator(*AllocPtr);
+    if (CtxAlloc)
+    {
+        if (!CtxAlloc->ctx_malloc_func || !CtxAlloc->ctx_free_func)
+            return CCUNICODE_INVALID_ALLOCATOR;
+    }
+    else if (!(*AllocPtr)->malloc_func || !(*AllocPtr)->free_func)
+        return CCUNICODE_INVALID_ALLOCATOR;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+// The allocator must have gone through ccunicode_CheckAllocator
+static void *ccunicode_InternalMalloc(const TCCUnicode_MallocPtr *AllocPtr, size_t Size)
+{
+#ifdef __CCUNICODE_STATS__
+    ccunicode_InternalRecordAllocation(Size);
+#endif
+    const TCCUnicode_CtxMallocPtr *CtxAlloc = ccunicode_InternalGetCtxAllocator(AllocPtr);
+    if (CtxAlloc)
+        return CtxAlloc->ctx_malloc_func(CtxAlloc->ctx, Size);
+    return AllocPtr->malloc_func(Size);
+}
+
+static void ccunicode_InternalFree(const TCCUnicode_MallocPtr *AllocPtr, void *Ptr)
+{
+    const TCCUnicode_CtxMallocPtr *CtxAlloc = ccunicode_InternalGetCtxAllocator(AllocPtr);
+    if (CtxAlloc)
+        CtxAlloc->ctx_free_func(CtxAlloc->ctx, Ptr);
+    else
+        AllocPtr->free_func(Ptr);
+}
+
+// Alignment is a hint: it is only honoured by allocators with an aligned function
+static void *ccunicode_InternalAlignedMalloc(const TCCUnicode_MallocPtr *AllocPtr, size_t Alignment, size_t Size)
+{
+    const TCCUnicode_CtxMallocPtr *CtxAlloc = ccunicode_InternalGetCtxAllocator(AllocPtr);
+    if (!CtxAlloc || !CtxAlloc->ctx_aligned_alloc_func)
+        return ccunicode_InternalMalloc(AllocPtr, Size);
+#ifdef __CCUNICODE_STATS__
+    ccunicode_InternalRecordAllocation(Size);
+#endif
+    return CtxAlloc->ctx_aligned_alloc_func(CtxAlloc->ctx, Alignment, Size);
+}
+
+// The first KeepSize bytes are kept, Ptr is freed if a new block is returned
+static void *ccunicode_InternalRealloc(const TCCUnicode_MallocPtr *AllocPtr, void *Ptr, size_t KeepSize, size_t NewSize)
+{
+    const TCCUnicode_CtxMallocPtr *CtxAlloc = ccunicode_InternalGetCtxAllocator(AllocPtr);
+    if (CtxAlloc && CtxAlloc->ctx_realloc_func)
+    {
+#ifdef __CCUNICODE_STATS__
+        ccunicode_InternalRecordAllocation(NewSize);
+#endif
+        return CtxAlloc->ctx_realloc_func(CtxAlloc->ctx, Ptr, KeepSize, NewSize);
+    }
+
+    void *NewPtr = ccunicode_InternalMalloc(AllocPtr, NewSize);
+    if (NewPtr && Ptr)
+    {
+        memcpy(NewPtr, Ptr, KeepSize < NewSize ? KeepSize : NewSize);
+        ccunicode_InternalFree(AllocPtr, Ptr);
+    }
+    return NewPtr;
+}
+
+int ccunicode_GetUtf8StrLen(const uint8_t *Utf8Str)
+{
+    if (!Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+
+    int Len = 0;
+    while (Utf8Str[Len] != 0)
+    {
+        if (Len == INT_MAX)
+            return CCUNICODE_OVERFLOW;
+        ++Len;
+    }
+    return Len;
+}
+
+int ccunicode_GetUtf16StrLen(const uint16_t *Utf16Str)
+{
+    if (!Utf16Str)
+        return CCUNICODE_NULL_POINTER;
+
+    int Len = 0;
+    while (Utf16Str[Len] != 0)
+    {
+        if (Len == INT_MAX)
+            return CCUNICODE_OVERFLOW;
+        ++Len;
+    }
+    return Len;
+}
+
+int ccunicode_GetCodepointCount(const uint32_t *Codepoints)
+{
+    if (!Codepoints)
+        return CCUNICODE_NULL_POINTER;
+
+    int Len = 0;
+    while (Codepoints[Len] != 0)
+    {
+        if (Len == INT_MAX)
+            return CCUNICODE_OVERFLOW;
+        ++Len;
+    }
+    return Len;
+}
+
+int ccunicode_CountCodepointsInUtf8(const uint8_t *Utf8Str)
+{
+    int Res = ccunicode_GetUtf8StrLen(Utf8Str);
+    if (Res < 0)
+        return Res;
+
+    return ccunicode_CountCodepointsInUtf8_n(Utf8Str, Res);
+}
+
+int ccunicode_CountCodepointsInUtf8_n(const uint8_t *Utf8Str, int Utf8Size)
+{
+    if (!Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (!Utf8Size)
+        return 0;
+
+    int Count = 0;
+    int RemainingBytes = 0;
+    for (int Pos = 0; Pos < Utf8Size; ++Pos)
+    {
+        uint8_t CurrentByte = Utf8Str[Pos];
+
+        // If the code is 0 then we have reached the end of the string
+        if (CurrentByte == 0x00)
+            return Count;
+
+        // The first byte encoding a code point must either be ASCII (< 0x80)
+        // or it must carry the correct starting bitmask for the length info.
+        // In practice, the following range are forbidden:
+        // 0x80-0xBF
+        // 0xF8-0xFF
+        if (CurrentByte >= 0x80 && CurrentByte <= 0xBF)
+            return CCUNICODE_INVALID_UTF8_CHARACTER;
+        if (CurrentByte >= 0xF8 /* && CurrentByte <= 0xFF */)
+            return CCUNICODE_INVALID_UTF8_CHARACTER;
+
+        if (Count == INT_MAX)
+            return CCUNICODE_OVERFLOW;
+        ++Count;
+
+        if (CurrentByte >= 0x01 && CurrentByte <= 0x7F)
+        {
+            RemainingBytes = 0;
+        }
+
+        if (CurrentByte >= 0xC0 && CurrentByte <= 0xDF)
+        {
+            RemainingBytes = 1;
+        }
+
+        if (CurrentByte >= 0xE0 && CurrentByte <= 0xEF)
+        {
+            RemainingBytes = 2;
+        }
+
+        if (CurrentByte >= 0xF0 && CurrentByte <= 0xF7)
+        {
+            RemainingBytes = 3;
+        }
+
+        // We check we are allowed that many bytes for the codepoint
+        if (Pos + RemainingBytes >= Utf8Size)
+            return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+
+        // Now collect remaining part of the codepoint (if any)
+        for (size_t j = 0; j < RemainingBytes; ++j)
+        {
+            CurrentByte = Utf8Str[++Pos];
+
+            if (CurrentByte == 0)
+                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+            // The only valid range is 0x80-0xBF for an extension
+            if (CurrentByte < 0x80 || CurrentByte > 0xBF)
+                return CCUNICODE_INVALID_UTF8_CHARACTER;
+        }
+    }
+
+    return Count;
+}
+
+int ccunicode_CountCodepointsInUtf16(const uint16_t *Utf16Str)
+{
+    int Res = ccunicode_GetUtf16StrLen(Utf16Str);
+    if (Res < 0)
+        return Res;
+
+    return ccunicode_CountCodepointsInUtf16_n(Utf16Str, Res);
+}
+
+int ccunicode_CountCodepointsInUtf16_n(const uint16_t *Utf16Str, int Utf16Size)
+{
+    if (!Utf16Str)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf16Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (!Utf16Size)
+        return 0;
+
+    int Count = 0;
+    int RemainingBytes = 0;
+    for (int Pos = 0; Pos < Utf16Size; ++Pos)
+    {
+        uint16_t CurrentCodeUnit = Utf16Str[Pos];
+
+        // We must distinguish between surrogate pairs and single units
+        if (CurrentCodeUnit >= 0xD800 && CurrentCodeUnit <= 0xDFFF)
+        {
+            if (CurrentCodeUnit >= 0xDC00)
+                return CCUNICODE_SURROGATE_PAIR_INVERSION;
+
+            if (Pos == Utf16Size-1)
+                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+
+            CurrentCodeUnit = Utf16Str[++Pos];
+            if (CurrentCodeUnit == 0)
+                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+            if (CurrentCodeUnit < 0xDC00 || CurrentCodeUnit > 0xDFFF)
+                return CCUNICODE_INVALID_UTF16_CHARACTER;
+
+            if (Count == INT_MAX)
+                return CCUNICODE_OVERFLOW;
+            ++Count;
+        }
+        else
+        {
+            if (CurrentCodeUnit == 0)
+                return Count;
+
+            if (Count == INT_MAX)
+                return CCUNICODE_OVERFLOW;
+            ++Count;
+        }
+    }
+
+    return Count;
+}
+
+int ccunicode_GetUtf8SizeFromCodepoints(const uint32_t *Codepoints)
+{
+    int Res = ccunicode_GetCodepointCount(Codepoints);
+    if (Res < 0)
+        return Res;
+
+    return ccunicode_GetUtf8SizeFromCodepoints_n(Codepoints, Res);
+}
+
+int ccunicode_GetUtf8SizeFromCodepoints_n(const uint32_t *Codepoints, int CodepointCount)
+{
+    if (!Codepoints)
+        return CCUNICODE_NULL_POINTER;
+    if (CodepointCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (!CodepointCount)
+        return 0;
+
+    int Utf8Size = 0;
+    for (int Pos = 0; Pos < CodepointCount; ++Pos)
+    {
+        uint32_t CurrentCodepoint = Codepoints[Pos];
+
+        if (CurrentCodepoint > 0x10FFFF)
+            return CCUNICODE_INVALID_CODEPOINT;
+        if (CurrentCodepoint >= 0xD800 && CurrentCodepoint <= 0xDFFF)
+            return CCUNICODE_INVALID_CODEPOINT;
+        if (CurrentCodepoint == 0)
+            return Utf8Size;
+
+        if (CurrentCodepoint >= 1 && CurrentCodepoint <= 0x7F)
+        {
+            if (Utf8Size == INT_MAX)
+                return CCUNICODE_OVERFLOW;
+            Utf8Size += 1;
+        }
+        if (CurrentCodepoint >= 0x80 && CurrentCodepoint <= 0x7FF)
+        {
+            if (Utf8Size > INT_MAX-2)
+                return CCUNICODE_OVERFLOW;
+            Utf8Size += 2;
+        }
+        if (CurrentCodepoint >= 0x800 && CurrentCodepoint <= 0xFFFF)
+        {
+            if (Utf8Size > INT_MAX-3)
+                return CCUNICODE_OVERFLOW;
+            Utf8Size += 3;
+        }
+        if (CurrentCodepoint >= 0x10000 && CurrentCodepoint <= 0x10FFFF)
+        {
+            if (Utf8Size > INT_MAX-4)
+                return CCUNICODE_OVERFLOW;
+            Utf8Size += 4;
+        }
+    }
+
+    return Utf8Size;
+}
+
+int ccunicode_GetUtf16SizeFromCodepoints(const uint32_t *Codepoints)
+{
+    int Res = ccunicode_GetCodepointCount(Codepoints);
+    if (Res < 0)
+        return Res;
+
+    return ccunicode_GetUtf16SizeFromCodepoints_n(Codepoints, Res);
+}
+
+int ccunicode_GetUtf16SizeFromCodepoints_n(const uint32_t *Codepoints, int CodepointCount)
+{
+    if (!Codepoints)
+        return CCUNICODE_NULL_POINTER;
+    if (CodepointCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (!CodepointCount)
+        return 0;
+
+    int Utf16Size = 0;
+    for (int Pos = 0; Pos < CodepointCount; ++Pos)
+    {
+        uint32_t CurrentCodepoint = Codepoints[Pos];
+
+        if (CurrentCodepoint > 0x10FFFF)
+            return CCUNICODE_INVALID_CODEPOINT;
+        if (CurrentCodepoint >= 0xD800 && CurrentCodepoint <= 0xDFFF)
+            return CCUNICODE_INVALID_CODEPOINT;
+        if (CurrentCodepoint == 0)
+            return Utf16Size;
+
+        if (CurrentCodepoint >= 1 && CurrentCodepoint <= 0xD7FF)
+        {
+            if (Utf16Size == INT_MAX)
+                return CCUNICODE_OVERFLOW;
+            Utf16Size += 1;
+        }
+        if (CurrentCodepoint >= 0xE000 && CurrentCodepoint <= 0xFFFF)
+        {
+            if (Utf16Size == INT_MAX)
+                return CCUNICODE_OVERFLOW;
+            Utf16Size += 1;
+        }
+
+        if (CurrentCodepoint >= 0x10000 && CurrentCodepoint <= 0x10FFFF)
+        {
+            if (Utf16Size > INT_MAX-2)
+                return CCUNICODE_OVERFLOW;
+            Utf16Size += 2;
+        }
+    }
+
+    return Utf16Size;
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_Utf8ToCodepoints(const uint8_t *Utf8Str, uint32_t **Codepoints)
+{
+    return ccunicode_Utf8ToCodepoints_a(Utf8Str, Codepoints, NULL);
+}
+
+int ccunicode_Utf8ToCodepoints_n(const uint8_t *Utf8Str, int Utf8Size, uint32_t **Codepoints)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_CODEPOINTS_N, Utf8Size)
+    int Res = ccunicode_Utf8ToCodepoints_na(Utf8Str, Utf8Size, Codepoints, NULL);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+#endif
+
+int ccunicode_Utf8ToCodepoints_a(const uint8_t *Utf8Str, uint32_t **Codepoints, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    int Utf8Size = ccunicode_GetUtf8StrLen(Utf8Str);
+    if (Utf8Size < 0)
+        return Utf8Size;
+
+    return ccunicode_Utf8ToCodepoints_na(Utf8Str, Utf8Size, Codepoints, AllocPtr);
+}
+
+static int ccunicode_InternalUtf8ToCodepoints_na(const uint8_t *Utf8Str, int Utf8Size, uint32_t **Codepoints, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    if (!Codepoints)
+        return CCUNICODE_NULL_POINTER;
+
+    int CodepointCount = ccunicode_CountCodepointsInUtf8_n(Utf8Str, Utf8Size);
+    if (CodepointCount < 0)
+        return CodepointCount;
+    if (CodepointCount == INT_MAX)
+        return CCUNICODE_OVERFLOW;
+
+    if (CodepointCount+1 > INT_MAX/sizeof(**Codepoints))
+        return CCUNICODE_OVERFLOW;
+    *Codepoints = ccunicode_InternalMalloc(AllocPtr, (CodepointCount+1)*sizeof(**Codepoints));
+    if (!(*Codepoints))
+        return CCUNICODE_BAD_ALLOCATION;
+
+    int Result = ccunicode_Utf8ToCodepoints_nm(Utf8Str, Utf8Size, *Codepoints, CodepointCount);
+    if (Result < 0)
+    {
+        ccunicode_InternalFree(AllocPtr, *Codepoints);
+        *Codepoints = NULL;
+    }
+    return Result;
+}
+
+int ccunicode_Utf8ToCodepoints_na(const uint8_t *Utf8Str, int Utf8Size, uint32_t **Codepoints, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_CODEPOINTS_NA, Utf8Size)
+    int Res = ccunicode_InternalUtf8ToCodepoints_na(Utf8Str, Utf8Size, Codepoints, AllocPtr);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf8ToCodepoints_m(const uint8_t *Utf8Str, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    int Utf8Size = ccunicode_GetUtf8StrLen(Utf8Str);
+    if (Utf8Size < 0)
+        return Utf8Size;
+
+    return ccunicode_Utf8ToCodepoints_nm(Utf8Str, Utf8Size, Codepoints, MaxCodepointsCount);
+}
+
+static int ccunicode_InternalUtf8ToCodepoints_nm(const uint8_t *Utf8Str, int Utf8Size, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    if (!Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+    if (!Codepoints)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (MaxCodepointsCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    int WritePos = 0;
+    int ReadPos = 0;
+    while ((ReadPos < Utf8Size) && (WritePos < MaxCodepointsCount))
+    {
+        uint32_t CodePoint = 0;
+
+        int RemainingBytes = 0;
+        if (ReadPos == INT_MAX)
+            return CCUNICODE_OVERFLOW;
+        uint8_t CurrentByte = Utf8Str[ReadPos++];
+
+        // If it is the final character let's stop there
+        if (CurrentByte == 0)
+        {
+            Codepoints[WritePos] = 0;
+            return WritePos;
+        }
+
+        // If we have an illegal character, we stop
+        if (CurrentByte >= 0x80 && CurrentByte <= 0xBF)
+            return CCUNICODE_INVALID_UTF8_CHARACTER;
+        if (CurrentByte >= 0xF8 /* && CurrentByte <= 0xFF */)
+            return CCUNICODE_INVALID_UTF8_CHARACTER;
+
+        if (CurrentByte >= 0x01 && CurrentByte <= 0x7F)
+        {
+            CodePoint = CurrentByte;
+            RemainingBytes = 0;
+        }
+
+        if (CurrentByte >= 0xC0 && CurrentByte <= 0xDF)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0x1F);
+            RemainingBytes = 1;
+        }
+
+        if (CurrentByte >= 0xE0 && CurrentByte <= 0xEF)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0xF);
+            RemainingBytes = 2;
+        }
+
+        if (CurrentByte >= 0xF0 && CurrentByte <= 0xF7)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0x7);
+            RemainingBytes = 3;
+        }
+
+        // We check we are allowed that many bytes for the codepoint
+        if (ReadPos + RemainingBytes > Utf8Size)
+            return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+
+        // Now collect remaining part of the codepoint (if any)
+        for (size_t j = 0; j < RemainingBytes; ++j)
+        {
+            CodePoint <<= 6;
+            CurrentByte = Utf8Str[ReadPos++];
+
+            // The only valid range is 0x80-0xBF for an extension
+            if (CurrentByte < 0x80 || CurrentByte > 0xBF)
+                return CCUNICODE_INVALID_UTF8_CHARACTER;
+
+            CodePoint += (uint32_t)(CurrentByte & 0x3F);
+        }
+
+        if (WritePos == INT_MAX)
+            return CCUNICODE_OVERFLOW;
+        Codepoints[WritePos++] = CodePoint;
+    }
+
+    // Reaching the null character right when the buffer is full is not an error
+    if (ReadPos != Utf8Size && Utf8Str[ReadPos] != 0)
+        return CCUNICODE_BUFFER_TOO_SMALL;
+
+    Codepoints[WritePos] = 0;
+    return WritePos;
+}
+
+int ccunicode_Utf8ToCodepoints_nm(const uint8_t *Utf8Str, int Utf8Size, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_CODEPOINTS_NM, Utf8Size)
+    int Res = ccunicode_InternalUtf8ToCodepoints_nm(Utf8Str, Utf8Size, Codepoints, MaxCodepointsCount);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_Utf16ToCodepoints(const uint16_t *Utf16Str, uint32_t **Codepoints)
+{
+    return ccunicode_Utf16ToCodepoints_a(Utf16Str, Codepoints, NULL);
+}
+
+int ccunicode_Utf16ToCodepoints_n(const uint16_t *Utf16Str, int Utf16Size, uint32_t **Codepoints)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_CODEPOINTS_N, Utf16Size)
+    int Res = ccunicode_Utf16ToCodepoints_na(Utf16Str, Utf16Size, Codepoints, NULL);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+#endif
+
+int ccunicode_Utf16ToCodepoints_a(const uint16_t *Utf16Str, uint32_t **Codepoints, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    int Utf16Size = ccunicode_GetUtf16StrLen(Utf16Str);
+    if (Utf16Size < 0)
+        return Utf16Size;
+
+    return ccunicode_Utf16ToCodepoints_na(Utf16Str, Utf16Size, Codepoints, AllocPtr);
+}
+
+static int ccunicode_InternalUtf16ToCodepoints_na(const uint16_t *Utf16Str, int Utf16Size, uint32_t **Codepoints, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    if (!Codepoints)
+        return CCUNICODE_NULL_POINTER;
+
+    int CodepointCount = ccunicode_CountCodepointsInUtf16_n(Utf16Str, Utf16Size);
+    if (CodepointCount < 0)
+        return CodepointCount;
+    if (CodepointCount == INT_MAX)
+        return CCUNICODE_OVERFLOW;
+
+    if (CodepointCount+1 > INT_MAX/sizeof(**Codepoints))
+        return CCUNICODE_OVERFLOW;
+    *Codepoints = ccunicode_InternalMalloc(AllocPtr, (CodepointCount+1)*sizeof(**Codepoints));
+    if (!(*Codepoints))
+        return CCUNICODE_BAD_ALLOCATION;
+
+    int Result = ccunicode_Utf16ToCodepoints_nm(Utf16Str, Utf16Size, *Codepoints, CodepointCount);
+    if (Result < 0)
+    {
+        ccunicode_InternalFree(AllocPtr, *Codepoints);
+        *Codepoints = NULL;
+    }
+    return Result;
+}
+
+int ccunicode_Utf16ToCodepoints_na(const uint16_t *Utf16Str, int Utf16Size, uint32_t **Codepoints, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_CODEPOINTS_NA, Utf16Size)
+    int Res = ccunicode_InternalUtf16ToCodepoints_na(Utf16Str, Utf16Size, Codepoints, AllocPtr);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf16ToCodepoints_m(const uint16_t *Utf16Str, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    int Utf16Size = ccunicode_GetUtf16StrLen(Utf16Str);
+    if (Utf16Size < 0)
+        return Utf16Size;
+
+    return ccunicode_Utf16ToCodepoints_nm(Utf16Str, Utf16Size, Codepoints, MaxCodepointsCount);
+}
+
+static int ccunicode_InternalUtf16ToCodepoints_nm(const uint16_t *Utf16Str, int Utf16Size, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    if (!Utf16Str)
+        return CCUNICODE_NULL_POINTER;
+    if (!Codepoints)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf16Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (MaxCodepointsCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    int WritePos = 0;
+    int ReadPos = 0;
+    while ((ReadPos < Utf16Size) && (WritePos < MaxCodepointsCount))
+    {
+        uint32_t CodePoint = 0;
+
+        int RemainingBytes = 0;
+        if (ReadPos == INT_MAX)
+            return CCUNICODE_OVERFLOW;
+        uint16_t CurrentCodeUnit = Utf16Str[ReadPos++];
+
+        // We must distinguish between surrogate pairs and single units
+        if (CurrentCodeUnit >= 0xD800 && CurrentCodeUnit <= 0xDFFF)
+        {
+            if (CurrentCodeUnit >= 0xDC00)
+                return CCUNICODE_SURROGATE_PAIR_INVERSION;
+
+            if (ReadPos == Utf16Size)
+                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+
+            uint16_t HighBits = CurrentCodeUnit - 0xD800;
+
+            CurrentCodeUnit = Utf16Str[ReadPos++];
+            if (CurrentCodeUnit == 0)
+                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+            if (CurrentCodeUnit < 0xDC00 || CurrentCodeUnit > 0xDFFF)
+                return CCUNICODE_INVALID_UTF16_CHARACTER;
+
+            uint16_t LowBits = CurrentCodeUnit - 0xDC00;
+
+            CodePoint = ((uint32_t)(HighBits) << 10) + (uint32_t)(LowBits) + 0x10000;
+        }
+        else
+        {
+            if (CurrentCodeUnit == 0)
+            {
+                Codepoints[WritePos] = 0;
+                return WritePos;
+            }
+
+            CodePoint = (uint32_t)CurrentCodeUnit;
+        }
+
+        if (WritePos == INT_MAX)
+            return CCUNICODE_OVERFLOW;
+        Codepoints[WritePos++] = CodePoint;
+    }
+
+    // Reaching the null character right when the buffer is full is not an error
+    if (ReadPos != Utf16Size && Utf16Str[ReadPos] != 0)
+        return CCUNICODE_BUFFER_TOO_SMALL;
+    Codepoints[WritePos] = 0;
+    return WritePos;
+}
+
+int ccunicode_Utf16ToCodepoints_nm(const uint16_t *Utf16Str, int Utf16Size, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_CODEPOINTS_NM, Utf16Size)
+    int Res = ccunicode_InternalUtf16ToCodepoints_nm(Utf16Str, Utf16Size, Codepoints, MaxCodepointsCount);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_CodepointsToUtf8(const uint32_t *Codepoints, uint8_t **Utf8Str)
+{
+    return ccunicode_CodepointsToUtf8_a(Codepoints, Utf8Str, NULL);
+}
+
+int ccunicode_CodepointsToUtf8_n(const uint32_t *Codepoints, int CodepointCount, uint8_t **Utf8Str)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF8_N, CodepointCount)
+    int Res = ccunicode_CodepointsToUtf8_na(Codepoints, CodepointCount, Utf8Str, NULL);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+#endif
+
+int ccunicode_CodepointsToUtf8_a(const uint32_t *Codepoints, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    int CodepointCount = ccunicode_GetCodepointCount(Codepoints);
+    if (CodepointCount < 0)
+        return CodepointCount;
+
+    return ccunicode_CodepointsToUtf8_na(Codepoints, CodepointCount, Utf8Str, AllocPtr);
+}
+
+static int ccunicode_InternalCodepointsToUtf8_na(const uint32_t *Codepoints, int CodepointCount, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    if (!Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+
+    int Utf8Size = ccunicode_GetUtf8SizeFromCodepoints_n(Codepoints, CodepointCount);
+    if (Utf8Size < 0)
+        return Utf8Size;
+    if (Utf8Size == INT_MAX)
+        return CCUNICODE_OVERFLOW;
+
+    *Utf8Str = ccunicode_InternalMalloc(AllocPtr, Utf8Size+1);
+    if (!(*Utf8Str))
+        return CCUNICODE_BAD_ALLOCATION;
+
+    int Result = ccunicode_CodepointsToUtf8_nm(Codepoints, CodepointCount, *Utf8Str, Utf8Size);
+    if (Result < 0)
+    {
+        ccunicode_InternalFree(AllocPtr, *Utf8Str);
+        *Utf8Str = NULL;
+    }
+    return Result;
+}
+
+int ccunicode_CodepointsToUtf8_na(const uint32_t *Codepoints, int CodepointCount, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF8_NA, CodepointCount)
+    int Res = ccunicode_InternalCodepointsToUtf8_na(Codepoints, CodepointCount, Utf8Str, AllocPtr);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_CodepointsToUtf8_m(const uint32_t *Codepoints, uint8_t *Utf8Str, int Utf8Size)
+{
+    int CodepointCount = ccunicode_GetCodepointCount(Codepoints);
+    if (CodepointCount < 0)
+        return CodepointCount;
+
+    return ccunicode_CodepointsToUtf8_nm(Codepoints, CodepointCount, Utf8Str, Utf8Size);
+}
+
+static int ccunicode_InternalCodepointsToUtf8_nm(const uint32_t *Codepoints, int CodepointCount, uint8_t *Utf8Str, int Utf8Size)
+{
+    if (!Codepoints)
+        return CCUNICODE_NULL_POINTER;
+    if (!Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+    if (CodepointCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (Utf8Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    int WritePos = 0;
+    int ReadPos = 0;
+    while ((ReadPos < CodepointCount) && (WritePos < Utf8Size))
+    {
+        uint32_t CurrentCodepoint = Codepoints[ReadPos++];
+
+        if (CurrentCodepoint > 0x10FFFF)
+            return CCUNICODE_INVALID_CODEPOINT;
+        if (CurrentCodepoint >= 0xD800 && CurrentCodepoint <= 0xDFFF)
+            return CCUNICODE_INVALID_CODEPOINT;
+        if (CurrentCodepoint == 0)
+        {
+            Utf8Str[WritePos] = 0;
+            return WritePos;
+        }
+
+        if (CurrentCodepoint >= 1 && CurrentCodepoint <= 0x7F)
+        {
+            Utf8Str[WritePos++] = (uint8_t)CurrentCodepoint;
+        }
+        if (CurrentCodepoint >= 0x80 && CurrentCodepoint <= 0x7FF)
+        {
+            if (WritePos > Utf8Size-2)
+                return CCUNICODE_BUFFER_TOO_SMALL;
+
+            Utf8Str[WritePos++] = 0xC0 + (uint8_t)((CurrentCodepoint >> 6) & 0x1F);
+            Utf8Str[WritePos++] = 0x80 + (uint8_t)(CurrentCodepoint & 0x3F);
+        }
+        if (CurrentCodepoint >= 0x800 && CurrentCodepoint <= 0xFFFF)
+        {
+            if (WritePos > Utf8Size-3)
+                return CCUNICODE_BUFFER_TOO_SMALL;
+
+            Utf8Str[WritePos++] = 0xE0 + (uint8_t)((CurrentCodepoint >> 12) & 0xF);
+            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint >> 6) & 0x3F);
+            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint) & 0x3F);
+        }
+        if (CurrentCodepoint >= 0x10000 && CurrentCodepoint <= 0x10FFFF)
+        {
+            if (WritePos > Utf8Size-4)
+                return CCUNICODE_BUFFER_TOO_SMALL;
+
+            Utf8Str[WritePos++] = 0xF0 + (uint8_t)((CurrentCodepoint >> 18) & 0xF);
+            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint >> 12) & 0x3F);
+            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint >> 6) & 0x3F);
+            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint) & 0x3F);
+        }
+    }
+
+    // Reaching the null character right when the buffer is full is not an error
+    if (ReadPos != CodepointCount && Codepoints[ReadPos] != 0)
+        return CCUNICODE_BUFFER_TOO_SMALL;
+
+    Utf8Str[WritePos] = 0;
+    return WritePos;
+}
+
+int ccunicode_CodepointsToUtf8_nm(const uint32_t *Codepoints, int CodepointCount, uint8_t *Utf8Str, int Utf8Size)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF8_NM, CodepointCount)
+    int Res = ccunicode_InternalCodepointsToUtf8_nm(Codepoints, CodepointCount, Utf8Str, Utf8Size);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_CodepointsToUtf16(const uint32_t *Codepoints, uint16_t **Utf16Str)
+{
+    return ccunicode_CodepointsToUtf16_a(Codepoints, Utf16Str, NULL);
+}
+
+int ccunicode_CodepointsToUtf16_n(const uint32_t *Codepoints, int CodepointCount, uint16_t **Utf16Str)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF16_N, CodepointCount)
+    int Res = ccunicode_CodepointsToUtf16_na(Codepoints, CodepointCount, Utf16Str, NULL);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+#endif
+
+int ccunicode_CodepointsToUtf16_a(const uint32_t *Codepoints, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    int CodepointCount = ccunicode_GetCodepointCount(Codepoints);
+    if (CodepointCount < 0)
+        return CodepointCount;
+
+    return ccunicode_CodepointsToUtf16_na(Codepoints, CodepointCount, Utf16Str, AllocPtr);
+}
+
+static int ccunicode_InternalCodepointsToUtf16_na(const uint32_t *Codepoints, int CodepointCount, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    if (!Utf16Str)
+        return CCUNICODE_NULL_POINTER;
+
+    int Utf16Size = ccunicode_GetUtf16SizeFromCodepoints_n(Codepoints, CodepointCount);
+    if (Utf16Size < 0)
+        return Utf16Size;
+    if (Utf16Size == INT_MAX)
+        return CCUNICODE_OVERFLOW;
+
+    if (Utf16Size+1 > INT_MAX/sizeof(**Utf16Str))
+        return CCUNICODE_OVERFLOW;
+    *Utf16Str = ccunicode_InternalMalloc(AllocPtr, (Utf16Size+1)*sizeof(**Utf16Str));
+    if (!(*Utf16Str))
+        return CCUNICODE_BAD_ALLOCATION;
+
+    int Result = ccunicode_CodepointsToUtf16_nm(Codepoints, CodepointCount, *Utf16Str, Utf16Size);
+    if (Result < 0)
+    {
+        ccunicode_InternalFree(AllocPtr, *Utf16Str);
+        *Utf16Str = NULL;
+    }
+    return Result;
+}
+
+int ccunicode_CodepointsToUtf16_na(const uint32_t *Codepoints, int CodepointCount, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF16_NA, CodepointCount)
+    int Res = ccunicode_InternalCodepointsToUtf16_na(Codepoints, CodepointCount, Utf16Str, AllocPtr);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_CodepointsToUtf16_m(const uint32_t *Codepoints, uint16_t *Utf16Str, int Utf16Size)
+{
+    int CodepointCount = ccunicode_GetCodepointCount(Codepoints);
+    if (CodepointCount < 0)
+        return CodepointCount;
+
+    return ccunicode_CodepointsToUtf16_nm(Codepoints, CodepointCount, Utf16Str, Utf16Size);
+}
+
+static int ccunicode_InternalCodepointsToUtf16_nm(const uint32_t *Codepoints, int CodepointCount, uint16_t *Utf16Str, int Utf16Size)
+{
+    if (!Codepoints)
+        return CCUNICODE_NULL_POINTER;
+    if (!Utf16Str)
+        return CCUNICODE_NULL_POINTER;
+    if (CodepointCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (Utf16Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    int WritePos = 0;
+    int ReadPos = 0;
+    while ((ReadPos < CodepointCount) && (WritePos < Utf16Size))
+    {
+        uint32_t CurrentCodepoint = Codepoints[ReadPos++];
+
+        if (CurrentCodepoint > 0x10FFFF)
+            return CCUNICODE_INVALID_CODEPOINT;
+        if (CurrentCodepoint >= 0xD800 && CurrentCodepoint <= 0xDFFF)
+            return CCUNICODE_INVALID_CODEPOINT;
+        if (CurrentCodepoint == 0)
+        {
+            Utf16Str[WritePos] = 0;
+            return WritePos;
+        }
+
+        if (CurrentCodepoint >= 1 && CurrentCodepoint <= 0xFFFF)
+        {
+            Utf16Str[WritePos++] = (uint16_t)CurrentCodepoint;
+        }
+
+        if (CurrentCodepoint >= 0x10000 && CurrentCodepoint <= 0x10FFFF)
+        {
+            if (WritePos > Utf16Size-2)
+                return CCUNICODE_BUFFER_TOO_SMALL;
+
+            CurrentCodepoint -= 0x10000;
+            uint16_t HighBits = (uint16_t)((CurrentCodepoint >> 10) & 0x3FF);
+            uint16_t LowBits = (uint16_t)(CurrentCodepoint & 0x3FF);
+
+            Utf16Str[WritePos++] = HighBits + 0xD800;
+            Utf16Str[WritePos++] = LowBits + 0xDC00;
+        }
+    }
+
+    // Reaching the null character right when the buffer is full is not an error
+    if (ReadPos != CodepointCount && Codepoints[ReadPos] != 0)
+        return CCUNICODE_BUFFER_TOO_SMALL;
+
+    Utf16Str[WritePos] = 0;
+    return WritePos;
+}
+
+int ccunicode_CodepointsToUtf16_nm(const uint32_t *Codepoints, int CodepointCount, uint16_t *Utf16Str, int Utf16Size)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF16_NM, CodepointCount)
+    int Res = ccunicode_InternalCodepointsToUtf16_nm(Codepoints, CodepointCount, Utf16Str, Utf16Size);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+// Errors caused by the content of the input
+static int ccunicode_InternalIsInputError(int Res)
+{
+    return Res <= CCUNICODE_INVALID_UTF8_CHARACTER && Res >= CCUNICODE_SURROGATE_PAIR_INVERSION;
+}
+
+// The functions allocating their result validate the input with the count functions first, which can report
+// a different error than the decoding functions for the same input. Only called once decoding failed.
+static int ccunicode_InternalGetUtf8Error(const uint8_t *Utf8Str, int Utf8Size, int Res)
+{
+    int CountRes = ccunicode_CountCodepointsInUtf8_n(Utf8Str, Utf8Size);
+    return CountRes < 0 ? CountRes : Res;
+}
+
+static int ccunicode_InternalGetUtf16Error(const uint16_t *Utf16Str, int Utf16Size, int Res)
+{
+    int CountRes = ccunicode_CountCodepointsInUtf16_n(Utf16Str, Utf16Size);
+    return CountRes < 0 ? CountRes : Res;
+}
+
+#if CCUNICODE_SMALL_STRING_CODEPOINTS < 4
+#error "CCUNICODE_SMALL_STRING_CODEPOINTS must be at least 4"
+#endif
+
+// Number of bytes from Pos holding at most CCUNICODE_SMALL_STRING_CODEPOINTS codepoints, without cutting a character in two.
+// IsLast is set if the window reaches the end of the string or its null character.
+static int ccunicode_InternalGetUtf8Window(const uint8_t *Utf8Str, int Utf8Size, int Pos, int *IsLast)
+{
+    int Window = Utf8Size - Pos;
+    if (Window > CCUNICODE_SMALL_STRING_CODEPOINTS)
+        Window = CCUNICODE_SMALL_STRING_CODEPOINTS;
+
+    // Nothing after the null character may be read: the maximum size can be larger than the buffer
+    for (int i = 0; i < Window; ++i)
+    {
+        if (!Utf8Str[Pos+i])
+        {
+            *IsLast = 1;
+            return i + 1;
+        }
+    }
+
+    // Without a null character in the window, the byte after it is still part of the string
+    *IsLast = (Pos + Window == Utf8Size);
+    if (!*IsLast)
+    {
+        // A character has at most 3 continuation bytes: on invalid input the decoding of the window reports the error
+        for (int i = 0; i < 3 && (Utf8Str[Pos+Window] & 0xC0) == 0x80; ++i)
+            --Window;
+    }
+    return Window;
+}
+
+// Number of shorts from Pos holding at most CCUNICODE_SMALL_STRING_CODEPOINTS codepoints, without cutting a surrogate pair in two.
+// IsLast is set if the window reaches the end of the string or its null character.
+static int ccunicode_InternalGetUtf16Window(const uint16_t *Utf16Str, int Utf16Size, int Pos, int *IsLast)
+{
+    int Window = Utf16Size - Pos;
+    if (Window > CCUNICODE_SMALL_STRING_CODEPOINTS)
+        Window = CCUNICODE_SMALL_STRING_CODEPOINTS;
+
+    // Nothing after the null character may be read: the maximum size can be larger than the buffer
+    for (int i = 0; i < Window; ++i)
+    {
+        if (!Utf16Str[Pos+i])
+        {
+            *IsLast = 1;
+            return i + 1;
+        }
+    }
+
+    // Without a null character in the window, the short after it is still part of the string
+    *IsLast = (Pos + Window == Utf16Size);
+    if (!*IsLast && Utf16Str[Pos+Window] >= 0xDC00 && Utf16Str[Pos+Window] <= 0xDFFF)
+        --Window;
+    return Window;
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_Utf8ToUtf16(const uint8_t *Utf8Str, uint16_t **Utf16Str)
+{
+    return ccunicode_Utf8ToUtf16_a(Utf8Str, Utf16Str, NULL);
+}
+
+int ccunicode_Utf8ToUtf16_n(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_N, Utf8Size)
+    int Res = ccunicode_Utf8ToUtf16_na(Utf8Str, Utf8Size, Utf16Str, NULL);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf8ToUtf16_m(const uint8_t *Utf8Str, uint16_t *Utf16Str, int Utf16Size)
+{
+    return ccunicode_Utf8ToUtf16_ma(Utf8Str, Utf16Str, Utf16Size, NULL);
+}
+
+int ccunicode_Utf8ToUtf16_nm(const uint8_t *Utf8Str, int Utf8Size, uint16_t *Utf16Str, int Utf16Size)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NM, Utf8Size)
+    int Res = ccunicode_Utf8ToUtf16_nma(Utf8Str, Utf8Size, Utf16Str, Utf16Size, NULL);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf8ToUtf16_l(const uint8_t *Utf8Str, uint16_t **Utf16Str, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    return ccunicode_Utf8ToUtf16_la(Utf8Str, Utf16Str, Codepoints, MaxCodepointsCount, NULL);
+}
+
+int ccunicode_Utf8ToUtf16_nl(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NL, Utf8Size)
+    int Res = ccunicode_Utf8ToUtf16_nla(Utf8Str, Utf8Size, Utf16Str, Codepoints, MaxCodepointsCount, NULL);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+#endif
+
+int ccunicode_Utf8ToUtf16_a(const uint8_t *Utf8Str, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    int Utf8Size = ccunicode_GetUtf8StrLen(Utf8Str);
+    if (Utf8Size < 0)
+        return Utf8Size;
+
+    return ccunicode_Utf8ToUtf16_na(Utf8Str, Utf8Size, Utf16Str, AllocPtr);
+}
+
+static int ccunicode_InternalUtf8ToUtf16_na(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    uint32_t *Codepoints = NULL;
+    int CodepointCount = ccunicode_Utf8ToCodepoints_na(Utf8Str, Utf8Size, &Codepoints, AllocPtr);
+    if (CodepointCount < 0)
+        return CodepointCount;
+
+    int Res = ccunicode_CodepointsToUtf16_na(Codepoints, CodepointCount, Utf16Str, AllocPtr);
+    ccunicode_InternalFree(AllocPtr, Codepoints);
+    return Res;
+}
+
+int ccunicode_Utf8ToUtf16_na(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NA, Utf8Size)
+    int Res = ccunicode_InternalUtf8ToUtf16_na(Utf8Str, Utf8Size, Utf16Str, AllocPtr);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf8ToUtf16_ma(const uint8_t *Utf8Str, uint16_t *Utf16Str, int Utf16Size, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    int Utf8Size = ccunicode_GetUtf8StrLen(Utf8Str);
+    if (Utf8Size < 0)
+        return Utf8Size;
+
+    return ccunicode_Utf8ToUtf16_nma(Utf8Str, Utf8Size, Utf16Str, Utf16Size, AllocPtr);
+}
+
+static int ccunicode_InternalUtf8ToUtf16_nma(const uint8_t *Utf8Str, int Utf8Size, uint16_t *Utf16Str, int Utf16Size, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    // Short strings are decoded on the stack and the allocator is only used above the threshold
+    uint32_t SmallCodepoints[CCUNICODE_SMALL_STRING_CODEPOINTS+1];
+    int CodepointCount = ccunicode_Utf8ToCodepoints_nm(Utf8Str, Utf8Size, SmallCodepoints, CCUNICODE_SMALL_STRING_CODEPOINTS);
+    if (CodepointCount >= 0)
+    {
+        CCUNICODE_INTERNAL_SET_VARIANT(CCUNICODE_VARIANT_STACK_BUFFER)
+        return ccunicode_CodepointsToUtf16_nm(SmallCodepoints, CodepointCount, Utf16Str, Utf16Size);
+    }
+    if (ccunicode_InternalIsInputError(CodepointCount))
+        return ccunicode_InternalGetUtf8Error(Utf8Str, Utf8Size, CodepointCount);
+    if (CodepointCount != CCUNICODE_BUFFER_TOO_SMALL)
+        return CodepointCount;
+
+    // Longer strings go through the same buffer one window at a time instead of being copied whole
+    CCUNICODE_INTERNAL_SET_VARIANT(CCUNICODE_VARIANT_STACK_WINDOWS)
+    int ReadPos = 0;
+    int WritePos = 0;
+    int IsLast = 0;
+    int OutputEnded = 0;
+    while (!IsLast && !OutputEnded)
+    {
+        int Window = ccunicode_InternalGetUtf8Window(Utf8Str, Utf8Size, ReadPos, &IsLast);
+
+        int Res = ccunicode_InternalUtf8ToCodepoints_nm(Utf8Str + ReadPos, Window, SmallCodepoints, CCUNICODE_SMALL_STRING_CODEPOINTS);
+        if (Res >= 0)
+        {
+            // An overlong null character also ends the output
+            for (int i = 0; i < Res && !OutputEnded; ++i)
+                OutputEnded = SmallCodepoints[i] == 0;
+            Res = ccunicode_InternalCodepointsToUtf16_nm(SmallCodepoints, Res, Utf16Str + WritePos, Utf16Size - WritePos);
+        }
+        // Invalid input further on takes precedence, as when the whole string was decoded first
+        if (Res < 0)
+            return ccunicode_InternalGetUtf8Error(Utf8Str, Utf8Size, Res);
+
+        ReadPos += Window;
+        WritePos += Res;
+    }
+    // The input after an overlong null character is not converted but must still be valid
+    if (OutputEnded && !IsLast)
+        return ccunicode_InternalGetUtf8Error(Utf8Str, Utf8Size, WritePos);
+    return WritePos;
+}
+
+int ccunicode_Utf8ToUtf16_nma(const uint8_t *Utf8Str, int Utf8Size, uint16_t *Utf16Str, int Utf16Size, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NMA, Utf8Size)
+    int Res = ccunicode_InternalUtf8ToUtf16_nma(Utf8Str, Utf8Size, Utf16Str, Utf16Size, AllocPtr);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf8ToUtf16_la(const uint8_t *Utf8Str, uint16_t **Utf16Str, uint32_t *Codepoints, int MaxCodepointsCount, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    int Utf8Size = ccunicode_GetUtf8StrLen(Utf8Str);
+    if (Utf8Size < 0)
+        return Utf8Size;
+
+    return ccunicode_Utf8ToUtf16_nla(Utf8Str, Utf8Size, Utf16Str, Codepoints, MaxCodepointsCount, AllocPtr);
+}
+
+static int ccunicode_InternalUtf8ToUtf16_nla(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, uint32_t *Codepoints, int MaxCodepointsCount, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    int Res = ccunicode_Utf8ToCodepoints_nm(Utf8Str, Utf8Size, Codepoints, MaxCodepointsCount);
+    if (Res < 0)
+        return Res;
+
+    return ccunicode_CodepointsToUtf16_na(Codepoints, MaxCodepointsCount, Utf16Str, AllocPtr);
+}
+
+int ccunicode_Utf8ToUtf16_nla(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, uint32_t *Codepoints, int MaxCodepointsCount, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NLA, Utf8Size)
+    int Res = ccunicode_InternalUtf8ToUtf16_nla(Utf8Str, Utf8Size, Utf16Str, Codepoints, MaxCodepointsCount, AllocPtr);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf8ToUtf16_ml(const uint8_t *Utf8Str, uint16_t *Utf16Str, int Utf16Size, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    int Utf8Size = ccunicode_GetUtf8StrLen(Utf8Str);
+    if (Utf8Size < 0)
+        return Utf8Size;
+
+    return ccunicode_Utf8ToUtf16_nml(Utf8Str, Utf8Size, Utf16Str, Utf16Size, Codepoints, MaxCodepointsCount);
+}
+
+static int ccunicode_InternalUtf8ToUtf16_nml(const uint8_t *Utf8Str, int Utf8Size, uint16_t *Utf16Str, int Utf16Size, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    int Res = ccunicode_Utf8ToCodepoints_nm(Utf8Str, Utf8Size, Codepoints, MaxCodepointsCount);
+    if (Res < 0)
+        return Res;
+
+    return ccunicode_CodepointsToUtf16_nm(Codepoints, MaxCodepointsCount, Utf16Str, Utf16Size);
+}
+
+int ccunicode_Utf8ToUtf16_nml(const uint8_t *Utf8Str, int Utf8Size, uint16_t *Utf16Str, int Utf16Size, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NML, Utf8Size)
+    int Res = ccunicode_InternalUtf8ToUtf16_nml(Utf8Str, Utf8Size, Utf16Str, Utf16Size, Codepoints, MaxCodepointsCount);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_Utf16ToUtf8(const uint16_t *Utf16Str, uint8_t **Utf8Str)
+{
+    return ccunicode_Utf16ToUtf8_a(Utf16Str, Utf8Str, NULL);
+}
+
+int ccunicode_Utf16ToUtf8_n(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_N, Utf16Size)
+    int Res = ccunicode_Utf16ToUtf8_na(Utf16Str, Utf16Size, Utf8Str, NULL);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf16ToUtf8_m(const uint16_t *Utf16Str, uint8_t *Utf8Str, int Utf8Size)
+{
+    return ccunicode_Utf16ToUtf8_ma(Utf16Str, Utf8Str, Utf8Size, NULL);
+}
+
+int ccunicode_Utf16ToUtf8_nm(const uint16_t *Utf16Str, int Utf16Size, uint8_t *Utf8Str, int Utf8Size)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_NM, Utf16Size)
+    int Res = ccunicode_Utf16ToUtf8_nma(Utf16Str, Utf16Size, Utf8Str, Utf8Size, NULL);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf16ToUtf8_l(const uint16_t *Utf16Str, uint8_t **Utf8Str, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    return ccunicode_Utf16ToUtf8_la(Utf16Str, Utf8Str, Codepoints, MaxCodepointsCount, NULL);
+}
+
+int ccunicode_Utf16ToUtf8_nl(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_NL, Utf16Size)
+    int Res = ccunicode_Utf16ToUtf8_nla(Utf16Str, Utf16Size, Utf8Str, Codepoints, MaxCodepointsCount, NULL);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+#endif
+
+int ccunicode_Utf16ToUtf8_a(const uint16_t *Utf16Str, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    int Utf16Size = ccunicode_GetUtf16StrLen(Utf16Str);
+    if (Utf16Size < 0)
+        return Utf16Size;
+
+    return ccunicode_Utf16ToUtf8_na(Utf16Str, Utf16Size, Utf8Str, AllocPtr);
+}
+
+static int ccunicode_InternalUtf16ToUtf8_na(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    uint32_t *Codepoints = NULL;
+    int CodepointCount = ccunicode_Utf16ToCodepoints_na(Utf16Str, Utf16Size, &Codepoints, AllocPtr);
+    if (CodepointCount < 0)
+        return CodepointCount;
+
+    int Res = ccunicode_CodepointsToUtf8_na(Codepoints, CodepointCount, Utf8Str, AllocPtr);
+    ccunicode_InternalFree(AllocPtr, Codepoints);
+    return Res;
+}
+
+int ccunicode_Utf16ToUtf8_na(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_NA, Utf16Size)
+    int Res = ccunicode_InternalUtf16ToUtf8_na(Utf16Str, Utf16Size, Utf8Str, AllocPtr);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf16ToUtf8_ma(const uint16_t *Utf16Str, uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    int Utf16Size = ccunicode_GetUtf16StrLen(Utf16Str);
+    if (Utf16Size < 0)
+        return Utf16Size;
+
+    return ccunicode_Utf16ToUtf8_nma(Utf16Str, Utf16Size, Utf8Str, Utf8Size, AllocPtr);
+}
+
+static int ccunicode_InternalUtf16ToUtf8_nma(const uint16_t *Utf16Str, int Utf16Size, uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    // Short strings are decoded on the stack and the allocator is only used above the threshold
+    uint32_t SmallCodepoints[CCUNICODE_SMALL_STRING_CODEPOINTS+1];
+    int CodepointCount = ccunicode_Utf16ToCodepoints_nm(Utf16Str, Utf16Size, SmallCodepoints, CCUNICODE_SMALL_STRING_CODEPOINTS);
+    if (CodepointCount >= 0)
+    {
+        CCUNICODE_INTERNAL_SET_VARIANT(CCUNICODE_VARIANT_STACK_BUFFER)
+        return ccunicode_CodepointsToUtf8_nm(SmallCodepoints, CodepointCount, Utf8Str, Utf8Size);
+    }
+    if (ccunicode_InternalIsInputError(CodepointCount))
+        return ccunicode_InternalGetUtf16Error(Utf16Str, Utf16Size, CodepointCount);
+    if (CodepointCount != CCUNICODE_BUFFER_TOO_SMALL)
+        return CodepointCount;
+
+    // Longer strings go through the same buffer one window at a time instead of being copied whole
+    CCUNICODE_INTERNAL_SET_VARIANT(CCUNICODE_VARIANT_STACK_WINDOWS)
+    int ReadPos = 0;
+    int WritePos = 0;
+    int IsLast = 0;
+    while (!IsLast)
+    {
+        int Window = ccunicode_InternalGetUtf16Window(Utf16Str, Utf16Size, ReadPos, &IsLast);
+
+        int Res = ccunicode_InternalUtf16ToCodepoints_nm(Utf16Str + ReadPos, Window, SmallCodepoints, CCUNICODE_SMALL_STRING_CODEPOINTS);
+        if (Res >= 0)
+            Res = ccunicode_InternalCodepointsToUtf8_nm(SmallCodepoints, Res, Utf8Str + WritePos, Utf8Size - WritePos);
+        // Invalid input further on takes precedence, as when the whole string was decoded first
+        if (Res < 0)
+            return ccunicode_InternalGetUtf16Error(Utf16Str, Utf16Size, Res);
+
+        ReadPos += Window;
+        WritePos += Res;
+    }
+    return WritePos;
+}
+
+int ccunicode_Utf16ToUtf8_nma(const uint16_t *Utf16Str, int Utf16Size, uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_NMA, Utf16Size)
+    int Res = ccunicode_InternalUtf16ToUtf8_nma(Utf16Str, Utf16Size, Utf8Str, Utf8Size, AllocPtr);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf16ToUtf8_la(const uint16_t *Utf16Str, uint8_t **Utf8Str, uint32_t *Codepoints, int MaxCodepointsCount, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    int Utf16Size = ccunicode_GetUtf16StrLen(Utf16Str);
+    if (Utf16Size < 0)
+        return Utf16Size;
+
+    return ccunicode_Utf16ToUtf8_nla(Utf16Str, Utf16Size, Utf8Str, Codepoints, MaxCodepointsCount, AllocPtr);
+}
+
+static int ccunicode_InternalUtf16ToUtf8_nla(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, uint32_t *Codepoints, int MaxCodepointsCount, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    int Res = ccunicode_Utf16ToCodepoints_nm(Utf16Str, Utf16Size, Codepoints, MaxCodepointsCount);
+    if (Res < 0)
+        return Res;
+
+    return ccunicode_CodepointsToUtf8_na(Codepoints, MaxCodepointsCount, Utf8Str, AllocPtr);
+}
+
+int ccunicode_Utf16ToUtf8_nla(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, uint32_t *Codepoints, int MaxCodepointsCount, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_NLA, Utf16Size)
+    int Res = ccunicode_InternalUtf16ToUtf8_nla(Utf16Str, Utf16Size, Utf8Str, Codepoints, MaxCodepointsCount, AllocPtr);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf16ToUtf8_ml(const uint16_t *Utf16Str, uint8_t *Utf8Str, int Utf8Size, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    int Utf16Size = ccunicode_GetUtf16StrLen(Utf16Str);
+    if (Utf16Size < 0)
+        return Utf16Size;
+
+    return ccunicode_Utf16ToUtf8_nml(Utf16Str, Utf16Size, Utf8Str, Utf8Size, Codepoints, MaxCodepointsCount);
+}
+
+static int ccunicode_InternalUtf16ToUtf8_nml(const uint16_t *Utf16Str, int Utf16Size, uint8_t *Utf8Str, int Utf8Size, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    int Res = ccunicode_Utf16ToCodepoints_nm(Utf16Str, Utf16Size, Codepoints, MaxCodepointsCount);
+    if (Res < 0)
+        return Res;
+
+    return ccunicode_CodepointsToUtf8_nm(Codepoints, MaxCodepointsCount, Utf8Str, Utf8Size);
+}
+
+int ccunicode_Utf16ToUtf8_nml(const uint16_t *Utf16Str, int Utf16Size, uint8_t *Utf8Str, int Utf8Size, uint32_t *Codepoints, int MaxCodepointsCount)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_NML, Utf16Size)
+    int Res = ccunicode_InternalUtf16ToUtf8_nml(Utf16Str, Utf16Size, Utf8Str, Utf8Size, Codepoints, MaxCodepointsCount);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+// Chunk status meaning that the string (or the codepoints list) ended with a null character inside the chunk
+#define CCUNICODE_INTERNAL_CHUNK_ENDED 1
+
+typedef struct
+{
+    int Begin;          // Position of the first code unit of the chunk
+    int End;            // Position one past the last code unit that may start a character of the chunk
+    int Count;          // Number of characters validated before CountStatus was set
+    int CountStatus;    // CCUNICODE_NO_ERROR, CCUNICODE_INTERNAL_CHUNK_ENDED or the validation error
+    int64_t Units;      // Number of output code units needed before EncodeStatus was set
+    int EncodeStatus;   // CCUNICODE_NO_ERROR, CCUNICODE_INTERNAL_CHUNK_ENDED or the encoding error
+    int64_t Offset;     // Position of the chunk in the output (prefix sum of the previous Units)
+} TCCUnicode_InternalChunk;
+
+typedef struct
+{
+    const void *Src;
+    int SrcSize;
+    void *Dest;
+    int ChunkCount;
+    int LastChunk;      // Last chunk contributing to the output
+    TCCUnicode_InternalChunk Chunks[CCUNICODE_MAX_THREADS];
+} TCCUnicode_InternalParallelJob;
+
+#ifdef __CCUNICODE_PTHREADS__
+typedef struct
+{
+    void (*TaskFunc)(void*, int);
+    void *TaskData;
+    int TaskIndex;
+} TCCUnicode_InternalThreadArg;
+
+static void *ccunicode_InternalThreadMain(void *Arg)
+{
+    TCCUnicode_InternalThreadArg *ThreadArg = (TCCUnicode_InternalThreadArg*)Arg;
+    ThreadArg->TaskFunc(ThreadArg->TaskData, ThreadArg->TaskIndex);
+    return NULL;
+}
+#endif
+
+static void ccunicode_InternalRunTasks(const TCCUnicode_ThreadPool *Pool, void (*TaskFunc)(void*, int), void *TaskData, int TaskCount)
+{
+    if (TaskCount == 1)
+    {
+        TaskFunc(TaskData, 0);
+        return;
+    }
+
+    if (Pool && Pool->run_func)
+    {
+        Pool->run_func(Pool->pool_data, TaskFunc, TaskData, TaskCount);
+        return;
+    }
+
+#ifdef __CCUNICODE_PTHREADS__
+    pthread_t Threads[CCUNICODE_MAX_THREADS];
+    TCCUnicode_InternalThreadArg Args[CCUNICODE_MAX_THREADS];
+    int Started[CCUNICODE_MAX_THREADS];
+
+    // The first task is kept for the calling thread
+    for (int i = 1; i < TaskCount; ++i)
+    {
+        Args[i].TaskFunc = TaskFunc;
+        Args[i].TaskData = TaskData;
+        Args[i].TaskIndex = i;
+        Started[i] = !pthread_create(&Threads[i], NULL, &ccunicode_InternalThreadMain, &Args[i]);
+    }
+
+    TaskFunc(TaskData, 0);
+
+    for (int i = 1; i < TaskCount; ++i)
+    {
+        // If a thread could not be created, we just do its work ourselves
+        if (Started[i])
+            pthread_join(Threads[i], NULL);
+        else
+            TaskFunc(TaskData, i);
+    }
+#else
+    for (int i = 0; i < TaskCount; ++i)
+        TaskFunc(TaskData, i);
+#endif
+}
+
+static int ccunicode_InternalGetTaskCount(const TCCUnicode_ThreadPool *Pool, int WorkSize, int MinTaskSize)
+{
+    if (!Pool || Pool->thread_count < 2)
+        return 1;
+
+    int TaskCount = Pool->thread_count;
+    if (TaskCount > CCUNICODE_MAX_THREADS)
+        TaskCount = CCUNICODE_MAX_THREADS;
+    if (TaskCount > WorkSize / MinTaskSize)
+        TaskCount = WorkSize / MinTaskSize;
+    if (TaskCount < 1)
+        TaskCount = 1;
+
+    return TaskCount;
+}
+
+static void ccunicode_InternalScanUtf8(const uint8_t *Utf8Str, int Utf8Size, TCCUnicode_InternalChunk *Chunk)
+{
+    Chunk->Count = 0;
+    Chunk->CountStatus = CCUNICODE_NO_ERROR;
+    Chunk->Units = 0;
+    Chunk->EncodeStatus = CCUNICODE_NO_ERROR;
+
+    // Same rules as ccunicode_CountCodepointsInUtf8_n, except the last character
+    // of the chunk may read past End. It is then an error as the byte at End is never an extension.
+    int Pos = Chunk->Begin;
+    while (Pos < Chunk->End)
+    {
+        uint8_t CurrentByte = Utf8Str[Pos];
+
+        if (CurrentByte == 0x00)
+        {
+            Chunk->CountStatus = CCUNICODE_INTERNAL_CHUNK_ENDED;
+            return;
+        }
+        if ((CurrentByte >= 0x80 && CurrentByte <= 0xBF) || CurrentByte >= 0xF8)
+        {
+            Chunk->CountStatus = CCUNICODE_INVALID_UTF8_CHARACTER;
+            return;
+        }
+
+        uint32_t CodePoint = CurrentByte;
+        int RemainingBytes = 0;
+        if (CurrentByte >= 0xC0 && CurrentByte <= 0xDF)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0x1F);
+            RemainingBytes = 1;
+        }
+        if (CurrentByte >= 0xE0 && CurrentByte <= 0xEF)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0xF);
+            RemainingBytes = 2;
+        }
+        if (CurrentByte >= 0xF0 && CurrentByte <= 0xF7)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0x7);
+            RemainingBytes = 3;
+        }
+
+        if (Pos + RemainingBytes >= Utf8Size)
+        {
+            Chunk->CountStatus = CCUNICODE_STRING_ENDED_IN_CHARACTER;
+            return;
+        }
+
+        for (int j = 0; j < RemainingBytes; ++j)
+        {
+            CurrentByte = Utf8Str[++Pos];
+
+            if (CurrentByte == 0)
+            {
+                Chunk->CountStatus = CCUNICODE_STRING_ENDED_IN_CHARACTER;
+                return;
+            }
+            if (CurrentByte < 0x80 || CurrentByte > 0xBF)
+            {
+                Chunk->CountStatus = CCUNICODE_INVALID_UTF8_CHARACTER;
+                return;
+            }
+
+            CodePoint = (CodePoint << 6) + (uint32_t)(CurrentByte & 0x3F);
+        }
+        ++Pos;
+        ++Chunk->Count;
+
+        // Same rules as ccunicode_CodepointsToUtf16_nm. Validation goes on after the encoding stopped
+        // as the serial functions validate the whole string before encoding anything.
+        if (Chunk->EncodeStatus != CCUNICODE_NO_ERROR)
+            continue;
+        if (CodePoint > 0x10FFFF || (CodePoint >= 0xD800 && CodePoint <= 0xDFFF))
+            Chunk->EncodeStatus = CCUNICODE_INVALID_CODEPOINT;
+        else if (CodePoint == 0)
+            Chunk->EncodeStatus = CCUNICODE_INTERNAL_CHUNK_ENDED;
+        else
+            Chunk->Units += (CodePoint >= 0x10000) ? 2 : 1;
+    }
+}
+
+static void ccunicode_InternalScanUtf8Task(void *Data, int Index)
+{
+    TCCUnicode_InternalParallelJob *Job = (TCCUnicode_InternalParallelJob*)Data;
+    ccunicode_InternalScanUtf8((const uint8_t*)Job->Src, Job->SrcSize, &Job->Chunks[Index]);
+}
+
+// Writes the Units first code units of the chunk to Utf16Str
+static void ccunicode_InternalWriteUtf16(const uint8_t *Utf8Str, const TCCUnicode_InternalChunk *Chunk, uint16_t *Utf16Str)
+{
+    // The chunk has already been validated, so we only decode
+    int ReadPos = Chunk->Begin;
+    int64_t WritePos = 0;
+    while (WritePos < Chunk->Units)
+    {
+        uint8_t CurrentByte = Utf8Str[ReadPos++];
+
+        uint32_t CodePoint = CurrentByte;
+        int RemainingBytes = 0;
+        if (CurrentByte >= 0xF0)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0x7);
+            RemainingBytes = 3;
+        }
+        else if (CurrentByte >= 0xE0)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0xF);
+            RemainingBytes = 2;
+        }
+        else if (CurrentByte >= 0xC0)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0x1F);
+            RemainingBytes = 1;
+        }
+
+        for (int j = 0; j < RemainingBytes; ++j)
+            CodePoint = (CodePoint << 6) + (uint32_t)(Utf8Str[ReadPos++] & 0x3F);
+
+        if (CodePoint < 0x10000)
+        {
+            Utf16Str[WritePos++] = (uint16_t)CodePoint;
+        }
+        else
+        {
+            CodePoint -= 0x10000;
+            Utf16Str[WritePos++] = (uint16_t)((CodePoint >> 10) & 0x3FF) + 0xD800;
+            Utf16Str[WritePos++] = (uint16_t)(CodePoint & 0x3FF) + 0xDC00;
+        }
+    }
+}
+
+static void ccunicode_InternalWriteUtf16Task(void *Data, int Index)
+{
+    TCCUnicode_InternalParallelJob *Job = (TCCUnicode_InternalParallelJob*)Data;
+    if (Index > Job->LastChunk)
+        return;
+
+    const TCCUnicode_InternalChunk *Chunk = &Job->Chunks[Index];
+    ccunicode_InternalWriteUtf16((const uint8_t*)Job->Src, Chunk, (uint16_t*)Job->Dest + Chunk->Offset);
+}
+
+static void ccunicode_InternalScanUtf16(const uint16_t *Utf16Str, int Utf16Size, TCCUnicode_InternalChunk *Chunk)
+{
+    Chunk->Count = 0;
+    Chunk->CountStatus = CCUNICODE_NO_ERROR;
+    Chunk->Units = 0;
+    Chunk->EncodeStatus = CCUNICODE_NO_ERROR;
+
+    // Same rules as ccunicode_CountCodepointsInUtf16_n, except the last character
+    // of the chunk may read past End. It is then an error as the short at End is never a low surrogate.
+    int Pos = Chunk->Begin;
+    while (Pos < Chunk->End)
+    {
+        uint16_t CurrentCodeUnit = Utf16Str[Pos++];
+        uint32_t CodePoint = CurrentCodeUnit;
+
+        if (CurrentCodeUnit >= 0xD800 && CurrentCodeUnit <= 0xDFFF)
+        {
+            if (CurrentCodeUnit >= 0xDC00)
+            {
+                Chunk->CountStatus = CCUNICODE_SURROGATE_PAIR_INVERSION;
+                return;
+            }
+            if (Pos == Utf16Size)
+            {
+                Chunk->CountStatus = CCUNICODE_STRING_ENDED_IN_CHARACTER;
+                return;
+            }
+
+            uint16_t HighBits = CurrentCodeUnit - 0xD800;
+
+            CurrentCodeUnit = Utf16Str[Pos++];
+            if (CurrentCodeUnit == 0)
+            {
+                Chunk->CountStatus = CCUNICODE_STRING_ENDED_IN_CHARACTER;
+                return;
+            }
+            if (CurrentCodeUnit < 0xDC00 || CurrentCodeUnit > 0xDFFF)
+            {
+                Chunk->CountStatus = CCUNICODE_INVALID_UTF16_CHARACTER;
+                return;
+            }
+
+            CodePoint = ((uint32_t)(HighBits) << 10) + (uint32_t)(CurrentCodeUnit - 0xDC00) + 0x10000;
+        }
+        else if (CurrentCodeUnit == 0)
+        {
+            Chunk->CountStatus = CCUNICODE_INTERNAL_CHUNK_ENDED;
+            return;
+        }
+
+        ++Chunk->Count;
+
+        // Decoded UTF16 never holds an invalid or a null codepoint, so the encoding never stops
+        if (CodePoint <= 0x7F)
+            Chunk->Units += 1;
+        else if (CodePoint <= 0x7FF)
+            Chunk->Units += 2;
+        else if (CodePoint <= 0xFFFF)
+            Chunk->Units += 3;
+        else
+            Chunk->Units += 4;
+    }
+}
+
+static void ccunicode_InternalScanUtf16Task(void *Data, int Index)
+{
+    TCCUnicode_InternalParallelJob *Job = (TCCUnicode_InternalParallelJob*)Data;
+    ccunicode_InternalScanUtf16((const uint16_t*)Job->Src, Job->SrcSize, &Job->Chunks[Index]);
+}
+
+// Writes the Units first code units of the chunk to Utf8Str
+static void ccunicode_InternalWriteUtf8(const uint16_t *Utf16Str, const TCCUnicode_InternalChunk *Chunk, uint8_t *Utf8Str)
+{
+    // The chunk has already been validated, so we only decode
+    int ReadPos = Chunk->Begin;
+    int64_t WritePos = 0;
+    while (WritePos < Chunk->Units)
+    {
+        uint32_t CodePoint = Utf16Str[ReadPos++];
+        if (CodePoint >= 0xD800 && CodePoint <= 0xDBFF)
+            CodePoint = ((CodePoint - 0xD800) << 10) + (uint32_t)(Utf16Str[ReadPos++] - 0xDC00) + 0x10000;
+
+        if (CodePoint <= 0x7F)
+        {
+            Utf8Str[WritePos++] = (uint8_t)CodePoint;
+        }
+        else if (CodePoint <= 0x7FF)
+        {
+            Utf8Str[WritePos++] = 0xC0 + (uint8_t)((CodePoint >> 6) & 0x1F);
+            Utf8Str[WritePos++] = 0x80 + (uint8_t)(CodePoint & 0x3F);
+        }
+        else if (CodePoint <= 0xFFFF)
+        {
+            Utf8Str[WritePos++] = 0xE0 + (uint8_t)((CodePoint >> 12) & 0xF);
+            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CodePoint >> 6) & 0x3F);
+            Utf8Str[WritePos++] = 0x80 + (uint8_t)(CodePoint & 0x3F);
+        }
+        else
+        {
+            Utf8Str[WritePos++] = 0xF0 + (uint8_t)((CodePoint >> 18) & 0x7);
+            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CodePoint >> 12) & 0x3F);
+            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CodePoint >> 6) & 0x3F);
+            Utf8Str[WritePos++] = 0x80 + (uint8_t)(CodePoint & 0x3F);
+        }
+    }
+}
+
+static void ccunicode_InternalWriteUtf8Task(void *Data, int Index)
+{
+    TCCUnicode_InternalParallelJob *Job = (TCCUnicode_InternalParallelJob*)Data;
+    if (Index > Job->LastChunk)
+        return;
+
+    const TCCUnicode_InternalChunk *Chunk = &Job->Chunks[Index];
+    ccunicode_InternalWriteUtf8((const uint16_t*)Job->Src, Chunk, (uint8_t*)Job->Dest + Chunk->Offset);
+}
+
+// Merges the chunk results in string order, the way the serial functions process the whole string:
+// first the validation of every character up to the null character, then the encoding.
+static int ccunicode_InternalResolveChunks(TCCUnicode_InternalChunk *Chunks, int ChunkCount, int *LastChunk, int64_t *Units, int *StopStatus)
+{
+    int64_t CodepointCount = 0;
+    *LastChunk = ChunkCount-1;
+    for (int i = 0; i < ChunkCount; ++i)
+    {
+        const TCCUnicode_InternalChunk *Chunk = &Chunks[i];
+
+        CodepointCount += Chunk->Count;
+        if (Chunk->CountStatus < 0)
+            return Chunk->CountStatus;
+        if (Chunk->CountStatus == CCUNICODE_INTERNAL_CHUNK_ENDED)
+        {
+            *LastChunk = i;
+            break;
+        }
+    }
+
+    // The serial functions need to fit the codepoints in an intermediate buffer
+    if (CodepointCount+1 > (int64_t)(INT_MAX/sizeof(uint32_t)))
+        return CCUNICODE_OVERFLOW;
+
+    *Units = 0;
+    *StopStatus = CCUNICODE_NO_ERROR;
+    for (int i = 0; i <= *LastChunk; ++i)
+    {
+        TCCUnicode_InternalChunk *Chunk = &Chunks[i];
+
+        Chunk->Offset = *Units;
+        *Units += Chunk->Units;
+        if (Chunk->EncodeStatus != CCUNICODE_NO_ERROR)
+        {
+            *StopStatus = Chunk->EncodeStatus;
+            *LastChunk = i;
+            break;
+        }
+    }
+
+    return CCUNICODE_NO_ERROR;
+}
+
+// Reproduces the buffer checks of ccunicode_CodepointsToUtf8_nm and ccunicode_CodepointsToUtf16_nm:
+// an invalid codepoint is only reached if there is still room left in the buffer.
+static int ccunicode_InternalCheckOutputSize(int64_t Units, int StopStatus, int OutputSize)
+{
+    if (StopStatus >= CCUNICODE_NO_ERROR)
+        return (Units <= OutputSize) ? CCUNICODE_NO_ERROR : CCUNICODE_BUFFER_TOO_SMALL;
+
+    return (Units < OutputSize) ? StopStatus : CCUNICODE_BUFFER_TOO_SMALL;
+}
+
+// Reproduces the checks of ccunicode_CodepointsToUtf8_na and ccunicode_CodepointsToUtf16_na
+// before the output is allocated. Returns the size of the output.
+static int ccunicode_InternalGetAllocatedSize(int64_t Units, int StopStatus, size_t UnitSize)
+{
+    // Sizing the output already fails on invalid codepoints
+    if (StopStatus < 0)
+        return StopStatus;
+    if (Units >= INT_MAX)
+        return CCUNICODE_OVERFLOW;
+    if (Units+1 > (int64_t)(INT_MAX/UnitSize))
+        return CCUNICODE_OVERFLOW;
+
+    return (int)Units;
+}
+
+static int ccunicode_InternalPlanUtf8ToUtf16(const uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_ThreadPool *Pool,
+                                             TCCUnicode_InternalParallelJob *Job, int64_t *Units, int *StopStatus)
+{
+    if (!Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    Job->Src = Utf8Str;
+    Job->SrcSize = Utf8Size;
+    Job->ChunkCount = ccunicode_InternalGetTaskCount(Pool, Utf8Size, CCUNICODE_PARALLEL_MIN_CHUNK);
+    if (Job->ChunkCount > 1)
+        CCUNICODE_INTERNAL_SET_VARIANT(CCUNICODE_VARIANT_PARALLEL)
+
+    // Chunks are cut just before a byte that can not be an extension
+    int Begin = 0;
+    for (int i = 0; i < Job->ChunkCount; ++i)
+    {
+        int End = (int)(((int64_t)Utf8Size * (i+1)) / Job->ChunkCount);
+        if (End < Begin)
+            End = Begin;
+        while (End < Utf8Size && Utf8Str[End] >= 0x80 && Utf8Str[End] <= 0xBF)
+            ++End;
+
+        Job->Chunks[i].Begin = Begin;
+        Job->Chunks[i].End = End;
+        Begin = End;
+    }
+
+    ccunicode_InternalRunTasks(Pool, &ccunicode_InternalScanUtf8Task, Job, Job->ChunkCount);
+    return ccunicode_InternalResolveChunks(Job->Chunks, Job->ChunkCount, &Job->LastChunk, Units, StopStatus);
+}
+
+static int ccunicode_InternalPlanUtf16ToUtf8(const uint16_t *Utf16Str, int Utf16Size, const TCCUnicode_ThreadPool *Pool,
+                                             TCCUnicode_InternalParallelJob *Job, int64_t *Units, int *StopStatus)
+{
+    if (!Utf16Str)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf16Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    Job->Src = Utf16Str;
+    Job->SrcSize = Utf16Size;
+    Job->ChunkCount = ccunicode_InternalGetTaskCount(Pool, Utf16Size, CCUNICODE_PARALLEL_MIN_CHUNK);
+    if (Job->ChunkCount > 1)
+        CCUNICODE_INTERNAL_SET_VARIANT(CCUNICODE_VARIANT_PARALLEL)
+
+    // Chunks are cut just before a short that is not a low surrogate
+    int Begin = 0;
+    for (int i = 0; i < Job->ChunkCount; ++i)
+    {
+        int End = (int)(((int64_t)Utf16Size * (i+1)) / Job->ChunkCount);
+        if (End < Begin)
+            End = Begin;
+        while (End < Utf16Size && Utf16Str[End] >= 0xDC00 && Utf16Str[End] <= 0xDFFF)
+            ++End;
+
+        Job->Chunks[i].Begin = Begin;
+        Job->Chunks[i].End = End;
+        Begin = End;
+    }
+
+    ccunicode_InternalRunTasks(Pool, &ccunicode_InternalScanUtf16Task, Job, Job->ChunkCount);
+    return ccunicode_InternalResolveChunks(Job->Chunks, Job->ChunkCount, &Job->LastChunk, Units, StopStatus);
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_Utf8ToUtf16_np(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NP, Utf8Size)
+    int Res = ccunicode_Utf8ToUtf16_nap(Utf8Str, Utf8Size, Utf16Str, NULL, Pool);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+#endif
+
+static int ccunicode_InternalUtf8ToUtf16_nap(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    TCCUnicode_InternalParallelJob Job;
+    int64_t Units = 0;
+    int StopStatus = CCUNICODE_NO_ERROR;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalPlanUtf8ToUtf16(Utf8Str, Utf8Size, Pool, &Job, &Units, &StopStatus))
+
+    if (!Utf16Str)
+        return CCUNICODE_NULL_POINTER;
+    int Utf16Size = ccunicode_InternalGetAllocatedSize(Units, StopStatus, sizeof(**Utf16Str));
+    if (Utf16Size < 0)
+        return Utf16Size;
+
+    *Utf16Str = ccunicode_InternalMalloc(AllocPtr, (Utf16Size+1)*sizeof(**Utf16Str));
+    if (!(*Utf16Str))
+        return CCUNICODE_BAD_ALLOCATION;
+
+    Job.Dest = *Utf16Str;
+    ccunicode_InternalRunTasks(Pool, &ccunicode_InternalWriteUtf16Task, &Job, Job.ChunkCount);
+    (*Utf16Str)[Utf16Size] = 0;
+    return Utf16Size;
+}
+
+int ccunicode_Utf8ToUtf16_nap(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NAP, Utf8Size)
+    int Res = ccunicode_InternalUtf8ToUtf16_nap(Utf8Str, Utf8Size, Utf16Str, AllocPtr, Pool);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+static int ccunicode_InternalUtf8ToUtf16_nmp(const uint8_t *Utf8Str, int Utf8Size, uint16_t *Utf16Str, int Utf16Size, const TCCUnicode_ThreadPool *Pool)
+{
+    TCCUnicode_InternalParallelJob Job;
+    int64_t Units = 0;
+    int StopStatus = CCUNICODE_NO_ERROR;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalPlanUtf8ToUtf16(Utf8Str, Utf8Size, Pool, &Job, &Units, &StopStatus))
+
+    if (!Utf16Str)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf16Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckOutputSize(Units, StopStatus, Utf16Size))
+
+    Job.Dest = Utf16Str;
+    ccunicode_InternalRunTasks(Pool, &ccunicode_InternalWriteUtf16Task, &Job, Job.ChunkCount);
+    Utf16Str[Units] = 0;
+    return (int)Units;
+}
+
+int ccunicode_Utf8ToUtf16_nmp(const uint8_t *Utf8Str, int Utf8Size, uint16_t *Utf16Str, int Utf16Size, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NMP, Utf8Size)
+    int Res = ccunicode_InternalUtf8ToUtf16_nmp(Utf8Str, Utf8Size, Utf16Str, Utf16Size, Pool);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_Utf16ToUtf8_np(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_NP, Utf16Size)
+    int Res = ccunicode_Utf16ToUtf8_nap(Utf16Str, Utf16Size, Utf8Str, NULL, Pool);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+#endif
+
+static int ccunicode_InternalUtf16ToUtf8_nap(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    TCCUnicode_InternalParallelJob Job;
+    int64_t Units = 0;
+    int StopStatus = CCUNICODE_NO_ERROR;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalPlanUtf16ToUtf8(Utf16Str, Utf16Size, Pool, &Job, &Units, &StopStatus))
+
+    if (!Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+    int Utf8Size = ccunicode_InternalGetAllocatedSize(Units, StopStatus, sizeof(**Utf8Str));
+    if (Utf8Size < 0)
+        return Utf8Size;
+
+    *Utf8Str = ccunicode_InternalMalloc(AllocPtr, (Utf8Size+1)*sizeof(**Utf8Str));
+    if (!(*Utf8Str))
+        return CCUNICODE_BAD_ALLOCATION;
+
+    Job.Dest = *Utf8Str;
+    ccunicode_InternalRunTasks(Pool, &ccunicode_InternalWriteUtf8Task, &Job, Job.ChunkCount);
+    (*Utf8Str)[Utf8Size] = 0;
+    return Utf8Size;
+}
+
+int ccunicode_Utf16ToUtf8_nap(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_NAP, Utf16Size)
+    int Res = ccunicode_InternalUtf16ToUtf8_nap(Utf16Str, Utf16Size, Utf8Str, AllocPtr, Pool);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+static int ccunicode_InternalUtf16ToUtf8_nmp(const uint16_t *Utf16Str, int Utf16Size, uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_ThreadPool *Pool)
+{
+    TCCUnicode_InternalParallelJob Job;
+    int64_t Units = 0;
+    int StopStatus = CCUNICODE_NO_ERROR;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalPlanUtf16ToUtf8(Utf16Str, Utf16Size, Pool, &Job, &Units, &StopStatus))
+
+    if (!Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckOutputSize(Units, StopStatus, Utf8Size))
+
+    Job.Dest = Utf8Str;
+    ccunicode_InternalRunTasks(Pool, &ccunicode_InternalWriteUtf8Task, &Job, Job.ChunkCount);
+    Utf8Str[Units] = 0;
+    return (int)Units;
+}
+
+int ccunicode_Utf16ToUtf8_nmp(const uint16_t *Utf16Str, int Utf16Size, uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_NMP, Utf16Size)
+    int Res = ccunicode_InternalUtf16ToUtf8_nmp(Utf16Str, Utf16Size, Utf8Str, Utf8Size, Pool);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+// Number of strings a batch task claims at once
+#define CCUNICODE_INTERNAL_BATCH_BLOCK 64
+
+typedef struct
+{
+    const void *Strs;
+    int StrCount;
+    void *Dest;
+    int64_t *Offsets;
+    int *Results;
+    int TaskCount;
+    int64_t NextStr;    // First string not claimed yet
+} TCCUnicode_InternalBatchJob;
+
+// Claims the next block of strings for a task and returns its first string.
+// Tasks keep claiming blocks until none is left, so a task that got short strings takes over the work of the others.
+static int64_t ccunicode_InternalClaimBatchBlock(TCCUnicode_InternalBatchJob *Job, int TaskIndex, int64_t *Round)
+{
+#ifdef CCUNICODE_INTERNAL_FETCH_ADD
+    (void)TaskIndex;
+    (void)Round;
+    return CCUNICODE_INTERNAL_FETCH_ADD(&Job->NextStr, CCUNICODE_INTERNAL_BATCH_BLOCK);
+#else
+    // Without atomic operations, blocks are dealt round-robin instead
+    return ((*Round)++ * Job->TaskCount + TaskIndex) * CCUNICODE_INTERNAL_BATCH_BLOCK;
+#endif
+}
+
+// Same result as ccunicode_Utf8ToUtf16_na, but nothing is written
+static int ccunicode_InternalSizeUtf8ToUtf16(const uint8_t *Utf8Str, int Utf8Size)
+{
+    if (!Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    TCCUnicode_InternalChunk Chunk;
+    Chunk.Begin = 0;
+    Chunk.End = Utf8Size;
+    ccunicode_InternalScanUtf8(Utf8Str, Utf8Size, &Chunk);
+
+    int LastChunk = 0;
+    int64_t Units = 0;
+    int StopStatus = CCUNICODE_NO_ERROR;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalResolveChunks(&Chunk, 1, &LastChunk, &Units, &StopStatus))
+    return ccunicode_InternalGetAllocatedSize(Units, StopStatus, sizeof(uint16_t));
+}
+
+// Same result as ccunicode_Utf16ToUtf8_na, but nothing is written
+static int ccunicode_InternalSizeUtf16ToUtf8(const uint16_t *Utf16Str, int Utf16Size)
+{
+    if (!Utf16Str)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf16Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    TCCUnicode_InternalChunk Chunk;
+    Chunk.Begin = 0;
+    Chunk.End = Utf16Size;
+    ccunicode_InternalScanUtf16(Utf16Str, Utf16Size, &Chunk);
+
+    int LastChunk = 0;
+    int64_t Units = 0;
+    int StopStatus = CCUNICODE_NO_ERROR;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalResolveChunks(&Chunk, 1, &LastChunk, &Units, &StopStatus))
+    return ccunicode_InternalGetAllocatedSize(Units, StopStatus, sizeof(uint8_t));
+}
+
+static void ccunicode_InternalSizeUtf8ToUtf16BatchTask(void *Data, int Index)
+{
+    TCCUnicode_InternalBatchJob *Job = (TCCUnicode_InternalBatchJob*)Data;
+    const TCCUnicode_Utf8Span *Utf8Strs = (const TCCUnicode_Utf8Span*)Job->Strs;
+
+    int64_t Round = 0;
+    for (int64_t First = ccunicode_InternalClaimBatchBlock(Job, Index, &Round); First < Job->StrCount; First = ccunicode_InternalClaimBatchBlock(Job, Index, &Round))
+    {
+        int64_t Last = First + CCUNICODE_INTERNAL_BATCH_BLOCK;
+        if (Last > Job->StrCount)
+            Last = Job->StrCount;
+
+        for (int64_t i = First; i < Last; ++i)
+            Job->Results[i] = ccunicode_InternalSizeUtf8ToUtf16(Utf8Strs[i].str, Utf8Strs[i].size);
+    }
+}
+
+static void ccunicode_InternalWriteUtf8ToUtf16BatchTask(void *Data, int Index)
+{
+    TCCUnicode_InternalBatchJob *Job = (TCCUnicode_InternalBatchJob*)Data;
+    const TCCUnicode_Utf8Span *Utf8Strs = (const TCCUnicode_Utf8Span*)Job->Strs;
+
+    int64_t Round = 0;
+    for (int64_t First = ccunicode_InternalClaimBatchBlock(Job, Index, &Round); First < Job->StrCount; First = ccunicode_InternalClaimBatchBlock(Job, Index, &Round))
+    {
+        int64_t Last = First + CCUNICODE_INTERNAL_BATCH_BLOCK;
+        if (Last > Job->StrCount)
+            Last = Job->StrCount;
+
+        for (int64_t i = First; i < Last; ++i)
+        {
+            if (Job->Results[i] < 0)
+                continue;
+
+            TCCUnicode_InternalChunk Chunk;
+            Chunk.Begin = 0;
+            Chunk.Units = Job->Results[i];
+
+            uint16_t *Utf16Str = (uint16_t*)Job->Dest + Job->Offsets[i];
+            ccunicode_InternalWriteUtf16(Utf8Strs[i].str, &Chunk, Utf16Str);
+            Utf16Str[Chunk.Units] = 0;
+        }
+    }
+}
+
+static void ccunicode_InternalSizeUtf16ToUtf8BatchTask(void *Data, int Index)
+{
+    TCCUnicode_InternalBatchJob *Job = (TCCUnicode_InternalBatchJob*)Data;
+    const TCCUnicode_Utf16Span *Utf16Strs = (const TCCUnicode_Utf16Span*)Job->Strs;
+
+    int64_t Round = 0;
+    for (int64_t First = ccunicode_InternalClaimBatchBlock(Job, Index, &Round); First < Job->StrCount; First = ccunicode_InternalClaimBatchBlock(Job, Index, &Round))
+    {
+        int64_t Last = First + CCUNICODE_INTERNAL_BATCH_BLOCK;
+        if (Last > Job->StrCount)
+            Last = Job->StrCount;
+
+        for (int64_t i = First; i < Last; ++i)
+            Job->Results[i] = ccunicode_InternalSizeUtf16ToUtf8(Utf16Strs[i].str, Utf16Strs[i].size);
+    }
+}
+
+static void ccunicode_InternalWriteUtf16ToUtf8BatchTask(void *Data, int Index)
+{
+    TCCUnicode_InternalBatchJob *Job = (TCCUnicode_InternalBatchJob*)Data;
+    const TCCUnicode_Utf16Span *Utf16Strs = (const TCCUnicode_Utf16Span*)Job->Strs;
+
+    int64_t Round = 0;
+    for (int64_t First = ccunicode_InternalClaimBatchBlock(Job, Index, &Round); First < Job->StrCount; First = ccunicode_InternalClaimBatchBlock(Job, Index, &Round))
+    {
+        int64_t Last = First + CCUNICODE_INTERNAL_BATCH_BLOCK;
+        if (Last > Job->StrCount)
+            Last = Job->StrCount;
+
+        for (int64_t i = First; i < Last; ++i)
+        {
+            if (Job->Results[i] < 0)
+                continue;
+
+            TCCUnicode_InternalChunk Chunk;
+            Chunk.Begin = 0;
+            Chunk.Units = Job->Results[i];
+
+            uint8_t *Utf8Str = (uint8_t*)Job->Dest + Job->Offsets[i];
+            ccunicode_InternalWriteUtf8(Utf16Strs[i].str, &Chunk, Utf8Str);
+            Utf8Str[Chunk.Units] = 0;
+        }
+    }
+}
+
+static void ccunicode_InternalRunBatch(TCCUnicode_InternalBatchJob *Job, const TCCUnicode_ThreadPool *Pool, void (*TaskFunc)(void*, int))
+{
+    Job->NextStr = 0;
+    ccunicode_InternalRunTasks(Pool, TaskFunc, Job, Job->TaskCount);
+}
+
+// Fills Results with the size of every string and Offsets with their position in the output
+static int ccunicode_InternalSizeBatch(TCCUnicode_InternalBatchJob *Job, const void *Strs, int StrCount, int64_t *Offsets, int *Results,
+                                       const TCCUnicode_ThreadPool *Pool, void (*SizeTaskFunc)(void*, int))
+{
+    if (StrCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (!Strs || !Offsets || !Results)
+        return CCUNICODE_NULL_POINTER;
+
+    Job->Strs = Strs;
+    Job->StrCount = StrCount;
+    Job->Dest = NULL;
+    Job->Offsets = Offsets;
+    Job->Results = Results;
+    Job->TaskCount = ccunicode_InternalGetTaskCount(Pool, StrCount, CCUNICODE_INTERNAL_BATCH_BLOCK);
+    if (Job->TaskCount > 1)
+        CCUNICODE_INTERNAL_SET_VARIANT(CCUNICODE_VARIANT_PARALLEL)
+    ccunicode_InternalRunBatch(Job, Pool, SizeTaskFunc);
+
+    // Every string is followed by its null character while failed strings take no room
+    Offsets[0] = 0;
+    for (int i = 0; i < StrCount; ++i)
+        Offsets[i+1] = Offsets[i] + ((Results[i] >= 0) ? (int64_t)Results[i]+1 : 0);
+
+    return CCUNICODE_NO_ERROR;
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_Utf8ToUtf16Batch_np(const TCCUnicode_Utf8Span *Utf8Strs, int StrCount, uint16_t **Utf16Strs, int64_t *Offsets, int *Results, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_BATCH_NP, StrCount)
+    int Res = ccunicode_Utf8ToUtf16Batch_nap(Utf8Strs, StrCount, Utf16Strs, Offsets, Results, NULL, Pool);
+    CCUNICODE_INTERNAL_LEAVE(Res, Offsets[StrCount])
+    return Res;
+}
+#endif
+
+static int ccunicode_InternalUtf8ToUtf16Batch_nap(const TCCUnicode_Utf8Span *Utf8Strs, int StrCount, uint16_t **Utf16Strs, int64_t *Offsets, int *Results, const TCCUnicode_MallocPtr *AllocPtr, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    if (!Utf16Strs)
+        return CCUNICODE_NULL_POINTER;
+
+    TCCUnicode_InternalBatchJob Job;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalSizeBatch(&Job, Utf8Strs, StrCount, Offsets, Results, Pool, &ccunicode_InternalSizeUtf8ToUtf16BatchTask))
+
+    int64_t Utf16Size = Offsets[StrCount];
+    if ((uint64_t)Utf16Size > SIZE_MAX/sizeof(**Utf16Strs))
+        return CCUNICODE_OVERFLOW;
+
+    // An empty batch still gets a valid buffer
+    *Utf16Strs = ccunicode_InternalMalloc(AllocPtr, (Utf16Size ? (size_t)Utf16Size : 1)*sizeof(**Utf16Strs));
+    if (!(*Utf16Strs))
+        return CCUNICODE_BAD_ALLOCATION;
+
+    Job.Dest = *Utf16Strs;
+    ccunicode_InternalRunBatch(&Job, Pool, &ccunicode_InternalWriteUtf8ToUtf16BatchTask);
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_Utf8ToUtf16Batch_nap(const TCCUnicode_Utf8Span *Utf8Strs, int StrCount, uint16_t **Utf16Strs, int64_t *Offsets, int *Results, const TCCUnicode_MallocPtr *AllocPtr, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_BATCH_NAP, StrCount)
+    int Res = ccunicode_InternalUtf8ToUtf16Batch_nap(Utf8Strs, StrCount, Utf16Strs, Offsets, Results, AllocPtr, Pool);
+    CCUNICODE_INTERNAL_LEAVE(Res, Offsets[StrCount])
+    return Res;
+}
+
+static int ccunicode_InternalUtf8ToUtf16Batch_nmp(const TCCUnicode_Utf8Span *Utf8Strs, int StrCount, uint16_t *Utf16Strs, int64_t Utf16Size, int64_t *Offsets, int *Results, const TCCUnicode_ThreadPool *Pool)
+{
+    if (Utf16Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (!Utf16Strs && Utf16Size)
+        return CCUNICODE_NULL_POINTER;
+
+    TCCUnicode_InternalBatchJob Job;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalSizeBatch(&Job, Utf8Strs, StrCount, Offsets, Results, Pool, &ccunicode_InternalSizeUtf8ToUtf16BatchTask))
+
+    if (Offsets[StrCount] > Utf16Size)
+        return CCUNICODE_BUFFER_TOO_SMALL;
+
+    Job.Dest = Utf16Strs;
+    ccunicode_InternalRunBatch(&Job, Pool, &ccunicode_InternalWriteUtf8ToUtf16BatchTask);
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_Utf8ToUtf16Batch_nmp(const TCCUnicode_Utf8Span *Utf8Strs, int StrCount, uint16_t *Utf16Strs, int64_t Utf16Size, int64_t *Offsets, int *Results, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_BATCH_NMP, StrCount)
+    int Res = ccunicode_InternalUtf8ToUtf16Batch_nmp(Utf8Strs, StrCount, Utf16Strs, Utf16Size, Offsets, Results, Pool);
+    CCUNICODE_INTERNAL_LEAVE(Res, Offsets[StrCount])
+    return Res;
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_Utf16ToUtf8Batch_np(const TCCUnicode_Utf16Span *Utf16Strs, int StrCount, uint8_t **Utf8Strs, int64_t *Offsets, int *Results, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_BATCH_NP, StrCount)
+    int Res = ccunicode_Utf16ToUtf8Batch_nap(Utf16Strs, StrCount, Utf8Strs, Offsets, Results, NULL, Pool);
+    CCUNICODE_INTERNAL_LEAVE(Res, Offsets[StrCount])
+    return Res;
+}
+#endif
+
+static int ccunicode_InternalUtf16ToUtf8Batch_nap(const TCCUnicode_Utf16Span *Utf16Strs, int StrCount, uint8_t **Utf8Strs, int64_t *Offsets, int *Results, const TCCUnicode_MallocPtr *AllocPtr, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    if (!Utf8Strs)
+        return CCUNICODE_NULL_POINTER;
+
+    TCCUnicode_InternalBatchJob Job;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalSizeBatch(&Job, Utf16Strs, StrCount, Offsets, Results, Pool, &ccunicode_InternalSizeUtf16ToUtf8BatchTask))
+
+    int64_t Utf8Size = Offsets[StrCount];
+    if ((uint64_t)Utf8Size > SIZE_MAX/sizeof(**Utf8Strs))
+        return CCUNICODE_OVERFLOW;
+
+    // An empty batch still gets a valid buffer
+    *Utf8Strs = ccunicode_InternalMalloc(AllocPtr, (Utf8Size ? (size_t)Utf8Size : 1)*sizeof(**Utf8Strs));
+    if (!(*Utf8Strs))
+        return CCUNICODE_BAD_ALLOCATION;
+
+    Job.Dest = *Utf8Strs;
+    ccunicode_InternalRunBatch(&Job, Pool, &ccunicode_InternalWriteUtf16ToUtf8BatchTask);
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_Utf16ToUtf8Batch_nap(const TCCUnicode_Utf16Span *Utf16Strs, int StrCount, uint8_t **Utf8Strs, int64_t *Offsets, int *Results, const TCCUnicode_MallocPtr *AllocPtr, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_BATCH_NAP, StrCount)
+    int Res = ccunicode_InternalUtf16ToUtf8Batch_nap(Utf16Strs, StrCount, Utf8Strs, Offsets, Results, AllocPtr, Pool);
+    CCUNICODE_INTERNAL_LEAVE(Res, Offsets[StrCount])
+    return Res;
+}
+
+static int ccunicode_InternalUtf16ToUtf8Batch_nmp(const TCCUnicode_Utf16Span *Utf16Strs, int StrCount, uint8_t *Utf8Strs, int64_t Utf8Size, int64_t *Offsets, int *Results, const TCCUnicode_ThreadPool *Pool)
+{
+    if (Utf8Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (!Utf8Strs && Utf8Size)
+        return CCUNICODE_NULL_POINTER;
+
+    TCCUnicode_InternalBatchJob Job;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalSizeBatch(&Job, Utf16Strs, StrCount, Offsets, Results, Pool, &ccunicode_InternalSizeUtf16ToUtf8BatchTask))
+
+    if (Offsets[StrCount] > Utf8Size)
+        return CCUNICODE_BUFFER_TOO_SMALL;
+
+    Job.Dest = Utf8Strs;
+    ccunicode_InternalRunBatch(&Job, Pool, &ccunicode_InternalWriteUtf16ToUtf8BatchTask);
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_Utf16ToUtf8Batch_nmp(const TCCUnicode_Utf16Span *Utf16Strs, int StrCount, uint8_t *Utf8Strs, int64_t Utf8Size, int64_t *Offsets, int *Results, const TCCUnicode_ThreadPool *Pool)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_BATCH_NMP, StrCount)
+    int Res = ccunicode_InternalUtf16ToUtf8Batch_nmp(Utf16Strs, StrCount, Utf8Strs, Utf8Size, Offsets, Results, Pool);
+    CCUNICODE_INTERNAL_LEAVE(Res, Offsets[StrCount])
+    return Res;
+}
+
+static int64_t ccunicode_InternalGetColumnOffset(const void *Offsets, int Wide, int64_t Index)
+{
+    return Wide ? ((const int64_t*)Offsets)[Index] : (int64_t)((const int32_t*)Offsets)[Index];
+}
+
+static int ccunicode_InternalSetColumnOffset(void *Offsets, int Wide, int64_t Index, int64_t Value)
+{
+    if (Wide)
+    {
+        ((int64_t*)Offsets)[Index] = Value;
+        return CCUNICODE_NO_ERROR;
+    }
+
+    if (Value > INT32_MAX)
+        return CCUNICODE_OVERFLOW;
+    ((int32_t*)Offsets)[Index] = (int32_t)Value;
+    return CCUNICODE_NO_ERROR;
+}
+
+// Gets the size of the data buffer of a column (from the first offset to the last one)
+static int ccunicode_InternalGetColumnDataSize(const void *Data, const void *Offsets, int Wide, int64_t RowCount, int64_t *DataSize)
+{
+    if (!Data || !Offsets)
+        return CCUNICODE_NULL_POINTER;
+    if (RowCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    int64_t Begin = ccunicode_InternalGetColumnOffset(Offsets, Wide, 0);
+    int64_t End = ccunicode_InternalGetColumnOffset(Offsets, Wide, RowCount);
+    if (Begin < 0 || End < Begin)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    *DataSize = End - Begin;
+    return CCUNICODE_NO_ERROR;
+}
+
+// Converts a column as a single stream, or only validates and sizes it if Write is 0.
+// Units receives the number of shorts of the output data buffer.
+static int ccunicode_InternalUtf8ToUtf16Column(const uint8_t *Utf8Data, const void *Utf8Offsets, int64_t RowCount, int Wide,
+                                               int Write, uint16_t *Utf16Data, int64_t Utf16Size, void *Utf16Offsets, int64_t *Units, int64_t *ErrorRow)
+{
+    int64_t DummyRow;
+    if (!ErrorRow)
+        ErrorRow = &DummyRow;
+    *ErrorRow = -1;
+
+    int64_t Utf8Size = 0;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalGetColumnDataSize(Utf8Data, Utf8Offsets, Wide, RowCount, &Utf8Size))
+    if (!Units)
+        return CCUNICODE_NULL_POINTER;
+    if (Write)
+    {
+        if (!Utf16Offsets)
+            return CCUNICODE_NULL_POINTER;
+        if (Utf16Size < 0)
+            return CCUNICODE_INVALID_PARAMETER;
+        if (!Utf16Data && Utf16Size)
+            return CCUNICODE_NULL_POINTER;
+
+        ccunicode_InternalSetColumnOffset(Utf16Offsets, Wide, 0, 0);
+    }
+
+    int64_t Pos = ccunicode_InternalGetColumnOffset(Utf8Offsets, Wide, 0);
+    int64_t End = Pos + Utf8Size;
+    int64_t Row = 0;
+    int64_t RowEnd = Pos;
+    int64_t WritePos = 0;
+    for (;;)
+    {
+        // Closes the rows ending before the current position. Only ASCII characters can have been read
+        // since their end, so their output offsets follow from the current positions.
+        while (Row < RowCount)
+        {
+            int64_t NextRowEnd = ccunicode_InternalGetColumnOffset(Utf8Offsets, Wide, Row+1);
+            if (NextRowEnd < RowEnd || NextRowEnd > End)
+            {
+                *ErrorRow = Row;
+                return CCUNICODE_INVALID_PARAMETER;
+            }
+
+            RowEnd = NextRowEnd;
+            if (RowEnd > Pos)
+                break;
+
+            ++Row;
+            if (Write && ccunicode_InternalSetColumnOffset(Utf16Offsets, Wide, Row, WritePos - (Pos - RowEnd)))
+                return CCUNICODE_OVERFLOW;
+        }
+        if (Row == RowCount)
+            break;
+
+        // ASCII is handled 8 bytes at a time, whatever the rows those bytes belong to
+        if (End - Pos >= 8 && (!Write || Utf16Size - WritePos >= 8))
+        {
+            uint64_t Word;
+            memcpy(&Word, Utf8Data + Pos, sizeof(Word));
+            if (!(Word & 0x8080808080808080ULL))
+            {
+                if (Write)
+                {
+                    for (int i = 0; i < 8; ++i)
+                        Utf16Data[WritePos+i] = Utf8Data[Pos+i];
+                }
+                Pos += 8;
+                WritePos += 8;
+                continue;
+            }
+        }
+
+        // Otherwise we decode a single character, which must end within its row
+        *ErrorRow = Row;
+        uint8_t CurrentByte = Utf8Data[Pos++];
+        if ((CurrentByte >= 0x80 && CurrentByte <= 0xBF) || CurrentByte >= 0xF8)
+            return CCUNICODE_INVALID_UTF8_CHARACTER;
+
+        uint32_t CodePoint = CurrentByte;
+        int RemainingBytes = 0;
+        if (CurrentByte >= 0xF0)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0x7);
+            RemainingBytes = 3;
+        }
+        else if (CurrentByte >= 0xE0)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0xF);
+            RemainingBytes = 2;
+        }
+        else if (CurrentByte >= 0xC0)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0x1F);
+            RemainingBytes = 1;
+        }
+
+        if (Pos + RemainingBytes > RowEnd)
+            return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+
+        for (int j = 0; j < RemainingBytes; ++j)
+        {
+            CurrentByte = Utf8Data[Pos++];
+            if (CurrentByte < 0x80 || CurrentByte > 0xBF)
+                return CCUNICODE_INVALID_UTF8_CHARACTER;
+
+            CodePoint = (CodePoint << 6) + (uint32_t)(CurrentByte & 0x3F);
+        }
+
+        if (CodePoint > 0x10FFFF || (CodePoint >= 0xD800 && CodePoint <= 0xDFFF))
+            return CCUNICODE_INVALID_CODEPOINT;
+
+        int UnitCount = (CodePoint >= 0x10000) ? 2 : 1;
+        if (Write)
+        {
+            if (Utf16Size - WritePos < UnitCount)
+                return CCUNICODE_BUFFER_TOO_SMALL;
+
+            if (UnitCount == 1)
+            {
+                Utf16Data[WritePos] = (uint16_t)CodePoint;
+            }
+            else
+            {
+                CodePoint -= 0x10000;
+                Utf16Data[WritePos] = (uint16_t)((CodePoint >> 10) & 0x3FF) + 0xD800;
+                Utf16Data[WritePos+1] = (uint16_t)(CodePoint & 0x3FF) + 0xDC00;
+            }
+        }
+        WritePos += UnitCount;
+        *ErrorRow = -1;
+    }
+
+    *Units = WritePos;
+    return CCUNICODE_NO_ERROR;
+}
+
+// Converts a column as a single stream, or only validates and sizes it if Write is 0.
+// Units receives the number of bytes of the output data buffer.
+static int ccunicode_InternalUtf16ToUtf8Column(const uint16_t *Utf16Data, const void *Utf16Offsets, int64_t RowCount, int Wide,
+                                               int Write, uint8_t *Utf8Data, int64_t Utf8Size, void *Utf8Offsets, int64_t *Units, int64_t *ErrorRow)
+{
+    int64_t DummyRow;
+    if (!ErrorRow)
+        ErrorRow = &DummyRow;
+    *ErrorRow = -1;
+
+    int64_t Utf16Size = 0;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalGetColumnDataSize(Utf16Data, Utf16Offsets, Wide, RowCount, &Utf16Size))
+    if (!Units)
+        return CCUNICODE_NULL_POINTER;
+    if (Write)
+    {
+        if (!Utf8Offsets)
+            return CCUNICODE_NULL_POINTER;
+        if (Utf8Size < 0)
+            return CCUNICODE_INVALID_PARAMETER;
+        if (!Utf8Data && Utf8Size)
+            return CCUNICODE_NULL_POINTER;
+
+        ccunicode_InternalSetColumnOffset(Utf8Offsets, Wide, 0, 0);
+    }
+
+    int64_t Pos = ccunicode_InternalGetColumnOffset(Utf16Offsets, Wide, 0);
+    int64_t End = Pos + Utf16Size;
+    int64_t Row = 0;
+    int64_t RowEnd = Pos;
+    int64_t WritePos = 0;
+    for (;;)
+    {
+        // Closes the rows ending before the current position. Only ASCII characters can have been read
+        // since their end, so their output offsets follow from the current positions.
+        while (Row < RowCount)
+        {
+            int64_t NextRowEnd = ccunicode_InternalGetColumnOffset(Utf16Offsets, Wide, Row+1);
+            if (NextRowEnd < RowEnd || NextRowEnd > End)
+            {
+                *ErrorRow = Row;
+                return CCUNICODE_INVALID_PARAMETER;
+            }
+
+            RowEnd = NextRowEnd;
+            if (RowEnd > Pos)
+                break;
+
+            ++Row;
+            if (Write && ccunicode_InternalSetColumnOffset(Utf8Offsets, Wide, Row, WritePos - (Pos - RowEnd)))
+                return CCUNICODE_OVERFLOW;
+        }
+        if (Row == RowCount)
+            break;
+
+        // ASCII is handled 4 shorts at a time, whatever the rows those shorts belong to
+        if (End - Pos >= 4 && (!Write || Utf8Size - WritePos >= 4))
+        {
+            uint64_t Word;
+            memcpy(&Word, Utf16Data + Pos, sizeof(Word));
+            if (!(Word & 0xFF80FF80FF80FF80ULL))
+            {
+                if (Write)
+                {
+                    for (int i = 0; i < 4; ++i)
+                        Utf8Data[WritePos+i] = (uint8_t)Utf16Data[Pos+i];
+                }
+                Pos += 4;
+                WritePos += 4;
+                continue;
+            }
+        }
+
+        // Otherwise we decode a single character, which must end within its row
+        *ErrorRow = Row;
+        uint32_t CodePoint = Utf16Data[Pos++];
+        if (CodePoint >= 0xDC00 && CodePoint <= 0xDFFF)
+            return CCUNICODE_SURROGATE_PAIR_INVERSION;
+        if (CodePoint >= 0xD800 && CodePoint <= 0xDBFF)
+        {
+            if (Pos == RowEnd)
+                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+
+            uint16_t CurrentCodeUnit = Utf16Data[Pos++];
+            if (CurrentCodeUnit < 0xDC00 || CurrentCodeUnit > 0xDFFF)
+                return CCUNICODE_INVALID_UTF16_CHARACTER;
+
+            CodePoint = ((CodePoint - 0xD800) << 10) + (uint32_t)(CurrentCodeUnit - 0xDC00) + 0x10000;
+        }
+
+        int UnitCount = 4;
+        if (CodePoint <= 0x7F)
+            UnitCount = 1;
+        else if (CodePoint <= 0x7FF)
+            UnitCount = 2;
+        else if (CodePoint <= 0xFFFF)
+            UnitCount = 3;
+
+        if (Write)
+        {
+            if (Utf8Size - WritePos < UnitCount)
+                return CCUNICODE_BUFFER_TOO_SMALL;
+
+            uint8_t *Dest = Utf8Data + WritePos;
+            if (UnitCount == 1)
+            {
+                Dest[0] = (uint8_t)CodePoint;
+            }
+            else if (UnitCount == 2)
+            {
+                Dest[0] = 0xC0 + (uint8_t)((CodePoint >> 6) & 0x1F);
+                Dest[1] = 0x80 + (uint8_t)(CodePoint & 0x3F);
+            }
+            else if (UnitCount == 3)
+            {
+                Dest[0] = 0xE0 + (uint8_t)((CodePoint >> 12) & 0xF);
+                Dest[1] = 0x80 + (uint8_t)((CodePoint >> 6) & 0x3F);
+                Dest[2] = 0x80 + (uint8_t)(CodePoint & 0x3F);
+            }
+            else
+            {
+                Dest[0] = 0xF0 + (uint8_t)((CodePoint >> 18) & 0x7);
+                Dest[1] = 0x80 + (uint8_t)((CodePoint >> 12) & 0x3F);
+                Dest[2] = 0x80 + (uint8_t)((CodePoint >> 6) & 0x3F);
+                Dest[3] = 0x80 + (uint8_t)(CodePoint & 0x3F);
+            }
+        }
+        WritePos += UnitCount;
+        *ErrorRow = -1;
+    }
+
+    *Units = WritePos;
+    return CCUNICODE_NO_ERROR;
+}
+
+// Allocates the output data buffer for the worst case, then converts the column in a single pass
+static int ccunicode_InternalUtf8ToUtf16Column_a(const uint8_t *Utf8Data, const void *Utf8Offsets, int64_t RowCount, int Wide,
+                                                 uint16_t **Utf16Data, void *Utf16Offsets, const TCCUnicode_MallocPtr *AllocPtr, int64_t *ErrorRow)
+{
+    if (ErrorRow)
+        *ErrorRow = -1;
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    if (!Utf16Data)
+        return CCUNICODE_NULL_POINTER;
+
+    // Every UTF8 byte gives at most one short
+    int64_t Utf16Size = 0;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalGetColumnDataSize(Utf8Data, Utf8Offsets, Wide, RowCount, &Utf16Size))
+    if ((uint64_t)Utf16Size > SIZE_MAX/sizeof(**Utf16Data))
+        return CCUNICODE_OVERFLOW;
+
+    *Utf16Data = ccunicode_InternalMalloc(AllocPtr, (Utf16Size ? (size_t)Utf16Size : 1)*sizeof(**Utf16Data));
+    if (!(*Utf16Data))
+        return CCUNICODE_BAD_ALLOCATION;
+
+    int64_t Units = 0;
+    int Res = ccunicode_InternalUtf8ToUtf16Column(Utf8Data, Utf8Offsets, RowCount, Wide, 1, *Utf16Data, Utf16Size, Utf16Offsets, &Units, ErrorRow);
+    if (Res)
+    {
+        ccunicode_InternalFree(AllocPtr, *Utf16Data);
+        *Utf16Data = NULL;
+    }
+    return Res;
+}
+
+// Allocates the output data buffer for the worst case, then converts the column in a single pass
+static int ccunicode_InternalUtf16ToUtf8Column_a(const uint16_t *Utf16Data, const void *Utf16Offsets, int64_t RowCount, int Wide,
+                                                 uint8_t **Utf8Data, void *Utf8Offsets, const TCCUnicode_MallocPtr *AllocPtr, int64_t *ErrorRow)
+{
+    if (ErrorRow)
+        *ErrorRow = -1;
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    if (!Utf8Data)
+        return CCUNICODE_NULL_POINTER;
+
+    // Every UTF16 short gives at most three bytes (surrogate pairs give four bytes for two shorts)
+    int64_t Utf16Size = 0;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalGetColumnDataSize(Utf16Data, Utf16Offsets, Wide, RowCount, &Utf16Size))
+    if ((uint64_t)Utf16Size > SIZE_MAX/3)
+        return CCUNICODE_OVERFLOW;
+    int64_t Utf8Size = 3*Utf16Size;
+
+    *Utf8Data = ccunicode_InternalMalloc(AllocPtr, Utf8Size ? (size_t)Utf8Size : 1);
+    if (!(*Utf8Data))
+        return CCUNICODE_BAD_ALLOCATION;
+
+    int64_t Units = 0;
+    int Res = ccunicode_InternalUtf16ToUtf8Column(Utf16Data, Utf16Offsets, RowCount, Wide, 1, *Utf8Data, Utf8Size, Utf8Offsets, &Units, ErrorRow);
+    if (Res)
+    {
+        ccunicode_InternalFree(AllocPtr, *Utf8Data);
+        *Utf8Data = NULL;
+    }
+    return Res;
+}
+
+int ccunicode_ValidateUtf8Column(const uint8_t *Utf8Data, const int32_t *Utf8Offsets, int64_t RowCount, int64_t *ErrorRow)
+{
+    int64_t Utf16Size = 0;
+    return ccunicode_InternalUtf8ToUtf16Column(Utf8Data, Utf8Offsets, RowCount, 0, 0, NULL, 0, NULL, &Utf16Size, ErrorRow);
+}
+
+int ccunicode_GetUtf16SizeFromUtf8Column(const uint8_t *Utf8Data, const int32_t *Utf8Offsets, int64_t RowCount, int64_t *Utf16Size, int64_t *ErrorRow)
+{
+    return ccunicode_InternalUtf8ToUtf16Column(Utf8Data, Utf8Offsets, RowCount, 0, 0, NULL, 0, NULL, Utf16Size, ErrorRow);
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_Utf8ToUtf16Column(const uint8_t *Utf8Data, const int32_t *Utf8Offsets, int64_t RowCount, uint16_t **Utf16Data, int32_t *Utf16Offsets, int64_t *ErrorRow)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_COLUMN, RowCount)
+    int Res = ccunicode_InternalUtf8ToUtf16Column_a(Utf8Data, Utf8Offsets, RowCount, 0, Utf16Data, Utf16Offsets, NULL, ErrorRow);
+    CCUNICODE_INTERNAL_LEAVE(Res, Utf16Offsets[RowCount])
+    return Res;
+}
+#endif
+
+int ccunicode_Utf8ToUtf16Column_a(const uint8_t *Utf8Data, const int32_t *Utf8Offsets, int64_t RowCount, uint16_t **Utf16Data, int32_t *Utf16Offsets, const TCCUnicode_MallocPtr *AllocPtr, int64_t *ErrorRow)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_COLUMN_A, RowCount)
+    int Res = ccunicode_InternalUtf8ToUtf16Column_a(Utf8Data, Utf8Offsets, RowCount, 0, Utf16Data, Utf16Offsets, AllocPtr, ErrorRow);
+    CCUNICODE_INTERNAL_LEAVE(Res, Utf16Offsets[RowCount])
+    return Res;
+}
+
+int ccunicode_Utf8ToUtf16Column_m(const uint8_t *Utf8Data, const int32_t *Utf8Offsets, int64_t RowCount, uint16_t *Utf16Data, int64_t Utf16Size, int32_t *Utf16Offsets, int64_t *ErrorRow)
+{
+    int64_t Units = 0;
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_COLUMN_M, RowCount)
+    int Res = ccunicode_InternalUtf8ToUtf16Column(Utf8Data, Utf8Offsets, RowCount, 0, 1, Utf16Data, Utf16Size, Utf16Offsets, &Units, ErrorRow);
+    CCUNICODE_INTERNAL_LEAVE(Res, Units)
+    return Res;
+}
+
+int ccunicode_ValidateUtf8Column64(const uint8_t *Utf8Data, const int64_t *Utf8Offsets, int64_t RowCount, int64_t *ErrorRow)
+{
+    int64_t Utf16Size = 0;
+    return ccunicode_InternalUtf8ToUtf16Column(Utf8Data, Utf8Offsets, RowCount, 1, 0, NULL, 0, NULL, &Utf16Size, ErrorRow);
+}
+
+int ccunicode_GetUtf16SizeFromUtf8Column64(const uint8_t *Utf8Data, const int64_t *Utf8Offsets, int64_t RowCount, int64_t *Utf16Size, int64_t *ErrorRow)
+{
+    return ccunicode_InternalUtf8ToUtf16Column(Utf8Data, Utf8Offsets, RowCount, 1, 0, NULL, 0, NULL, Utf16Size, ErrorRow);
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_Utf8ToUtf16Column64(const uint8_t *Utf8Data, const int64_t *Utf8Offsets, int64_t RowCount, uint16_t **Utf16Data, int64_t *Utf16Offsets, int64_t *ErrorRow)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_COLUMN64, RowCount)
+    int Res = ccunicode_InternalUtf8ToUtf16Column_a(Utf8Data, Utf8Offsets, RowCount, 1, Utf16Data, Utf16Offsets, NULL, ErrorRow);
+    CCUNICODE_INTERNAL_LEAVE(Res, Utf16Offsets[RowCount])
+    return Res;
+}
+#endif
+
+int ccunicode_Utf8ToUtf16Column64_a(const uint8_t *Utf8Data, const int64_t *Utf8Offsets, int64_t RowCount, uint16_t **Utf16Data, int64_t *Utf16Offsets, const TCCUnicode_MallocPtr *AllocPtr, int64_t *ErrorRow)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_COLUMN64_A, RowCount)
+    int Res = ccunicode_InternalUtf8ToUtf16Column_a(Utf8Data, Utf8Offsets, RowCount, 1, Utf16Data, Utf16Offsets, AllocPtr, ErrorRow);
+    CCUNICODE_INTERNAL_LEAVE(Res, Utf16Offsets[RowCount])
+    return Res;
+}
+
+int ccunicode_Utf8ToUtf16Column64_m(const uint8_t *Utf8Data, const int64_t *Utf8Offsets, int64_t RowCount, uint16_t *Utf16Data, int64_t Utf16Size, int64_t *Utf16Offsets, int64_t *ErrorRow)
+{
+    int64_t Units = 0;
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_COLUMN64_M, RowCount)
+    int Res = ccunicode_InternalUtf8ToUtf16Column(Utf8Data, Utf8Offsets, RowCount, 1, 1, Utf16Data, Utf16Size, Utf16Offsets, &Units, ErrorRow);
+    CCUNICODE_INTERNAL_LEAVE(Res, Units)
+    return Res;
+}
+
+int ccunicode_ValidateUtf16Column(const uint16_t *Utf16Data, const int32_t *Utf16Offsets, int64_t RowCount, int64_t *ErrorRow)
+{
+    int64_t Utf8Size = 0;
+    return ccunicode_InternalUtf16ToUtf8Column(Utf16Data, Utf16Offsets, RowCount, 0, 0, NULL, 0, NULL, &Utf8Size, ErrorRow);
+}
+
+int ccunicode_GetUtf8SizeFromUtf16Column(const uint16_t *Utf16Data, const int32_t *Utf16Offsets, int64_t RowCount, int64_t *Utf8Size, int64_t *ErrorRow)
+{
+    return ccunicode_InternalUtf16ToUtf8Column(Utf16Data, Utf16Offsets, RowCount, 0, 0, NULL, 0, NULL, Utf8Size, ErrorRow);
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_Utf16ToUtf8Column(const uint16_t *Utf16Data, const int32_t *Utf16Offsets, int64_t RowCount, uint8_t **Utf8Data, int32_t *Utf8Offsets, int64_t *ErrorRow)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_COLUMN, RowCount)
+    int Res = ccunicode_InternalUtf16ToUtf8Column_a(Utf16Data, Utf16Offsets, RowCount, 0, Utf8Data, Utf8Offsets, NULL, ErrorRow);
+    CCUNICODE_INTERNAL_LEAVE(Res, Utf8Offsets[RowCount])
+    return Res;
+}
+#endif
+
+int ccunicode_Utf16ToUtf8Column_a(const uint16_t *Utf16Data, const int32_t *Utf16Offsets, int64_t RowCount, uint8_t **Utf8Data, int32_t *Utf8Offsets, const TCCUnicode_MallocPtr *AllocPtr, int64_t *ErrorRow)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_COLUMN_A, RowCount)
+    int Res = ccunicode_InternalUtf16ToUtf8Column_a(Utf16Data, Utf16Offsets, RowCount, 0, Utf8Data, Utf8Offsets, AllocPtr, ErrorRow);
+    CCUNICODE_INTERNAL_LEAVE(Res, Utf8Offsets[RowCount])
+    return Res;
+}
+
+int ccunicode_Utf16ToUtf8Column_m(const uint16_t *Utf16Data, const int32_t *Utf16Offsets, int64_t RowCount, uint8_t *Utf8Data, int64_t Utf8Size, int32_t *Utf8Offsets, int64_t *ErrorRow)
+{
+    int64_t Units = 0;
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_COLUMN_M, RowCount)
+    int Res = ccunicode_InternalUtf16ToUtf8Column(Utf16Data, Utf16Offsets, RowCount, 0, 1, Utf8Data, Utf8Size, Utf8Offsets, &Units, ErrorRow);
+    CCUNICODE_INTERNAL_LEAVE(Res, Units)
+    return Res;
+}
+
+int ccunicode_ValidateUtf16Column64(const uint16_t *Utf16Data, const int64_t *Utf16Offsets, int64_t RowCount, int64_t *ErrorRow)
+{
+    int64_t Utf8Size = 0;
+    return ccunicode_InternalUtf16ToUtf8Column(Utf16Data, Utf16Offsets, RowCount, 1, 0, NULL, 0, NULL, &Utf8Size, ErrorRow);
+}
+
+int ccunicode_GetUtf8SizeFromUtf16Column64(const uint16_t *Utf16Data, const int64_t *Utf16Offsets, int64_t RowCount, int64_t *Utf8Size, int64_t *ErrorRow)
+{
+    return ccunicode_InternalUtf16ToUtf8Column(Utf16Data, Utf16Offsets, RowCount, 1, 0, NULL, 0, NULL, Utf8Size, ErrorRow);
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+int ccunicode_Utf16ToUtf8Column64(const uint16_t *Utf16Data, const int64_t *Utf16Offsets, int64_t RowCount, uint8_t **Utf8Data, int64_t *Utf8Offsets, int64_t *ErrorRow)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_COLUMN64, RowCount)
+    int Res = ccunicode_InternalUtf16ToUtf8Column_a(Utf16Data, Utf16Offsets, RowCount, 1, Utf8Data, Utf8Offsets, NULL, ErrorRow);
+    CCUNICODE_INTERNAL_LEAVE(Res, Utf8Offsets[RowCount])
+    return Res;
+}
+#endif
+
+int ccunicode_Utf16ToUtf8Column64_a(const uint16_t *Utf16Data, const int64_t *Utf16Offsets, int64_t RowCount, uint8_t **Utf8Data, int64_t *Utf8Offsets, const TCCUnicode_MallocPtr *AllocPtr, int64_t *ErrorRow)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_COLUMN64_A, RowCount)
+    int Res = ccunicode_InternalUtf16ToUtf8Column_a(Utf16Data, Utf16Offsets, RowCount, 1, Utf8Data, Utf8Offsets, AllocPtr, ErrorRow);
+    CCUNICODE_INTERNAL_LEAVE(Res, Utf8Offsets[RowCount])
+    return Res;
+}
+
+int ccunicode_Utf16ToUtf8Column64_m(const uint16_t *Utf16Data, const int64_t *Utf16Offsets, int64_t RowCount, uint8_t *Utf8Data, int64_t Utf8Size, int64_t *Utf8Offsets, int64_t *ErrorRow)
+{
+    int64_t Units = 0;
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_COLUMN64_M, RowCount)
+    int Res = ccunicode_InternalUtf16ToUtf8Column(Utf16Data, Utf16Offsets, RowCount, 1, 1, Utf8Data, Utf8Size, Utf8Offsets, &Units, ErrorRow);
+    CCUNICODE_INTERNAL_LEAVE(Res, Units)
+    return Res;
+}
+
+// Strings up to this size are counted with two 64 bits words
+#define CCUNICODE_INTERNAL_TINY_STRING 16
+#define CCUNICODE_INTERNAL_SWAR_LOW 0x0101010101010101ULL
+#define CCUNICODE_INTERNAL_SWAR_HIGH 0x8080808080808080ULL
+
+// The SWAR helpers work on 8 lanes of 8 bits. Lane masks only use the high bit of each lane.
+static uint64_t ccunicode_InternalSwarIsZero(uint64_t Word)
+{
+    return ~(((Word & ~CCUNICODE_INTERNAL_SWAR_HIGH) + ~CCUNICODE_INTERNAL_SWAR_HIGH) | Word) & CCUNICODE_INTERNAL_SWAR_HIGH;
+}
+
+// Loads 8 bytes so that Bytes[j] ends up in bits 8*j to 8*j+7
+static uint64_t ccunicode_InternalLoadLittleEndian64(const uint8_t *Bytes)
+{
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_MSC_VER)
+    uint64_t Word;
+    memcpy(&Word, Bytes, sizeof(Word));
+    return Word;
+#else
+    uint64_t Word = 0;
+    for (int j = 7; j >= 0; --j)
+        Word = (Word << 8) | Bytes[j];
+    return Word;
+#endif
+}
+
+static uint64_t ccunicode_InternalLoadLittleEndian32(const uint8_t *Bytes)
+{
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_MSC_VER)
+    uint32_t Word;
+    memcpy(&Word, Bytes, sizeof(Word));
+    return Word;
+#else
+    return (uint64_t)Bytes[0] | ((uint64_t)Bytes[1] << 8) | ((uint64_t)Bytes[2] << 16) | ((uint64_t)Bytes[3] << 24);
+#endif
+}
+
+// Loads a string of at most 16 bytes into two words padded with 0, without reading past its end.
+// Overlapping fixed size loads avoid a loop over the bytes, whose exit is hard to predict with strings of various sizes.
+static void ccunicode_InternalLoadTinyString(const uint8_t *Str, int Size, uint64_t *Low, uint64_t *High)
+{
+    *High = 0;
+    if (Size >= 8)
+    {
+        *Low = ccunicode_InternalLoadLittleEndian64(Str);
+        if (Size > 8)
+            *High = ccunicode_InternalLoadLittleEndian64(Str + Size - 8) >> (8*(16 - Size));
+    }
+    else if (Size >= 4)
+    {
+        *Low = ccunicode_InternalLoadLittleEndian32(Str) | (ccunicode_InternalLoadLittleEndian32(Str + Size - 4) << (8*(Size - 4)));
+    }
+    else if (Size > 0)
+    {
+        *Low = (uint64_t)Str[0] | ((uint64_t)Str[Size/2] << (8*(Size/2))) | ((uint64_t)Str[Size-1] << (8*(Size-1)));
+    }
+    else
+    {
+        *Low = 0;
+    }
+}
+
+// Number of bytes flagged in a lane mask
+static int ccunicode_InternalSwarCountLanes(uint64_t Mask)
+{
+    return (int)(((Mask >> 7) * CCUNICODE_INTERNAL_SWAR_LOW) >> 56);
+}
+
+// Lanes below the lowest flagged lane of a mask (all lanes if none is flagged)
+static uint64_t ccunicode_InternalSwarLanesBelow(uint64_t Mask)
+{
+    return ((Mask & (~Mask + 1)) - 1) & CCUNICODE_INTERNAL_SWAR_HIGH;
+}
+
+// Counts the codepoints of a string of at most CCUNICODE_INTERNAL_TINY_STRING bytes held in two words,
+// with the same result as ccunicode_CountCodepointsInUtf8_n
+static int ccunicode_InternalCountTinyUtf8(const uint8_t *Utf8Str, int Utf8Size)
+{
+    // Bytes past the end of the string are 0, which stops the count exactly as reaching its size would
+    uint64_t Low;
+    uint64_t High;
+    ccunicode_InternalLoadTinyString(Utf8Str, Utf8Size, &Low, &High);
+
+    uint64_t LowZeros = ccunicode_InternalSwarIsZero(Low);
+    uint64_t HighZeros = ccunicode_InternalSwarIsZero(High);
+
+    // ASCII only: every byte up to the first 0 is a codepoint
+    if (!((Low | High) & CCUNICODE_INTERNAL_SWAR_HIGH))
+    {
+        if (LowZeros)
+            return ccunicode_InternalSwarCountLanes(ccunicode_InternalSwarLanesBelow(LowZeros));
+        return 8 + ccunicode_InternalSwarCountLanes(ccunicode_InternalSwarLanesBelow(HighZeros));
+    }
+
+    // A byte must be an extension if the previous one starts a character of 2 bytes or more,
+    // the one before that a character of 3 bytes or more, or the one 3 bytes before a character of 4 bytes
+    uint64_t LowLead2 = Low & (Low << 1) & CCUNICODE_INTERNAL_SWAR_HIGH;
+    uint64_t LowLead3 = LowLead2 & (Low << 2);
+    uint64_t LowLead4 = LowLead3 & (Low << 3);
+    uint64_t HighLead2 = High & (High << 1) & CCUNICODE_INTERNAL_SWAR_HIGH;
+    uint64_t HighLead3 = HighLead2 & (High << 2);
+    uint64_t HighLead4 = HighLead3 & (High << 3);
+
+    uint64_t LowExpected = (LowLead2 << 8) | (LowLead3 << 16) | (LowLead4 << 24);
+    uint64_t HighExpected = (HighLead2 << 8) | (HighLead3 << 16) | (HighLead4 << 24) | (LowLead2 >> 56) | (LowLead3 >> 48) | (LowLead4 >> 40);
+    uint64_t Pending = (HighLead2 >> 56) | (HighLead3 >> 48) | (HighLead4 >> 40);
+
+    uint64_t LowErrors = (LowExpected ^ (Low & ~(Low << 1) & CCUNICODE_INTERNAL_SWAR_HIGH)) | (LowLead4 & (Low << 4));
+    uint64_t HighErrors = (HighExpected ^ (High & ~(High << 1) & CCUNICODE_INTERNAL_SWAR_HIGH)) | (HighLead4 & (High << 4));
+
+    // The string ends at the first 0 where no extension is expected
+    uint64_t LowEnds = LowZeros & ~LowExpected;
+    uint64_t HighEnds = HighZeros & ~HighExpected;
+    uint64_t LowCounted = ccunicode_InternalSwarLanesBelow(LowEnds);
+    uint64_t HighCounted = LowEnds ? 0 : ccunicode_InternalSwarLanesBelow(HighEnds);
+
+    // Errors are rare, the serial count gives their exact code
+    if ((LowErrors & LowCounted) || (HighErrors & HighCounted) || (!LowEnds && !HighEnds && Pending))
+        return ccunicode_CountCodepointsInUtf8_n(Utf8Str, Utf8Size);
+
+    return ccunicode_InternalSwarCountLanes(LowCounted & ~LowExpected) + ccunicode_InternalSwarCountLanes(HighCounted & ~HighExpected);
+}
+
+int ccunicode_CountCodepointsInUtf8Batch_n(const TCCUnicode_Utf8Span *Utf8Strs, int StrCount, int *Results)
+{
+    if (!Utf8Strs || !Results)
+        return CCUNICODE_NULL_POINTER;
+    if (StrCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    for (int i = 0; i < StrCount; ++i)
+    {
+        const uint8_t *Utf8Str = Utf8Strs[i].str;
+        int Utf8Size = Utf8Strs[i].size;
+        if (Utf8Str && Utf8Size >= 0 && Utf8Size <= CCUNICODE_INTERNAL_TINY_STRING)
+            Results[i] = ccunicode_InternalCountTinyUtf8(Utf8Str, Utf8Size);
+        else
+            Results[i] = ccunicode_CountCodepointsInUtf8_n(Utf8Str, Utf8Size);
+    }
+
+    return CCUNICODE_NO_ERROR;
+}
+
+#define CCUNICODE_INTERNAL_ARENA_ALIGN 16
+
+struct TCCUnicode_ArenaChunk
+{
+    TCCUnicode_ArenaChunk *next;
+    size_t size;
+};
+
+// Chunk data starts after the header, rounded up so that it stays aligned
+#define CCUNICODE_INTERNAL_ARENA_HEADER ((sizeof(TCCUnicode_ArenaChunk)+CCUNICODE_INTERNAL_ARENA_ALIGN-1)/CCUNICODE_INTERNAL_ARENA_ALIGN*CCUNICODE_INTERNAL_ARENA_ALIGN)
+
+static uint8_t *ccunicode_InternalGetChunkData(TCCUnicode_ArenaChunk *Chunk)
+{
+    return (uint8_t*)Chunk + CCUNICODE_INTERNAL_ARENA_HEADER;
+}
+
+// Returns the offset in Chunk at which Size bytes aligned on Alignment fit after Offset, or SIZE_MAX if they do not
+static size_t ccunicode_InternalFitInChunk(TCCUnicode_ArenaChunk *Chunk, size_t Offset, size_t Alignment, size_t Size)
+{
+    uintptr_t Base = (uintptr_t)ccunicode_InternalGetChunkData(Chunk);
+    size_t Start = (size_t)(((Base + Offset + Alignment-1) & ~(uintptr_t)(Alignment-1)) - Base);
+    if (Start > Chunk->size || Size > Chunk->size - Start)
+        return SIZE_MAX;
+    return Start;
+}
+
+static void *ccunicode_InternalArenaAlloc(TCCUnicode_Arena *Arena, size_t Alignment, size_t Size)
+{
+    if (Alignment < CCUNICODE_INTERNAL_ARENA_ALIGN)
+        Alignment = CCUNICODE_INTERNAL_ARENA_ALIGN;
+    if (Alignment & (Alignment-1))
+        return NULL;
+
+    // Chunks after the current one are left over from before a reset or a rewind: reuse them first
+    TCCUnicode_ArenaChunk *Chunk = Arena->current;
+    size_t Offset = Arena->offset;
+    size_t Start = SIZE_MAX;
+    while (Chunk)
+    {
+        Start = ccunicode_InternalFitInChunk(Chunk, Offset, Alignment, Size);
+        if (Start != SIZE_MAX || !Chunk->next)
+            break;
+        Chunk = Chunk->next;
+        Offset = 0;
+    }
+
+    if (Start == SIZE_MAX)
+    {
+        size_t ChunkSize = Arena->chunk_size;
+        if (Size > SIZE_MAX - Alignment - CCUNICODE_INTERNAL_ARENA_HEADER)
+            return NULL;
+        if (ChunkSize < Size + Alignment)
+            ChunkSize = Size + Alignment;
+
+        TCCUnicode_ArenaChunk *NewChunk = ccunicode_InternalMalloc(&Arena->backing.malloc_ptr, CCUNICODE_INTERNAL_ARENA_HEADER + ChunkSize);
+        if (!NewChunk)
+            return NULL;
+        NewChunk->next = NULL;
+        NewChunk->size = ChunkSize;
+        if (Chunk)
+            Chunk->next = NewChunk;
+        else
+            Arena->first = NewChunk;
+
+        Arena->stats.chunk_count++;
+        Arena->stats.reserved_size += ChunkSize;
+        Arena->stats.grow_count++;
+
+        Chunk = NewChunk;
+        Offset = 0;
+        Start = ccunicode_InternalFitInChunk(Chunk, Offset, Alignment, Size);
+    }
+
+    if (Chunk == Arena->current)
+        Arena->stats.used_size += Start + Size - Offset;
+    else
+        Arena->stats.used_size += Start + Size;
+    if (Arena->stats.used_size > Arena->stats.peak_size)
+        Arena->stats.peak_size = Arena->stats.used_size;
+    Arena->stats.alloc_count++;
+
+    Arena->current = Chunk;
+    Arena->offset = Start + Size;
+    Arena->last = ccunicode_InternalGetChunkData(Chunk) + Start;
+    return Arena->last;
+}
+
+static void *ccunicode_InternalArenaMalloc(void *Ctx, size_t Size)
+{
+    return ccunicode_InternalArenaAlloc((TCCUnicode_Arena*)Ctx, CCUNICODE_INTERNAL_ARENA_ALIGN, Size);
+}
+
+static void *ccunicode_InternalArenaAlignedAlloc(void *Ctx, size_t Alignment, size_t Size)
+{
+    return ccunicode_InternalArenaAlloc((TCCUnicode_Arena*)Ctx, Alignment, Size);
+}
+
+static void ccunicode_InternalArenaFree(void *Ctx, void *Ptr)
+{
+    TCCUnicode_Arena *Arena = (TCCUnicode_Arena*)Ctx;
+    if (!Ptr || Ptr != Arena->last)
+        return;
+
+    // Only the latest allocation can be given back
+    size_t Start = (size_t)((uint8_t*)Ptr - ccunicode_InternalGetChunkData(Arena->current));
+    Arena->stats.used_size -= Arena->offset - Start;
+    Arena->offset = Start;
+    Arena->last = NULL;
+}
+
+static void *ccunicode_InternalArenaRealloc(void *Ctx, void *Ptr, size_t OldSize, size_t NewSize)
+{
+    TCCUnicode_Arena *Arena = (TCCUnicode_Arena*)Ctx;
+    if (!Ptr)
+        return ccunicode_InternalArenaMalloc(Ctx, NewSize);
+
+    // The latest allocation grows or shrinks in place if the current chunk allows it
+    if (Ptr == Arena->last)
+    {
+        size_t Start = (size_t)((uint8_t*)Ptr - ccunicode_InternalGetChunkData(Arena->current));
+        if (NewSize <= Arena->current->size - Start)
+        {
+            Arena->stats.used_size = Arena->stats.used_size - (Arena->offset - Start) + NewSize;
+            if (Arena->stats.used_size > Arena->stats.peak_size)
+                Arena->stats.peak_size = Arena->stats.used_size;
+            Arena->offset = Start + NewSize;
+            return Ptr;
+        }
+    }
+
+    void *NewPtr = ccunicode_InternalArenaMalloc(Ctx, NewSize);
+    if (NewPtr)
+        memcpy(NewPtr, Ptr, OldSize < NewSize ? OldSize : NewSize);
+    return NewPtr;
+}
+
+int ccunicode_InitArena(TCCUnicode_Arena *Arena, size_t ChunkSize, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    if (!Arena)
+        return CCUNICODE_NULL_POINTER;
+
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    memset(Arena, 0, sizeof(*Arena));
+    ccunicode_InitCtxMallocPtr(&Arena->allocator, Arena, &ccunicode_InternalArenaMalloc, &ccunicode_InternalArenaFree);
+    Arena->allocator.ctx_realloc_func = &ccunicode_InternalArenaRealloc;
+    Arena->allocator.ctx_aligned_alloc_func = &ccunicode_InternalArenaAlignedAlloc;
+    ccunicode_InternalCopyAllocator(&Arena->backing, AllocPtr);
+    Arena->chunk_size = ChunkSize ? ChunkSize : CCUNICODE_ARENA_CHUNK_SIZE;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_DestroyArena(TCCUnicode_Arena *Arena)
+{
+    if (!Arena)
+        return CCUNICODE_NULL_POINTER;
+
+    TCCUnicode_ArenaChunk *Chunk = Arena->first;
+    while (Chunk)
+    {
+        TCCUnicode_ArenaChunk *Next = Chunk->next;
+        ccunicode_InternalFree(&Arena->backing.malloc_ptr, Chunk);
+        Chunk = Next;
+    }
+
+    Arena->first = NULL;
+    Arena->current = NULL;
+    Arena->offset = 0;
+    Arena->last = NULL;
+    Arena->stats.chunk_count = 0;
+    Arena->stats.reserved_size = 0;
+    Arena->stats.used_size = 0;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_ResetArena(TCCUnicode_Arena *Arena)
+{
+    if (!Arena)
+        return CCUNICODE_NULL_POINTER;
+
+    Arena->current = Arena->first;
+    Arena->offset = 0;
+    Arena->last = NULL;
+    Arena->stats.used_size = 0;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_GetArenaMark(const TCCUnicode_Arena *Arena, TCCUnicode_ArenaMark *Mark)
+{
+    if (!Arena || !Mark)
+        return CCUNICODE_NULL_POINTER;
+
+    Mark->chunk = Arena->current;
+    Mark->offset = Arena->offset;
+    Mark->used_size = Arena->stats.used_size;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_RewindArena(TCCUnicode_Arena *Arena, const TCCUnicode_ArenaMark *Mark)
+{
+    if (!Arena || !Mark)
+        return CCUNICODE_NULL_POINTER;
+    if (Mark->used_size > Arena->stats.used_size)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    // A mark taken before the first allocation has no chunk yet
+    Arena->current = Mark->chunk ? Mark->chunk : Arena->first;
+    Arena->offset = Mark->chunk ? Mark->offset : 0;
+    Arena->last = NULL;
+    Arena->stats.used_size = Mark->used_size;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_GetArenaStats(const TCCUnicode_Arena *Arena, TCCUnicode_ArenaStats *Stats)
+{
+    if (!Arena || !Stats)
+        return CCUNICODE_NULL_POINTER;
+
+    *Stats = Arena->stats;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+#ifndef __CCUNICODE_NOSTDALLOC__
+
+#ifdef CCUNICODE_INTERNAL_THREAD_LOCAL
+static CCUNICODE_INTERNAL_THREAD_LOCAL TCCUnicode_Arena ccunicode_ThreadArena;
+static CCUNICODE_INTERNAL_THREAD_LOCAL int ccunicode_ThreadArenaReady;
+#endif
+
+TCCUnicode_Arena *ccunicode_GetThreadArena(void)
+{
+#ifdef CCUNICODE_INTERNAL_THREAD_LOCAL
+    if (!ccunicode_ThreadArenaReady)
+    {
+        if (ccunicode_InitArena(&ccunicode_ThreadArena, 0, NULL) != CCUNICODE_NO_ERROR)
+            return NULL;
+        ccunicode_ThreadArenaReady = 1;
+    }
+    return &ccunicode_ThreadArena;
+#else
+    return NULL;
+#endif
+}
+
+int ccunicode_DestroyThreadArena(void)
+{
+#ifdef CCUNICODE_INTERNAL_THREAD_LOCAL
+    if (!ccunicode_ThreadArenaReady)
+        return CCUNICODE_NO_ERROR;
+    ccunicode_ThreadArenaReady = 0;
+    return ccunicode_DestroyArena(&ccunicode_ThreadArena);
+#else
+    return CCUNICODE_NO_ERROR;
+#endif
+}
+
+#endif // __CCUNICODE_NOSTDALLOC__
+
+struct TCCUnicode_TrackedBlock
+{
+    TCCUnicode_TrackedBlock *prev;
+    TCCUnicode_TrackedBlock *next;
+    size_t size;
+    size_t sequence;
+};
+
+// Block data starts after the header, rounded up so that it keeps the alignment of the backing allocator
+#define CCUNICODE_INTERNAL_TRACKED_HEADER ((sizeof(TCCUnicode_TrackedBlock)+CCUNICODE_INTERNAL_ARENA_ALIGN-1)/CCUNICODE_INTERNAL_ARENA_ALIGN*CCUNICODE_INTERNAL_ARENA_ALIGN)
+
+static void *ccunicode_InternalTrackedMalloc(void *Ctx, size_t Size)
+{
+    TCCUnicode_TrackingAllocator *Tracker = (TCCUnicode_TrackingAllocator*)Ctx;
+    TCCUnicode_TrackedBlock *Block = NULL;
+    if (Size <= SIZE_MAX - CCUNICODE_INTERNAL_TRACKED_HEADER)
+        Block = (TCCUnicode_TrackedBlock*)ccunicode_InternalMalloc(&Tracker->backing.malloc_ptr, CCUNICODE_INTERNAL_TRACKED_HEADER + Size);
+    if (!Block)
+    {
+        Tracker->stats.failed_count++;
+        return NULL;
+    }
+
+    Block->prev = NULL;
+    Block->next = Tracker->blocks;
+    Block->size = Size;
+    Block->sequence = Tracker->next_sequence++;
+    if (Tracker->blocks)
+        Tracker->blocks->prev = Block;
+    Tracker->blocks = Block;
+
+    int Bucket = 0;
+    while (Bucket < CCUNICODE_TRACKING_SIZE_BUCKETS-1 && (Size >> (Bucket+1)))
+        ++Bucket;
+    Tracker->stats.size_histogram[Bucket]++;
+    Tracker->stats.alloc_count++;
+    Tracker->stats.outstanding_count++;
+    Tracker->stats.total_bytes += Size;
+    Tracker->stats.current_bytes += Size;
+    if (Tracker->stats.current_bytes > Tracker->stats.peak_bytes)
+        Tracker->stats.peak_bytes = Tracker->stats.current_bytes;
+
+    return (uint8_t*)Block + CCUNICODE_INTERNAL_TRACKED_HEADER;
+}
+
+static void ccunicode_InternalUnlinkTrackedBlock(TCCUnicode_TrackingAllocator *Tracker, TCCUnicode_TrackedBlock *Block)
+{
+    if (Block->prev)
+        Block->prev->next = Block->next;
+    else
+        Tracker->blocks = Block->next;
+    if (Block->next)
+        Block->next->prev = Block->prev;
+
+    Tracker->stats.outstanding_count--;
+    Tracker->stats.current_bytes -= Block->size;
+}
+
+static void ccunicode_InternalTrackedFree(void *Ctx, void *Ptr)
+{
+    TCCUnicode_TrackingAllocator *Tracker = (TCCUnicode_TrackingAllocator*)Ctx;
+    if (!Ptr)
+        return;
+
+    TCCUnicode_TrackedBlock *Block = (TCCUnicode_TrackedBlock*)((uint8_t*)Ptr - CCUNICODE_INTERNAL_TRACKED_HEADER);
+    ccunicode_InternalUnlinkTrackedBlock(Tracker, Block);
+    Tracker->stats.free_count++;
+    ccunicode_InternalFree(&Tracker->backing.malloc_ptr, Block);
+}
+
+int ccunicode_InitTrackingAllocator(TCCUnicode_TrackingAllocator *Tracker, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    if (!Tracker)
+        return CCUNICODE_NULL_POINTER;
+
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    memset(Tracker, 0, sizeof(*Tracker));
+    ccunicode_InitCtxMallocPtr(&Tracker->allocator, Tracker, &ccunicode_InternalTrackedMalloc, &ccunicode_InternalTrackedFree);
+    ccunicode_InternalCopyAllocator(&Tracker->backing, AllocPtr);
+
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_DestroyTrackingAllocator(TCCUnicode_TrackingAllocator *Tracker)
+{
+    if (!Tracker)
+        return CCUNICODE_NULL_POINTER;
+
+    while (Tracker->blocks)
+    {
+        TCCUnicode_TrackedBlock *Block = Tracker->blocks;
+        ccunicode_InternalUnlinkTrackedBlock(Tracker, Block);
+        ccunicode_InternalFree(&Tracker->backing.malloc_ptr, Block);
+    }
+
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_GetTrackingStats(const TCCUnicode_TrackingAllocator *Tracker, TCCUnicode_TrackingStats *Stats)
+{
+    if (!Tracker || !Stats)
+        return CCUNICODE_NULL_POINTER;
+
+    *Stats = Tracker->stats;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_ResetTrackingStats(TCCUnicode_TrackingAllocator *Tracker)
+{
+    if (!Tracker)
+        return CCUNICODE_NULL_POINTER;
+
+    size_t CurrentBytes = Tracker->stats.current_bytes;
+    size_t OutstandingCount = Tracker->stats.outstanding_count;
+    memset(&Tracker->stats, 0, sizeof(Tracker->stats));
+    Tracker->stats.current_bytes = CurrentBytes;
+    Tracker->stats.peak_bytes = CurrentBytes;
+    Tracker->stats.outstanding_count = OutstandingCount;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_ReportTrackedBlocks(const TCCUnicode_TrackingAllocator *Tracker, void (*ReportFunc)(void *UserData, const void *Ptr, size_t Size, size_t Sequence), void *UserData)
+{
+    if (!Tracker)
+        return CCUNICODE_NULL_POINTER;
+
+    int Count = 0;
+    for (const TCCUnicode_TrackedBlock *Block = Tracker->blocks; Block; Block = Block->next)
+    {
+        if (ReportFunc)
+            ReportFunc(UserData, (const uint8_t*)Block + CCUNICODE_INTERNAL_TRACKED_HEADER, Block->size, Block->sequence);
+        if (Count == INT_MAX)
+            return CCUNICODE_OVERFLOW;
+        ++Count;
+    }
+
+    return Count;
+}
+
+// Output sizes of the context conversions are int, even if the buffer could hold more
+static int ccunicode_InternalClampSize(int64_t Size)
+{
+    return Size > INT_MAX ? INT_MAX : (int)Size;
+}
+
+// Alignment asked for the buffers of a context
+#define CCUNICODE_INTERNAL_CACHE_LINE 64
+
+// Buffers of a context only hold the result of the latest conversion, so they are not copied when growing
+static int ccunicode_InternalReserve(const TCCUnicode_MallocPtr *AllocPtr, void **Buffer, size_t *BufferSize, size_t Size)
+{
+    if (Size <= *BufferSize)
+        return CCUNICODE_NO_ERROR;
+
+    // A buffer grows through realloc keeping no byte, which an arena can do in place
+    size_t NewSize = (*BufferSize <= SIZE_MAX/2 && *BufferSize*2 > Size) ? *BufferSize*2 : Size;
+    void *NewBuffer = *Buffer ? ccunicode_InternalRealloc(AllocPtr, *Buffer, 0, NewSize) : ccunicode_InternalAlignedMalloc(AllocPtr, CCUNICODE_INTERNAL_CACHE_LINE, NewSize);
+    if (!NewBuffer)
+        return CCUNICODE_BAD_ALLOCATION;
+
+    *Buffer = NewBuffer;
+    *BufferSize = NewSize;
+    return CCUNICODE_NO_ERROR;
+}
+
+static int ccunicode_InternalReserveOutput(TCCUnicode_Context *Context, int64_t Units, size_t UnitSize)
+{
+    if ((uint64_t)Units > SIZE_MAX/UnitSize)
+        return CCUNICODE_OVERFLOW;
+    return ccunicode_InternalReserve(&Context->allocator.malloc_ptr, &Context->output, &Context->output_size, (size_t)Units*UnitSize);
+}
+
+static int ccunicode_InternalReserveScratch(TCCUnicode_Context *Context, int64_t Codepoints)
+{
+    if ((uint64_t)Codepoints > SIZE_MAX/sizeof(uint32_t))
+        return CCUNICODE_OVERFLOW;
+    return ccunicode_InternalReserve(&Context->allocator.malloc_ptr, &Context->scratch, &Context->scratch_size, (size_t)Codepoints*sizeof(uint32_t));
+}
+
+// Decodes like ccunicode_Utf8ToCodepoints_nm, but invalid characters are replaced and decoding goes on.
+// Codepoints must hold Utf8Size+1 codepoints.
+static int ccunicode_InternalUtf8ToCodepointsReplace(const uint8_t *Utf8Str, int Utf8Size, uint32_t *Codepoints, TCCUnicode_Context *Context)
+{
+    int WritePos = 0;
+    int ReadPos = 0;
+    while (ReadPos < Utf8Size)
+    {
+        uint8_t CurrentByte = Utf8Str[ReadPos++];
+        if (CurrentByte == 0)
+            break;
+
+        uint32_t CodePoint = CurrentByte;
+        int RemainingBytes = 0;
+        if (CurrentByte >= 0xC0 && CurrentByte <= 0xDF)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0x1F);
+            RemainingBytes = 1;
+        }
+        else if (CurrentByte >= 0xE0 && CurrentByte <= 0xEF)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0xF);
+            RemainingBytes = 2;
+        }
+        else if (CurrentByte >= 0xF0 && CurrentByte <= 0xF7)
+        {
+            CodePoint = (uint32_t)(CurrentByte & 0x7);
+            RemainingBytes = 3;
+        }
+        else if (CurrentByte >= 0x80)
+        {
+            Codepoints[WritePos++] = Context->replacement;
+            Context->replacement_count++;
+            continue;
+        }
+
+        // A truncated character is replaced as a whole and decoding resumes on the offending byte
+        int j = 0;
+        for (; j < RemainingBytes && ReadPos < Utf8Size; ++j)
+        {
+            CurrentByte = Utf8Str[ReadPos];
+            if (CurrentByte < 0x80 || CurrentByte > 0xBF)
+                break;
+            CodePoint = (CodePoint << 6) + (uint32_t)(CurrentByte & 0x3F);
+            ReadPos++;
+        }
+        if (j < RemainingBytes)
+        {
+            CodePoint = Context->replacement;
+            Context->replacement_count++;
+        }
+
+        Codepoints[WritePos++] = CodePoint;
+    }
+
+    Codepoints[WritePos] = 0;
+    return WritePos;
+}
+
+// Decodes like ccunicode_Utf16ToCodepoints_nm, but unpaired surrogates are replaced and decoding goes on.
+// Codepoints must hold Utf16Size+1 codepoints.
+static int ccunicode_InternalUtf16ToCodepointsReplace(const uint16_t *Utf16Str, int Utf16Size, uint32_t *Codepoints, TCCUnicode_Context *Context)
+{
+    int WritePos = 0;
+    int ReadPos = 0;
+    while (ReadPos < Utf16Size)
+    {
+        uint16_t CurrentCodeUnit = Utf16Str[ReadPos++];
+        if (CurrentCodeUnit == 0)
+            break;
+
+        uint32_t CodePoint = CurrentCodeUnit;
+        if (CurrentCodeUnit >= 0xD800 && CurrentCodeUnit <= 0xDFFF)
+        {
+            // The unit following an unpaired high surrogate is decoded on its own
+            if (CurrentCodeUnit < 0xDC00 && ReadPos < Utf16Size && Utf16Str[ReadPos] >= 0xDC00 && Utf16Str[ReadPos] <= 0xDFFF)
+                CodePoint = ((uint32_t)(CurrentCodeUnit - 0xD800) << 10) + (uint32_t)(Utf16Str[ReadPos++] - 0xDC00) + 0x10000;
+            else
+            {
+                CodePoint = Context->replacement;
+                Context->replacement_count++;
+            }
+        }
+
+        Codepoints[WritePos++] = CodePoint;
+    }
+
+    Codepoints[WritePos] = 0;
+    return WritePos;
+}
+
+// Replaces the codepoints ccunicode_CodepointsToUtf8_nm and ccunicode_CodepointsToUtf16_nm reject
+static void ccunicode_InternalSanitizeCodepoints(uint32_t *Codepoints, int CodepointCount, TCCUnicode_Context *Context)
+{
+    for (int i = 0; i < CodepointCount; ++i)
+    {
+        if (Codepoints[i] > 0x10FFFF || (Codepoints[i] >= 0xD800 && Codepoints[i] <= 0xDFFF))
+        {
+            Codepoints[i] = Context->replacement;
+            Context->replacement_count++;
+        }
+    }
+}
+
+static int ccunicode_InternalCheckContext(TCCUnicode_Context *Context, const void *Str, int Size, const void *Result)
+{
+    if (!Context)
+        return CCUNICODE_NULL_POINTER;
+    if (!Str || !Result)
+        return CCUNICODE_NULL_POINTER;
+    if (Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (Context->error_policy == CCUNICODE_ERROR_POLICY_REPLACE && (Context->replacement > 0x10FFFF || (Context->replacement >= 0xD800 && Context->replacement <= 0xDFFF)))
+        return CCUNICODE_INVALID_CODEPOINT;
+
+    Context->replacement_count = 0;
+    return CCUNICODE_NO_ERROR;
+}
+
+// Number of code units of UnitSize bytes a replacement takes, or 0 without the replace policy
+static int ccunicode_InternalGetReplacementUnits(const TCCUnicode_Context *Context, int UnitSize)
+{
+    if (Context->error_policy != CCUNICODE_ERROR_POLICY_REPLACE)
+        return 0;
+    if (UnitSize == 2)
+        return Context->replacement >= 0x10000 ? 2 : 1;
+    if (Context->replacement <= 0x7F)
+        return 1;
+    if (Context->replacement <= 0x7FF)
+        return 2;
+    return Context->replacement <= 0xFFFF ? 3 : 4;
+}
+
+int ccunicode_InitContext(TCCUnicode_Context *Context, int ErrorPolicy, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    if (!Context)
+        return CCUNICODE_NULL_POINTER;
+    if (ErrorPolicy != CCUNICODE_ERROR_POLICY_STOP && ErrorPolicy != CCUNICODE_ERROR_POLICY_REPLACE)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    memset(Context, 0, sizeof(*Context));
+    ccunicode_InternalCopyAllocator(&Context->allocator, AllocPtr);
+    Context->error_policy = ErrorPolicy;
+    Context->replacement = 0xFFFD;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_SetContextReplacement(TCCUnicode_Context *Context, uint32_t Replacement)
+{
+    if (!Context)
+        return CCUNICODE_NULL_POINTER;
+    if (Replacement > 0x10FFFF || (Replacement >= 0xD800 && Replacement <= 0xDFFF))
+        return CCUNICODE_INVALID_CODEPOINT;
+
+    Context->replacement = Replacement;
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_DestroyContext(TCCUnicode_Context *Context)
+{
+    if (!Context)
+        return CCUNICODE_NULL_POINTER;
+
+    if (Context->output)
+        ccunicode_InternalFree(&Context->allocator.malloc_ptr, Context->output);
+    if (Context->scratch)
+        ccunicode_InternalFree(&Context->allocator.malloc_ptr, Context->scratch);
+
+    Context->output = NULL;
+    Context->output_size = 0;
+    Context->scratch = NULL;
+    Context->scratch_size = 0;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_Utf8ToCodepoints_c(TCCUnicode_Context *Context, const uint8_t *Utf8Str, uint32_t **Codepoints)
+{
+    return ccunicode_Utf8ToCodepoints_nc(Context, Utf8Str, ccunicode_GetUtf8StrLen(Utf8Str), Codepoints);
+}
+
+static int ccunicode_InternalUtf8ToCodepoints_nc(TCCUnicode_Context *Context, const uint8_t *Utf8Str, int Utf8Size, uint32_t **Codepoints)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckContext(Context, Utf8Str, Utf8Size, Codepoints))
+
+    // Each byte gives at most one codepoint
+    int64_t MaxCodepoints = (int64_t)Utf8Size + 1;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalReserveOutput(Context, MaxCodepoints, sizeof(uint32_t)))
+
+    uint32_t *Output = (uint32_t*)Context->output;
+    int Res = ccunicode_Utf8ToCodepoints_nm(Utf8Str, Utf8Size, Output, ccunicode_InternalClampSize(MaxCodepoints));
+    if (Res < 0 && ccunicode_InternalIsInputError(Res))
+    {
+        if (Context->error_policy == CCUNICODE_ERROR_POLICY_REPLACE)
+            Res = ccunicode_InternalUtf8ToCodepointsReplace(Utf8Str, Utf8Size, Output, Context);
+        else
+            Res = ccunicode_InternalGetUtf8Error(Utf8Str, Utf8Size, Res);
+    }
+
+    if (Res >= 0)
+        *Codepoints = Output;
+    return Res;
+}
+
+int ccunicode_Utf8ToCodepoints_nc(TCCUnicode_Context *Context, const uint8_t *Utf8Str, int Utf8Size, uint32_t **Codepoints)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_CODEPOINTS_NC, Utf8Size)
+    int Res = ccunicode_InternalUtf8ToCodepoints_nc(Context, Utf8Str, Utf8Size, Codepoints);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf16ToCodepoints_c(TCCUnicode_Context *Context, const uint16_t *Utf16Str, uint32_t **Codepoints)
+{
+    return ccunicode_Utf16ToCodepoints_nc(Context, Utf16Str, ccunicode_GetUtf16StrLen(Utf16Str), Codepoints);
+}
+
+static int ccunicode_InternalUtf16ToCodepoints_nc(TCCUnicode_Context *Context, const uint16_t *Utf16Str, int Utf16Size, uint32_t **Codepoints)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckContext(Context, Utf16Str, Utf16Size, Codepoints))
+
+    // Each short gives at most one codepoint
+    int64_t MaxCodepoints = (int64_t)Utf16Size + 1;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalReserveOutput(Context, MaxCodepoints, sizeof(uint32_t)))
+
+    uint32_t *Output = (uint32_t*)Context->output;
+    int Res = ccunicode_Utf16ToCodepoints_nm(Utf16Str, Utf16Size, Output, ccunicode_InternalClampSize(MaxCodepoints));
+    if (Res < 0 && ccunicode_InternalIsInputError(Res))
+    {
+        if (Context->error_policy == CCUNICODE_ERROR_POLICY_REPLACE)
+            Res = ccunicode_InternalUtf16ToCodepointsReplace(Utf16Str, Utf16Size, Output, Context);
+        else
+            Res = ccunicode_InternalGetUtf16Error(Utf16Str, Utf16Size, Res);
+    }
 
-    return CCUNICODE_NO_ERROR;
+    if (Res >= 0)
+        *Codepoints = Output;
+    return Res;
 }
 
-int ccunicode_GetUtf8StrLen(const uint8_t *Utf8Str)
+int ccunicode_Utf16ToCodepoints_nc(TCCUnicode_Context *Context, const uint16_t *Utf16Str, int Utf16Size, uint32_t **Codepoints)
 {
-    if (!Utf8Str)
-        return CCUNICODE_NULL_POINTER;
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_CODEPOINTS_NC, Utf16Size)
+    int Res = ccunicode_InternalUtf16ToCodepoints_nc(Context, Utf16Str, Utf16Size, Codepoints);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
 
-    int Len = 0;
-    while (Utf8Str[Len] != 0)
+// Copies the codepoints to the scratch buffer, replacing the invalid ones
+static int ccunicode_InternalSanitizeToScratch(TCCUnicode_Context *Context, const uint32_t *Codepoints, int CodepointCount, uint32_t **Sanitized)
+{
+    int Count = 0;
+    while (Count < CodepointCount && Codepoints[Count])
+        ++Count;
+
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalReserveScratch(Context, (int64_t)Count + 1))
+    *Sanitized = (uint32_t*)Context->scratch;
+    memcpy(*Sanitized, Codepoints, (size_t)Count*sizeof(uint32_t));
+    (*Sanitized)[Count] = 0;
+    ccunicode_InternalSanitizeCodepoints(*Sanitized, Count, Context);
+    return Count;
+}
+
+int ccunicode_CodepointsToUtf8_c(TCCUnicode_Context *Context, const uint32_t *Codepoints, uint8_t **Utf8Str)
+{
+    return ccunicode_CodepointsToUtf8_nc(Context, Codepoints, ccunicode_GetCodepointCount(Codepoints), Utf8Str);
+}
+
+static int ccunicode_InternalCodepointsToUtf8_nc(TCCUnicode_Context *Context, const uint32_t *Codepoints, int CodepointCount, uint8_t **Utf8Str)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckContext(Context, Codepoints, CodepointCount, Utf8Str))
+
+    // Each codepoint gives at most four bytes
+    int64_t MaxBytes = 4*(int64_t)CodepointCount + 1;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalReserveOutput(Context, MaxBytes, sizeof(uint8_t)))
+
+    uint8_t *Output = (uint8_t*)Context->output;
+    int Res = ccunicode_CodepointsToUtf8_nm(Codepoints, CodepointCount, Output, ccunicode_InternalClampSize(MaxBytes));
+    if (Res < 0 && Context->error_policy == CCUNICODE_ERROR_POLICY_REPLACE && ccunicode_InternalIsInputError(Res))
     {
-        if (Len == INT_MAX)
-            return CCUNICODE_OVERFLOW;
-        ++Len;
+        uint32_t *Sanitized;
+        int Count = ccunicode_InternalSanitizeToScratch(Context, Codepoints, CodepointCount, &Sanitized);
+        if (Count < 0)
+            return Count;
+        Res = ccunicode_CodepointsToUtf8_nm(Sanitized, Count, Output, ccunicode_InternalClampSize(MaxBytes));
     }
-    return Len;
+
+    if (Res >= 0)
+        *Utf8Str = Output;
+    return Res;
 }
 
-int ccunicode_GetUtf16StrLen(const uint16_t *Utf16Str)
+int ccunicode_CodepointsToUtf8_nc(TCCUnicode_Context *Context, const uint32_t *Codepoints, int CodepointCount, uint8_t **Utf8Str)
 {
-    if (!Utf16Str)
-        return CCUNICODE_NULL_POINTER;
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF8_NC, CodepointCount)
+    int Res = ccunicode_InternalCodepointsToUtf8_nc(Context, Codepoints, CodepointCount, Utf8Str);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
 
-    int Len = 0;
-    while (Utf16Str[Len] != 0)
+int ccunicode_CodepointsToUtf16_c(TCCUnicode_Context *Context, const uint32_t *Codepoints, uint16_t **Utf16Str)
+{
+    return ccunicode_CodepointsToUtf16_nc(Context, Codepoints, ccunicode_GetCodepointCount(Codepoints), Utf16Str);
+}
+
+static int ccunicode_InternalCodepointsToUtf16_nc(TCCUnicode_Context *Context, const uint32_t *Codepoints, int CodepointCount, uint16_t **Utf16Str)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckContext(Context, Codepoints, CodepointCount, Utf16Str))
+
+    // Each codepoint gives at most two shorts
+    int64_t MaxShorts = 2*(int64_t)CodepointCount + 1;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalReserveOutput(Context, MaxShorts, sizeof(uint16_t)))
+
+    uint16_t *Output = (uint16_t*)Context->output;
+    int Res = ccunicode_CodepointsToUtf16_nm(Codepoints, CodepointCount, Output, ccunicode_InternalClampSize(MaxShorts));
+    if (Res < 0 && Context->error_policy == CCUNICODE_ERROR_POLICY_REPLACE && ccunicode_InternalIsInputError(Res))
     {
-        if (Len == INT_MAX)
-            return CCUNICODE_OVERFLOW;
-        ++Len;
+        uint32_t *Sanitized;
+        int Count = ccunicode_InternalSanitizeToScratch(Context, Codepoints, CodepointCount, &Sanitized);
+        if (Count < 0)
+            return Count;
+        Res = ccunicode_CodepointsToUtf16_nm(Sanitized, Count, Output, ccunicode_InternalClampSize(MaxShorts));
     }
-    return Len;
+
+    if (Res >= 0)
+        *Utf16Str = Output;
+    return Res;
 }
 
-int ccunicode_GetCodepointCount(const uint32_t *Codepoints)
+int ccunicode_CodepointsToUtf16_nc(TCCUnicode_Context *Context, const uint32_t *Codepoints, int CodepointCount, uint16_t **Utf16Str)
 {
-    if (!Codepoints)
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF16_NC, CodepointCount)
+    int Res = ccunicode_InternalCodepointsToUtf16_nc(Context, Codepoints, CodepointCount, Utf16Str);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf8ToUtf16_c(TCCUnicode_Context *Context, const uint8_t *Utf8Str, uint16_t **Utf16Str)
+{
+    return ccunicode_Utf8ToUtf16_nc(Context, Utf8Str, ccunicode_GetUtf8StrLen(Utf8Str), Utf16Str);
+}
+
+static int ccunicode_InternalUtf8ToUtf16_nc(TCCUnicode_Context *Context, const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckContext(Context, Utf8Str, Utf8Size, Utf16Str))
+
+    // Each byte gives at most one codepoint and one short, or the shorts of a replacement
+    int ReplacementUnits = ccunicode_InternalGetReplacementUnits(Context, 2);
+    int64_t MaxCodepoints = (int64_t)Utf8Size + 1;
+    int64_t MaxUnits = (ReplacementUnits > 1 ? ReplacementUnits : 1)*(int64_t)Utf8Size + 1;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalReserveOutput(Context, MaxUnits, sizeof(uint16_t)))
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalReserveScratch(Context, MaxCodepoints))
+
+    uint32_t *Codepoints = (uint32_t*)Context->scratch;
+    int CodepointCount = ccunicode_Utf8ToCodepoints_nm(Utf8Str, Utf8Size, Codepoints, ccunicode_InternalClampSize(MaxCodepoints));
+    if (Context->error_policy == CCUNICODE_ERROR_POLICY_REPLACE)
+    {
+        if (CodepointCount < 0 && ccunicode_InternalIsInputError(CodepointCount))
+            CodepointCount = ccunicode_InternalUtf8ToCodepointsReplace(Utf8Str, Utf8Size, Codepoints, Context);
+        if (CodepointCount >= 0)
+            ccunicode_InternalSanitizeCodepoints(Codepoints, CodepointCount, Context);
+    }
+    else if (CodepointCount < 0 && ccunicode_InternalIsInputError(CodepointCount))
+        CodepointCount = ccunicode_InternalGetUtf8Error(Utf8Str, Utf8Size, CodepointCount);
+    if (CodepointCount < 0)
+        return CodepointCount;
+
+    uint16_t *Output = (uint16_t*)Context->output;
+    int Res = ccunicode_CodepointsToUtf16_nm(Codepoints, CodepointCount, Output, ccunicode_InternalClampSize(MaxUnits));
+    if (Res >= 0)
+        *Utf16Str = Output;
+    return Res;
+}
+
+int ccunicode_Utf8ToUtf16_nc(TCCUnicode_Context *Context, const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NC, Utf8Size)
+    int Res = ccunicode_InternalUtf8ToUtf16_nc(Context, Utf8Str, Utf8Size, Utf16Str);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+int ccunicode_Utf16ToUtf8_c(TCCUnicode_Context *Context, const uint16_t *Utf16Str, uint8_t **Utf8Str)
+{
+    return ccunicode_Utf16ToUtf8_nc(Context, Utf16Str, ccunicode_GetUtf16StrLen(Utf16Str), Utf8Str);
+}
+
+static int ccunicode_InternalUtf16ToUtf8_nc(TCCUnicode_Context *Context, const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckContext(Context, Utf16Str, Utf16Size, Utf8Str))
+
+    // Each short gives at most one codepoint and three bytes, or the bytes of a replacement
+    int ReplacementBytes = ccunicode_InternalGetReplacementUnits(Context, 1);
+    int64_t MaxCodepoints = (int64_t)Utf16Size + 1;
+    int64_t MaxBytes = (ReplacementBytes > 3 ? ReplacementBytes : 3)*(int64_t)Utf16Size + 1;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalReserveOutput(Context, MaxBytes, sizeof(uint8_t)))
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalReserveScratch(Context, MaxCodepoints))
+
+    uint32_t *Codepoints = (uint32_t*)Context->scratch;
+    int CodepointCount = ccunicode_Utf16ToCodepoints_nm(Utf16Str, Utf16Size, Codepoints, ccunicode_InternalClampSize(MaxCodepoints));
+    if (Context->error_policy == CCUNICODE_ERROR_POLICY_REPLACE)
+    {
+        if (CodepointCount < 0 && ccunicode_InternalIsInputError(CodepointCount))
+            CodepointCount = ccunicode_InternalUtf16ToCodepointsReplace(Utf16Str, Utf16Size, Codepoints, Context);
+        if (CodepointCount >= 0)
+            ccunicode_InternalSanitizeCodepoints(Codepoints, CodepointCount, Context);
+    }
+    else if (CodepointCount < 0 && ccunicode_InternalIsInputError(CodepointCount))
+        CodepointCount = ccunicode_InternalGetUtf16Error(Utf16Str, Utf16Size, CodepointCount);
+    if (CodepointCount < 0)
+        return CodepointCount;
+
+    uint8_t *Output = (uint8_t*)Context->output;
+    int Res = ccunicode_CodepointsToUtf8_nm(Codepoints, CodepointCount, Output, ccunicode_InternalClampSize(MaxBytes));
+    if (Res >= 0)
+        *Utf8Str = Output;
+    return Res;
+}
+
+int ccunicode_Utf16ToUtf8_nc(TCCUnicode_Context *Context, const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_UTF16_TO_UTF8_NC, Utf16Size)
+    int Res = ccunicode_InternalUtf16ToUtf8_nc(Context, Utf16Str, Utf16Size, Utf8Str);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+// The in-place conversions write each codepoint after reading it and never write past what was read:
+// after reading ReadPos codepoints (4*ReadPos bytes), at most 4*ReadPos bytes were written.
+// Four codepoints are handled at once while they all take a single code unit.
+int ccunicode_CodepointsToUtf8InPlace(uint32_t *Codepoints, uint8_t **Utf8Str)
+{
+    int CodepointCount = ccunicode_GetCodepointCount(Codepoints);
+    if (CodepointCount < 0)
+        return CodepointCount;
+
+    return ccunicode_CodepointsToUtf8InPlace_n(Codepoints, CodepointCount, Utf8Str);
+}
+
+static int ccunicode_InternalCodepointsToUtf8InPlace_n(uint32_t *Codepoints, int CodepointCount, uint8_t **Utf8Str)
+{
+    if (!Codepoints || !Utf8Str)
         return CCUNICODE_NULL_POINTER;
+    if (CodepointCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
 
-    int Len = 0;
-    while (Codepoints[Len] != 0)
+    uint8_t *Output = (uint8_t*)Codepoints;
+    int64_t WritePos = 0;
+    int ReadPos = 0;
+    while (ReadPos < CodepointCount)
     {
-        if (Len == INT_MAX)
-            return CCUNICODE_OVERFLOW;
-        ++Len;
+        // Codepoints 1 to 0x7F are single bytes (the subtraction sends 0 out of range)
+        while (CodepointCount - ReadPos >= 4 && Codepoints[ReadPos]-1 < 0x7F)
+        {
+            uint32_t C0 = Codepoints[ReadPos];
+            uint32_t C1 = Codepoints[ReadPos+1];
+            uint32_t C2 = Codepoints[ReadPos+2];
+            uint32_t C3 = Codepoints[ReadPos+3];
+            if (!((C0-1 < 0x7F) & (C1-1 < 0x7F) & (C2-1 < 0x7F) & (C3-1 < 0x7F)))
+                break;
+
+            uint8_t Packed[4] = {(uint8_t)C0, (uint8_t)C1, (uint8_t)C2, (uint8_t)C3};
+            memcpy(Output + WritePos, Packed, sizeof(Packed));
+            WritePos += 4;
+            ReadPos += 4;
+        }
+        if (ReadPos == CodepointCount)
+            break;
+
+        uint32_t CurrentCodepoint = Codepoints[ReadPos++];
+        if (CurrentCodepoint > 0x10FFFF)
+            return CCUNICODE_INVALID_CODEPOINT;
+        if (CurrentCodepoint >= 0xD800 && CurrentCodepoint <= 0xDFFF)
+            return CCUNICODE_INVALID_CODEPOINT;
+        if (CurrentCodepoint == 0)
+            break;
+
+        if (CurrentCodepoint <= 0x7F)
+        {
+            Output[WritePos++] = (uint8_t)CurrentCodepoint;
+        }
+        else if (CurrentCodepoint <= 0x7FF)
+        {
+            Output[WritePos++] = 0xC0 + (uint8_t)((CurrentCodepoint >> 6) & 0x1F);
+            Output[WritePos++] = 0x80 + (uint8_t)(CurrentCodepoint & 0x3F);
+        }
+        else if (CurrentCodepoint <= 0xFFFF)
+        {
+            Output[WritePos++] = 0xE0 + (uint8_t)((CurrentCodepoint >> 12) & 0xF);
+            Output[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint >> 6) & 0x3F);
+            Output[WritePos++] = 0x80 + (uint8_t)(CurrentCodepoint & 0x3F);
+        }
+        else
+        {
+            Output[WritePos++] = 0xF0 + (uint8_t)((CurrentCodepoint >> 18) & 0x7);
+            Output[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint >> 12) & 0x3F);
+            Output[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint >> 6) & 0x3F);
+            Output[WritePos++] = 0x80 + (uint8_t)(CurrentCodepoint & 0x3F);
+        }
     }
-    return Len;
+
+    if (WritePos > INT_MAX)
+        return CCUNICODE_OVERFLOW;
+
+    Output[WritePos] = 0;
+    *Utf8Str = Output;
+    return (int)WritePos;
 }
 
-int ccunicode_CountCodepointsInUtf8(const uint8_t *Utf8Str)
+int ccunicode_CodepointsToUtf8InPlace_n(uint32_t *Codepoints, int CodepointCount, uint8_t **Utf8Str)
 {
-    int Res = ccunicode_GetUtf8StrLen(Utf8Str);
-    if (Res < 0)
-        return Res;
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF8_IN_PLACE_N, CodepointCount)
+    int Res = ccunicode_InternalCodepointsToUtf8InPlace_n(Codepoints, CodepointCount, Utf8Str);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
 
-    return ccunicode_CountCodepointsInUtf8_n(Utf8Str, Res);
+int ccunicode_CodepointsToUtf16InPlace(uint32_t *Codepoints, uint16_t **Utf16Str)
+{
+    int CodepointCount = ccunicode_GetCodepointCount(Codepoints);
+    if (CodepointCount < 0)
+        return CodepointCount;
+
+    return ccunicode_CodepointsToUtf16InPlace_n(Codepoints, CodepointCount, Utf16Str);
 }
 
-int ccunicode_CountCodepointsInUtf8_n(const uint8_t *Utf8Str, int Utf8Size)
+static int ccunicode_InternalCodepointsToUtf16InPlace_n(uint32_t *Codepoints, int CodepointCount, uint16_t **Utf16Str)
 {
-    if (!Utf8Str)
+    if (!Codepoints || !Utf16Str)
         return CCUNICODE_NULL_POINTER;
-    if (Utf8Size < 0)
+    if (CodepointCount < 0)
         return CCUNICODE_INVALID_PARAMETER;
-    if (!Utf8Size)
-        return 0;
 
-    int Count = 0;
-    int RemainingBytes = 0;
-    for (int Pos = 0; Pos < Utf8Size; ++Pos)
+    uint16_t *Output = (uint16_t*)Codepoints;
+    int64_t WritePos = 0;
+    int ReadPos = 0;
+    while (ReadPos < CodepointCount)
     {
-        uint8_t CurrentByte = Utf8Str[Pos];
+        // Codepoints 1 to 0xD7FF are single shorts (the subtraction sends 0 out of range)
+        while (CodepointCount - ReadPos >= 4 && Codepoints[ReadPos]-1 < 0xD7FF)
+        {
+            uint32_t C0 = Codepoints[ReadPos];
+            uint32_t C1 = Codepoints[ReadPos+1];
+            uint32_t C2 = Codepoints[ReadPos+2];
+            uint32_t C3 = Codepoints[ReadPos+3];
+            if (!((C0-1 < 0xD7FF) & (C1-1 < 0xD7FF) & (C2-1 < 0xD7FF) & (C3-1 < 0xD7FF)))
+                break;
+
+            // Storing through memcpy keeps these stores after the loads of the same bytes
+            uint16_t Packed[4] = {(uint16_t)C0, (uint16_t)C1, (uint16_t)C2, (uint16_t)C3};
+            memcpy(Output + WritePos, Packed, sizeof(Packed));
+            WritePos += 4;
+            ReadPos += 4;
+        }
+        if (ReadPos == CodepointCount)
+            break;
 
-        // If the code is 0 then we have reached the end of the string
-        if (CurrentByte == 0x00)
-            return Count;
+        uint32_t CurrentCodepoint = Codepoints[ReadPos++];
+        if (CurrentCodepoint > 0x10FFFF)
+            return CCUNICODE_INVALID_CODEPOINT;
+        if (CurrentCodepoint >= 0xD800 && CurrentCodepoint <= 0xDFFF)
+            return CCUNICODE_INVALID_CODEPOINT;
+        if (CurrentCodepoint == 0)
+            break;
+
+        if (CurrentCodepoint <= 0xFFFF)
+        {
+            Output[WritePos++] = (uint16_t)CurrentCodepoint;
+        }
+        else
+        {
+            CurrentCodepoint -= 0x10000;
+            Output[WritePos++] = (uint16_t)(0xD800 + ((CurrentCodepoint >> 10) & 0x3FF));
+            Output[WritePos++] = (uint16_t)(0xDC00 + (CurrentCodepoint & 0x3FF));
+        }
+    }
+
+    if (WritePos > INT_MAX)
+        return CCUNICODE_OVERFLOW;
+
+    Output[WritePos] = 0;
+    *Utf16Str = Output;
+    return (int)WritePos;
+}
+
+int ccunicode_CodepointsToUtf16InPlace_n(uint32_t *Codepoints, int CodepointCount, uint16_t **Utf16Str)
+{
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF16_IN_PLACE_N, CodepointCount)
+    int Res = ccunicode_InternalCodepointsToUtf16InPlace_n(Codepoints, CodepointCount, Utf16Str);
+    CCUNICODE_INTERNAL_LEAVE(Res, Res)
+    return Res;
+}
+
+// Counts the characters of Utf8Str from Utf8Pos up to Utf8Size, stopping after MaxCount of them or at a null byte.
+// Whole words are counted by their lead bytes and validated as in ccunicode_InternalCountTinyUtf8,
+// the scalar loop then finishes from the last word boundary which was also a character boundary.
+// Returns the position reached and sets Count, or returns a negative number on error.
+static int ccunicode_InternalSkipUtf8(const uint8_t *Utf8Str, int Utf8Size, int Utf8Pos, int MaxCount, int *Count)
+{
+    int Pos = Utf8Pos;
+    int Counted = 0;
+    int BoundaryPos = Pos;
+    int BoundaryCount = 0;
+    uint64_t Carry = 0;
+    while (Utf8Size - Pos >= 8)
+    {
+        uint64_t Word = ccunicode_InternalLoadLittleEndian64(Utf8Str + Pos);
+        uint64_t Zeros = ccunicode_InternalSwarIsZero(Word);
+
+        uint64_t Lead2 = Word & (Word << 1) & CCUNICODE_INTERNAL_SWAR_HIGH;
+        uint64_t Lead3 = Lead2 & (Word << 2);
+        uint64_t Lead4 = Lead3 & (Word << 3);
+        uint64_t Expected = Carry | (Lead2 << 8) | (Lead3 << 16) | (Lead4 << 24);
+        uint64_t Extensions = Word & ~(Word << 1) & CCUNICODE_INTERNAL_SWAR_HIGH;
+        uint64_t Errors = (Expected ^ Extensions) | (Lead4 & (Word << 4));
+
+        // The end of the string, an error or the last codepoint to count are located by the scalar loop
+        if (Zeros | Errors)
+            break;
+        int WordCount = 8 - ccunicode_InternalSwarCountLanes(Extensions);
+        if (WordCount > MaxCount - Counted)
+            break;
+
+        Pos += 8;
+        Counted += WordCount;
+        Carry = (Lead2 >> 56) | (Lead3 >> 48) | (Lead4 >> 40);
+        if (!Carry)
+        {
+            BoundaryPos = Pos;
+            BoundaryCount = Counted;
+        }
+    }
+
+    Pos = BoundaryPos;
+    Counted = BoundaryCount;
+    while (Counted < MaxCount && Pos < Utf8Size)
+    {
+        uint8_t CurrentByte = Utf8Str[Pos];
+        if (CurrentByte == 0)
+            break;
 
-        // The first byte encoding a code point must either be ASCII (< 0x80)
-        // or it must carry the correct starting bitmask for the length info.
-        // In practice, the following range are forbidden:
-        // 0x80-0xBF
-        // 0xF8-0xFF
         if (CurrentByte >= 0x80 && CurrentByte <= 0xBF)
             return CCUNICODE_INVALID_UTF8_CHARACTER;
-        if (CurrentByte >= 0xF8 /* && CurrentByte <= 0xFF */)
+        if (CurrentByte >= 0xF8)
             return CCUNICODE_INVALID_UTF8_CHARACTER;
 
-        if (Count == INT_MAX)
-            return CCUNICODE_OVERFLOW;
-        ++Count;
+        int Length = 1 + (CurrentByte >= 0xC0) + (CurrentByte >= 0xE0) + (CurrentByte >= 0xF0);
+        if (Length > Utf8Size - Pos)
+            return CCUNICODE_STRING_ENDED_IN_CHARACTER;
 
-        if (CurrentByte >= 0x01 && CurrentByte <= 0x7F)
+        for (int j = 1; j < Length; ++j)
         {
-            RemainingBytes = 0;
+            CurrentByte = Utf8Str[Pos+j];
+            if (CurrentByte == 0)
+                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+            if (CurrentByte < 0x80 || CurrentByte > 0xBF)
+                return CCUNICODE_INVALID_UTF8_CHARACTER;
         }
 
-        if (CurrentByte >= 0xC0 && CurrentByte <= 0xDF)
+        Pos += Length;
+        ++Counted;
+    }
+
+    *Count = Counted;
+    return Pos;
+}
+
+// Same as ccunicode_InternalSkipUtf8 for UTF16, where words of 4 shorts without surrogates nor null are skipped at once
+static int ccunicode_InternalSkipUtf16(const uint16_t *Utf16Str, int Utf16Size, int Utf16Pos, int MaxCount, int *Count)
+{
+    const uint64_t Low = 0x0001000100010001ULL;
+    const uint64_t High = 0x8000800080008000ULL;
+
+    int Pos = Utf16Pos;
+    int Counted = 0;
+    while (Counted < MaxCount && Pos < Utf16Size)
+    {
+        if (Utf16Size - Pos >= 4 && MaxCount - Counted >= 4)
         {
-            RemainingBytes = 1;
+            uint64_t Word;
+            memcpy(&Word, Utf16Str + Pos, sizeof(Word));
+
+            // A lane is null or a surrogate if it is 0 or if its top 5 bits are 11011
+            uint64_t Surrogates = (Word & 0xF800F800F800F800ULL) ^ 0xD800D800D800D800ULL;
+            uint64_t Special = ((Word - Low) & ~Word) | ((Surrogates - Low) & ~Surrogates);
+            if (!(Special & High))
+            {
+                Pos += 4;
+                Counted += 4;
+                continue;
+            }
         }
 
-        if (CurrentByte >= 0xE0 && CurrentByte <= 0xEF)
+        uint16_t CurrentCodeUnit = Utf16Str[Pos];
+        if (CurrentCodeUnit == 0)
+            break;
+
+        if (CurrentCodeUnit >= 0xD800 && CurrentCodeUnit <= 0xDFFF)
         {
-            RemainingBytes = 2;
-        }
+            if (CurrentCodeUnit >= 0xDC00)
+                return CCUNICODE_SURROGATE_PAIR_INVERSION;
+            if (Pos == Utf16Size-1)
+                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
 
-        if (CurrentByte >= 0xF0 && CurrentByte <= 0xF7)
+            CurrentCodeUnit = Utf16Str[Pos+1];
+            if (CurrentCodeUnit == 0)
+                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+            if (CurrentCodeUnit < 0xDC00 || CurrentCodeUnit > 0xDFFF)
+                return CCUNICODE_INVALID_UTF16_CHARACTER;
+            Pos += 2;
+        }
+        else
         {
-            RemainingBytes = 3;
+            ++Pos;
         }
+        ++Counted;
+    }
 
-        // We check we are allowed that many bytes for the codepoint
-        if (Pos + RemainingBytes >= Utf8Size)
-            return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+    *Count = Counted;
+    return Pos;
+}
 
-        // Now collect remaining part of the codepoint (if any)
-        for (size_t j = 0; j < RemainingBytes; ++j)
-        {
-            CurrentByte = Utf8Str[++Pos];
+int ccunicode_AdvanceUtf8_n(const uint8_t *Utf8Str, int Utf8Size, int Utf8Pos, int CodepointCount)
+{
+    if (!Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < 0 || Utf8Pos < 0 || Utf8Pos > Utf8Size || CodepointCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    int Count = 0;
+    int Pos = ccunicode_InternalSkipUtf8(Utf8Str, Utf8Size, Utf8Pos, CodepointCount, &Count);
+    if (Pos < 0)
+        return Pos;
+    if (Count < CodepointCount)
+        return CCUNICODE_INVALID_PARAMETER;
+    return Pos;
+}
+
+int ccunicode_AdvanceUtf16_n(const uint16_t *Utf16Str, int Utf16Size, int Utf16Pos, int CodepointCount)
+{
+    if (!Utf16Str)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf16Size < 0 || Utf16Pos < 0 || Utf16Pos > Utf16Size || CodepointCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    int Count = 0;
+    int Pos = ccunicode_InternalSkipUtf16(Utf16Str, Utf16Size, Utf16Pos, CodepointCount, &Count);
+    if (Pos < 0)
+        return Pos;
+    if (Count < CodepointCount)
+        return CCUNICODE_INVALID_PARAMETER;
+    return Pos;
+}
 
-            if (CurrentByte == 0)
-                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
-            // The only valid range is 0x80-0xDF for an extension
-            if (CurrentByte < 0x80 || CurrentByte > 0xDF)
-                return CCUNICODE_INVALID_UTF8_CHARACTER;
-        }
-    }
+int ccunicode_GetUtf8OffsetOfCodepoint_n(const uint8_t *Utf8Str, int Utf8Size, int CodepointIndex)
+{
+    return ccunicode_AdvanceUtf8_n(Utf8Str, Utf8Size, 0, CodepointIndex);
+}
 
-    return Count;
+int ccunicode_GetUtf16OffsetOfCodepoint_n(const uint16_t *Utf16Str, int Utf16Size, int CodepointIndex)
+{
+    return ccunicode_AdvanceUtf16_n(Utf16Str, Utf16Size, 0, CodepointIndex);
 }
 
-int ccunicode_CountCodepointsInUtf16(const uint16_t *Utf16Str)
+int ccunicode_GetCodepointIndexOfUtf8Offset_n(const uint8_t *Utf8Str, int Utf8Size, int Utf8Offset)
 {
-    int Res = ccunicode_GetUtf16StrLen(Utf16Str);
-    if (Res < 0)
-        return Res;
+    if (!Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < 0 || Utf8Offset < 0 || Utf8Offset > Utf8Size)
+        return CCUNICODE_INVALID_PARAMETER;
 
-    return ccunicode_CountCodepointsInUtf16_n(Utf16Str, Res);
+    // Scanning only up to the offset reports a character cut by it as ended in the middle
+    int Count = 0;
+    int Pos = ccunicode_InternalSkipUtf8(Utf8Str, Utf8Offset, 0, INT_MAX, &Count);
+    if (Pos < 0)
+        return Pos;
+    if (Pos < Utf8Offset)
+        return CCUNICODE_INVALID_PARAMETER;
+    return Count;
 }
 
-int ccunicode_CountCodepointsInUtf16_n(const uint16_t *Utf16Str, int Utf16Size)
+int ccunicode_GetCodepointIndexOfUtf16Offset_n(const uint16_t *Utf16Str, int Utf16Size, int Utf16Offset)
 {
     if (!Utf16Str)
         return CCUNICODE_NULL_POINTER;
-    if (Utf16Size < 0)
+    if (Utf16Size < 0 || Utf16Offset < 0 || Utf16Offset > Utf16Size)
         return CCUNICODE_INVALID_PARAMETER;
-    if (!Utf16Size)
-        return 0;
 
     int Count = 0;
-    int RemainingBytes = 0;
-    for (int Pos = 0; Pos < Utf16Size; ++Pos)
+    int Pos = ccunicode_InternalSkipUtf16(Utf16Str, Utf16Offset, 0, INT_MAX, &Count);
+    if (Pos < 0)
+        return Pos;
+    if (Pos < Utf16Offset)
+        return CCUNICODE_INVALID_PARAMETER;
+    return Count;
+}
+
+// Number of 4 bytes characters, which become surrogate pairs in UTF16, in a valid UTF8 string
+static int ccunicode_InternalCountSupplementaryUtf8(const uint8_t *Utf8Str, int Utf8Size)
+{
+    int Count = 0;
+    int Pos = 0;
+    for (; Utf8Size - Pos >= 8; Pos += 8)
     {
-        uint16_t CurrentCodeUnit = Utf16Str[Pos];
+        uint64_t Word = ccunicode_InternalLoadLittleEndian64(Utf8Str + Pos);
+        Count += ccunicode_InternalSwarCountLanes(Word & (Word << 1) & (Word << 2) & (Word << 3) & CCUNICODE_INTERNAL_SWAR_HIGH);
+    }
+    for (; Pos < Utf8Size; ++Pos)
+        Count += (Utf8Str[Pos] >= 0xF0);
+    return Count;
+}
 
-        // We must distinguish between surrogate pairs and single units
-        if (CurrentCodeUnit >= 0xD800 && CurrentCodeUnit <= 0xDFFF)
-        {
-            if (CurrentCodeUnit >= 0xDC00)
-                return CCUNICODE_SURROGATE_PAIR_INVERSION;
+#define CCUNICODE_INTERNAL_INDEX_MAGIC 0x49554343 // "CCUI" read as a little endian integer
+#define CCUNICODE_INTERNAL_INDEX_VERSION 1
+#define CCUNICODE_INTERNAL_INDEX_HEADER 7
 
-            if (Pos == Utf16Size-1)
-                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+static void ccunicode_InternalStoreLittleEndian32(uint8_t *Bytes, uint32_t Value)
+{
+    Bytes[0] = (uint8_t)Value;
+    Bytes[1] = (uint8_t)(Value >> 8);
+    Bytes[2] = (uint8_t)(Value >> 16);
+    Bytes[3] = (uint8_t)(Value >> 24);
+}
 
-            CurrentCodeUnit = Utf16Str[++Pos];
-            if (CurrentCodeUnit == 0)
-                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
-            if (CurrentCodeUnit < 0xDC00 || CurrentCodeUnit > 0xDFFF)
-                return CCUNICODE_INVALID_UTF16_CHARACTER;
+// The lookups read the string up to the size recorded by the index, which may come from another string once deserialized
+static int ccunicode_InternalCheckCodepointIndex(const TCCUnicode_CodepointIndex *Index, const uint8_t *Utf8Str, int Utf8Size)
+{
+    if (!Index || !Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+    if (!Index->entries)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < Index->utf8_size)
+        return CCUNICODE_INVALID_PARAMETER;
+    return CCUNICODE_NO_ERROR;
+}
 
-            if (Count == INT_MAX)
-                return CCUNICODE_OVERFLOW;
-            ++Count;
-        }
-        else
+int ccunicode_BuildCodepointIndex_n(TCCUnicode_CodepointIndex *Index, const uint8_t *Utf8Str, int Utf8Size, int Stride, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    if (!Index || !Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < 0 || Stride < 1)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    // The entries grow by doubling, starting from a guess assuming mostly 1 byte characters
+    int Capacity = Utf8Size/Stride < 64 ? Utf8Size/Stride + 1 : 64;
+    TCCUnicode_CodepointIndexEntry *Entries = (TCCUnicode_CodepointIndexEntry*)ccunicode_InternalMalloc(AllocPtr, Capacity*sizeof(*Entries));
+    if (!Entries)
+        return CCUNICODE_BAD_ALLOCATION;
+
+    Entries[0].utf8_offset = 0;
+    Entries[0].utf16_offset = 0;
+    int EntryCount = 1;
+    int Pos = 0;
+    int Utf16Pos = 0;
+    int Count = 0;
+    for (;;)
+    {
+        int Skipped = 0;
+        int Next = ccunicode_InternalSkipUtf8(Utf8Str, Utf8Size, Pos, Stride, &Skipped);
+        if (Next < 0)
         {
-            if (CurrentCodeUnit == 0)
-                return Count;
+            ccunicode_InternalFree(AllocPtr, Entries);
+            return Next;
+        }
 
-            if (Count == INT_MAX)
-                return CCUNICODE_OVERFLOW;
-            ++Count;
+        Utf16Pos += Skipped + ccunicode_InternalCountSupplementaryUtf8(Utf8Str + Pos, Next - Pos);
+        Count += Skipped;
+        Pos = Next;
+        if (Skipped < Stride)
+            break;
+
+        if (EntryCount == Capacity)
+        {
+            int NewCapacity = Capacity <= Utf8Size/Stride/2 ? Capacity*2 : Utf8Size/Stride + 1;
+            TCCUnicode_CodepointIndexEntry *NewEntries = (TCCUnicode_CodepointIndexEntry*)ccunicode_InternalRealloc(AllocPtr, Entries, EntryCount*sizeof(*Entries), NewCapacity*sizeof(*Entries));
+            if (!NewEntries)
+            {
+                ccunicode_InternalFree(AllocPtr, Entries);
+                return CCUNICODE_BAD_ALLOCATION;
+            }
+            Entries = NewEntries;
+            Capacity = NewCapacity;
         }
+
+        Entries[EntryCount].utf8_offset = Pos;
+        Entries[EntryCount].utf16_offset = Utf16Pos;
+        ++EntryCount;
     }
 
+    ccunicode_InternalCopyAllocator(&Index->allocator, AllocPtr);
+    Index->stride = Stride;
+    Index->codepoint_count = Count;
+    Index->utf8_size = Pos;
+    Index->utf16_size = Utf16Pos;
+    Index->entry_count = EntryCount;
+    Index->entries = Entries;
     return Count;
 }
 
-int ccunicode_GetUtf8SizeFromCodepoints(const uint32_t *Codepoints)
+int ccunicode_DestroyCodepointIndex(TCCUnicode_CodepointIndex *Index)
 {
-    int Res = ccunicode_GetCodepointCount(Codepoints);
-    if (Res < 0)
-        return Res;
+    if (!Index)
+        return CCUNICODE_NULL_POINTER;
 
-    return ccunicode_GetUtf8SizeFromCodepoints_n(Codepoints, Res);
+    if (Index->entries)
+        ccunicode_InternalFree(&Index->allocator.malloc_ptr, Index->entries);
+    Index->entries = NULL;
+    Index->entry_count = 0;
+
+    return CCUNICODE_NO_ERROR;
 }
 
-int ccunicode_GetUtf8SizeFromCodepoints_n(const uint32_t *Codepoints, int CodepointCount)
+int ccunicode_GetIndexedUtf8Offset(const TCCUnicode_CodepointIndex *Index, const uint8_t *Utf8Str, int Utf8Size, int CodepointIndex)
 {
-    if (!Codepoints)
-        return CCUNICODE_NULL_POINTER;
-    if (CodepointCount < 0)
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckCodepointIndex(Index, Utf8Str, Utf8Size))
+    if (CodepointIndex < 0 || CodepointIndex > Index->codepoint_count)
         return CCUNICODE_INVALID_PARAMETER;
-    if (!CodepointCount)
-        return 0;
 
-    int Utf8Size = 0;
-    for (int Pos = 0; Pos < CodepointCount; ++Pos)
-    {
-        uint32_t CurrentCodepoint = Codepoints[Pos];
+    const TCCUnicode_CodepointIndexEntry *Entry = &Index->entries[CodepointIndex / Index->stride];
+    return ccunicode_AdvanceUtf8_n(Utf8Str, Index->utf8_size, Entry->utf8_offset, CodepointIndex % Index->stride);
+}
 
-        if (CurrentCodepoint > 0x10FFFF)
-            return CCUNICODE_INVALID_CODEPOINT;
-        if (CurrentCodepoint >= 0xD800 && CurrentCodepoint <= 0xDFFF)
-            return CCUNICODE_INVALID_CODEPOINT;
-        if (CurrentCodepoint == 0)
-            return Utf8Size;
+int ccunicode_GetIndexedUtf16Offset(const TCCUnicode_CodepointIndex *Index, const uint8_t *Utf8Str, int Utf8Size, int CodepointIndex)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckCodepointIndex(Index, Utf8Str, Utf8Size))
+    if (CodepointIndex < 0 || CodepointIndex > Index->codepoint_count)
+        return CCUNICODE_INVALID_PARAMETER;
 
-        if (CurrentCodepoint >= 1 && CurrentCodepoint <= 0x7F)
-        {
-            if (Utf8Size == INT_MAX)
-                return CCUNICODE_OVERFLOW;
-            Utf8Size += 1;
-        }
-        if (CurrentCodepoint >= 0x80 && CurrentCodepoint <= 0x7FF)
-        {
-            if (Utf8Size > INT_MAX-2)
-                return CCUNICODE_OVERFLOW;
-            Utf8Size += 2;
-        }
-        if (CurrentCodepoint >= 0x800 && CurrentCodepoint <= 0xFFFF)
-        {
-            if (Utf8Size > INT_MAX-3)
-                return CCUNICODE_OVERFLOW;
-            Utf8Size += 3;
-        }
-        if (CurrentCodepoint >= 0x1000 && CurrentCodepoint <= 0x10FFFF)
-        {
-            if (Utf8Size > INT_MAX-4)
-                return CCUNICODE_OVERFLOW;
-            Utf8Size += 4;
-        }
+    const TCCUnicode_CodepointIndexEntry *Entry = &Index->entries[CodepointIndex / Index->stride];
+    int Remaining = CodepointIndex % Index->stride;
+    int Pos = ccunicode_AdvanceUtf8_n(Utf8Str, Index->utf8_size, Entry->utf8_offset, Remaining);
+    if (Pos < 0)
+        return Pos;
+    return Entry->utf16_offset + Remaining + ccunicode_InternalCountSupplementaryUtf8(Utf8Str + Entry->utf8_offset, Pos - Entry->utf8_offset);
+}
+
+int ccunicode_GetIndexedCodepoint(const TCCUnicode_CodepointIndex *Index, const uint8_t *Utf8Str, int Utf8Size, int Utf8Offset)
+{
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckCodepointIndex(Index, Utf8Str, Utf8Size))
+    if (Utf8Offset < 0 || Utf8Offset > Index->utf8_size)
+        return CCUNICODE_INVALID_PARAMETER;
+
+    // Last entry at or before the offset
+    int Low = 0;
+    int High = Index->entry_count - 1;
+    while (Low < High)
+    {
+        int Middle = Low + (High - Low + 1)/2;
+        if (Index->entries[Middle].utf8_offset <= Utf8Offset)
+            Low = Middle;
+        else
+            High = Middle - 1;
     }
 
-    return Utf8Size;
+    const TCCUnicode_CodepointIndexEntry *Entry = &Index->entries[Low];
+    int Count = 0;
+    int Pos = ccunicode_InternalSkipUtf8(Utf8Str, Utf8Offset, Entry->utf8_offset, INT_MAX, &Count);
+    if (Pos < 0)
+        return Pos;
+    if (Pos < Utf8Offset)
+        return CCUNICODE_INVALID_PARAMETER;
+    return Low*Index->stride + Count;
 }
 
-int ccunicode_GetUtf16SizeFromCodepoints(const uint32_t *Codepoints)
+int ccunicode_GetCodepointIndexSerializedSize(const TCCUnicode_CodepointIndex *Index)
 {
-    int Res = ccunicode_GetCodepointCount(Codepoints);
-    if (Res < 0)
-        return Res;
+    if (!Index)
+        return CCUNICODE_NULL_POINTER;
+    if (Index->entry_count < 0 || Index->entry_count > (INT_MAX/4 - CCUNICODE_INTERNAL_INDEX_HEADER)/2)
+        return CCUNICODE_OVERFLOW;
 
-    return ccunicode_GetUtf16SizeFromCodepoints_n(Codepoints, Res);
+    return 4*(CCUNICODE_INTERNAL_INDEX_HEADER + 2*Index->entry_count);
 }
 
-int ccunicode_GetUtf16SizeFromCodepoints_n(const uint32_t *Codepoints, int CodepointCount)
+int ccunicode_SerializeCodepointIndex(const TCCUnicode_CodepointIndex *Index, uint8_t *Buffer, int BufferSize)
 {
-    if (!Codepoints)
+    if (!Buffer)
         return CCUNICODE_NULL_POINTER;
-    if (CodepointCount < 0)
-        return CCUNICODE_INVALID_PARAMETER;
-    if (!CodepointCount)
-        return 0;
+    int Size = ccunicode_GetCodepointIndexSerializedSize(Index);
+    if (Size < 0)
+        return Size;
+    if (!Index->entries)
+        return CCUNICODE_NULL_POINTER;
+    if (BufferSize < Size)
+        return CCUNICODE_BUFFER_TOO_SMALL;
 
-    int Utf16Size = 0;
-    for (int Pos = 0; Pos < CodepointCount; ++Pos)
+    const int Header[CCUNICODE_INTERNAL_INDEX_HEADER] = {CCUNICODE_INTERNAL_INDEX_MAGIC, CCUNICODE_INTERNAL_INDEX_VERSION, Index->stride,
+                                                         Index->codepoint_count, Index->utf8_size, Index->utf16_size, Index->entry_count};
+    for (int i = 0; i < CCUNICODE_INTERNAL_INDEX_HEADER; ++i)
+        ccunicode_InternalStoreLittleEndian32(Buffer + 4*i, (uint32_t)Header[i]);
+
+    uint8_t *Output = Buffer + 4*CCUNICODE_INTERNAL_INDEX_HEADER;
+    for (int i = 0; i < Index->entry_count; ++i)
     {
-        uint32_t CurrentCodepoint = Codepoints[Pos];
+        ccunicode_InternalStoreLittleEndian32(Output + 8*i, (uint32_t)Index->entries[i].utf8_offset);
+        ccunicode_InternalStoreLittleEndian32(Output + 8*i + 4, (uint32_t)Index->entries[i].utf16_offset);
+    }
 
-        if (CurrentCodepoint > 0x10FFFF)
-            return CCUNICODE_INVALID_CODEPOINT;
-        if (CurrentCodepoint >= 0xD800 && CurrentCodepoint <= 0xDFFF)
-            return CCUNICODE_INVALID_CODEPOINT;
-        if (CurrentCodepoint == 0)
-            return Utf16Size;
+    return Size;
+}
 
-        if (CurrentCodepoint >= 1 && CurrentCodepoint <= 0xD7FF)
-        {
-            if (Utf16Size == INT_MAX)
-                return CCUNICODE_OVERFLOW;
-            Utf16Size += 1;
-        }
-        if (CurrentCodepoint >= 0xE000 && CurrentCodepoint <= 0xFFFF)
-        {
-            if (Utf16Size == INT_MAX)
-                return CCUNICODE_OVERFLOW;
-            Utf16Size += 1;
-        }
+int ccunicode_DeserializeCodepointIndex(TCCUnicode_CodepointIndex *Index, const uint8_t *Buffer, int BufferSize, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    if (!Index || !Buffer)
+        return CCUNICODE_NULL_POINTER;
+    if (BufferSize < 4*CCUNICODE_INTERNAL_INDEX_HEADER)
+        return CCUNICODE_INVALID_PARAMETER;
 
-        if (CurrentCodepoint >= 0x10000 && CurrentCodepoint <= 0x10FFFF)
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    uint32_t Header[CCUNICODE_INTERNAL_INDEX_HEADER];
+    for (int i = 0; i < CCUNICODE_INTERNAL_INDEX_HEADER; ++i)
+        Header[i] = (uint32_t)ccunicode_InternalLoadLittleEndian32(Buffer + 4*i);
+    for (int i = 2; i < CCUNICODE_INTERNAL_INDEX_HEADER; ++i)
+        if (Header[i] > INT_MAX)
+            return CCUNICODE_INVALID_PARAMETER;
+
+    int Stride = (int)Header[2];
+    int CodepointCount = (int)Header[3];
+    int Utf8Size = (int)Header[4];
+    int Utf16Size = (int)Header[5];
+    int EntryCount = (int)Header[6];
+    if (Header[0] != CCUNICODE_INTERNAL_INDEX_MAGIC || Header[1] != CCUNICODE_INTERNAL_INDEX_VERSION)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (Stride < 1 || EntryCount != CodepointCount/Stride + 1)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (EntryCount > (INT_MAX/4 - CCUNICODE_INTERNAL_INDEX_HEADER)/2 || BufferSize < 4*(CCUNICODE_INTERNAL_INDEX_HEADER + 2*EntryCount))
+        return CCUNICODE_INVALID_PARAMETER;
+
+    TCCUnicode_CodepointIndexEntry *Entries = (TCCUnicode_CodepointIndexEntry*)ccunicode_InternalMalloc(AllocPtr, EntryCount*sizeof(*Entries));
+    if (!Entries)
+        return CCUNICODE_BAD_ALLOCATION;
+
+    // Consecutive entries are stride codepoints apart: 1 to 4 bytes and 1 to 2 shorts per codepoint
+    const uint8_t *Input = Buffer + 4*CCUNICODE_INTERNAL_INDEX_HEADER;
+    int64_t PreviousUtf8 = 0;
+    int64_t PreviousUtf16 = 0;
+    for (int i = 0; i < EntryCount; ++i)
+    {
+        int64_t Utf8Offset = (int64_t)ccunicode_InternalLoadLittleEndian32(Input + 8*i);
+        int64_t Utf16Offset = (int64_t)ccunicode_InternalLoadLittleEndian32(Input + 8*i + 4);
+        int64_t Step = i ? Stride : 0;
+        if (Utf8Offset < PreviousUtf8 + Step || Utf8Offset > PreviousUtf8 + 4*Step
+            || Utf16Offset < PreviousUtf16 + Step || Utf16Offset > PreviousUtf16 + 2*Step
+            || Utf8Offset > Utf8Size || Utf16Offset > Utf16Size)
         {
-            if (Utf16Size > INT_MAX-2)
-                return CCUNICODE_OVERFLOW;
-            Utf16Size += 2;
+            ccunicode_InternalFree(AllocPtr, Entries);
+            return CCUNICODE_INVALID_PARAMETER;
         }
+        Entries[i].utf8_offset = (int)Utf8Offset;
+        Entries[i].utf16_offset = (int)Utf16Offset;
+        PreviousUtf8 = Utf8Offset;
+        PreviousUtf16 = Utf16Offset;
     }
 
-    return Utf16Size;
+    ccunicode_InternalCopyAllocator(&Index->allocator, AllocPtr);
+    Index->stride = Stride;
+    Index->codepoint_count = CodepointCount;
+    Index->utf8_size = Utf8Size;
+    Index->utf16_size = Utf16Size;
+    Index->entry_count = EntryCount;
+    Index->entries = Entries;
+    return 4*(CCUNICODE_INTERNAL_INDEX_HEADER + 2*EntryCount);
 }
 
-#ifndef __CCUNICODE_NOSTDALLOC__
-int ccunicode_Utf8ToCodepoints(const uint8_t *Utf8Str, uint32_t **Codepoints)
+// Position of the first '\r' or '\n' at or after Pos, or Utf8Size if there is none
+static int ccunicode_InternalFindLineEnd(const uint8_t *Utf8Str, int Utf8Size, int Pos)
 {
-    return ccunicode_Utf8ToCodepoints_a(Utf8Str, Codepoints, NULL);
+    for (; Utf8Size - Pos >= 8; Pos += 8)
+    {
+        uint64_t Word = ccunicode_InternalLoadLittleEndian64(Utf8Str + Pos);
+        uint64_t Ends = ccunicode_InternalSwarIsZero(Word ^ (CCUNICODE_INTERNAL_SWAR_LOW * '\n'))
+                      | ccunicode_InternalSwarIsZero(Word ^ (CCUNICODE_INTERNAL_SWAR_LOW * '\r'));
+        if (Ends)
+            return Pos + ccunicode_InternalSwarCountLanes(ccunicode_InternalSwarLanesBelow(Ends));
+    }
+    for (; Pos < Utf8Size; ++Pos)
+        if (Utf8Str[Pos] == '\n' || Utf8Str[Pos] == '\r')
+            break;
+    return Pos;
 }
 
-int ccunicode_Utf8ToCodepoints_n(const uint8_t *Utf8Str, int Utf8Size, uint32_t **Codepoints)
+// Start of the line following the one ending at LineEnd, or -1 if LineEnd is the end of the text
+static int ccunicode_InternalNextLineStart(const uint8_t *Utf8Str, int Utf8Size, int LineEnd)
 {
-    return ccunicode_Utf8ToCodepoints_na(Utf8Str, Utf8Size, Codepoints, NULL);
+    if (LineEnd == Utf8Size)
+        return -1;
+    if (Utf8Str[LineEnd] == '\r' && LineEnd + 1 < Utf8Size && Utf8Str[LineEnd+1] == '\n')
+        return LineEnd + 2;
+    return LineEnd + 1;
 }
-#endif
 
-int ccunicode_Utf8ToCodepoints_a(const uint8_t *Utf8Str, uint32_t **Codepoints, const TCCUnicode_MallocPtr *AllocPtr)
+// Number of line ends a byte adds to a text, given whether the text ended with '\r': a '\n' after it completes the same "\r\n"
+static int ccunicode_InternalAddsLineEnd(uint8_t Byte, int AfterCr)
 {
-    int Utf8Size = ccunicode_GetUtf8StrLen(Utf8Str);
-    if (Utf8Size < 0)
-        return Utf8Size;
+    return Byte == '\r' || (Byte == '\n' && !AfterCr);
+}
 
-    return ccunicode_Utf8ToCodepoints_na(Utf8Str, Utf8Size, Codepoints, AllocPtr);
+// Number of line ends in a text, as the line table and the position functions see them ("\n", "\r\n" or "\r")
+static int ccunicode_InternalCountLineEnds(const uint8_t *Utf8Str, int Utf8Size)
+{
+    int Count = 0;
+    int AfterCr = 0;
+    int Pos = 0;
+    for (; Utf8Size - Pos >= 8; Pos += 8)
+    {
+        uint64_t Word = ccunicode_InternalLoadLittleEndian64(Utf8Str + Pos);
+        uint64_t Lfs = ccunicode_InternalSwarIsZero(Word ^ (CCUNICODE_INTERNAL_SWAR_LOW * '\n'));
+        uint64_t Crs = ccunicode_InternalSwarIsZero(Word ^ (CCUNICODE_INTERNAL_SWAR_LOW * '\r'));
+        // A '\n' following a '\r', in the word or at the end of the previous one, does not count
+        uint64_t Pairs = ((Crs << 8) | (uint64_t)AfterCr << 7) & Lfs;
+        Count += ccunicode_InternalSwarCountLanes(Lfs | Crs) - ccunicode_InternalSwarCountLanes(Pairs);
+        AfterCr = (int)(Crs >> 63);
+    }
+    for (; Pos < Utf8Size; ++Pos)
+    {
+        Count += ccunicode_InternalAddsLineEnd(Utf8Str[Pos], AfterCr);
+        AfterCr = Utf8Str[Pos] == '\r';
+    }
+    return Count;
 }
 
-int ccunicode_Utf8ToCodepoints_na(const uint8_t *Utf8Str, int Utf8Size, uint32_t **Codepoints, const TCCUnicode_MallocPtr *AllocPtr)
+static void ccunicode_InternalSetErrorIndex(int *ErrorIndex, int Index)
 {
-    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+    if (ErrorIndex)
+        *ErrorIndex = Index;
+}
 
-    if (!Codepoints)
+int ccunicode_BuildLineTable_n(TCCUnicode_LineTable *Table, const uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    if (!Table || !Utf8Str)
         return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
 
-    int CodepointCount = ccunicode_CountCodepointsInUtf8_n(Utf8Str, Utf8Size);
-    if (CodepointCount < 0)
-        return CodepointCount;
-    if (CodepointCount == INT_MAX)
-        return CCUNICODE_OVERFLOW;
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
 
-    if (CodepointCount+1 > INT_MAX/sizeof(**Codepoints))
-        return CCUNICODE_OVERFLOW;
-    *Codepoints = AllocPtr->malloc_func((CodepointCount+1)*sizeof(**Codepoints));
-    if (!(*Codepoints))
+    int Capacity = 64;
+    int *LineStarts = (int*)ccunicode_InternalMalloc(AllocPtr, Capacity*sizeof(*LineStarts));
+    if (!LineStarts)
         return CCUNICODE_BAD_ALLOCATION;
 
-    int Result = ccunicode_Utf8ToCodepoints_nm(Utf8Str, Utf8Size, *Codepoints, CodepointCount);
-    if (Result < 0)
+    int LineCount = 0;
+    int Start = 0;
+    while (Start >= 0)
     {
-        AllocPtr->free_func(*Codepoints);
-        *Codepoints = NULL;
+        if (LineCount == Capacity)
+        {
+            // There are at most Utf8Size + 1 lines
+            int NewCapacity = Capacity <= Utf8Size/2 ? Capacity*2 : Utf8Size + 1;
+            int *NewLineStarts = (int*)ccunicode_InternalRealloc(AllocPtr, LineStarts, LineCount*sizeof(*LineStarts), NewCapacity*sizeof(*LineStarts));
+            if (!NewLineStarts)
+            {
+                ccunicode_InternalFree(AllocPtr, LineStarts);
+                return CCUNICODE_BAD_ALLOCATION;
+            }
+            LineStarts = NewLineStarts;
+            Capacity = NewCapacity;
+        }
+
+        LineStarts[LineCount++] = Start;
+        Start = ccunicode_InternalNextLineStart(Utf8Str, Utf8Size, ccunicode_InternalFindLineEnd(Utf8Str, Utf8Size, Start));
     }
-    return Result;
+
+    ccunicode_InternalCopyAllocator(&Table->allocator, AllocPtr);
+    Table->line_count = LineCount;
+    Table->utf8_size = Utf8Size;
+    Table->line_starts = LineStarts;
+    return LineCount;
 }
 
-int ccunicode_Utf8ToCodepoints_m(const uint8_t *Utf8Str, uint32_t *Codepoints, int MaxCodepointsCount)
+int ccunicode_DestroyLineTable(TCCUnicode_LineTable *Table)
 {
-    int Utf8Size = ccunicode_GetUtf8StrLen(Utf8Str);
-    if (Utf8Size < 0)
-        return Utf8Size;
+    if (!Table)
+        return CCUNICODE_NULL_POINTER;
 
-    return ccunicode_Utf8ToCodepoints_nm(Utf8Str, Utf8Size, Codepoints, MaxCodepointsCount);
+    if (Table->line_starts)
+        ccunicode_InternalFree(&Table->allocator.malloc_ptr, Table->line_starts);
+    Table->line_starts = NULL;
+    Table->line_count = 0;
+
+    return CCUNICODE_NO_ERROR;
+}
+
+static int ccunicode_InternalCheckLineTable(const TCCUnicode_LineTable *Table, int Utf8Size)
+{
+    if (!Table)
+        return CCUNICODE_NO_ERROR;
+    if (!Table->line_starts)
+        return CCUNICODE_NULL_POINTER;
+    if (Table->utf8_size != Utf8Size || Table->line_count < 1)
+        return CCUNICODE_INVALID_PARAMETER;
+    return CCUNICODE_NO_ERROR;
 }
 
-int ccunicode_Utf8ToCodepoints_nm(const uint8_t *Utf8Str, int Utf8Size, uint32_t *Codepoints, int MaxCodepointsCount)
+int ccunicode_Utf16PositionsToUtf8Offsets_n(const uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_LineTable *Table,
+                                            const TCCUnicode_TextPosition *Positions, int PositionCount, int *Utf8Offsets, int *ErrorIndex)
 {
-    if (!Utf8Str)
+    ccunicode_InternalSetErrorIndex(ErrorIndex, -1);
+    if (!Utf8Str || !Positions || !Utf8Offsets)
         return CCUNICODE_NULL_POINTER;
-    if (!Codepoints)
-        return CCUNICODE_NULL_POINTER;
-    if (Utf8Size < 0)
-        return CCUNICODE_INVALID_PARAMETER;
-    if (MaxCodepointsCount < 0)
+    if (Utf8Size < 0 || PositionCount < 0)
         return CCUNICODE_INVALID_PARAMETER;
-
-    int WritePos = 0;
-    int ReadPos = 0;
-    while ((ReadPos < Utf8Size) && (WritePos < MaxCodepointsCount))
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckLineTable(Table, Utf8Size))
+
+    // Line reached by the scan when there is no table
+    int CurrentLine = 0;
+    int CurrentStart = 0;
+    // Walk of the previous position, which a later position on the same line resumes
+    int PreviousLine = -1;
+    int PreviousColumn = 0;
+    int PreviousEnd = 0;
+    int Pos = 0;
+    int Units = 0;
+    for (int i = 0; i < PositionCount; ++i)
     {
-        uint32_t CodePoint = 0;
-
-        int RemainingBytes = 0;
-        if (ReadPos == INT_MAX)
-            return CCUNICODE_OVERFLOW;
-        uint8_t CurrentByte = Utf8Str[ReadPos++];
-
-        // If it is the final character let's stop there
-        if (CurrentByte == 0)
+        int Line = Positions[i].line;
+        int Column = Positions[i].utf16_column;
+        int Start;
+        if (Line < 0 || Column < 0)
         {
-            Codepoints[WritePos] = 0;
-            return WritePos;
+            ccunicode_InternalSetErrorIndex(ErrorIndex, i);
+            return CCUNICODE_INVALID_PARAMETER;
         }
 
-        // If we have an illegal character, we stop
-        if (CurrentByte >= 0x80 && CurrentByte <= 0xBF)
-            return CCUNICODE_INVALID_UTF8_CHARACTER;
-        if (CurrentByte >= 0xF8 /* && CurrentByte <= 0xFF */)
-            return CCUNICODE_INVALID_UTF8_CHARACTER;
-
-        if (CurrentByte >= 0x01 && CurrentByte <= 0x7F)
+        if (Table)
         {
-            CodePoint = CurrentByte;
-            RemainingBytes = 0;
+            if (Line >= Table->line_count)
+            {
+                ccunicode_InternalSetErrorIndex(ErrorIndex, i);
+                return CCUNICODE_INVALID_PARAMETER;
+            }
+            Start = Table->line_starts[Line];
         }
-
-        if (CurrentByte >= 0xC0 && CurrentByte <= 0xDF)
+        else
         {
-            CodePoint = (uint32_t)(CurrentByte & 0x1F);
-            RemainingBytes = 1;
+            if (Line < CurrentLine)
+            {
+                CurrentLine = 0;
+                CurrentStart = 0;
+            }
+            while (CurrentLine < Line)
+            {
+                CurrentStart = ccunicode_InternalNextLineStart(Utf8Str, Utf8Size, ccunicode_InternalFindLineEnd(Utf8Str, Utf8Size, CurrentStart));
+                if (CurrentStart < 0)
+                {
+                    ccunicode_InternalSetErrorIndex(ErrorIndex, i);
+                    return CCUNICODE_INVALID_PARAMETER;
+                }
+                ++CurrentLine;
+            }
+            Start = CurrentStart;
         }
 
-        if (CurrentByte >= 0xE0 && CurrentByte <= 0xEF)
+        int End = PreviousEnd;
+        if (Line != PreviousLine || Column < PreviousColumn)
         {
-            CodePoint = (uint32_t)(CurrentByte & 0xF);
-            RemainingBytes = 2;
+            End = ccunicode_InternalFindLineEnd(Utf8Str, Utf8Size, Start);
+            Pos = Start;
+            Units = 0;
         }
+        PreviousLine = Line;
+        PreviousColumn = Column;
+        PreviousEnd = End;
 
-        if (CurrentByte >= 0xF0 && CurrentByte <= 0xF7)
+        // Runs of ASCII are one short per byte, and hold no line terminator before End
+        while (Column - Units >= 8 && End - Pos >= 8 && !(ccunicode_InternalLoadLittleEndian64(Utf8Str + Pos) & CCUNICODE_INTERNAL_SWAR_HIGH))
         {
-            CodePoint = (uint32_t)(CurrentByte & 0x7);
-            RemainingBytes = 3;
+            Pos += 8;
+            Units += 8;
+        }
+        while (Units < Column && Pos < End)
+        {
+            uint32_t Codepoint;
+            int Length = ccunicode_DecodeNextUtf8(Utf8Str, End, Pos, &Codepoint);
+            if (Length < 0)
+            {
+                ccunicode_InternalSetErrorIndex(ErrorIndex, i);
+                return Length;
+            }
+            int Width = (Length == 4) ? 2 : 1;
+            if (Units + Width > Column)
+                break;
+            Units += Width;
+            Pos += Length;
         }
 
-        // We check we are allowed that many bytes for the codepoint
-        if (ReadPos + RemainingBytes > Utf8Size)
-            return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+        Utf8Offsets[i] = Pos;
+    }
 
-        // Now collect remaining part of the codepoint (if any)
-        for (size_t j = 0; j < RemainingBytes; ++j)
+    return CCUNICODE_NO_ERROR;
+}
+
+int ccunicode_Utf8OffsetsToUtf16Positions_n(const uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_LineTable *Table,
+                                            const int *Utf8Offsets, int OffsetCount, TCCUnicode_TextPosition *Positions, int *ErrorIndex)
+{
+    ccunicode_InternalSetErrorIndex(ErrorIndex, -1);
+    if (!Utf8Str || !Utf8Offsets || !Positions)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < 0 || OffsetCount < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckLineTable(Table, Utf8Size))
+
+    int CurrentLine = 0;
+    int CurrentStart = 0;
+    // Start of the line after the current one when there is no table, found once per line
+    int NextStart = Table ? -1 : ccunicode_InternalNextLineStart(Utf8Str, Utf8Size, ccunicode_InternalFindLineEnd(Utf8Str, Utf8Size, 0));
+    // Walk of the previous offset, which a later offset on the same line resumes
+    int PreviousLine = -1;
+    int Pos = 0;
+    int Units = 0;
+    for (int i = 0; i < OffsetCount; ++i)
+    {
+        int Offset = Utf8Offsets[i];
+        if (Offset < 0 || Offset > Utf8Size)
         {
-            CodePoint <<= 6;
-            CurrentByte = Utf8Str[ReadPos++];
+            ccunicode_InternalSetErrorIndex(ErrorIndex, i);
+            return CCUNICODE_INVALID_PARAMETER;
+        }
 
-            // The only valid range is 0x80-0xDF for an extension
-            if (CurrentByte < 0x80 || CurrentByte > 0xDF)
-                return CCUNICODE_INVALID_UTF8_CHARACTER;
+        if (Table)
+        {
+            // Last line starting at or before the offset
+            int Low = 0;
+            int High = Table->line_count - 1;
+            while (Low < High)
+            {
+                int Middle = Low + (High - Low + 1)/2;
+                if (Table->line_starts[Middle] <= Offset)
+                    Low = Middle;
+                else
+                    High = Middle - 1;
+            }
+            CurrentLine = Low;
+            CurrentStart = Table->line_starts[Low];
+        }
+        else
+        {
+            if (Offset < CurrentStart)
+            {
+                CurrentLine = 0;
+                CurrentStart = 0;
+                NextStart = ccunicode_InternalNextLineStart(Utf8Str, Utf8Size, ccunicode_InternalFindLineEnd(Utf8Str, Utf8Size, 0));
+            }
+            while (NextStart >= 0 && NextStart <= Offset)
+            {
+                CurrentStart = NextStart;
+                ++CurrentLine;
+                NextStart = ccunicode_InternalNextLineStart(Utf8Str, Utf8Size, ccunicode_InternalFindLineEnd(Utf8Str, Utf8Size, CurrentStart));
+            }
+        }
 
-            CodePoint += (uint32_t)(CurrentByte & 0x3F);
+        if (CurrentLine != PreviousLine || Offset < Pos)
+        {
+            Pos = CurrentStart;
+            Units = 0;
+        }
+        PreviousLine = CurrentLine;
+        while (Offset - Pos >= 8 && !(ccunicode_InternalLoadLittleEndian64(Utf8Str + Pos) & CCUNICODE_INTERNAL_SWAR_HIGH))
+        {
+            Pos += 8;
+            Units += 8;
+        }
+        while (Pos < Offset)
+        {
+            uint32_t Codepoint;
+            int Length = ccunicode_DecodeNextUtf8(Utf8Str, Offset, Pos, &Codepoint);
+            if (Length < 0)
+            {
+                ccunicode_InternalSetErrorIndex(ErrorIndex, i);
+                return Length;
+            }
+            Units += (Length == 4) ? 2 : 1;
+            Pos += Length;
         }
 
-        if (WritePos == INT_MAX)
-            return CCUNICODE_OVERFLOW;
-        Codepoints[WritePos++] = CodePoint;
+        Positions[i].line = CurrentLine;
+        Positions[i].utf16_column = Units;
     }
 
-    if (ReadPos != Utf8Size)
-        return CCUNICODE_BUFFER_TOO_SMALL;
-
-    Codepoints[WritePos] = 0;
-    return WritePos;
+    return CCUNICODE_NO_ERROR;
 }
 
-#ifndef __CCUNICODE_NOSTDALLOC__
-int ccunicode_Utf16ToCodepoints(const uint16_t *Utf16Str, uint32_t **Codepoints)
+struct TCCUnicode_RopeNode
 {
-    return ccunicode_Utf16ToCodepoints_a(Utf16Str, Codepoints, NULL);
-}
+    TCCUnicode_RopeNode *left;
+    TCCUnicode_RopeNode *right;
+    uint32_t priority;                        // Heap order of the treap: a node has a priority no lower than its children
+    TCCUnicode_RopeMetrics chunk;             // Metrics of data
+    TCCUnicode_RopeMetrics total;             // Metrics of the subtree
+    int chunk_edges;                          // CCUNICODE_INTERNAL_ROPE_* flags of data
+    int total_edges;                          // CCUNICODE_INTERNAL_ROPE_* flags of the subtree
+    uint8_t data[CCUNICODE_ROPE_CHUNK_SIZE];
+};
 
-int ccunicode_Utf16ToCodepoints_n(const uint16_t *Utf16Str, int Utf16Size, uint32_t **Codepoints)
+static int ccunicode_InternalGetMetric(const TCCUnicode_RopeMetrics *Metrics, int Unit)
 {
-    return ccunicode_Utf16ToCodepoints_na(Utf16Str, Utf16Size, Codepoints, NULL);
+    if (Unit == CCUNICODE_UNIT_UTF16)
+        return Metrics->utf16_size;
+    if (Unit == CCUNICODE_UNIT_CODEPOINT)
+        return Metrics->codepoint_count;
+    return Metrics->utf8_size;
 }
-#endif
 
-int ccunicode_Utf16ToCodepoints_a(const uint16_t *Utf16Str, uint32_t **Codepoints, const TCCUnicode_MallocPtr *AllocPtr)
+// Edges of a text telling whether it joins a "\r\n" with the text before or after it
+#define CCUNICODE_INTERNAL_ROPE_STARTS_WITH_LF 1
+#define CCUNICODE_INTERNAL_ROPE_ENDS_WITH_CR 2
+
+// Appends the metrics of a text to those of the text before it. A "\r\n" cut between them is one line end.
+static void ccunicode_InternalAppendMetrics(TCCUnicode_RopeMetrics *Metrics, int *Edges, const TCCUnicode_RopeMetrics *Other, int OtherEdges)
 {
-    int Utf16Size = ccunicode_GetUtf16StrLen(Utf16Str);
-    if (Utf16Size < 0)
-        return Utf16Size;
+    if (!Other->utf8_size)
+        return;
+    if (!Metrics->utf8_size)
+    {
+        *Metrics = *Other;
+        *Edges = OtherEdges;
+        return;
+    }
 
-    return ccunicode_Utf16ToCodepoints_na(Utf16Str, Utf16Size, Codepoints, AllocPtr);
+    Metrics->utf8_size += Other->utf8_size;
+    Metrics->codepoint_count += Other->codepoint_count;
+    Metrics->utf16_size += Other->utf16_size;
+    Metrics->line_count += Other->line_count;
+    if ((*Edges & CCUNICODE_INTERNAL_ROPE_ENDS_WITH_CR) && (OtherEdges & CCUNICODE_INTERNAL_ROPE_STARTS_WITH_LF))
+        Metrics->line_count--;
+    *Edges = (*Edges & CCUNICODE_INTERNAL_ROPE_STARTS_WITH_LF) | (OtherEdges & CCUNICODE_INTERNAL_ROPE_ENDS_WITH_CR);
 }
 
-int ccunicode_Utf16ToCodepoints_na(const uint16_t *Utf16Str, int Utf16Size, uint32_t **Codepoints, const TCCUnicode_MallocPtr *AllocPtr)
+// Metrics of valid UTF8 text
+static void ccunicode_InternalMeasureUtf8(const uint8_t *Utf8Str, int Utf8Size, TCCUnicode_RopeMetrics *Metrics, int *Edges)
 {
-    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+    int Count = 0;
+    ccunicode_InternalSkipUtf8(Utf8Str, Utf8Size, 0, INT_MAX, &Count);
+
+    Metrics->utf8_size = Utf8Size;
+    Metrics->codepoint_count = Count;
+    Metrics->utf16_size = Count + ccunicode_InternalCountSupplementaryUtf8(Utf8Str, Utf8Size);
+    Metrics->line_count = ccunicode_InternalCountLineEnds(Utf8Str, Utf8Size);
+    *Edges = 0;
+    if (Utf8Size && Utf8Str[0] == '\n')
+        *Edges |= CCUNICODE_INTERNAL_ROPE_STARTS_WITH_LF;
+    if (Utf8Size && Utf8Str[Utf8Size-1] == '\r')
+        *Edges |= CCUNICODE_INTERNAL_ROPE_ENDS_WITH_CR;
+}
 
-    if (!Codepoints)
-        return CCUNICODE_NULL_POINTER;
+static void ccunicode_InternalMeasureRopeChunk(TCCUnicode_RopeNode *Node, int Utf8Size)
+{
+    ccunicode_InternalMeasureUtf8(Node->data, Utf8Size, &Node->chunk, &Node->chunk_edges);
+}
 
-    int CodepointCount = ccunicode_CountCodepointsInUtf16_n(Utf16Str, Utf16Size);
-    if (CodepointCount < 0)
-        return CodepointCount;
-    if (CodepointCount == INT_MAX)
-        return CCUNICODE_OVERFLOW;
+static void ccunicode_InternalUpdateRopeNode(TCCUnicode_RopeNode *Node)
+{
+    memset(&Node->total, 0, sizeof(Node->total));
+    Node->total_edges = 0;
+    if (Node->left)
+        ccunicode_InternalAppendMetrics(&Node->total, &Node->total_edges, &Node->left->total, Node->left->total_edges);
+    ccunicode_InternalAppendMetrics(&Node->total, &Node->total_edges, &Node->chunk, Node->chunk_edges);
+    if (Node->right)
+        ccunicode_InternalAppendMetrics(&Node->total, &Node->total_edges, &Node->right->total, Node->right->total_edges);
+}
 
-    if (CodepointCount+1 > INT_MAX/sizeof(**Codepoints))
-        return CCUNICODE_OVERFLOW;
-    *Codepoints = AllocPtr->malloc_func((CodepointCount+1)*sizeof(**Codepoints));
-    if (!(*Codepoints))
-        return CCUNICODE_BAD_ALLOCATION;
+static uint32_t ccunicode_InternalNextRopePriority(TCCUnicode_Rope *Rope)
+{
+    // xorshift32
+    uint32_t Seed = Rope->seed;
+    Seed ^= Seed << 13;
+    Seed ^= Seed >> 17;
+    Seed ^= Seed << 5;
+    Rope->seed = Seed;
+    return Seed;
+}
 
-    int Result = ccunicode_Utf16ToCodepoints_nm(Utf16Str, Utf16Size, *Codepoints, CodepointCount);
-    if (Result < 0)
+static void ccunicode_InternalFreeRopeNodes(TCCUnicode_Rope *Rope, TCCUnicode_RopeNode *Node)
+{
+    while (Node)
     {
-        AllocPtr->free_func(*Codepoints);
-        *Codepoints = NULL;
+        ccunicode_InternalFreeRopeNodes(Rope, Node->left);
+        TCCUnicode_RopeNode *Right = Node->right;
+        ccunicode_InternalFree(&Rope->allocator.malloc_ptr, Node);
+        --Rope->node_count;
+        Node = Right;
     }
-    return Result;
 }
 
-int ccunicode_Utf16ToCodepoints_m(const uint16_t *Utf16Str, uint32_t *Codepoints, int MaxCodepointsCount)
+static TCCUnicode_RopeNode *ccunicode_InternalMergeRopeNodes(TCCUnicode_RopeNode *Left, TCCUnicode_RopeNode *Right)
 {
-    int Utf16Size = ccunicode_GetUtf16StrLen(Utf16Str);
-    if (Utf16Size < 0)
-        return Utf16Size;
+    if (!Left)
+        return Right;
+    if (!Right)
+        return Left;
 
-    return ccunicode_Utf16ToCodepoints_nm(Utf16Str, Utf16Size, Codepoints, MaxCodepointsCount);
+    if (Left->priority >= Right->priority)
+    {
+        Left->right = ccunicode_InternalMergeRopeNodes(Left->right, Right);
+        ccunicode_InternalUpdateRopeNode(Left);
+        return Left;
+    }
+    Right->left = ccunicode_InternalMergeRopeNodes(Left, Right->left);
+    ccunicode_InternalUpdateRopeNode(Right);
+    return Right;
 }
 
-int ccunicode_Utf16ToCodepoints_nm(const uint16_t *Utf16Str, int Utf16Size, uint32_t *Codepoints, int MaxCodepointsCount)
+// Splits the nodes before and after a byte offset between two characters.
+// Cutting a chunk uses the spare node, which must then be non NULL.
+static void ccunicode_InternalSplitRopeNodes(TCCUnicode_RopeNode *Node, int Utf8Offset, TCCUnicode_RopeNode **Left, TCCUnicode_RopeNode **Right, TCCUnicode_RopeNode **Spare)
 {
-    if (!Utf16Str)
-        return CCUNICODE_NULL_POINTER;
-    if (!Codepoints)
-        return CCUNICODE_NULL_POINTER;
-    if (Utf16Size < 0)
-        return CCUNICODE_INVALID_PARAMETER;
-    if (MaxCodepointsCount < 0)
-        return CCUNICODE_INVALID_PARAMETER;
-
-    int WritePos = 0;
-    int ReadPos = 0;
-    while ((ReadPos < Utf16Size) && (WritePos < MaxCodepointsCount))
+    if (!Node)
     {
-        uint32_t CodePoint = 0;
+        *Left = NULL;
+        *Right = NULL;
+        return;
+    }
 
-        int RemainingBytes = 0;
-        if (ReadPos == INT_MAX)
-            return CCUNICODE_OVERFLOW;
-        uint16_t CurrentCodeUnit = Utf16Str[ReadPos++];
+    int LeftSize = Node->left ? Node->left->total.utf8_size : 0;
+    if (Utf8Offset <= LeftSize)
+    {
+        ccunicode_InternalSplitRopeNodes(Node->left, Utf8Offset, Left, &Node->left, Spare);
+        ccunicode_InternalUpdateRopeNode(Node);
+        *Right = Node;
+    }
+    else if (Utf8Offset >= LeftSize + Node->chunk.utf8_size)
+    {
+        ccunicode_InternalSplitRopeNodes(Node->right, Utf8Offset - LeftSize - Node->chunk.utf8_size, &Node->right, Right, Spare);
+        ccunicode_InternalUpdateRopeNode(Node);
+        *Left = Node;
+    }
+    else
+    {
+        // The end of the chunk moves to the spare node, which takes the priority of the node to keep the heap order
+        int Cut = Utf8Offset - LeftSize;
+        TCCUnicode_RopeNode *Second = *Spare;
+        *Spare = NULL;
+        memcpy(Second->data, Node->data + Cut, Node->chunk.utf8_size - Cut);
+        ccunicode_InternalMeasureRopeChunk(Second, Node->chunk.utf8_size - Cut);
+        ccunicode_InternalMeasureRopeChunk(Node, Cut);
+        Second->priority = Node->priority;
+        Second->left = NULL;
+        Second->right = Node->right;
+        Node->right = NULL;
+        ccunicode_InternalUpdateRopeNode(Second);
+        ccunicode_InternalUpdateRopeNode(Node);
+        *Left = Node;
+        *Right = Second;
+    }
+}
 
-        // We must distinguish between surrogate pairs and single units
-        if (CurrentCodeUnit >= 0xD800 && CurrentCodeUnit <= 0xDFFF)
+// Byte at an offset of the rope, or 0 at the end of the text
+static uint8_t ccunicode_InternalGetRopeByte(const TCCUnicode_RopeNode *Node, int Utf8Offset)
+{
+    while (Node)
+    {
+        int LeftSize = Node->left ? Node->left->total.utf8_size : 0;
+        if (Utf8Offset < LeftSize)
         {
-            if (CurrentCodeUnit >= 0xDC00)
-                return CCUNICODE_SURROGATE_PAIR_INVERSION;
+            Node = Node->left;
+            continue;
+        }
+        Utf8Offset -= LeftSize;
+        if (Utf8Offset < Node->chunk.utf8_size)
+            return Node->data[Utf8Offset];
+        Utf8Offset -= Node->chunk.utf8_size;
+        Node = Node->right;
+    }
+    return 0;
+}
 
-            if (ReadPos == Utf16Size)
-                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+static int ccunicode_InternalCheckRopeOffset(const TCCUnicode_Rope *Rope, int Utf8Offset)
+{
+    int Size = Rope->root ? Rope->root->total.utf8_size : 0;
+    if (Utf8Offset < 0 || Utf8Offset > Size)
+        return CCUNICODE_INVALID_PARAMETER;
+    if ((ccunicode_InternalGetRopeByte(Rope->root, Utf8Offset) & 0xC0) == 0x80)
+        return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+    return CCUNICODE_NO_ERROR;
+}
 
-            uint16_t HighBits = CurrentCodeUnit - 0xD800;
+// Inserts valid text into the chunk holding the offset if it has room for it. Returns 1 if it did, 0 otherwise.
+static int ccunicode_InternalInsertIntoRopeChunk(TCCUnicode_RopeNode *Node, int Utf8Offset, const uint8_t *Utf8Str, int Utf8Size)
+{
+    if (!Node)
+        return 0;
 
-            CurrentCodeUnit = Utf16Str[ReadPos++];
-            if (CurrentCodeUnit == 0)
-                return CCUNICODE_STRING_ENDED_IN_CHARACTER;
-            if (CurrentCodeUnit < 0xDC00 || CurrentCodeUnit > 0xDFFF)
-                return CCUNICODE_INVALID_UTF16_CHARACTER;
+    int Done;
+    int LeftSize = Node->left ? Node->left->total.utf8_size : 0;
+    if (Node->left && Utf8Offset <= LeftSize)
+    {
+        Done = ccunicode_InternalInsertIntoRopeChunk(Node->left, Utf8Offset, Utf8Str, Utf8Size);
+    }
+    else if (Utf8Offset - LeftSize <= Node->chunk.utf8_size)
+    {
+        int Pos = Utf8Offset - LeftSize;
+        Done = (Node->chunk.utf8_size + Utf8Size <= CCUNICODE_ROPE_CHUNK_SIZE);
+        if (Done)
+        {
+            // The chunk is measured again, as the text may join a "\r\n" with it
+            memmove(Node->data + Pos + Utf8Size, Node->data + Pos, Node->chunk.utf8_size - Pos);
+            memcpy(Node->data + Pos, Utf8Str, Utf8Size);
+            ccunicode_InternalMeasureRopeChunk(Node, Node->chunk.utf8_size + Utf8Size);
+        }
+    }
+    else
+    {
+        Done = ccunicode_InternalInsertIntoRopeChunk(Node->right, Utf8Offset - LeftSize - Node->chunk.utf8_size, Utf8Str, Utf8Size);
+    }
 
-            uint16_t LowBits = CurrentCodeUnit - 0xDC00;
+    if (Done)
+        ccunicode_InternalUpdateRopeNode(Node);
+    return Done;
+}
 
-            CodePoint = ((uint32_t)(HighBits) << 10) + (uint32_t)(LowBits) + 0x10000;
-        }
-        else
-        {
-            if (CurrentCodeUnit == 0)
-            {
-                Codepoints[WritePos] = 0;
-                return WritePos;
-            }
+// Removes a range from the chunk holding all of it, if it does not empty the chunk. Returns 1 if it did, 0 otherwise.
+static int ccunicode_InternalDeleteFromRopeChunk(TCCUnicode_RopeNode *Node, int Utf8Offset, int Utf8Size)
+{
+    if (!Node)
+        return 0;
 
-            CodePoint = (uint32_t)CurrentCodeUnit;
+    int Done;
+    int LeftSize = Node->left ? Node->left->total.utf8_size : 0;
+    if (Utf8Offset < LeftSize)
+    {
+        Done = ccunicode_InternalDeleteFromRopeChunk(Node->left, Utf8Offset, Utf8Size);
+    }
+    else if (Utf8Offset - LeftSize < Node->chunk.utf8_size)
+    {
+        int Pos = Utf8Offset - LeftSize;
+        Done = (Pos + Utf8Size <= Node->chunk.utf8_size && Utf8Size < Node->chunk.utf8_size);
+        if (Done)
+        {
+            memmove(Node->data + Pos, Node->data + Pos + Utf8Size, Node->chunk.utf8_size - Pos - Utf8Size);
+            ccunicode_InternalMeasureRopeChunk(Node, Node->chunk.utf8_size - Utf8Size);
         }
+    }
+    else
+    {
+        Done = ccunicode_InternalDeleteFromRopeChunk(Node->right, Utf8Offset - LeftSize - Node->chunk.utf8_size, Utf8Size);
+    }
 
-        if (WritePos == INT_MAX)
-            return CCUNICODE_OVERFLOW;
-        Codepoints[WritePos++] = CodePoint;
+    if (Done)
+        ccunicode_InternalUpdateRopeNode(Node);
+    return Done;
+}
+
+// Gives the chunk holding the byte at an offset of the text and sets ChunkStart to the offset of its first byte
+static TCCUnicode_RopeNode *ccunicode_InternalFindRopeChunk(TCCUnicode_RopeNode *Node, int Utf8Offset, int *ChunkStart)
+{
+    *ChunkStart = 0;
+    while (Node)
+    {
+        int LeftSize = Node->left ? Node->left->total.utf8_size : 0;
+        if (Utf8Offset < LeftSize)
+        {
+            Node = Node->left;
+            continue;
+        }
+        Utf8Offset -= LeftSize;
+        *ChunkStart += LeftSize;
+        if (Utf8Offset < Node->chunk.utf8_size)
+            return Node;
+        Utf8Offset -= Node->chunk.utf8_size;
+        *ChunkStart += Node->chunk.utf8_size;
+        Node = Node->right;
     }
+    return NULL;
+}
 
-    if (ReadPos != Utf16Size)
-        return CCUNICODE_BUFFER_TOO_SMALL;
-    Codepoints[WritePos] = 0;
-    return WritePos;
+// Merges the two chunks on each side of a chunk boundary if one of them holds less than half a chunk and they fit in one.
+// Returns 1 if it did, 0 otherwise.
+static int ccunicode_InternalMergeRopeChunksAt(TCCUnicode_Rope *Rope, int Utf8Offset)
+{
+    int FirstStart = 0;
+    int SecondStart = 0;
+    TCCUnicode_RopeNode *First = Utf8Offset > 0 ? ccunicode_InternalFindRopeChunk(Rope->root, Utf8Offset - 1, &FirstStart) : NULL;
+    TCCUnicode_RopeNode *Second = ccunicode_InternalFindRopeChunk(Rope->root, Utf8Offset, &SecondStart);
+    if (!First || !Second || First == Second)
+        return 0;
+    int FirstSize = First->chunk.utf8_size;
+    int SecondSize = Second->chunk.utf8_size;
+    if ((FirstSize >= CCUNICODE_ROPE_CHUNK_SIZE/2 && SecondSize >= CCUNICODE_ROPE_CHUNK_SIZE/2) || FirstSize + SecondSize > CCUNICODE_ROPE_CHUNK_SIZE)
+        return 0;
+
+    // Splitting at chunk boundaries never cuts a chunk, so no spare node is needed
+    TCCUnicode_RopeNode *NoSpare = NULL;
+    TCCUnicode_RopeNode *Left;
+    TCCUnicode_RopeNode *Middle;
+    TCCUnicode_RopeNode *Right;
+    ccunicode_InternalSplitRopeNodes(Rope->root, FirstStart, &Left, &Middle, &NoSpare);
+    ccunicode_InternalSplitRopeNodes(Middle, FirstSize + SecondSize, &Middle, &Right, &NoSpare);
+
+    memcpy(First->data + FirstSize, Second->data, SecondSize);
+    ccunicode_InternalMeasureRopeChunk(First, FirstSize + SecondSize);
+    First->left = NULL;
+    First->right = NULL;
+    ccunicode_InternalUpdateRopeNode(First);
+    Second->left = NULL;
+    Second->right = NULL;
+    ccunicode_InternalFreeRopeNodes(Rope, Second);
+
+    Rope->root = ccunicode_InternalMergeRopeNodes(ccunicode_InternalMergeRopeNodes(Left, First), Right);
+    return 1;
 }
 
-#ifndef __CCUNICODE_NOSTDALLOC__
-int ccunicode_CodepointsToUtf8(const uint32_t *Codepoints, uint8_t **Utf8Str)
+// After a deletion at an offset, the chunks around it may be small: each of them is merged into a neighbour if it fits
+static void ccunicode_InternalMergeSmallRopeChunks(TCCUnicode_Rope *Rope, int Utf8Offset)
 {
-    return ccunicode_CodepointsToUtf8_a(Codepoints, Utf8Str, NULL);
+    int Start;
+    const TCCUnicode_RopeNode *Node;
+    if (Utf8Offset > 0 && (Node = ccunicode_InternalFindRopeChunk(Rope->root, Utf8Offset - 1, &Start)) != NULL)
+    {
+        if (!ccunicode_InternalMergeRopeChunksAt(Rope, Start + Node->chunk.utf8_size))
+            ccunicode_InternalMergeRopeChunksAt(Rope, Start);
+    }
+    if ((Node = ccunicode_InternalFindRopeChunk(Rope->root, Utf8Offset, &Start)) != NULL)
+    {
+        if (!ccunicode_InternalMergeRopeChunksAt(Rope, Start))
+            ccunicode_InternalMergeRopeChunksAt(Rope, Start + Node->chunk.utf8_size);
+    }
 }
 
-int ccunicode_CodepointsToUtf8_n(const uint32_t *Codepoints, int CodepointCount, uint8_t **Utf8Str)
-{
-    return ccunicode_CodepointsToUtf8_na(Codepoints, CodepointCount, Utf8Str, NULL);
+static TCCUnicode_RopeNode *ccunicode_InternalNewRopeNode(TCCUnicode_Rope *Rope)
+{
+    TCCUnicode_RopeNode *Node = (TCCUnicode_RopeNode*)ccunicode_InternalMalloc(&Rope->allocator.malloc_ptr, sizeof(*Node));
+    if (!Node)
+        return NULL;
+    Node->left = NULL;
+    Node->right = NULL;
+    Node->priority = ccunicode_InternalNextRopePriority(Rope);
+    ++Rope->node_count;
+    return Node;
+}
+
+int ccunicode_InitRope(TCCUnicode_Rope *Rope, const TCCUnicode_MallocPtr *AllocPtr)
+{
+    if (!Rope)
+        return CCUNICODE_NULL_POINTER;
+
+    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+
+    ccunicode_InternalCopyAllocator(&Rope->allocator, AllocPtr);
+    Rope->root = NULL;
+    Rope->seed = 0x9E3779B9;
+    Rope->node_count = 0;
+    return CCUNICODE_NO_ERROR;
 }
-#endif
 
-int ccunicode_CodepointsToUtf8_a(const uint32_t *Codepoints, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr)
+int ccunicode_DestroyRope(TCCUnicode_Rope *Rope)
 {
-    int CodepointCount = ccunicode_GetCodepointCount(Codepoints);
-    if (CodepointCount < 0)
-        return CodepointCount;
+    if (!Rope)
+        return CCUNICODE_NULL_POINTER;
 
-    return ccunicode_CodepointsToUtf8_na(Codepoints, CodepointCount, Utf8Str, AllocPtr);
+    ccunicode_InternalFreeRopeNodes(Rope, Rope->root);
+    Rope->root = NULL;
+    return CCUNICODE_NO_ERROR;
 }
 
-int ccunicode_CodepointsToUtf8_na(const uint32_t *Codepoints, int CodepointCount, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr)
+int ccunicode_InsertIntoRope_n(TCCUnicode_Rope *Rope, int Utf8Offset, const uint8_t *Utf8Str, int Utf8Size)
 {
-    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
-
-    if (!Utf8Str)
+    if (!Rope || !Utf8Str)
         return CCUNICODE_NULL_POINTER;
-
-    int Utf8Size = ccunicode_GetUtf8SizeFromCodepoints_n(Codepoints, CodepointCount);
     if (Utf8Size < 0)
-        return Utf8Size;
-    if (Utf8Size == INT_MAX)
+        return CCUNICODE_INVALID_PARAMETER;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckRopeOffset(Rope, Utf8Offset))
+
+    int Count = 0;
+    int InsertSize = ccunicode_InternalSkipUtf8(Utf8Str, Utf8Size, 0, INT_MAX, &Count);
+    if (InsertSize < 0)
+        return InsertSize;
+    if (!InsertSize)
+        return 0;
+    if (Rope->root && Rope->root->total.utf8_size > INT_MAX - InsertSize)
         return CCUNICODE_OVERFLOW;
 
-    *Utf8Str = AllocPtr->malloc_func(Utf8Size+1);
-    if (!(*Utf8Str))
+    // Small insertions, such as typing, go into the chunk holding the offset
+    if (InsertSize <= CCUNICODE_ROPE_CHUNK_SIZE && ccunicode_InternalInsertIntoRopeChunk(Rope->root, Utf8Offset, Utf8Str, InsertSize))
+        return InsertSize;
+
+    // Otherwise the text gets new chunks, cut between characters, and the tree is split at the offset.
+    // All the nodes are allocated first so that the rope is left unchanged on allocation failure.
+    TCCUnicode_RopeNode *Spare = ccunicode_InternalNewRopeNode(Rope);
+    if (!Spare)
         return CCUNICODE_BAD_ALLOCATION;
 
-    int Result = ccunicode_CodepointsToUtf8_nm(Codepoints, CodepointCount, *Utf8Str, Utf8Size);
-    if (Result < 0)
+    TCCUnicode_RopeNode *Inserted = NULL;
+    int Pos = 0;
+    while (Pos < InsertSize)
     {
-        AllocPtr->free_func(*Utf8Str);
-        *Utf8Str = NULL;
-    }
-    return Result;
-}
+        int ChunkSize = InsertSize - Pos;
+        if (ChunkSize > CCUNICODE_ROPE_CHUNK_SIZE)
+        {
+            ChunkSize = CCUNICODE_ROPE_CHUNK_SIZE;
+            while ((Utf8Str[Pos + ChunkSize] & 0xC0) == 0x80)
+                --ChunkSize;
+        }
 
-int ccunicode_CodepointsToUtf8_m(const uint32_t *Codepoints, uint8_t *Utf8Str, int Utf8Size)
-{
-    int CodepointCount = ccunicode_GetCodepointCount(Codepoints);
-    if (CodepointCount < 0)
-        return CodepointCount;
+        TCCUnicode_RopeNode *Node = ccunicode_InternalNewRopeNode(Rope);
+        if (!Node)
+        {
+            ccunicode_InternalFreeRopeNodes(Rope, Inserted);
+            ccunicode_InternalFreeRopeNodes(Rope, Spare);
+            return CCUNICODE_BAD_ALLOCATION;
+        }
+        memcpy(Node->data, Utf8Str + Pos, ChunkSize);
+        ccunicode_InternalMeasureRopeChunk(Node, ChunkSize);
+        ccunicode_InternalUpdateRopeNode(Node);
+        Inserted = ccunicode_InternalMergeRopeNodes(Inserted, Node);
+        Pos += ChunkSize;
+    }
 
-    return ccunicode_CodepointsToUtf8_nm(Codepoints, CodepointCount, Utf8Str, Utf8Size);
+    TCCUnicode_RopeNode *Left;
+    TCCUnicode_RopeNode *Right;
+    ccunicode_InternalSplitRopeNodes(Rope->root, Utf8Offset, &Left, &Right, &Spare);
+    Rope->root = ccunicode_InternalMergeRopeNodes(ccunicode_InternalMergeRopeNodes(Left, Inserted), Right);
+    ccunicode_InternalFreeRopeNodes(Rope, Spare);
+    return InsertSize;
 }
 
-int ccunicode_CodepointsToUtf8_nm(const uint32_t *Codepoints, int CodepointCount, uint8_t *Utf8Str, int Utf8Size)
+int ccunicode_DeleteFromRope(TCCUnicode_Rope *Rope, int Utf8Offset, int Utf8Size)
 {
-    if (!Codepoints)
+    if (!Rope)
         return CCUNICODE_NULL_POINTER;
-    if (!Utf8Str)
-        return CCUNICODE_NULL_POINTER;
-    if (CodepointCount < 0)
-        return CCUNICODE_INVALID_PARAMETER;
-    if (Utf8Size < 0)
+    if (Utf8Size < 0 || Utf8Offset > INT_MAX - Utf8Size)
         return CCUNICODE_INVALID_PARAMETER;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckRopeOffset(Rope, Utf8Offset))
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckRopeOffset(Rope, Utf8Offset + Utf8Size))
+    if (!Utf8Size)
+        return CCUNICODE_NO_ERROR;
 
-    int WritePos = 0;
-    int ReadPos = 0;
-    while ((ReadPos < CodepointCount) && (WritePos < Utf8Size))
+    if (ccunicode_InternalDeleteFromRopeChunk(Rope->root, Utf8Offset, Utf8Size))
     {
-        uint32_t CurrentCodepoint = Codepoints[ReadPos++];
+        ccunicode_InternalMergeSmallRopeChunks(Rope, Utf8Offset);
+        return CCUNICODE_NO_ERROR;
+    }
 
-        if (CurrentCodepoint > 0x10FFFF)
-            return CCUNICODE_INVALID_CODEPOINT;
-        if (CurrentCodepoint >= 0xD800 && CurrentCodepoint <= 0xDFFF)
-            return CCUNICODE_INVALID_CODEPOINT;
-        if (CurrentCodepoint == 0)
-        {
-            Utf8Str[WritePos] = 0;
-            return WritePos;
-        }
+    TCCUnicode_RopeNode *Spares[2];
+    Spares[0] = ccunicode_InternalNewRopeNode(Rope);
+    Spares[1] = ccunicode_InternalNewRopeNode(Rope);
+    if (!Spares[0] || !Spares[1])
+    {
+        ccunicode_InternalFreeRopeNodes(Rope, Spares[0]);
+        ccunicode_InternalFreeRopeNodes(Rope, Spares[1]);
+        return CCUNICODE_BAD_ALLOCATION;
+    }
 
-        if (CurrentCodepoint >= 1 && CurrentCodepoint <= 0x7F)
+    TCCUnicode_RopeNode *Left;
+    TCCUnicode_RopeNode *Middle;
+    TCCUnicode_RopeNode *Right;
+    ccunicode_InternalSplitRopeNodes(Rope->root, Utf8Offset, &Left, &Middle, &Spares[0]);
+    ccunicode_InternalSplitRopeNodes(Middle, Utf8Size, &Middle, &Right, &Spares[1]);
+    ccunicode_InternalFreeRopeNodes(Rope, Middle);
+    Rope->root = ccunicode_InternalMergeRopeNodes(Left, Right);
+    ccunicode_InternalFreeRopeNodes(Rope, Spares[0]);
+    ccunicode_InternalFreeRopeNodes(Rope, Spares[1]);
+    ccunicode_InternalMergeSmallRopeChunks(Rope, Utf8Offset);
+    return CCUNICODE_NO_ERROR;
+}
+
+static void ccunicode_InternalCopyRopeNodes(const TCCUnicode_RopeNode *Node, int Utf8Offset, int Utf8Size, uint8_t *Utf8Str)
+{
+    while (Node && Utf8Size > 0)
+    {
+        int LeftSize = Node->left ? Node->left->total.utf8_size : 0;
+        if (Utf8Offset < LeftSize)
         {
-            Utf8Str[WritePos++] = (uint8_t)CurrentCodepoint;
+            int LeftPart = (Utf8Size < LeftSize - Utf8Offset) ? Utf8Size : LeftSize - Utf8Offset;
+            ccunicode_InternalCopyRopeNodes(Node->left, Utf8Offset, LeftPart, Utf8Str);
+            Utf8Str += LeftPart;
+            Utf8Size -= LeftPart;
+            Utf8Offset = LeftSize;
         }
-        if (CurrentCodepoint >= 0x80 && CurrentCodepoint <= 0x7FF)
-        {
-            if (WritePos > Utf8Size-2)
-                return CCUNICODE_BUFFER_TOO_SMALL;
 
-            Utf8Str[WritePos++] = 0xC0 + (uint8_t)((CurrentCodepoint >> 6) & 0x1F);
-            Utf8Str[WritePos++] = 0x80 + (uint8_t)(CurrentCodepoint & 0x3F);
-        }
-        if (CurrentCodepoint >= 0x800 && CurrentCodepoint <= 0xFFFF)
+        int Pos = Utf8Offset - LeftSize;
+        if (Pos < Node->chunk.utf8_size)
         {
-            if (WritePos > Utf8Size-3)
-                return CCUNICODE_BUFFER_TOO_SMALL;
-
-            Utf8Str[WritePos++] = 0xE0 + (uint8_t)((CurrentCodepoint >> 12) & 0xF);
-            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint >> 6) & 0x3F);
-            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint) & 0x3F);
+            int ChunkPart = (Utf8Size < Node->chunk.utf8_size - Pos) ? Utf8Size : Node->chunk.utf8_size - Pos;
+            memcpy(Utf8Str, Node->data + Pos, ChunkPart);
+            Utf8Str += ChunkPart;
+            Utf8Size -= ChunkPart;
+            Pos += ChunkPart;
         }
-        if (CurrentCodepoint >= 0x1000 && CurrentCodepoint <= 0x10FFFF)
-        {
-            if (WritePos > Utf8Size-4)
-                return CCUNICODE_BUFFER_TOO_SMALL;
 
-            Utf8Str[WritePos++] = 0xF0 + (uint8_t)((CurrentCodepoint >> 18) & 0xF);
-            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint >> 12) & 0x3F);
-            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint >> 6) & 0x3F);
-            Utf8Str[WritePos++] = 0x80 + (uint8_t)((CurrentCodepoint) & 0x3F);
-        }
+        Utf8Offset = Pos - Node->chunk.utf8_size;
+        Node = Node->right;
     }
+}
 
-    if (ReadPos != CodepointCount)
+int ccunicode_CopyFromRope_m(const TCCUnicode_Rope *Rope, int Utf8Offset, int Utf8Size, uint8_t *Utf8Str, int MaxUtf8Size)
+{
+    if (!Rope || !Utf8Str)
+        return CCUNICODE_NULL_POINTER;
+    int Size = Rope->root ? Rope->root->total.utf8_size : 0;
+    if (Utf8Offset < 0 || Utf8Size < 0 || Utf8Offset > Size || Utf8Size > Size - Utf8Offset)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (MaxUtf8Size <= Utf8Size)
         return CCUNICODE_BUFFER_TOO_SMALL;
 
-    Utf8Str[WritePos] = 0;
-    return WritePos;
+    ccunicode_InternalCopyRopeNodes(Rope->root, Utf8Offset, Utf8Size, Utf8Str);
+    Utf8Str[Utf8Size] = 0;
+    return Utf8Size;
 }
 
-#ifndef __CCUNICODE_NOSTDALLOC__
-int ccunicode_CodepointsToUtf16(const uint32_t *Codepoints, uint16_t **Utf16Str)
+int ccunicode_GetRopeMetrics(const TCCUnicode_Rope *Rope, TCCUnicode_RopeMetrics *Metrics)
 {
-    return ccunicode_CodepointsToUtf16_a(Codepoints, Utf16Str, NULL);
-}
+    if (!Rope || !Metrics)
+        return CCUNICODE_NULL_POINTER;
 
-int ccunicode_CodepointsToUtf16_n(const uint32_t *Codepoints, int CodepointCount, uint16_t **Utf16Str)
-{
-    return ccunicode_CodepointsToUtf16_na(Codepoints, CodepointCount, Utf16Str, NULL);
+    if (Rope->root)
+        *Metrics = Rope->root->total;
+    else
+        memset(Metrics, 0, sizeof(*Metrics));
+    return CCUNICODE_NO_ERROR;
 }
-#endif
 
-int ccunicode_CodepointsToUtf16_a(const uint32_t *Codepoints, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr)
+// Walks the characters of a chunk, adding them to the metrics of the text before it, until Offset (in FromUnit) is reached,
+// or until Line line ends are before it if Line is positive
+static int ccunicode_InternalWalkRopeChunk(const TCCUnicode_RopeNode *Node, int FromUnit, int Offset, int Line, TCCUnicode_RopeMetrics *Before, int *BeforeEdges)
 {
-    int CodepointCount = ccunicode_GetCodepointCount(Codepoints);
-    if (CodepointCount < 0)
-        return CodepointCount;
+    int Pos = 0;
+    for (;;)
+    {
+        if (Line > 0 ? Before->line_count == Line : ccunicode_InternalGetMetric(Before, FromUnit) >= Offset)
+            break;
+
+        uint8_t Lead = Node->data[Pos];
+        int Length = 1 + (Lead >= 0xC0) + (Lead >= 0xE0) + (Lead >= 0xF0);
+        Before->line_count += ccunicode_InternalAddsLineEnd(Lead, *BeforeEdges & CCUNICODE_INTERNAL_ROPE_ENDS_WITH_CR);
+        if (!Before->utf8_size && Lead == '\n')
+            *BeforeEdges = CCUNICODE_INTERNAL_ROPE_STARTS_WITH_LF;
+        *BeforeEdges = (*BeforeEdges & CCUNICODE_INTERNAL_ROPE_STARTS_WITH_LF) | (Lead == '\r' ? CCUNICODE_INTERNAL_ROPE_ENDS_WITH_CR : 0);
+        Before->utf8_size += Length;
+        Before->codepoint_count += 1;
+        Before->utf16_size += (Length == 4) ? 2 : 1;
+        Pos += Length;
+    }
 
-    return ccunicode_CodepointsToUtf16_na(Codepoints, CodepointCount, Utf16Str, AllocPtr);
+    if (Line <= 0 && ccunicode_InternalGetMetric(Before, FromUnit) != Offset)
+        return CCUNICODE_STRING_ENDED_IN_CHARACTER;
+    return CCUNICODE_NO_ERROR;
 }
 
-int ccunicode_CodepointsToUtf16_na(const uint32_t *Codepoints, int CodepointCount, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr)
+// Finds the metrics of the text before an offset (in Unit), or before the first point where Line line ends are passed if Line is positive.
+// The latter can fall between the "\r" and the "\n" of a line end.
+static int ccunicode_InternalFindInRope(const TCCUnicode_Rope *Rope, int Unit, int Offset, int Line, TCCUnicode_RopeMetrics *Before, int *BeforeEdges)
 {
-    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
-
-    if (!Utf16Str)
+    if (!Rope)
         return CCUNICODE_NULL_POINTER;
+    if (Unit < CCUNICODE_UNIT_UTF8 || Unit > CCUNICODE_UNIT_CODEPOINT || Offset < 0 || Line < 0)
+        return CCUNICODE_INVALID_PARAMETER;
 
-    int Utf16Size = ccunicode_GetUtf16SizeFromCodepoints_n(Codepoints, CodepointCount);
-    if (Utf16Size < 0)
-        return Utf16Size;
-    if (Utf16Size == INT_MAX)
-        return CCUNICODE_OVERFLOW;
-
-    if (Utf16Size+1 > INT_MAX/sizeof(*Utf16Str))
-        return CCUNICODE_OVERFLOW;
-    *Utf16Str = AllocPtr->malloc_func((Utf16Size+1)*sizeof(*Utf16Str));
-    if (!(*Utf16Str))
-        return CCUNICODE_BAD_ALLOCATION;
-
-    int Result = ccunicode_CodepointsToUtf16_nm(Codepoints, CodepointCount, *Utf16Str, Utf16Size);
-    if (Result < 0)
+    memset(Before, 0, sizeof(*Before));
+    *BeforeEdges = 0;
+    const TCCUnicode_RopeNode *Node = Rope->root;
+    while (Node)
     {
-        AllocPtr->free_func(*Utf16Str);
-        *Utf16Str = NULL;
+        TCCUnicode_RopeMetrics Next = *Before;
+        int NextEdges = *BeforeEdges;
+        if (Node->left)
+        {
+            ccunicode_InternalAppendMetrics(&Next, &NextEdges, &Node->left->total, Node->left->total_edges);
+            if (Line > 0 ? Line <= Next.line_count : Offset <= ccunicode_InternalGetMetric(&Next, Unit))
+            {
+                Node = Node->left;
+                continue;
+            }
+            *Before = Next;
+            *BeforeEdges = NextEdges;
+        }
+
+        ccunicode_InternalAppendMetrics(&Next, &NextEdges, &Node->chunk, Node->chunk_edges);
+        if (Line > 0 ? Line <= Next.line_count : Offset <= ccunicode_InternalGetMetric(&Next, Unit))
+            return ccunicode_InternalWalkRopeChunk(Node, Unit, Offset, Line, Before, BeforeEdges);
+        *Before = Next;
+        *BeforeEdges = NextEdges;
+        Node = Node->right;
     }
-    return Result;
+
+    // Only the start of the text can be reached without going through a chunk
+    if (Line > 0 || Offset > 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    return CCUNICODE_NO_ERROR;
 }
 
-int ccunicode_CodepointsToUtf16_m(const uint32_t *Codepoints, uint16_t *Utf16Str, int Utf16Size)
+// Whether the text before an offset ends with the "\r" of a "\r\n"
+static int ccunicode_InternalIsInsideCrLf(const TCCUnicode_Rope *Rope, const TCCUnicode_RopeMetrics *Before, int BeforeEdges)
 {
-    int CodepointCount = ccunicode_GetCodepointCount(Codepoints);
-    if (CodepointCount < 0)
-        return CodepointCount;
-
-    return ccunicode_CodepointsToUtf16_nm(Codepoints, CodepointCount, Utf16Str, Utf16Size);
+    return (BeforeEdges & CCUNICODE_INTERNAL_ROPE_ENDS_WITH_CR) && ccunicode_InternalGetRopeByte(Rope->root, Before->utf8_size) == '\n';
 }
 
-int ccunicode_CodepointsToUtf16_nm(const uint32_t *Codepoints, int CodepointCount, uint16_t *Utf16Str, int Utf16Size)
+int ccunicode_ConvertRopeOffset(const TCCUnicode_Rope *Rope, int FromUnit, int Offset, int ToUnit)
 {
-    if (!Codepoints)
-        return CCUNICODE_NULL_POINTER;
-    if (!Utf16Str)
-        return CCUNICODE_NULL_POINTER;
-    if (CodepointCount < 0)
+    if (ToUnit < CCUNICODE_UNIT_UTF8 || ToUnit > CCUNICODE_UNIT_CODEPOINT)
         return CCUNICODE_INVALID_PARAMETER;
-    if (Utf16Size < 0)
+
+    TCCUnicode_RopeMetrics Before;
+    int BeforeEdges;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalFindInRope(Rope, FromUnit, Offset, 0, &Before, &BeforeEdges))
+    return ccunicode_InternalGetMetric(&Before, ToUnit);
+}
+
+int ccunicode_GetRopeLineStart(const TCCUnicode_Rope *Rope, int Line, int Unit)
+{
+    if (Line < 0)
         return CCUNICODE_INVALID_PARAMETER;
 
-    int WritePos = 0;
-    int ReadPos = 0;
-    while ((ReadPos < CodepointCount) && (WritePos < Utf16Size))
+    TCCUnicode_RopeMetrics Before;
+    int BeforeEdges;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalFindInRope(Rope, Unit, 0, Line, &Before, &BeforeEdges))
+    // The line starts after the "\n" of a "\r\n"
+    if (ccunicode_InternalIsInsideCrLf(Rope, &Before, BeforeEdges))
+        return ccunicode_InternalGetMetric(&Before, Unit) + 1;
+    return ccunicode_InternalGetMetric(&Before, Unit);
+}
+
+int ccunicode_GetRopeLineOfOffset(const TCCUnicode_Rope *Rope, int Unit, int Offset)
+{
+    TCCUnicode_RopeMetrics Before;
+    int BeforeEdges;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalFindInRope(Rope, Unit, Offset, 0, &Before, &BeforeEdges))
+    // The "\r" before the offset only ends its line with the "\n" after the offset
+    if (ccunicode_InternalIsInsideCrLf(Rope, &Before, BeforeEdges))
+        return Before.line_count - 1;
+    return Before.line_count;
+}
+
+// Number of codepoints decoded at once by ccunicode_Transcode_m
+#define CCUNICODE_INTERNAL_TRANSCODE_BLOCK 1024
+
+static int ccunicode_InternalIsValidEncoding(int Encoding)
+{
+    return Encoding >= CCUNICODE_ENCODING_UTF8 && Encoding <= CCUNICODE_ENCODING_UTF32BE;
+}
+
+// Applies the error policy to an invalid character: returns 1 if it is replaced, 0 if the conversion stops with Status
+static int ccunicode_InternalReplaceInvalid(TCCUnicode_Transcoder *Transcoder, uint32_t *Codepoint, int Error, int *Status)
+{
+    if (Transcoder->error_policy != CCUNICODE_ERROR_POLICY_REPLACE)
     {
-        uint32_t CurrentCodepoint = Codepoints[ReadPos++];
+        *Status = Error;
+        return 0;
+    }
+    *Codepoint = Transcoder->replacement;
+    Transcoder->replacement_count++;
+    return 1;
+}
 
-        if (CurrentCodepoint > 0x10FFFF)
-            return CCUNICODE_INVALID_CODEPOINT;
-        if (CurrentCodepoint >= 0xD800 && CurrentCodepoint <= 0xDFFF)
-            return CCUNICODE_INVALID_CODEPOINT;
-        if (CurrentCodepoint == 0)
-        {
-            Utf16Str[WritePos] = 0;
-            return WritePos;
-        }
+// Decodes up to MaxCount codepoints. Sets Read to the number of bytes consumed and Status to an error if one stopped the decoding.
+static int ccunicode_InternalDecodeBlock(TCCUnicode_Transcoder *Transcoder, const uint8_t *Source, int SourceSize, int IsLast,
+                                         uint32_t *Codepoints, int MaxCount, int *Read, int *Status)
+{
+    int Count = 0;
+    int Pos = 0;
+    *Status = CCUNICODE_NO_ERROR;
 
-        if (CurrentCodepoint >= 1 && CurrentCodepoint <= 0xFFFF)
+    if (Transcoder->source_encoding == CCUNICODE_ENCODING_UTF8)
+    {
+        while (Count < MaxCount && Pos < SourceSize)
         {
-            Utf16Str[WritePos++] = (uint16_t)CurrentCodepoint;
-        }
+            if (MaxCount - Count >= 8 && SourceSize - Pos >= 8 && !(ccunicode_InternalLoadLittleEndian64(Source + Pos) & CCUNICODE_INTERNAL_SWAR_HIGH))
+            {
+                for (int j = 0; j < 8; ++j)
+                    Codepoints[Count++] = Source[Pos++];
+                continue;
+            }
 
-        if (CurrentCodepoint >= 0x10000 && CurrentCodepoint <= 0x10FFFF)
+            uint32_t Codepoint;
+            int Length = ccunicode_DecodeNextUtf8(Source, SourceSize, Pos, &Codepoint);
+            if (Length == CCUNICODE_STRING_ENDED_IN_CHARACTER && !IsLast)
+                break;
+            if (Length < 0)
+            {
+                if (!ccunicode_InternalReplaceInvalid(Transcoder, &Codepoint, Length, Status))
+                    break;
+                // The lead byte and the valid extensions following it are replaced as a whole
+                uint8_t Lead = Source[Pos];
+                int Expected = (Lead >= 0xC0 && Lead < 0xF8) ? 2 + (Lead >= 0xE0) + (Lead >= 0xF0) : 1;
+                Length = 1;
+                while (Length < Expected && Pos + Length < SourceSize && (Source[Pos + Length] & 0xC0) == 0x80)
+                    ++Length;
+            }
+            else if (Codepoint > 0x10FFFF || (Codepoint >= 0xD800 && Codepoint <= 0xDFFF))
+            {
+                if (!ccunicode_InternalReplaceInvalid(Transcoder, &Codepoint, CCUNICODE_INVALID_CODEPOINT, Status))
+                    break;
+            }
+            Codepoints[Count++] = Codepoint;
+            Pos += Length;
+        }
+    }
+    else if (Transcoder->source_encoding <= CCUNICODE_ENCODING_UTF16BE)
+    {
+        int High = (Transcoder->source_encoding == CCUNICODE_ENCODING_UTF16BE) ? 0 : 1;
+        while (Count < MaxCount && Pos < SourceSize)
         {
-            if (WritePos > Utf16Size-2)
-                return CCUNICODE_BUFFER_TOO_SMALL;
+            if (SourceSize - Pos < 2)
+            {
+                if (!IsLast)
+                    break;
+                uint32_t Codepoint;
+                if (!ccunicode_InternalReplaceInvalid(Transcoder, &Codepoint, CCUNICODE_STRING_ENDED_IN_CHARACTER, Status))
+                    break;
+                Codepoints[Count++] = Codepoint;
+                Pos = SourceSize;
+                break;
+            }
 
-            CurrentCodepoint -= 0x10000;
-            uint16_t HighBits = (uint16_t)((CurrentCodepoint >> 10) & 0x3FF);
-            uint16_t LowBits = (uint16_t)(CurrentCodepoint & 0x3FF);
+            uint32_t First = ((uint32_t)Source[Pos + High] << 8) | Source[Pos + 1 - High];
+            if (First - 0xD800 >= 0x800)
+            {
+                Codepoints[Count++] = First;
+                Pos += 2;
+                continue;
+            }
 
-            Utf16Str[WritePos++] = HighBits + 0xD800;
-            Utf16Str[WritePos++] = LowBits + 0xDC00;
+            uint32_t Codepoint;
+            int Length = 2;
+            int Error = CCUNICODE_NO_ERROR;
+            if (First >= 0xDC00)
+            {
+                Error = CCUNICODE_SURROGATE_PAIR_INVERSION;
+            }
+            else if (SourceSize - Pos < 4)
+            {
+                if (!IsLast)
+                    break;
+                Error = CCUNICODE_STRING_ENDED_IN_CHARACTER;
+            }
+            else
+            {
+                uint32_t Second = ((uint32_t)Source[Pos + 2 + High] << 8) | Source[Pos + 3 - High];
+                if (Second - 0xDC00 >= 0x400)
+                    Error = CCUNICODE_INVALID_UTF16_CHARACTER;
+                Codepoint = ((First - 0xD800) << 10) + (Second - 0xDC00) + 0x10000;
+                Length = 4;
+            }
+
+            // An unpaired surrogate is replaced on its own and the following unit is decoded again
+            if (Error)
+            {
+                if (!ccunicode_InternalReplaceInvalid(Transcoder, &Codepoint, Error, Status))
+                    break;
+                Length = 2;
+            }
+            Codepoints[Count++] = Codepoint;
+            Pos += Length;
+        }
+    }
+    else
+    {
+        int BigEndian = (Transcoder->source_encoding == CCUNICODE_ENCODING_UTF32BE);
+        while (Count < MaxCount && Pos < SourceSize)
+        {
+            uint32_t Codepoint;
+            int Length = 4;
+            if (SourceSize - Pos < 4)
+            {
+                if (!IsLast)
+                    break;
+                if (!ccunicode_InternalReplaceInvalid(Transcoder, &Codepoint, CCUNICODE_STRING_ENDED_IN_CHARACTER, Status))
+                    break;
+                Length = SourceSize - Pos;
+            }
+            else
+            {
+                if (BigEndian)
+                    Codepoint = ((uint32_t)Source[Pos] << 24) | ((uint32_t)Source[Pos+1] << 16) | ((uint32_t)Source[Pos+2] << 8) | Source[Pos+3];
+                else
+                    Codepoint = (uint32_t)ccunicode_InternalLoadLittleEndian32(Source + Pos);
+
+                if (Codepoint > 0x10FFFF || (Codepoint >= 0xD800 && Codepoint <= 0xDFFF))
+                {
+                    if (!ccunicode_InternalReplaceInvalid(Transcoder, &Codepoint, CCUNICODE_INVALID_CODEPOINT, Status))
+                        break;
+                }
+            }
+            Codepoints[Count++] = Codepoint;
+            Pos += Length;
         }
     }
 
-    if (ReadPos != CodepointCount)
-        return CCUNICODE_BUFFER_TOO_SMALL;
+    *Read = Pos;
+    return Count;
+}
 
-    Utf16Str[WritePos] = 0;
-    return WritePos;
+// Encodes valid codepoints, the target must hold 4 bytes per codepoint
+static int ccunicode_InternalEncodeBlock(int Encoding, const uint32_t *Codepoints, int Count, uint8_t *Target)
+{
+    int Pos = 0;
+    if (Encoding == CCUNICODE_ENCODING_UTF8)
+    {
+        for (int i = 0; i < Count; ++i)
+        {
+            if (Codepoints[i] < 0x80)
+                Target[Pos++] = (uint8_t)Codepoints[i];
+            else
+                Pos += ccunicode_EncodeUtf8(Codepoints[i], Target + Pos, 4);
+        }
+    }
+    else if (Encoding <= CCUNICODE_ENCODING_UTF16BE)
+    {
+        int High = (Encoding == CCUNICODE_ENCODING_UTF16BE) ? 0 : 1;
+        for (int i = 0; i < Count; ++i)
+        {
+            uint16_t Units[2];
+            int UnitCount = ccunicode_EncodeUtf16(Codepoints[i], Units, 2);
+            for (int j = 0; j < UnitCount; ++j)
+            {
+                Target[Pos + High] = (uint8_t)(Units[j] >> 8);
+                Target[Pos + 1 - High] = (uint8_t)Units[j];
+                Pos += 2;
+            }
+        }
+    }
+    else
+    {
+        int BigEndian = (Encoding == CCUNICODE_ENCODING_UTF32BE);
+        for (int i = 0; i < Count; ++i)
+        {
+            uint32_t Codepoint = Codepoints[i];
+            if (BigEndian)
+            {
+                Target[Pos] = (uint8_t)(Codepoint >> 24);
+                Target[Pos+1] = (uint8_t)(Codepoint >> 16);
+                Target[Pos+2] = (uint8_t)(Codepoint >> 8);
+                Target[Pos+3] = (uint8_t)Codepoint;
+            }
+            else
+            {
+                ccunicode_InternalStoreLittleEndian32(Target + Pos, Codepoint);
+            }
+            Pos += 4;
+        }
+    }
+    return Pos;
 }
 
-#ifndef __CCUNICODE_NOSTDALLOC__
-int ccunicode_Utf8ToUtf16(const uint8_t *Utf8Str, uint16_t **Utf16Str)
+int ccunicode_InitTranscoder(TCCUnicode_Transcoder *Transcoder, int SourceEncoding, int TargetEncoding, int ErrorPolicy)
 {
-    return ccunicode_Utf8ToUtf16_a(Utf8Str, Utf16Str, NULL);
-}
+    if (!Transcoder)
+        return CCUNICODE_NULL_POINTER;
+    if (!ccunicode_InternalIsValidEncoding(SourceEncoding) || !ccunicode_InternalIsValidEncoding(TargetEncoding))
+        return CCUNICODE_INVALID_PARAMETER;
+    if (ErrorPolicy != CCUNICODE_ERROR_POLICY_STOP && ErrorPolicy != CCUNICODE_ERROR_POLICY_REPLACE)
+        return CCUNICODE_INVALID_PARAMETER;
 
-int ccunicode_Utf8ToUtf16_n(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str)
-{
-    return ccunicode_Utf8ToUtf16_na(Utf8Str, Utf8Size, Utf16Str, NULL);
+    Transcoder->source_encoding = SourceEncoding;
+    Transcoder->target_encoding = TargetEncoding;
+    Transcoder->error_policy = ErrorPolicy;
+    Transcoder->replacement = 0xFFFD;
+    Transcoder->source_offset = 0;
+    Transcoder->target_offset = 0;
+    Transcoder->replacement_count = 0;
+    return CCUNICODE_NO_ERROR;
 }
 
-int ccunicode_Utf8ToUtf16_m(const uint8_t *Utf8Str, uint16_t *Utf16Str, int Utf16Size)
+static int ccunicode_InternalTranscode_m(TCCUnicode_Transcoder *Transcoder, const uint8_t *Source, int SourceSize, int IsLast,
+                                         uint8_t *Target, int MaxTargetSize, int *SourceRead, int *TargetWritten)
 {
-    return ccunicode_Utf8ToUtf16_ma(Utf8Str, Utf16Str, Utf16Size, NULL);
-}
+    if (!Transcoder || !Source || !Target || !SourceRead || !TargetWritten)
+        return CCUNICODE_NULL_POINTER;
+    *SourceRead = 0;
+    *TargetWritten = 0;
+    if (SourceSize < 0 || MaxTargetSize < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    if (!ccunicode_InternalIsValidEncoding(Transcoder->source_encoding) || !ccunicode_InternalIsValidEncoding(Transcoder->target_encoding))
+        return CCUNICODE_INVALID_PARAMETER;
+    if (Transcoder->error_policy == CCUNICODE_ERROR_POLICY_REPLACE && (Transcoder->replacement > 0x10FFFF || (Transcoder->replacement >= 0xD800 && Transcoder->replacement <= 0xDFFF)))
+        return CCUNICODE_INVALID_CODEPOINT;
+
+    uint32_t Codepoints[CCUNICODE_INTERNAL_TRANSCODE_BLOCK];
+    int Read = 0;
+    int Written = 0;
+    int Status = CCUNICODE_NO_ERROR;
+    for (;;)
+    {
+        int MaxCount = (MaxTargetSize - Written)/4;
+        if (MaxCount > CCUNICODE_INTERNAL_TRANSCODE_BLOCK)
+            MaxCount = CCUNICODE_INTERNAL_TRANSCODE_BLOCK;
+        if (!MaxCount)
+            break;
+
+        int BlockRead = 0;
+        int Count = ccunicode_InternalDecodeBlock(Transcoder, Source + Read, SourceSize - Read, IsLast, Codepoints, MaxCount, &BlockRead, &Status);
+        Written += ccunicode_InternalEncodeBlock(Transcoder->target_encoding, Codepoints, Count, Target + Written);
+        Read += BlockRead;
+        if (Status != CCUNICODE_NO_ERROR || Count < MaxCount)
+            break;
+    }
 
-int ccunicode_Utf8ToUtf16_nm(const uint8_t *Utf8Str, int Utf8Size, uint16_t *Utf16Str, int Utf16Size)
-{
-    return ccunicode_Utf8ToUtf16_nma(Utf8Str, Utf8Size, Utf16Str, Utf16Size, NULL);
+    Transcoder->source_offset += Read;
+    Transcoder->target_offset += Written;
+    *SourceRead = Read;
+    *TargetWritten = Written;
+    return Status;
 }
 
-int ccunicode_Utf8ToUtf16_l(const uint8_t *Utf8Str, uint16_t **Utf16Str, uint32_t *Codepoints, int MaxCodepointsCount)
+int ccunicode_Transcode_m(TCCUnicode_Transcoder *Transcoder, const uint8_t *Source, int SourceSize, int IsLast,
+                          uint8_t *Target, int MaxTargetSize, int *SourceRead, int *TargetWritten)
 {
-    return ccunicode_Utf8ToUtf16_la(Utf8Str, Utf16Str, Codepoints, MaxCodepointsCount, NULL);
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_TRANSCODE_M, SourceSize)
+    int Res = ccunicode_InternalTranscode_m(Transcoder, Source, SourceSize, IsLast, Target, MaxTargetSize, SourceRead, TargetWritten);
+    CCUNICODE_INTERNAL_LEAVE(Res, *TargetWritten)
+    return Res;
 }
 
-int ccunicode_Utf8ToUtf16_nl(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, uint32_t *Codepoints, int MaxCodepointsCount)
+#if CCUNICODE_HAS_POSIX_FILES
+static int ccunicode_InternalWriteAll(int Fd, const uint8_t *Data, size_t Size)
 {
-    return ccunicode_Utf8ToUtf16_nla(Utf8Str, Utf8Size, Utf16Str, Codepoints, MaxCodepointsCount, NULL);
+    while (Size > 0)
+    {
+        ssize_t Res = write(Fd, Data, Size);
+        if (Res < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return CCUNICODE_IO_ERROR;
+        }
+        Data += Res;
+        Size -= (size_t)Res;
+    }
+    return CCUNICODE_NO_ERROR;
 }
-#endif
 
-int ccunicode_Utf8ToUtf16_a(const uint8_t *Utf8Str, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr)
+int ccunicode_TranscodeFile(TCCUnicode_Transcoder *Transcoder, const char *SourcePath, int TargetFd, const TCCUnicode_MallocPtr *AllocPtr)
 {
-    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
-
-    uint32_t *Codepoints = NULL;
-    int CodepointCount = ccunicode_Utf8ToCodepoints_a(Utf8Str, &Codepoints, AllocPtr);
-    if (CodepointCount < 0)
-        return CodepointCount;
-
-    int Res = ccunicode_CodepointsToUtf16_na(Codepoints, CodepointCount, Utf16Str, AllocPtr);
-    AllocPtr->free_func(Codepoints);
-    return Res;
-}
+    if (!Transcoder || !SourcePath)
+        return CCUNICODE_NULL_POINTER;
+    if (TargetFd < 0 || CCUNICODE_TRANSCODE_WINDOW < 8192)
+        return CCUNICODE_INVALID_PARAMETER;
 
-int ccunicode_Utf8ToUtf16_na(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, const TCCUnicode_MallocPtr *AllocPtr)
-{
     CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
 
-    uint32_t *Codepoints = NULL;
-    int CodepointCount = ccunicode_Utf8ToCodepoints_na(Utf8Str, Utf8Size, &Codepoints, AllocPtr);
-    if (CodepointCount < 0)
-        return CodepointCount;
-
-    int Res = ccunicode_CodepointsToUtf16_na(Codepoints, CodepointCount, Utf16Str, AllocPtr);
-    AllocPtr->free_func(Codepoints);
-    return Res;
-}
+    int SourceFd = open(SourcePath, O_RDONLY);
+    if (SourceFd < 0)
+        return CCUNICODE_IO_ERROR;
+    struct stat Stat;
+    if (fstat(SourceFd, &Stat) != 0)
+    {
+        close(SourceFd);
+        return CCUNICODE_IO_ERROR;
+    }
 
-int ccunicode_Utf8ToUtf16_ma(const uint8_t *Utf8Str, uint16_t *Utf16Str, int Utf16Size, const TCCUnicode_MallocPtr *AllocPtr)
-{
-    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+    size_t SourceSize = (size_t)Stat.st_size;
+    const uint8_t *Source = NULL;
+    if (SourceSize > 0)
+    {
+        void *Map = mmap(NULL, SourceSize, PROT_READ, MAP_PRIVATE, SourceFd, 0);
+        if (Map == MAP_FAILED)
+        {
+            close(SourceFd);
+            return CCUNICODE_IO_ERROR;
+        }
+#ifdef MADV_SEQUENTIAL
+        madvise(Map, SourceSize, MADV_SEQUENTIAL);
+#endif
+        Source = (const uint8_t*)Map;
+    }
+    close(SourceFd);
 
-    uint32_t *Codepoints = NULL;
-    int CodepointCount = ccunicode_Utf8ToCodepoints_a(Utf8Str, &Codepoints, AllocPtr);
-    if (CodepointCount < 0)
-        return CodepointCount;
+    uint8_t *Window = (uint8_t*)ccunicode_InternalMalloc(AllocPtr, CCUNICODE_TRANSCODE_WINDOW);
+    if (!Window)
+    {
+        if (Source)
+            munmap((void*)Source, SourceSize);
+        return CCUNICODE_BAD_ALLOCATION;
+    }
 
-    int Res = ccunicode_CodepointsToUtf16_nm(Codepoints, CodepointCount, Utf16Str, Utf16Size);
-    AllocPtr->free_func(Codepoints);
-    return Res;
-}
+    // Bytes of the window not written yet, and part of the mapping already released
+    const uint8_t Empty = 0;
+    const size_t PageSize = 4096;
+    size_t Pending = 0;
+    size_t Pos = 0;
+#ifdef MADV_DONTNEED
+    size_t Released = 0;
+#endif
+    int Res = CCUNICODE_NO_ERROR;
+    for (;;)
+    {
+        size_t Chunk = SourceSize - Pos;
+        if (Chunk > INT_MAX/2)
+            Chunk = INT_MAX/2;
+        int IsLast = (Pos + Chunk == SourceSize);
+
+        int Read = 0;
+        int Written = 0;
+        Res = ccunicode_Transcode_m(Transcoder, Source ? Source + Pos : &Empty, (int)Chunk, IsLast,
+                                    Window + Pending, (int)(CCUNICODE_TRANSCODE_WINDOW - Pending), &Read, &Written);
+        Pos += (size_t)Read;
+        Pending += (size_t)Written;
+        int Done = (Res != CCUNICODE_NO_ERROR) || (IsLast && Pos == SourceSize);
+
+        // Whole pages are written out, the rest moves to the start of the window
+        size_t Flushed = Done ? Pending : Pending - Pending % PageSize;
+        int WriteRes = ccunicode_InternalWriteAll(TargetFd, Window, Flushed);
+        if (WriteRes != CCUNICODE_NO_ERROR)
+        {
+            Res = WriteRes;
+            break;
+        }
+        memmove(Window, Window + Flushed, Pending - Flushed);
+        Pending -= Flushed;
 
-int ccunicode_Utf8ToUtf16_nma(const uint8_t *Utf8Str, int Utf8Size, uint16_t *Utf16Str, int Utf16Size, const TCCUnicode_MallocPtr *AllocPtr)
-{
-    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+#ifdef MADV_DONTNEED
+        if (Pos - Released >= CCUNICODE_TRANSCODE_WINDOW)
+        {
+            size_t ReleaseEnd = Pos - Pos % PageSize;
+            madvise((void*)(Source + Released), ReleaseEnd - Released, MADV_DONTNEED);
+            Released = ReleaseEnd;
+        }
+#endif
 
-    uint32_t *Codepoints = NULL;
-    int CodepointCount = ccunicode_Utf8ToCodepoints_na(Utf8Str, Utf8Size, &Codepoints, AllocPtr);
-    if (CodepointCount < 0)
-        return CodepointCount;
+        if (Done)
+            break;
+        if (!Read && !Written)
+        {
+            Res = CCUNICODE_BUFFER_TOO_SMALL;
+            break;
+        }
+    }
 
-    int Res = ccunicode_CodepointsToUtf16_nm(Codepoints, CodepointCount, Utf16Str, Utf16Size);
-    AllocPtr->free_func(Codepoints);
+    ccunicode_InternalFree(AllocPtr, Window);
+    if (Source)
+        munmap((void*)Source, SourceSize);
     return Res;
 }
+#endif
 
-int ccunicode_Utf8ToUtf16_la(const uint8_t *Utf8Str, uint16_t **Utf16Str, uint32_t *Codepoints, int MaxCodepointsCount, const TCCUnicode_MallocPtr *AllocPtr)
-{
-    int Res = ccunicode_Utf8ToCodepoints_m(Utf8Str, Codepoints, MaxCodepointsCount);
-    if (Res < 0)
-        return Res;
-
-    return ccunicode_CodepointsToUtf16_na(Codepoints, MaxCodepointsCount, Utf16Str, AllocPtr);
-}
-
-int ccunicode_Utf8ToUtf16_nla(const uint8_t *Utf8Str, int Utf8Size, uint16_t **Utf16Str, uint32_t *Codepoints, int MaxCodepointsCount, const TCCUnicode_MallocPtr *AllocPtr)
+static int ccunicode_InternalValidateUtf8Data(const uint8_t *Utf8Data, int64_t Utf8Size, int64_t *ErrorOffset)
 {
-    int Res = ccunicode_Utf8ToCodepoints_nm(Utf8Str, Utf8Size, Codepoints, MaxCodepointsCount);
-    if (Res < 0)
-        return Res;
-
-    return ccunicode_CodepointsToUtf16_na(Codepoints, MaxCodepointsCount, Utf16Str, AllocPtr);
-}
+    if (ErrorOffset)
+        *ErrorOffset = -1;
+    if (!Utf8Data)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
 
-int ccunicode_Utf8ToUtf16_ml(const uint8_t *Utf8Str, uint16_t *Utf16Str, int Utf16Size, uint32_t *Codepoints, int MaxCodepointsCount)
-{
-    int Res = ccunicode_Utf8ToCodepoints_m(Utf8Str, Codepoints, MaxCodepointsCount);
-    if (Res < 0)
-        return Res;
+    CCUNICODE_INTERNAL_SET_VARIANT(CCUNICODE_VARIANT_ASCII_BLOCKS)
+    int64_t Pos = 0;
+    while (Pos < Utf8Size)
+    {
+        if (Utf8Size - Pos >= 16)
+        {
+            uint64_t Word = ccunicode_InternalLoadLittleEndian64(Utf8Data + Pos) | ccunicode_InternalLoadLittleEndian64(Utf8Data + Pos + 8);
+            if (!(Word & CCUNICODE_INTERNAL_SWAR_HIGH))
+            {
+                Pos += 16;
+                continue;
+            }
+        }
 
-    return ccunicode_CodepointsToUtf16_nm(Codepoints, MaxCodepointsCount, Utf16Str, Utf16Size);
-}
+        if (Utf8Data[Pos] < 0x80)
+        {
+            ++Pos;
+            continue;
+        }
 
-int ccunicode_Utf8ToUtf16_nml(const uint8_t *Utf8Str, int Utf8Size, uint16_t *Utf16Str, int Utf16Size, uint32_t *Codepoints, int MaxCodepointsCount)
-{
-    int Res = ccunicode_Utf8ToCodepoints_nm(Utf8Str, Utf8Size, Codepoints, MaxCodepointsCount);
-    if (Res < 0)
-        return Res;
+        // A character is at most 4 bytes long, so the remaining size fits in an int
+        uint32_t Codepoint = 0;
+        int Length = ccunicode_DecodeNextUtf8(Utf8Data + Pos, (Utf8Size - Pos < 4) ? (int)(Utf8Size - Pos) : 4, 0, &Codepoint);
+        if (Length >= 0 && (Codepoint > 0x10FFFF || (Codepoint >= 0xD800 && Codepoint <= 0xDFFF)))
+            Length = CCUNICODE_INVALID_CODEPOINT;
+        if (Length < 0)
+        {
+            if (ErrorOffset)
+                *ErrorOffset = Pos;
+            return Length;
+        }
+        Pos += Length;
+    }
 
-    return ccunicode_CodepointsToUtf16_nm(Codepoints, MaxCodepointsCount, Utf16Str, Utf16Size);
+    return CCUNICODE_NO_ERROR;
 }
 
-#ifndef __CCUNICODE_NOSTDALLOC__
-int ccunicode_Utf16ToUtf8(const uint16_t *Utf16Str, uint8_t **Utf8Str)
+int ccunicode_ValidateUtf8Data(const uint8_t *Utf8Data, int64_t Utf8Size, int64_t *ErrorOffset)
 {
-    return ccunicode_Utf16ToUtf8_a(Utf16Str, Utf8Str, NULL);
+    CCUNICODE_INTERNAL_ENTER(CCUNICODE_FUNCTION_VALIDATE_UTF8_DATA, Utf8Size)
+    int Res = ccunicode_InternalValidateUtf8Data(Utf8Data, Utf8Size, ErrorOffset);
+    CCUNICODE_INTERNAL_LEAVE(Res, 0)
+    return Res;
 }
 
-int ccunicode_Utf16ToUtf8_n(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str)
-{
-    return ccunicode_Utf16ToUtf8_na(Utf16Str, Utf16Size, Utf8Str, NULL);
-}
+// Kinds of characters drawn by a corpus generator
+#define CCUNICODE_INTERNAL_CORPUS_VALID 0
+#define CCUNICODE_INTERNAL_CORPUS_NULL 1
+#define CCUNICODE_INTERNAL_CORPUS_ERROR 2
 
-int ccunicode_Utf16ToUtf8_m(const uint16_t *Utf16Str, uint8_t *Utf8Str, int Utf8Size)
+static uint32_t ccunicode_InternalNextCorpusRandom(TCCUnicode_CorpusGenerator *Generator)
 {
-    return ccunicode_Utf16ToUtf8_ma(Utf16Str, Utf8Str, Utf8Size, NULL);
+    // xorshift32
+    uint32_t State = Generator->state;
+    State ^= State << 13;
+    State ^= State >> 17;
+    State ^= State << 5;
+    Generator->state = State;
+    return State;
 }
 
-int ccunicode_Utf16ToUtf8_nm(const uint16_t *Utf16Str, int Utf16Size, uint8_t *Utf8Str, int Utf8Size)
+static int ccunicode_InternalCheckCorpusGenerator(const TCCUnicode_CorpusGenerator *Generator)
 {
-    return ccunicode_Utf16ToUtf8_nma(Utf16Str, Utf16Size, Utf8Str, Utf8Size, NULL);
-}
+    int TotalWeight = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        if (Generator->weights[i] < 0)
+            return CCUNICODE_INVALID_PARAMETER;
+        TotalWeight += Generator->weights[i];
+
+        // A range must hold at least one codepoint that is not a surrogate
+        uint32_t First = Generator->ranges[i][0];
+        uint32_t Last = Generator->ranges[i][1];
+        if (Generator->weights[i] && (First > Last || Last > 0x10FFFF || (First >= 0xD800 && Last <= 0xDFFF)))
+            return CCUNICODE_INVALID_PARAMETER;
+    }
+    if (!TotalWeight || Generator->errors_per_million < 0 || Generator->nulls_per_million < 0 || Generator->errors_per_million + Generator->nulls_per_million > 1000000)
+        return CCUNICODE_INVALID_PARAMETER;
 
-int ccunicode_Utf16ToUtf8_l(const uint16_t *Utf16Str, uint8_t **Utf8Str, uint32_t *Codepoints, int MaxCodepointsCount)
-{
-    return ccunicode_Utf16ToUtf8_la(Utf16Str, Utf8Str, Codepoints, MaxCodepointsCount, NULL);
+    return CCUNICODE_NO_ERROR;
 }
 
-int ccunicode_Utf16ToUtf8_nl(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, uint32_t *Codepoints, int MaxCodepointsCount)
+// Draws the next character, returns its kind
+static int ccunicode_InternalNextCorpusCharacter(TCCUnicode_CorpusGenerator *Generator, uint32_t *Codepoint)
 {
-    return ccunicode_Utf16ToUtf8_nla(Utf16Str, Utf16Size, Utf8Str, Codepoints, MaxCodepointsCount, NULL);
-}
-#endif
+    uint32_t Special = ccunicode_InternalNextCorpusRandom(Generator) % 1000000;
+    if (Special < (uint32_t)Generator->errors_per_million)
+        return CCUNICODE_INTERNAL_CORPUS_ERROR;
+    if (Special < (uint32_t)(Generator->errors_per_million + Generator->nulls_per_million))
+    {
+        *Codepoint = 0;
+        return CCUNICODE_INTERNAL_CORPUS_NULL;
+    }
 
-int ccunicode_Utf16ToUtf8_a(const uint16_t *Utf16Str, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr)
-{
-    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+    if (Generator->run_left <= 0)
+    {
+        int TotalWeight = Generator->weights[0] + Generator->weights[1] + Generator->weights[2] + Generator->weights[3];
+        int Pick = (int)(ccunicode_InternalNextCorpusRandom(Generator) % (uint32_t)TotalWeight);
+        int Class = 0;
+        while (Pick >= Generator->weights[Class])
+            Pick -= Generator->weights[Class++];
+        Generator->run_class = Class;
+
+        int MeanRun = (Generator->mean_run_length > 1) ? Generator->mean_run_length : 1;
+        Generator->run_left = 1 + (int)(ccunicode_InternalNextCorpusRandom(Generator) % (uint32_t)(2*MeanRun - 1));
+    }
+    Generator->run_left--;
 
-    uint32_t *Codepoints = NULL;
-    int CodepointCount = ccunicode_Utf16ToCodepoints_a(Utf16Str, &Codepoints, AllocPtr);
-    if (CodepointCount < 0)
-        return CodepointCount;
+    uint32_t First = Generator->ranges[Generator->run_class][0];
+    uint32_t Last = Generator->ranges[Generator->run_class][1];
+    do
+    {
+        *Codepoint = First + ccunicode_InternalNextCorpusRandom(Generator) % (Last - First + 1);
+    } while (*Codepoint >= 0xD800 && *Codepoint <= 0xDFFF);
 
-    int Res = ccunicode_CodepointsToUtf8_na(Codepoints, CodepointCount, Utf8Str, AllocPtr);
-    AllocPtr->free_func(Codepoints);
-    return Res;
+    return CCUNICODE_INTERNAL_CORPUS_VALID;
 }
 
-int ccunicode_Utf16ToUtf8_na(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, const TCCUnicode_MallocPtr *AllocPtr)
+int ccunicode_InitCorpusGenerator(TCCUnicode_CorpusGenerator *Generator, uint32_t Seed)
 {
-    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
-
-    uint32_t *Codepoints = NULL;
-    int CodepointCount = ccunicode_Utf16ToCodepoints_na(Utf16Str, Utf16Size, &Codepoints, AllocPtr);
-    if (CodepointCount < 0)
-        return CodepointCount;
+    if (!Generator)
+        return CCUNICODE_NULL_POINTER;
 
-    int Res = ccunicode_CodepointsToUtf8_na(Codepoints, CodepointCount, Utf8Str, AllocPtr);
-    AllocPtr->free_func(Codepoints);
-    return Res;
+    static const uint32_t DefaultRanges[4][2] = {{0x20, 0x7E}, {0x80, 0x7FF}, {0x800, 0xFFFF}, {0x10000, 0x10FFFF}};
+    for (int i = 0; i < 4; ++i)
+    {
+        Generator->weights[i] = (i == 0);
+        Generator->ranges[i][0] = DefaultRanges[i][0];
+        Generator->ranges[i][1] = DefaultRanges[i][1];
+    }
+    Generator->mean_run_length = 1;
+    Generator->errors_per_million = 0;
+    Generator->nulls_per_million = 0;
+    // xorshift32 never leaves 0
+    Generator->state = Seed ? Seed : 0x9E3779B9u;
+    Generator->run_left = 0;
+    Generator->run_class = 0;
+    return CCUNICODE_NO_ERROR;
 }
 
-int ccunicode_Utf16ToUtf8_ma(const uint16_t *Utf16Str, uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_MallocPtr *AllocPtr)
+int ccunicode_GenerateCodepoints(TCCUnicode_CorpusGenerator *Generator, uint32_t *Codepoints, int CodepointCount)
 {
-    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
-
-    uint32_t *Codepoints = NULL;
-    int CodepointCount = ccunicode_Utf16ToCodepoints_a(Utf16Str, &Codepoints, AllocPtr);
+    if (!Generator || !Codepoints)
+        return CCUNICODE_NULL_POINTER;
     if (CodepointCount < 0)
-        return CodepointCount;
+        return CCUNICODE_INVALID_PARAMETER;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckCorpusGenerator(Generator))
 
-    int Res = ccunicode_CodepointsToUtf8_nm(Codepoints, CodepointCount, Utf8Str, Utf8Size);
-    AllocPtr->free_func(Codepoints);
-    return Res;
+    for (int i = 0; i < CodepointCount; ++i)
+    {
+        uint32_t Codepoint = 0;
+        if (ccunicode_InternalNextCorpusCharacter(Generator, &Codepoint) == CCUNICODE_INTERNAL_CORPUS_ERROR)
+        {
+            uint32_t Random = ccunicode_InternalNextCorpusRandom(Generator);
+            Codepoint = (Random & 1) ? 0xD800 + (Random >> 1) % 0x800 : 0x110000 + (Random >> 1) % 0x100000;
+        }
+        Codepoints[i] = Codepoint;
+    }
+    return CodepointCount;
 }
 
-int ccunicode_Utf16ToUtf8_nma(const uint16_t *Utf16Str, int Utf16Size, uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_MallocPtr *AllocPtr)
+int ccunicode_GenerateUtf8(TCCUnicode_CorpusGenerator *Generator, uint8_t *Utf8Data, int Utf8Size)
 {
-    CCUNICODE_INTERNAL_TEST(ccunicode_CheckAllocator(&AllocPtr))
+    if (!Generator || !Utf8Data)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf8Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckCorpusGenerator(Generator))
 
-    uint32_t *Codepoints = NULL;
-    int CodepointCount = ccunicode_Utf16ToCodepoints_na(Utf16Str, Utf16Size, &Codepoints, AllocPtr);
-    if (CodepointCount < 0)
-        return CodepointCount;
+    int Pos = 0;
+    while (Pos < Utf8Size)
+    {
+        uint8_t Bytes[8];
+        int Length = 0;
+        uint32_t Codepoint = 0;
+        if (ccunicode_InternalNextCorpusCharacter(Generator, &Codepoint) != CCUNICODE_INTERNAL_CORPUS_ERROR)
+        {
+            Length = ccunicode_EncodeUtf8(Codepoint, Bytes, 4);
+        }
+        else
+        {
+            uint32_t Random = ccunicode_InternalNextCorpusRandom(Generator);
+            uint8_t Extension = (uint8_t)(0x80 + ((Random >> 8) & 0x3F));
+            switch (Random % 5)
+            {
+            case 0: // Isolated extension byte
+                Bytes[Length++] = Extension;
+                break;
+            case 1: // Character missing its last byte, followed by ASCII so that it can not be completed
+                Length = ccunicode_EncodeUtf8(0x800 + (Random >> 8) % 0xD000, Bytes, 4) - 1;
+                Bytes[Length++] = 'x';
+                break;
+            case 2: // Byte that never appears in UTF8
+                Bytes[Length++] = (uint8_t)(0xF8 + ((Random >> 8) & 0x7));
+                break;
+            case 3: // Encoded surrogate
+                Bytes[Length++] = 0xED;
+                Bytes[Length++] = (uint8_t)(0xA0 + ((Random >> 16) & 0x1F));
+                Bytes[Length++] = Extension;
+                break;
+            default: // Encoded value above 0x10FFFF
+                Bytes[Length++] = 0xF4;
+                Bytes[Length++] = (uint8_t)(0x90 + (Random >> 16) % 0x30);
+                Bytes[Length++] = Extension;
+                Bytes[Length++] = Extension;
+                break;
+            }
+        }
 
-    int Res = ccunicode_CodepointsToUtf8_nm(Codepoints, CodepointCount, Utf8Str, Utf8Size);
-    AllocPtr->free_func(Codepoints);
-    return Res;
+        if (Length > Utf8Size - Pos)
+        {
+            while (Pos < Utf8Size)
+                Utf8Data[Pos++] = 'x';
+            break;
+        }
+        for (int i = 0; i < Length; ++i)
+            Utf8Data[Pos++] = Bytes[i];
+    }
+    return Utf8Size;
 }
 
-int ccunicode_Utf16ToUtf8_la(const uint16_t *Utf16Str, uint8_t **Utf8Str, uint32_t *Codepoints, int MaxCodepointsCount, const TCCUnicode_MallocPtr *AllocPtr)
+int ccunicode_GenerateUtf16(TCCUnicode_CorpusGenerator *Generator, uint16_t *Utf16Data, int Utf16Size)
 {
-    int Res = ccunicode_Utf16ToCodepoints_m(Utf16Str, Codepoints, MaxCodepointsCount);
-    if (Res < 0)
-        return Res;
+    if (!Generator || !Utf16Data)
+        return CCUNICODE_NULL_POINTER;
+    if (Utf16Size < 0)
+        return CCUNICODE_INVALID_PARAMETER;
+    CCUNICODE_INTERNAL_TEST(ccunicode_InternalCheckCorpusGenerator(Generator))
 
-    return ccunicode_CodepointsToUtf8_na(Codepoints, MaxCodepointsCount, Utf8Str, AllocPtr);
+    int Pos = 0;
+    while (Pos < Utf16Size)
+    {
+        uint16_t Units[2];
+        int Length = 0;
+        uint32_t Codepoint = 0;
+        if (ccunicode_InternalNextCorpusCharacter(Generator, &Codepoint) != CCUNICODE_INTERNAL_CORPUS_ERROR)
+        {
+            Length = ccunicode_EncodeUtf16(Codepoint, Units, 2);
+        }
+        else
+        {
+            // Unpaired high surrogate (followed by ASCII so that it can not be paired) or low surrogate
+            uint32_t Random = ccunicode_InternalNextCorpusRandom(Generator);
+            if (Random & 1)
+            {
+                Units[Length++] = (uint16_t)(0xD800 + (Random >> 1) % 0x400);
+                Units[Length++] = 'x';
+            }
+            else
+            {
+                Units[Length++] = (uint16_t)(0xDC00 + (Random >> 1) % 0x400);
+            }
+        }
+
+        if (Length > Utf16Size - Pos)
+        {
+            Utf16Data[Pos++] = 'x';
+            break;
+        }
+        for (int i = 0; i < Length; ++i)
+            Utf16Data[Pos++] = Units[i];
+    }
+    return Utf16Size;
 }
 
-int ccunicode_Utf16ToUtf8_nla(const uint16_t *Utf16Str, int Utf16Size, uint8_t **Utf8Str, uint32_t *Codepoints, int MaxCodepointsCount, const TCCUnicode_MallocPtr *AllocPtr)
+int ccunicode_GetStats(TCCUnicode_Stats *Stats, int Reset)
 {
-    int Res = ccunicode_Utf16ToCodepoints_nm(Utf16Str, Utf16Size, Codepoints, MaxCodepointsCount);
-    if (Res < 0)
-        return Res;
+    if (!Stats)
+        return CCUNICODE_NULL_POINTER;
 
-    return ccunicode_CodepointsToUtf8_na(Codepoints, MaxCodepointsCount, Utf8Str, AllocPtr);
+    memset(Stats, 0, sizeof(*Stats));
+#ifdef __CCUNICODE_STATS__
+    Stats->enabled = 1;
+    ccunicode_InternalCopyStats(Stats->functions, Reset);
+#else
+    (void)Reset;
+#endif
+    return CCUNICODE_NO_ERROR;
 }
 
-int ccunicode_Utf16ToUtf8_ml(const uint16_t *Utf16Str, uint8_t *Utf8Str, int Utf8Size, uint32_t *Codepoints, int MaxCodepointsCount)
+int ccunicode_ResetStats(void)
 {
-    int Res = ccunicode_Utf16ToCodepoints_m(Utf16Str, Codepoints, MaxCodepointsCount);
-    if (Res < 0)
-        return Res;
-
-    return ccunicode_CodepointsToUtf8_nm(Codepoints, MaxCodepointsCount, Utf8Str, Utf8Size);
+#ifdef __CCUNICODE_STATS__
+    ccunicode_InternalCopyStats(NULL, 1);
+#endif
+    return CCUNICODE_NO_ERROR;
 }
 
-int ccunicode_Utf16ToUtf8_nml(const uint16_t *Utf16Str, int Utf16Size, uint8_t *Utf8Str, int Utf8Size, uint32_t *Codepoints, int MaxCodepointsCount)
+const char *ccunicode_GetFunctionName(int Function)
 {
-    int Res = ccunicode_Utf16ToCodepoints_nm(Utf16Str, Utf16Size, Codepoints, MaxCodepointsCount);
-    if (Res < 0)
-        return Res;
-
-    return ccunicode_CodepointsToUtf8_nm(Codepoints, MaxCodepointsCount, Utf8Str, Utf8Size);
+    if (Function < 0 || Function >= CCUNICODE_FUNCTION_COUNT)
+        return NULL;
+    return ccunicode_FunctionNames[Function];
 }
 #   endif
 
@@ -0,0 +1,224 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef struct
+{
+    int malloc_count;
+    int free_count;
+} TCountingContext;
+
+static void *CountingMalloc(void *Ctx, size_t Size)
+{
+    ((TCountingContext*)Ctx)->malloc_count++;
+    return malloc(Size);
+}
+
+static void CountingFree(void *Ctx, void *Ptr)
+{
+    ((TCountingContext*)Ctx)->free_count++;
+    free(Ptr);
+}
+
+int TestAlignmentAndGrowth(void)
+{
+    TCountingContext Ctx = {0, 0};
+    TCCUnicode_CtxMallocPtr Backing;
+    ccunicode_InitCtxMallocPtr(&Backing, &Ctx, &CountingMalloc, &CountingFree);
+
+    TCCUnicode_Arena Arena;
+    int Res = ccunicode_InitArena(&Arena, 256, &Backing.malloc_ptr);
+    if (Res != CCUNICODE_NO_ERROR)
+    {
+        fprintf(stderr, "Error %d in ccunicode_InitArena", Res);
+        return -1;
+    }
+
+    for (int i = 0; i < 100; ++i)
+    {
+        uint8_t *Ptr = Arena.allocator.ctx_malloc_func(Arena.allocator.ctx, 1 + i%37);
+        if (!Ptr || ((uintptr_t)Ptr & 15))
+        {
+            fprintf(stderr, "Bad arena allocation %p", (void*)Ptr);
+            ccunicode_DestroyArena(&Arena);
+            return -1;
+        }
+        memset(Ptr, i, 1 + i%37);
+    }
+
+    void *Aligned = Arena.allocator.ctx_aligned_alloc_func(Arena.allocator.ctx, 64, 10);
+    void *Big = Arena.allocator.ctx_malloc_func(Arena.allocator.ctx, 4096);
+    if (!Aligned || ((uintptr_t)Aligned & 63) || !Big)
+    {
+        fprintf(stderr, "Bad aligned or large arena allocation");
+        ccunicode_DestroyArena(&Arena);
+        return -1;
+    }
+
+    TCCUnicode_ArenaStats Stats;
+    ccunicode_GetArenaStats(&Arena, &Stats);
+    if (Stats.alloc_count != 102 || Stats.chunk_count < 2 || Stats.grow_count != Stats.chunk_count || Stats.chunk_count != (size_t)Ctx.malloc_count
+        || Stats.used_size < 4096 || Stats.peak_size != Stats.used_size || Stats.reserved_size < Stats.used_size)
+    {
+        fprintf(stderr, "Unexpected arena statistics");
+        ccunicode_DestroyArena(&Arena);
+        return -1;
+    }
+
+    ccunicode_DestroyArena(&Arena);
+    if (Ctx.malloc_count != Ctx.free_count)
+    {
+        fprintf(stderr, "Arena leaked chunks (%d mallocs, %d frees)", Ctx.malloc_count, Ctx.free_count);
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestResetAndRewind(void)
+{
+    TCCUnicode_Arena Arena;
+    ccunicode_InitArena(&Arena, 0, NULL);
+
+    void *First = Arena.allocator.ctx_malloc_func(Arena.allocator.ctx, 100);
+    TCCUnicode_ArenaMark Mark;
+    ccunicode_GetArenaMark(&Arena, &Mark);
+    void *Second = Arena.allocator.ctx_malloc_func(Arena.allocator.ctx, 100);
+    ccunicode_RewindArena(&Arena, &Mark);
+    void *Third = Arena.allocator.ctx_malloc_func(Arena.allocator.ctx, 100);
+    if (Second != Third)
+    {
+        fprintf(stderr, "Rewind did not reclaim memory");
+        ccunicode_DestroyArena(&Arena);
+        return -1;
+    }
+
+    // The latest allocation can be freed and grown in place
+    Arena.allocator.ctx_free_func(Arena.allocator.ctx, Third);
+    void *Fourth = Arena.allocator.ctx_malloc_func(Arena.allocator.ctx, 50);
+    void *Grown = Arena.allocator.ctx_realloc_func(Arena.allocator.ctx, Fourth, 50, 500);
+    if (Fourth != Third || Grown != Fourth)
+    {
+        fprintf(stderr, "Latest allocation was not freed or grown in place");
+        ccunicode_DestroyArena(&Arena);
+        return -1;
+    }
+
+    ccunicode_ResetArena(&Arena);
+    void *AfterReset = Arena.allocator.ctx_malloc_func(Arena.allocator.ctx, 100);
+    if (AfterReset != First)
+    {
+        fprintf(stderr, "Reset did not reclaim memory");
+        ccunicode_DestroyArena(&Arena);
+        return -1;
+    }
+
+    ccunicode_DestroyArena(&Arena);
+    return 0;
+}
+
+int TestConversionLoop(void)
+{
+    const char TrueUtf8Str[] = "\xF0\x9F\x98\x81 \xE2\x82\xAC Hello World !";
+    TCountingContext Ctx = {0, 0};
+    TCCUnicode_CtxMallocPtr Backing;
+    ccunicode_InitCtxMallocPtr(&Backing, &Ctx, &CountingMalloc, &CountingFree);
+
+    TCCUnicode_Arena Arena;
+    ccunicode_InitArena(&Arena, 4096, &Backing.malloc_ptr);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        uint16_t *WStr;
+        int Count = ccunicode_Utf8ToUtf16_a((const uint8_t*)TrueUtf8Str, &WStr, &Arena.allocator.malloc_ptr);
+        if (Count != 18 || WStr[0] != 0xD83D || WStr[Count] != 0)
+        {
+            fprintf(stderr, "Bad conversion through the arena (%d)", Count);
+            ccunicode_DestroyArena(&Arena);
+            return -1;
+        }
+        uint8_t *Str;
+        Count = ccunicode_Utf16ToUtf8_a(WStr, &Str, &Arena.allocator.malloc_ptr);
+        if (Count != (int)strlen(TrueUtf8Str) || memcmp(Str, TrueUtf8Str, Count+1))
+        {
+            fprintf(stderr, "Bad round trip through the arena (%d)", Count);
+            ccunicode_DestroyArena(&Arena);
+            return -1;
+        }
+        ccunicode_ResetArena(&Arena);
+    }
+
+    // Once warmed up, the loop does not touch the backing allocator any more
+    if (Ctx.malloc_count != 1)
+    {
+        fprintf(stderr, "Arena took %d chunks for a steady loop", Ctx.malloc_count);
+        ccunicode_DestroyArena(&Arena);
+        return -1;
+    }
+
+    ccunicode_DestroyArena(&Arena);
+    return 0;
+}
+
+int TestThreadArena(void)
+{
+    TCCUnicode_Arena *Arena = ccunicode_GetThreadArena();
+    if (!Arena)
+        return 0;
+    if (Arena != ccunicode_GetThreadArena())
+    {
+        fprintf(stderr, "Thread arena changed between calls");
+        return -1;
+    }
+
+    uint16_t *WStr;
+    int Count = ccunicode_Utf8ToUtf16_a((const uint8_t*)"Hello", &WStr, &Arena->allocator.malloc_ptr);
+    if (Count != 5)
+    {
+        fprintf(stderr, "Bad conversion through the thread arena (%d)", Count);
+        return -1;
+    }
+
+    return ccunicode_DestroyThreadArena();
+}
+
+int main(int argc, char **argv)
+{
+    int Res = 0;
+
+#define TEST(t) \
+    Res = t(); \
+    if (Res) \
+        return Res;
+
+    TEST(TestAlignmentAndGrowth)
+    TEST(TestResetAndRewind)
+    TEST(TestConversionLoop)
+    TEST(TestThreadArena)
+
+    return 0;
+}
@@ -0,0 +1,138 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_STRING_COUNT 200000
+#define TEST_MAX_STRING_SIZE 24
+
+// Bytes covering every class of the UTF8 decoder: ASCII, null, extensions, leads and forbidden bytes
+static const uint8_t InterestingBytes[] = {'a', 'Z', 0x00, 0x7F, 0x80, 0xA9, 0xBF, 0xC3, 0xDF, 0xE4, 0xEF, 0xF0, 0xF7, 0xF8, 0xFF};
+
+static uint32_t RandomState = 12345;
+
+static uint32_t Random(void)
+{
+    RandomState ^= RandomState << 13;
+    RandomState ^= RandomState >> 17;
+    RandomState ^= RandomState << 5;
+    return RandomState;
+}
+
+int TestMatchesSerialCount(void)
+{
+    TCCUnicode_Utf8Span *Spans = malloc(TEST_STRING_COUNT*sizeof(*Spans));
+    uint8_t *Buffer = malloc(TEST_STRING_COUNT*TEST_MAX_STRING_SIZE);
+    int *Results = malloc(TEST_STRING_COUNT*sizeof(*Results));
+    if (!Spans || !Buffer || !Results)
+    {
+        fprintf(stderr, "Could not allocate the test strings");
+        free(Spans);
+        free(Buffer);
+        free(Results);
+        return -1;
+    }
+
+    // Half of the strings are valid text, the others are random bytes
+    const char *Samples[] = {"key", "\xC3\xA9t\xC3\xA9", "\xE4\xB8\xAD\xE6\x96\x87", "\xF0\x9F\x98\x80!", "user_1234567890ab"};
+    for (int i = 0; i < TEST_STRING_COUNT; ++i)
+    {
+        uint8_t *Str = Buffer + i*TEST_MAX_STRING_SIZE;
+        int Size = 0;
+        if (i % 2)
+        {
+            const char *Sample = Samples[Random() % (sizeof(Samples)/sizeof(*Samples))];
+            Size = (int)strlen(Sample);
+            memcpy(Str, Sample, Size);
+            if (i % 7 == 0)
+                Size -= Random() % (Size+1);
+        }
+        else
+        {
+            Size = Random() % (TEST_MAX_STRING_SIZE+1);
+            for (int j = 0; j < Size; ++j)
+                Str[j] = InterestingBytes[Random() % sizeof(InterestingBytes)];
+        }
+
+        Spans[i].str = Str;
+        Spans[i].size = Size;
+    }
+    Spans[3].str = NULL;
+    Spans[5].size = -1;
+
+    int Res = ccunicode_CountCodepointsInUtf8Batch_n(Spans, TEST_STRING_COUNT, Results);
+    if (Res != CCUNICODE_NO_ERROR)
+    {
+        fprintf(stderr, "ccunicode_CountCodepointsInUtf8Batch_n returned %d", Res);
+        Res = -1;
+    }
+
+    for (int i = 0; i < TEST_STRING_COUNT && !Res; ++i)
+    {
+        int Expected = ccunicode_CountCodepointsInUtf8_n(Spans[i].str, Spans[i].size);
+        if (Results[i] != Expected)
+        {
+            fprintf(stderr, "String %d: counted %d instead of %d", i, Results[i], Expected);
+            Res = -1;
+        }
+    }
+
+    free(Spans);
+    free(Buffer);
+    free(Results);
+    return Res;
+}
+
+int TestInvalidBatch(void)
+{
+    int Results[1];
+    TCCUnicode_Utf8Span Span = {(const uint8_t*)"abc", 3};
+    if (ccunicode_CountCodepointsInUtf8Batch_n(NULL, 1, Results) != CCUNICODE_NULL_POINTER)
+    {
+        fprintf(stderr, "Expected error not encountered on NULL strings");
+        return -1;
+    }
+    if (ccunicode_CountCodepointsInUtf8Batch_n(&Span, -1, Results) != CCUNICODE_INVALID_PARAMETER)
+    {
+        fprintf(stderr, "Expected error not encountered on negative count");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int Res = 0;
+
+#define TEST(t) \
+    Res = t(); \
+    if (Res) \
+        return Res;
+
+    TEST(TestMatchesSerialCount)
+    TEST(TestInvalidBatch)
+
+    return 0;
+}
@@ -0,0 +1,348 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_STRING_COUNT 5000
+#define TEST_MAX_STRING_SIZE 48
+
+static const uint32_t PatternCodepoints[] = {'H', 'e', 'l', 'l', 'o', ' ', 0xC9, 0x800, 0x4E2D, 0xFFFD, 0x10000, 0x1F600, '\n'};
+
+static int AllocationCount = 0;
+
+static void *CountingMalloc(size_t Size)
+{
+    ++AllocationCount;
+    return malloc(Size);
+}
+
+// Runs the tasks backwards on the calling thread: results must not depend on the order
+static void RunTasksBackwards(void *PoolData, void (*TaskFunc)(void*, int), void *TaskData, int TaskCount)
+{
+    (void)PoolData;
+    for (int i = TaskCount-1; i >= 0; --i)
+        TaskFunc(TaskData, i);
+}
+
+// Builds short strings of various sizes, some of them invalid, all in one buffer
+static uint8_t *MakeUtf8Strs(TCCUnicode_Utf8Span *Spans)
+{
+    uint8_t *Buffer = malloc(TEST_STRING_COUNT*TEST_MAX_STRING_SIZE*4);
+    if (!Buffer)
+        return NULL;
+
+    uint8_t *Pos = Buffer;
+    for (int i = 0; i < TEST_STRING_COUNT; ++i)
+    {
+        uint32_t Codepoints[TEST_MAX_STRING_SIZE+1];
+        int Count = (i*7) % TEST_MAX_STRING_SIZE;
+        for (int j = 0; j < Count; ++j)
+            Codepoints[j] = PatternCodepoints[(i+j) % (sizeof(PatternCodepoints)/sizeof(*PatternCodepoints))];
+        Codepoints[Count] = 0;
+
+        int Size = ccunicode_CodepointsToUtf8_nm(Codepoints, Count, Pos, TEST_MAX_STRING_SIZE*4);
+        if (Size < 0)
+        {
+            free(Buffer);
+            return NULL;
+        }
+
+        if (Size && i % 17 == 0)
+            Pos[Size/2] = 0xFF;
+        else if (Size && i % 23 == 0)
+            Pos[Size-1] = 0;
+        else if (Size && i % 29 == 0)
+            --Size;
+
+        Spans[i].str = Pos;
+        Spans[i].size = Size;
+        Pos += Size;
+    }
+
+    return Buffer;
+}
+
+static int CheckUtf8ToUtf16Batch(const TCCUnicode_Utf8Span *Spans, const uint16_t *WStrs, const int64_t *Offsets, const int *Results)
+{
+    int64_t Offset = 0;
+    for (int i = 0; i < TEST_STRING_COUNT; ++i)
+    {
+        uint16_t *Expected = NULL;
+        int ExpectedCount = ccunicode_Utf8ToUtf16_n(Spans[i].str, Spans[i].size, &Expected);
+
+        int Res = 0;
+        if (Results[i] != ExpectedCount)
+        {
+            fprintf(stderr, "String %d: converted to %d characters instead of %d", i, Results[i], ExpectedCount);
+            Res = -1;
+        }
+        else if (Offsets[i] != Offset)
+        {
+            fprintf(stderr, "String %d: offset is %lld instead of %lld", i, (long long)Offsets[i], (long long)Offset);
+            Res = -1;
+        }
+        else if (ExpectedCount >= 0 && memcmp(Expected, WStrs + Offset, (ExpectedCount+1)*sizeof(*WStrs)))
+        {
+            fprintf(stderr, "String %d: mismatch between batch and single outputs", i);
+            Res = -1;
+        }
+
+        if (ExpectedCount >= 0)
+        {
+            Offset += ExpectedCount+1;
+            free(Expected);
+        }
+        if (Res)
+            return Res;
+    }
+
+    if (Offsets[TEST_STRING_COUNT] != Offset)
+    {
+        fprintf(stderr, "Total size is %lld instead of %lld", (long long)Offsets[TEST_STRING_COUNT], (long long)Offset);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int CheckUtf16ToUtf8Batch(const TCCUnicode_Utf16Span *Spans, const uint8_t *Strs, const int64_t *Offsets, const int *Results)
+{
+    int64_t Offset = 0;
+    for (int i = 0; i < TEST_STRING_COUNT; ++i)
+    {
+        uint8_t *Expected = NULL;
+        int ExpectedCount = ccunicode_Utf16ToUtf8_n(Spans[i].str, Spans[i].size, &Expected);
+
+        int Res = 0;
+        if (Results[i] != ExpectedCount)
+        {
+            fprintf(stderr, "String %d: converted to %d bytes instead of %d", i, Results[i], ExpectedCount);
+            Res = -1;
+        }
+        else if (Offsets[i] != Offset)
+        {
+            fprintf(stderr, "String %d: offset is %lld instead of %lld", i, (long long)Offsets[i], (long long)Offset);
+            Res = -1;
+        }
+        else if (ExpectedCount >= 0 && memcmp(Expected, Strs + Offset, ExpectedCount+1))
+        {
+            fprintf(stderr, "String %d: mismatch between batch and single outputs", i);
+            Res = -1;
+        }
+
+        if (ExpectedCount >= 0)
+        {
+            Offset += ExpectedCount+1;
+            free(Expected);
+        }
+        if (Res)
+            return Res;
+    }
+
+    if (Offsets[TEST_STRING_COUNT] != Offset)
+    {
+        fprintf(stderr, "Total size is %lld instead of %lld", (long long)Offsets[TEST_STRING_COUNT], (long long)Offset);
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestUtf8ToUtf16Batch(void)
+{
+    static TCCUnicode_Utf8Span Spans[TEST_STRING_COUNT];
+    static int64_t Offsets[TEST_STRING_COUNT+1];
+    static int Results[TEST_STRING_COUNT];
+
+    uint8_t *Buffer = MakeUtf8Strs(Spans);
+    if (!Buffer)
+    {
+        fprintf(stderr, "Could not build the test strings");
+        return -1;
+    }
+
+    TCCUnicode_MallocPtr Alloc = {&CountingMalloc, &free};
+    TCCUnicode_ThreadPool Pools[] = {{0, NULL, NULL}, {3, &RunTasksBackwards, NULL}, {4, NULL, NULL}};
+    int Res = 0;
+    for (int p = 0; p < (int)(sizeof(Pools)/sizeof(*Pools)) && !Res; ++p)
+    {
+        uint16_t *WStrs = NULL;
+        AllocationCount = 0;
+        int Status = ccunicode_Utf8ToUtf16Batch_nap(Spans, TEST_STRING_COUNT, &WStrs, Offsets, Results, &Alloc, &Pools[p]);
+        if (Status != CCUNICODE_NO_ERROR)
+        {
+            fprintf(stderr, "Pool %d: ccunicode_Utf8ToUtf16Batch_nap returned %d", p, Status);
+            return -1;
+        }
+
+        if (AllocationCount != 1)
+        {
+            fprintf(stderr, "Pool %d: %d allocations instead of 1", p, AllocationCount);
+            Res = -1;
+        }
+        else
+            Res = CheckUtf8ToUtf16Batch(Spans, WStrs, Offsets, Results);
+
+        free(WStrs);
+    }
+
+    free(Buffer);
+    return Res;
+}
+
+int TestUtf16ToUtf8Batch(void)
+{
+    static TCCUnicode_Utf8Span Utf8Spans[TEST_STRING_COUNT];
+    static TCCUnicode_Utf16Span Spans[TEST_STRING_COUNT];
+    static int64_t Offsets[TEST_STRING_COUNT+1];
+    static int Results[TEST_STRING_COUNT];
+
+    uint8_t *Buffer = MakeUtf8Strs(Utf8Spans);
+    uint16_t *WBuffer = malloc(TEST_STRING_COUNT*TEST_MAX_STRING_SIZE*2*sizeof(*WBuffer));
+    if (!Buffer || !WBuffer)
+    {
+        fprintf(stderr, "Could not build the test strings");
+        free(Buffer);
+        free(WBuffer);
+        return -1;
+    }
+
+    // Converts the valid strings and breaks some of them with lone surrogates
+    uint16_t *Pos = WBuffer;
+    for (int i = 0; i < TEST_STRING_COUNT; ++i)
+    {
+        int Size = ccunicode_Utf8ToUtf16_nm(Utf8Spans[i].str, Utf8Spans[i].size, Pos, TEST_MAX_STRING_SIZE*2);
+        if (Size < 0)
+            Size = 0;
+        if (Size && i % 19 == 0)
+            Pos[Size-1] = 0xD800;
+
+        Spans[i].str = Pos;
+        Spans[i].size = Size;
+        Pos += Size;
+    }
+
+    TCCUnicode_MallocPtr Alloc = {&CountingMalloc, &free};
+    TCCUnicode_ThreadPool Pools[] = {{0, NULL, NULL}, {3, &RunTasksBackwards, NULL}, {4, NULL, NULL}};
+    int Res = 0;
+    for (int p = 0; p < (int)(sizeof(Pools)/sizeof(*Pools)) && !Res; ++p)
+    {
+        uint8_t *Strs = NULL;
+        AllocationCount = 0;
+        int Status = ccunicode_Utf16ToUtf8Batch_nap(Spans, TEST_STRING_COUNT, &Strs, Offsets, Results, &Alloc, &Pools[p]);
+        if (Status != CCUNICODE_NO_ERROR)
+        {
+            fprintf(stderr, "Pool %d: ccunicode_Utf16ToUtf8Batch_nap returned %d", p, Status);
+            Res = -1;
+            break;
+        }
+
+        if (AllocationCount != 1)
+        {
+            fprintf(stderr, "Pool %d: %d allocations instead of 1", p, AllocationCount);
+            Res = -1;
+        }
+        else
+            Res = CheckUtf16ToUtf8Batch(Spans, Strs, Offsets, Results);
+
+        free(Strs);
+    }
+
+    free(WBuffer);
+    free(Buffer);
+    return Res;
+}
+
+int TestBatchBufferTooSmall(void)
+{
+    static TCCUnicode_Utf8Span Spans[TEST_STRING_COUNT];
+    static int64_t Offsets[TEST_STRING_COUNT+1];
+    static int Results[TEST_STRING_COUNT];
+
+    uint8_t *Buffer = MakeUtf8Strs(Spans);
+    if (!Buffer)
+    {
+        fprintf(stderr, "Could not build the test strings");
+        return -1;
+    }
+
+    TCCUnicode_ThreadPool ThreadedPool = {4, NULL, NULL};
+    int Res = 0;
+    int Status = ccunicode_Utf8ToUtf16Batch_nmp(Spans, TEST_STRING_COUNT, NULL, 0, Offsets, Results, &ThreadedPool);
+    int64_t Size = Offsets[TEST_STRING_COUNT];
+    if (Status != CCUNICODE_BUFFER_TOO_SMALL || Size <= 0)
+    {
+        fprintf(stderr, "Expected error not encountered on empty buffer. Returned %d", Status);
+        Res = -1;
+    }
+
+    uint16_t *WStrs = malloc(Size*sizeof(*WStrs));
+    if (!Res && !WStrs)
+    {
+        fprintf(stderr, "Could not allocate the output buffer");
+        Res = -1;
+    }
+
+    if (!Res)
+    {
+        Status = ccunicode_Utf8ToUtf16Batch_nmp(Spans, TEST_STRING_COUNT, WStrs, Size-1, Offsets, Results, &ThreadedPool);
+        if (Status != CCUNICODE_BUFFER_TOO_SMALL)
+        {
+            fprintf(stderr, "Expected error not encountered on small buffer. Returned %d", Status);
+            Res = -1;
+        }
+    }
+
+    if (!Res)
+    {
+        Status = ccunicode_Utf8ToUtf16Batch_nmp(Spans, TEST_STRING_COUNT, WStrs, Size, Offsets, Results, &ThreadedPool);
+        if (Status != CCUNICODE_NO_ERROR)
+        {
+            fprintf(stderr, "ccunicode_Utf8ToUtf16Batch_nmp returned %d on an exact buffer", Status);
+            Res = -1;
+        }
+        else
+            Res = CheckUtf8ToUtf16Batch(Spans, WStrs, Offsets, Results);
+    }
+
+    free(WStrs);
+    free(Buffer);
+    return Res;
+}
+
+int main(int argc, char **argv)
+{
+    int Res = 0;
+
+#define TEST(t) \
+    Res = t(); \
+    if (Res) \
+        return Res;
+
+    TEST(TestUtf8ToUtf16Batch)
+    TEST(TestUtf16ToUtf8Batch)
+    TEST(TestBatchBufferTooSmall)
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct
+{
+    int malloc_count;
+    int free_count;
+} TCountingContext;
+
+static void *CountingMalloc(void *Ctx, size_t Size)
+{
+    ((TCountingContext*)Ctx)->malloc_count++;
+    return malloc(Size);
+}
+
+static void CountingFree(void *Ctx, void *Ptr)
+{
+    ((TCountingContext*)Ctx)->free_count++;
+    free(Ptr);
+}
+
+// Mixes every UTF8 length and records the offsets of each codepoint in UTF8 and UTF16
+static int BuildMixedString(uint8_t *Utf8Str, int MaxSize, int *Utf8Offsets, int *Utf16Offsets)
+{
+    const char *Characters[] = {"a", "é", "€", "\U0001F600", "z", "日"};
+    int Size = 0;
+    int Utf16Size = 0;
+    int Count = 0;
+    for (int i = 0; ; ++i)
+    {
+        const char *Character = Characters[(i * 7 + i / 5) % 6];
+        int Length = (int)strlen(Character);
+        if (Size + Length >= MaxSize)
+            break;
+        Utf8Offsets[Count] = Size;
+        Utf16Offsets[Count] = Utf16Size;
+        ++Count;
+        memcpy(Utf8Str + Size, Character, Length);
+        Size += Length;
+        Utf16Size += (Length == 4) ? 2 : 1;
+    }
+    Utf8Offsets[Count] = Size;
+    Utf16Offsets[Count] = Utf16Size;
+    return Count;
+}
+
+int TestLookups(void)
+{
+    uint8_t Utf8Str[1000];
+    int Utf8Offsets[1001];
+    int Utf16Offsets[1001];
+    int Count = BuildMixedString(Utf8Str, sizeof(Utf8Str), Utf8Offsets, Utf16Offsets);
+    const int Strides[] = {1, 3, 16, 64, 5000};
+
+    for (int s = 0; s < (int)(sizeof(Strides)/sizeof(*Strides)); ++s)
+    {
+        TCCUnicode_CodepointIndex Index;
+        int Res = ccunicode_BuildCodepointIndex_n(&Index, Utf8Str, Utf8Offsets[Count], Strides[s], NULL);
+        if (Res != Count)
+        {
+            fprintf(stderr, "Index with stride %d counted %d codepoints instead of %d", Strides[s], Res, Count);
+            return -1;
+        }
+        if (Index.utf16_size != Utf16Offsets[Count] || Index.entry_count != Count/Strides[s] + 1)
+        {
+            fprintf(stderr, "Index with stride %d has wrong sizes", Strides[s]);
+            ccunicode_DestroyCodepointIndex(&Index);
+            return -1;
+        }
+
+        for (int i = 0; i <= Count; ++i)
+        {
+            if (ccunicode_GetIndexedUtf8Offset(&Index, Utf8Str, Utf8Offsets[Count], i) != Utf8Offsets[i]
+                || ccunicode_GetIndexedUtf16Offset(&Index, Utf8Str, Utf8Offsets[Count], i) != Utf16Offsets[i]
+                || ccunicode_GetIndexedCodepoint(&Index, Utf8Str, Utf8Offsets[Count], Utf8Offsets[i]) != i)
+            {
+                fprintf(stderr, "Lookup mismatch for codepoint %d with stride %d", i, Strides[s]);
+                ccunicode_DestroyCodepointIndex(&Index);
+                return -1;
+            }
+        }
+
+        if (ccunicode_GetIndexedUtf8Offset(&Index, Utf8Str, Utf8Offsets[Count], Count+1) != CCUNICODE_INVALID_PARAMETER
+            || ccunicode_GetIndexedCodepoint(&Index, Utf8Str, Utf8Offsets[Count], Utf8Offsets[1]+1) != CCUNICODE_STRING_ENDED_IN_CHARACTER)
+        {
+            fprintf(stderr, "Expected lookup error not encountered with stride %d", Strides[s]);
+            ccunicode_DestroyCodepointIndex(&Index);
+            return -1;
+        }
+
+        ccunicode_DestroyCodepointIndex(&Index);
+    }
+
+    const uint8_t BadUtf8Str[] = {'a', 'b', 0xE2, 0x82, 'c'};
+    TCCUnicode_CodepointIndex Index;
+    if (ccunicode_BuildCodepointIndex_n(&Index, BadUtf8Str, sizeof(BadUtf8Str), 2, NULL) != CCUNICODE_INVALID_UTF8_CHARACTER)
+    {
+        fprintf(stderr, "Expected error not encountered when indexing an invalid string");
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestSerialization(void)
+{
+    uint8_t Utf8Str[500];
+    int Utf8Offsets[501];
+    int Utf16Offsets[501];
+    int Count = BuildMixedString(Utf8Str, sizeof(Utf8Str), Utf8Offsets, Utf16Offsets);
+
+    TCountingContext Counts = {0, 0};
+    TCCUnicode_CtxMallocPtr Alloc;
+    ccunicode_InitCtxMallocPtr(&Alloc, &Counts, &CountingMalloc, &CountingFree);
+
+    TCCUnicode_CodepointIndex Index;
+    if (ccunicode_BuildCodepointIndex_n(&Index, Utf8Str, Utf8Offsets[Count], 7, &Alloc.malloc_ptr) != Count)
+    {
+        fprintf(stderr, "Failed to build the index to serialize");
+        return -1;
+    }
+
+    int Size = ccunicode_GetCodepointIndexSerializedSize(&Index);
+    uint8_t *Buffer = (uint8_t*)malloc(Size);
+    int Written = ccunicode_SerializeCodepointIndex(&Index, Buffer, Size);
+    if (Written != Size || ccunicode_SerializeCodepointIndex(&Index, Buffer, Size-1) != CCUNICODE_BUFFER_TOO_SMALL)
+    {
+        fprintf(stderr, "Serialization wrote %d bytes instead of %d", Written, Size);
+        free(Buffer);
+        ccunicode_DestroyCodepointIndex(&Index);
+        return -1;
+    }
+
+    TCCUnicode_CodepointIndex Copy;
+    int Read = ccunicode_DeserializeCodepointIndex(&Copy, Buffer, Size, &Alloc.malloc_ptr);
+    if (Read != Size || Copy.entry_count != Index.entry_count || Copy.codepoint_count != Index.codepoint_count
+        || memcmp(Copy.entries, Index.entries, Index.entry_count*sizeof(*Index.entries)))
+    {
+        fprintf(stderr, "Deserialized index differs from the original one");
+        free(Buffer);
+        ccunicode_DestroyCodepointIndex(&Index);
+        if (Read >= 0)
+            ccunicode_DestroyCodepointIndex(&Copy);
+        return -1;
+    }
+    // The lookups do not read past a string shorter than the one the index was built from
+    if (ccunicode_GetIndexedUtf8Offset(&Copy, Utf8Str, Utf8Offsets[Count]-1, 0) != CCUNICODE_INVALID_PARAMETER
+        || ccunicode_GetIndexedUtf16Offset(&Copy, Utf8Str, 10, 0) != CCUNICODE_INVALID_PARAMETER
+        || ccunicode_GetIndexedCodepoint(&Copy, Utf8Str, 10, 0) != CCUNICODE_INVALID_PARAMETER)
+    {
+        fprintf(stderr, "Deserialized index used with a shorter string");
+        free(Buffer);
+        ccunicode_DestroyCodepointIndex(&Index);
+        ccunicode_DestroyCodepointIndex(&Copy);
+        return -1;
+    }
+    ccunicode_DestroyCodepointIndex(&Copy);
+
+    // A truncated buffer and entries going backward are rejected
+    int Corrupted = ccunicode_DeserializeCodepointIndex(&Copy, Buffer, Size-1, &Alloc.malloc_ptr);
+    Buffer[4*7 + 8*2] = 0;
+    int Backward = ccunicode_DeserializeCodepointIndex(&Copy, Buffer, Size, &Alloc.malloc_ptr);
+    free(Buffer);
+    ccunicode_DestroyCodepointIndex(&Index);
+    if (Corrupted != CCUNICODE_INVALID_PARAMETER || Backward != CCUNICODE_INVALID_PARAMETER)
+    {
+        fprintf(stderr, "Corrupted serialized index not rejected (%d, %d)", Corrupted, Backward);
+        return -1;
+    }
+
+    if (Counts.malloc_count != Counts.free_count)
+    {
+        fprintf(stderr, "Index leaked entries (%d mallocs, %d frees)", Counts.malloc_count, Counts.free_count);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int Res = 0;
+
+#define TEST(t) \
+    Res = t(); \
+    if (Res) \
+        return Res;
+
+    TEST(TestLookups)
+    TEST(TestSerialization)
+
+    return 0;
+}
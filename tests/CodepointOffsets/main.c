@@ -0,0 +1,174 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Builds a long string mixing every UTF8 length so that characters straddle the 8 byte words
+static int BuildMixedString(uint8_t *Utf8Str, int MaxSize, int *Offsets)
+{
+    const char *Characters[] = {"a", "é", "€", "\U0001F600", "z", "日"};
+    int Size = 0;
+    int Count = 0;
+    for (int i = 0; ; ++i)
+    {
+        const char *Character = Characters[(i * 7 + i / 5) % 6];
+        int Length = (int)strlen(Character);
+        if (Size + Length >= MaxSize)
+            break;
+        Offsets[Count++] = Size;
+        memcpy(Utf8Str + Size, Character, Length);
+        Size += Length;
+    }
+    Offsets[Count] = Size;
+    return Count;
+}
+
+int TestAdvanceUtf8(void)
+{
+    uint8_t Utf8Str[300];
+    int Offsets[301];
+    int Count = BuildMixedString(Utf8Str, sizeof(Utf8Str), Offsets);
+    int Size = Offsets[Count];
+
+    for (int i = 0; i <= Count; ++i)
+    {
+        int Offset = ccunicode_GetUtf8OffsetOfCodepoint_n(Utf8Str, Size, i);
+        if (Offset != Offsets[i])
+        {
+            fprintf(stderr, "Codepoint %d expected at byte %d, got %d", i, Offsets[i], Offset);
+            return -1;
+        }
+        int Index = ccunicode_GetCodepointIndexOfUtf8Offset_n(Utf8Str, Size, Offsets[i]);
+        if (Index != i)
+        {
+            fprintf(stderr, "Byte %d expected to be codepoint %d, got %d", Offsets[i], i, Index);
+            return -1;
+        }
+        for (int j = i; j <= Count; j += 3)
+        {
+            int Pos = ccunicode_AdvanceUtf8_n(Utf8Str, Size, Offsets[i], j - i);
+            if (Pos != Offsets[j])
+            {
+                fprintf(stderr, "Skipping %d codepoints from byte %d gave %d instead of %d", j - i, Offsets[i], Pos, Offsets[j]);
+                return -1;
+            }
+        }
+    }
+
+    if (ccunicode_AdvanceUtf8_n(Utf8Str, Size, 0, Count+1) != CCUNICODE_INVALID_PARAMETER)
+    {
+        fprintf(stderr, "Skipping past the end of the string was not reported");
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestAdvanceUtf16(void)
+{
+    uint16_t Utf16Str[64];
+    int Offsets[65];
+    int Count = 0;
+    int Size = 0;
+    for (int i = 0; Size < 60; ++i)
+    {
+        Offsets[Count++] = Size;
+        if (i % 7 == 3)
+        {
+            Utf16Str[Size++] = 0xD83D;
+            Utf16Str[Size++] = 0xDE00;
+        }
+        else
+        {
+            Utf16Str[Size++] = (uint16_t)(0x41 + i);
+        }
+    }
+    Offsets[Count] = Size;
+
+    for (int i = 0; i <= Count; ++i)
+    {
+        if (ccunicode_GetUtf16OffsetOfCodepoint_n(Utf16Str, Size, i) != Offsets[i]
+            || ccunicode_GetCodepointIndexOfUtf16Offset_n(Utf16Str, Size, Offsets[i]) != i)
+        {
+            fprintf(stderr, "Offset mismatch for UTF16 codepoint %d", i);
+            return -1;
+        }
+        for (int j = i; j <= Count; ++j)
+        {
+            if (ccunicode_AdvanceUtf16_n(Utf16Str, Size, Offsets[i], j - i) != Offsets[j])
+            {
+                fprintf(stderr, "Skipping %d codepoints from short %d failed", j - i, Offsets[i]);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int TestBadOffsets(void)
+{
+    const uint8_t Utf8Str[] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 0xE2, 0x82, 0xAC, 'h', 0, 'i'};
+    const uint8_t BadUtf8Str[] = {'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 0x82, 'j'};
+    const uint16_t Utf16Str[] = {'a', 0xD83D, 0xDE00, 'b'};
+    const uint16_t BadUtf16Str[] = {'a', 'b', 'c', 'd', 0xDE00, 'e'};
+
+    if (ccunicode_GetCodepointIndexOfUtf8Offset_n(Utf8Str, sizeof(Utf8Str), 8) != CCUNICODE_STRING_ENDED_IN_CHARACTER
+        || ccunicode_GetCodepointIndexOfUtf8Offset_n(Utf8Str, sizeof(Utf8Str), 11) != 9
+        || ccunicode_GetCodepointIndexOfUtf8Offset_n(Utf8Str, sizeof(Utf8Str), 12) != CCUNICODE_INVALID_PARAMETER
+        || ccunicode_AdvanceUtf8_n(Utf8Str, sizeof(Utf8Str), 0, 10) != CCUNICODE_INVALID_PARAMETER
+        || ccunicode_AdvanceUtf8_n(BadUtf8Str, sizeof(BadUtf8Str), 0, 9) != 9
+        || ccunicode_AdvanceUtf8_n(BadUtf8Str, sizeof(BadUtf8Str), 0, 10) != CCUNICODE_INVALID_UTF8_CHARACTER)
+    {
+        fprintf(stderr, "Expected UTF8 error not encountered");
+        return -1;
+    }
+
+    if (ccunicode_GetCodepointIndexOfUtf16Offset_n(Utf16Str, 4, 2) != CCUNICODE_STRING_ENDED_IN_CHARACTER
+        || ccunicode_AdvanceUtf16_n(BadUtf16Str, 6, 0, 4) != 4
+        || ccunicode_AdvanceUtf16_n(BadUtf16Str, 6, 0, 5) != CCUNICODE_SURROGATE_PAIR_INVERSION)
+    {
+        fprintf(stderr, "Expected UTF16 error not encountered");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int Res = 0;
+
+#define TEST(t) \
+    Res = t(); \
+    if (Res) \
+        return Res;
+
+    TEST(TestAdvanceUtf8)
+    TEST(TestAdvanceUtf16)
+    TEST(TestBadOffsets)
+
+    return 0;
+}
@@ -162,6 +162,30 @@ int TestBadCodepoint3(void)
 
     return 0;
 }
+int TestInPlace(void)
+{
+    const uint16_t ExpectedWStr[] = {'H', 'e', 'l', 'l', 'o', ' ', 0xD83D, 0xDE01, 0xD83D, 0xDE01, ' ', 'W', 'o', 'r', 'l', 'd', ' ', 0xC9, 0x800, ' ', '!', 0};
+    uint32_t Codepoints[] = {'H', 'e', 'l', 'l', 'o', ' ', 0x1F601, 0x1F601, ' ', 'W', 'o', 'r', 'l', 'd', ' ', 0xC9, 0x800, ' ', '!', 0};
+
+    uint16_t *WStr;
+    int Count = ccunicode_CodepointsToUtf16InPlace(Codepoints, &WStr);
+    if (Count+1 != sizeof(ExpectedWStr)/sizeof(*ExpectedWStr) || (void*)WStr != (void*)Codepoints || memcmp(ExpectedWStr, WStr, (Count+1)*sizeof(*WStr)))
+    {
+        fprintf(stderr, "Mismatch for in-place conversion (%d)", Count);
+        return -1;
+    }
+
+    uint32_t BadCodepoints[] = {'a', 'b', 'c', 'd', 0x110000, 0};
+    Count = ccunicode_CodepointsToUtf16InPlace_n(BadCodepoints, 5, &WStr);
+    if (Count != CCUNICODE_INVALID_CODEPOINT)
+    {
+        fprintf(stderr, "Invalid codepoint not detected in place (%d)", Count);
+        return -1;
+    }
+
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     int Res = 0;
@@ -177,6 +201,7 @@ int main(int argc, char **argv)
     TEST(TestBadCodepoint1)
     TEST(TestBadCodepoint2)
     TEST(TestBadCodepoint3)
+    TEST(TestInPlace)
 
     return 0;
 }
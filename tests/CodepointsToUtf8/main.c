@@ -112,6 +112,35 @@ int TestTrueUtf8String(void)
     return 0;
 }
 
+int TestCjkString(void)
+{
+    const char CjkStr[] = "\u4E2D\u6587\uFFFD";
+    const uint32_t CjkCodepoints[] = {0x4E2D, 0x6587, 0xFFFD, 0};
+
+    uint8_t *Str;
+    int Count = ccunicode_CodepointsToUtf8(CjkCodepoints, &Str);
+    if (Count < 0)
+    {
+        fprintf(stderr, "Error %d in ccunicode_CodepointsToUtf8", Count);
+        return -1;
+    }
+    if (Count+1 != sizeof(CjkStr)/sizeof(*CjkStr))
+    {
+        fprintf(stderr, "Mismatch between expected output size (%d) and effective output size (%d).", (int)(sizeof(CjkStr)/sizeof(*CjkStr)), Count+1);
+        free(Str);
+        return -1;
+    }
+    if (memcmp(CjkStr, Str, (Count+1)*sizeof(*Str)))
+    {
+        fprintf(stderr, "Mismatch for Cjk string");
+        free(Str);
+        return -1;
+    }
+
+    free(Str);
+    return 0;
+}
+
 int TestBadCodepoint1(void)
 {
     const uint32_t BadCodepoint1[] = {0xD800, 0};
@@ -163,6 +192,30 @@ int TestBadCodepoint3(void)
     return 0;
 }
 
+int TestInPlace(void)
+{
+    const char ExpectedStr[] = "Hello \U0001F601 World \u00C9\u0800 !";
+    uint32_t Codepoints[] = {'H', 'e', 'l', 'l', 'o', ' ', 0x1F601, ' ', 'W', 'o', 'r', 'l', 'd', ' ', 0xC9, 0x800, ' ', '!', 0};
+
+    uint8_t *Str;
+    int Count = ccunicode_CodepointsToUtf8InPlace(Codepoints, &Str);
+    if (Count != (int)strlen(ExpectedStr) || (void*)Str != (void*)Codepoints || memcmp(ExpectedStr, Str, Count+1))
+    {
+        fprintf(stderr, "Mismatch for in-place conversion (%d)", Count);
+        return -1;
+    }
+
+    uint32_t BadCodepoints[] = {'a', 'b', 'c', 'd', 0xD800, 0};
+    Count = ccunicode_CodepointsToUtf8InPlace_n(BadCodepoints, 5, &Str);
+    if (Count != CCUNICODE_INVALID_CODEPOINT)
+    {
+        fprintf(stderr, "Invalid codepoint not detected in place (%d)", Count);
+        return -1;
+    }
+
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     int Res = 0;
@@ -175,9 +228,11 @@ int main(int argc, char **argv)
     TEST(TestEmptyString)
     TEST(TestHelloWorldString)
     TEST(TestTrueUtf8String)
+    TEST(TestCjkString)
     TEST(TestBadCodepoint1)
     TEST(TestBadCodepoint2)
     TEST(TestBadCodepoint3)
+    TEST(TestInPlace)
 
     return 0;
 }
@@ -0,0 +1,262 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_ROW_COUNT 3000
+#define TEST_MAX_ROW_SIZE 40
+
+// The column does not start at the beginning of the data buffer, as in a sliced Arrow array
+#define TEST_FIRST_OFFSET 5
+
+static const uint32_t PatternCodepoints[] = {'H', 'e', 'l', 'l', 'o', ' ', 'w', 'o', 'r', 'l', 'd', 0xC9, 0x800, 0x4E2D, 0x10000, 0x1F600, '\n'};
+
+static uint8_t Utf8Data[TEST_FIRST_OFFSET + TEST_ROW_COUNT*TEST_MAX_ROW_SIZE*4];
+static int32_t Utf8Offsets[TEST_ROW_COUNT+1];
+static int64_t Utf8Offsets64[TEST_ROW_COUNT+1];
+
+// Rows of various sizes, mostly ASCII, with some empty ones
+static int MakeColumn(void)
+{
+    memset(Utf8Data, 'x', TEST_FIRST_OFFSET);
+    int32_t Pos = TEST_FIRST_OFFSET;
+    for (int i = 0; i < TEST_ROW_COUNT; ++i)
+    {
+        uint32_t Codepoints[TEST_MAX_ROW_SIZE+1];
+        int Count = (i % 7 == 0) ? 0 : (i*13) % TEST_MAX_ROW_SIZE;
+        for (int j = 0; j < Count; ++j)
+        {
+            int Index = (i % 3) ? (i+j) % 11 : (i+j) % (int)(sizeof(PatternCodepoints)/sizeof(*PatternCodepoints));
+            Codepoints[j] = PatternCodepoints[Index];
+        }
+        Codepoints[Count] = 0;
+
+        Utf8Offsets[i] = Pos;
+        int Size = ccunicode_CodepointsToUtf8_nm(Codepoints, Count, Utf8Data + Pos, TEST_MAX_ROW_SIZE*4);
+        if (Size < 0)
+            return Size;
+        Pos += Size;
+    }
+    Utf8Offsets[TEST_ROW_COUNT] = Pos;
+
+    for (int i = 0; i <= TEST_ROW_COUNT; ++i)
+        Utf8Offsets64[i] = Utf8Offsets[i];
+    return 0;
+}
+
+static int CheckUtf16Rows(const uint16_t *Utf16Data, const int64_t *Utf16Offsets)
+{
+    for (int i = 0; i < TEST_ROW_COUNT; ++i)
+    {
+        uint16_t Expected[TEST_MAX_ROW_SIZE*2+1];
+        int Count = ccunicode_Utf8ToUtf16_nm(Utf8Data + Utf8Offsets[i], Utf8Offsets[i+1]-Utf8Offsets[i], Expected, TEST_MAX_ROW_SIZE*2);
+        if (Count < 0 || Utf16Offsets[i+1] - Utf16Offsets[i] != Count || memcmp(Expected, Utf16Data + Utf16Offsets[i], Count*sizeof(*Expected)))
+        {
+            fprintf(stderr, "Row %d: mismatch between column and single conversions", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int TestUtf8ToUtf16Column(void)
+{
+    int64_t Utf16Size = 0;
+    int64_t ErrorRow = 0;
+    int Res = ccunicode_GetUtf16SizeFromUtf8Column(Utf8Data, Utf8Offsets, TEST_ROW_COUNT, &Utf16Size, &ErrorRow);
+    if (Res != CCUNICODE_NO_ERROR || ErrorRow != -1)
+    {
+        fprintf(stderr, "ccunicode_GetUtf16SizeFromUtf8Column returned %d", Res);
+        return -1;
+    }
+
+    static int32_t Utf16Offsets[TEST_ROW_COUNT+1];
+    static int64_t Utf16Offsets64[TEST_ROW_COUNT+1];
+    uint16_t *Utf16Data = malloc(Utf16Size*sizeof(*Utf16Data));
+    if (!Utf16Data)
+    {
+        fprintf(stderr, "Could not allocate the output buffer");
+        return -1;
+    }
+
+    Res = ccunicode_Utf8ToUtf16Column_m(Utf8Data, Utf8Offsets, TEST_ROW_COUNT, Utf16Data, Utf16Size, Utf16Offsets, &ErrorRow);
+    if (Res != CCUNICODE_NO_ERROR || Utf16Offsets[TEST_ROW_COUNT] != Utf16Size)
+    {
+        fprintf(stderr, "ccunicode_Utf8ToUtf16Column_m returned %d", Res);
+        free(Utf16Data);
+        return -1;
+    }
+
+    for (int i = 0; i <= TEST_ROW_COUNT; ++i)
+        Utf16Offsets64[i] = Utf16Offsets[i];
+    Res = CheckUtf16Rows(Utf16Data, Utf16Offsets64);
+
+    if (!Res && ccunicode_Utf8ToUtf16Column_m(Utf8Data, Utf8Offsets, TEST_ROW_COUNT, Utf16Data, Utf16Size-1, Utf16Offsets, &ErrorRow) != CCUNICODE_BUFFER_TOO_SMALL)
+    {
+        fprintf(stderr, "Expected error not encountered on small buffer");
+        Res = -1;
+    }
+    free(Utf16Data);
+
+    // Same conversion with 64 bits offsets and an allocated output
+    Utf16Data = NULL;
+    if (!Res)
+    {
+        Res = ccunicode_Utf8ToUtf16Column64(Utf8Data, Utf8Offsets64, TEST_ROW_COUNT, &Utf16Data, Utf16Offsets64, &ErrorRow);
+        if (Res != CCUNICODE_NO_ERROR || Utf16Offsets64[TEST_ROW_COUNT] != Utf16Size)
+        {
+            fprintf(stderr, "ccunicode_Utf8ToUtf16Column64 returned %d", Res);
+            return -1;
+        }
+
+        Res = CheckUtf16Rows(Utf16Data, Utf16Offsets64);
+        free(Utf16Data);
+    }
+
+    return Res;
+}
+
+int TestUtf16ToUtf8Column(void)
+{
+    static int64_t Utf16Offsets[TEST_ROW_COUNT+1];
+    static int64_t BackOffsets[TEST_ROW_COUNT+1];
+    uint16_t *Utf16Data = NULL;
+    uint8_t *BackData = NULL;
+    int64_t ErrorRow = 0;
+
+    int Res = ccunicode_Utf8ToUtf16Column64(Utf8Data, Utf8Offsets64, TEST_ROW_COUNT, &Utf16Data, Utf16Offsets, &ErrorRow);
+    if (Res != CCUNICODE_NO_ERROR)
+    {
+        fprintf(stderr, "ccunicode_Utf8ToUtf16Column64 returned %d", Res);
+        return -1;
+    }
+
+    int64_t Utf8Size = 0;
+    Res = ccunicode_ValidateUtf16Column64(Utf16Data, Utf16Offsets, TEST_ROW_COUNT, &ErrorRow);
+    if (!Res)
+        Res = ccunicode_GetUtf8SizeFromUtf16Column64(Utf16Data, Utf16Offsets, TEST_ROW_COUNT, &Utf8Size, &ErrorRow);
+    if (!Res)
+        Res = ccunicode_Utf16ToUtf8Column64(Utf16Data, Utf16Offsets, TEST_ROW_COUNT, &BackData, BackOffsets, &ErrorRow);
+    if (Res != CCUNICODE_NO_ERROR)
+    {
+        fprintf(stderr, "UTF16 column conversion returned %d", Res);
+        free(Utf16Data);
+        return -1;
+    }
+
+    // The round trip gives back the original column, shifted to start at 0
+    int64_t ExpectedSize = Utf8Offsets64[TEST_ROW_COUNT] - TEST_FIRST_OFFSET;
+    if (Utf8Size != ExpectedSize || BackOffsets[TEST_ROW_COUNT] != ExpectedSize || memcmp(BackData, Utf8Data + TEST_FIRST_OFFSET, ExpectedSize))
+    {
+        fprintf(stderr, "Round trip through UTF16 does not give back the original data");
+        Res = -1;
+    }
+    for (int i = 0; i <= TEST_ROW_COUNT && !Res; ++i)
+    {
+        if (BackOffsets[i] != Utf8Offsets64[i] - TEST_FIRST_OFFSET)
+        {
+            fprintf(stderr, "Round trip through UTF16 gives a wrong offset for row %d", i);
+            Res = -1;
+        }
+    }
+
+    free(BackData);
+    free(Utf16Data);
+    return Res;
+}
+
+int TestInvalidRows(void)
+{
+    // "ab" | "\xC3" | "\xA9cd" : the character crosses a row boundary
+    const uint8_t CrossingData[] = {'a', 'b', 0xC3, 0xA9, 'c', 'd'};
+    const int32_t CrossingOffsets[] = {0, 2, 3, 6};
+    int64_t ErrorRow = -1;
+    int Res = ccunicode_ValidateUtf8Column(CrossingData, CrossingOffsets, 3, &ErrorRow);
+    if (Res != CCUNICODE_STRING_ENDED_IN_CHARACTER || ErrorRow != 1)
+    {
+        fprintf(stderr, "Character crossing rows: returned %d for row %lld", Res, (long long)ErrorRow);
+        return -1;
+    }
+
+    // An invalid byte after a long ASCII run spanning several rows
+    const uint8_t InvalidData[] = "0123456789abcdefghij\xFFklmnop";
+    const int32_t InvalidOffsets[] = {0, 3, 10, 18, 22, 27};
+    Res = ccunicode_ValidateUtf8Column(InvalidData, InvalidOffsets, 5, &ErrorRow);
+    if (Res != CCUNICODE_INVALID_UTF8_CHARACTER || ErrorRow != 3)
+    {
+        fprintf(stderr, "Invalid byte: returned %d for row %lld", Res, (long long)ErrorRow);
+        return -1;
+    }
+
+    // Null characters are regular characters inside rows
+    const uint8_t NullData[] = {'a', 0, 'b', 0, 0, 'c', 'd', 'e', 'f', 'g', 'h', 'i'};
+    const int64_t NullOffsets[] = {0, 2, 4, 12};
+    uint16_t Utf16Data[12];
+    int64_t Utf16Offsets[4];
+    Res = ccunicode_Utf8ToUtf16Column64_m(NullData, NullOffsets, 3, Utf16Data, 12, Utf16Offsets, &ErrorRow);
+    if (Res != CCUNICODE_NO_ERROR || Utf16Offsets[1] != 2 || Utf16Offsets[3] != 12 || Utf16Data[1] != 0 || Utf16Data[11] != 'i')
+    {
+        fprintf(stderr, "Null characters in rows: returned %d", Res);
+        return -1;
+    }
+
+    // Lone high surrogate at the end of a row
+    const uint16_t SurrogateData[] = {'a', 0xD83D, 0xDE00, 'b', 0xD83D, 0xDE00};
+    const int32_t SurrogateOffsets[] = {0, 3, 5, 6};
+    Res = ccunicode_ValidateUtf16Column(SurrogateData, SurrogateOffsets, 3, &ErrorRow);
+    if (Res != CCUNICODE_STRING_ENDED_IN_CHARACTER || ErrorRow != 1)
+    {
+        fprintf(stderr, "Surrogate pair crossing rows: returned %d for row %lld", Res, (long long)ErrorRow);
+        return -1;
+    }
+
+    // Decreasing offsets
+    const int32_t BadOffsets[] = {0, 4, 2, 6};
+    Res = ccunicode_ValidateUtf8Column(CrossingData, BadOffsets, 3, &ErrorRow);
+    if (Res != CCUNICODE_INVALID_PARAMETER)
+    {
+        fprintf(stderr, "Decreasing offsets: returned %d", Res);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int Res = 0;
+
+#define TEST(t) \
+    Res = t(); \
+    if (Res) \
+        return Res;
+
+    TEST(MakeColumn)
+    TEST(TestUtf8ToUtf16Column)
+    TEST(TestUtf16ToUtf8Column)
+    TEST(TestInvalidRows)
+
+    return 0;
+}
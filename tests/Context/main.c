@@ -0,0 +1,312 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct
+{
+    int malloc_count;
+    int free_count;
+} TCountingContext;
+
+static void *CountingMalloc(void *Ctx, size_t Size)
+{
+    ((TCountingContext*)Ctx)->malloc_count++;
+    return malloc(Size);
+}
+
+static void CountingFree(void *Ctx, void *Ptr)
+{
+    ((TCountingContext*)Ctx)->free_count++;
+    free(Ptr);
+}
+
+int TestSameResults(void)
+{
+    const char *Strs[] = {"", "Hello World !", "\xC3\x89\xE0\xA0\x80\xF0\x90\x80\x80", "\xF0\x9F\x98\x81 \xE2\x82\xAC", "\xC3", "\x80", "a\xED\xA0\x80"};
+
+    TCCUnicode_Context Context;
+    int Res = ccunicode_InitContext(&Context, CCUNICODE_ERROR_POLICY_STOP, NULL);
+    if (Res != CCUNICODE_NO_ERROR)
+    {
+        fprintf(stderr, "Error %d in ccunicode_InitContext", Res);
+        return -1;
+    }
+
+    for (size_t i = 0; i < sizeof(Strs)/sizeof(*Strs); ++i)
+    {
+        const uint8_t *Str = (const uint8_t*)Strs[i];
+
+        uint16_t *Expected = NULL;
+        uint16_t *WStr = NULL;
+        int ExpectedCount = ccunicode_Utf8ToUtf16(Str, &Expected);
+        int Count = ccunicode_Utf8ToUtf16_c(&Context, Str, &WStr);
+        if (Count != ExpectedCount || (Count >= 0 && memcmp(Expected, WStr, (Count+1)*sizeof(*WStr))))
+        {
+            fprintf(stderr, "Context conversion of string %d differs (%d instead of %d)", (int)i, Count, ExpectedCount);
+            free(Expected);
+            ccunicode_DestroyContext(&Context);
+            return -1;
+        }
+
+        if (Count >= 0)
+        {
+            uint8_t *Back = NULL;
+            Count = ccunicode_Utf16ToUtf8_nc(&Context, Expected, ExpectedCount, &Back);
+            if (Count != (int)strlen(Strs[i]) || memcmp(Back, Str, Count+1))
+            {
+                fprintf(stderr, "Context round trip of string %d differs", (int)i);
+                free(Expected);
+                ccunicode_DestroyContext(&Context);
+                return -1;
+            }
+        }
+        free(Expected);
+
+        uint32_t *Codepoints = NULL;
+        uint32_t *ExpectedCodepoints = NULL;
+        ExpectedCount = ccunicode_Utf8ToCodepoints(Str, &ExpectedCodepoints);
+        Count = ccunicode_Utf8ToCodepoints_c(&Context, Str, &Codepoints);
+        if (Count != ExpectedCount || (Count >= 0 && memcmp(ExpectedCodepoints, Codepoints, (Count+1)*sizeof(*Codepoints))))
+        {
+            fprintf(stderr, "Context decoding of string %d differs (%d instead of %d)", (int)i, Count, ExpectedCount);
+            free(ExpectedCodepoints);
+            ccunicode_DestroyContext(&Context);
+            return -1;
+        }
+        free(ExpectedCodepoints);
+    }
+
+    ccunicode_DestroyContext(&Context);
+    return 0;
+}
+
+int TestReplacePolicy(void)
+{
+    const char Utf8Str[] = "a\xC3" "b\x80\xE2\x82" "c\xF0\x9F\x98\x81\xED\xA0\x80\xE2\x82";
+    const uint16_t ExpectedWStr[] = {'a', 0xFFFD, 'b', 0xFFFD, 0xFFFD, 'c', 0xD83D, 0xDE01, 0xFFFD, 0xFFFD, 0};
+    const uint16_t Utf16Str[] = {'x', 0xDC00, 0xD800, 'y', 0xD83D, 0xDE01, 0xD800, 0};
+    const char ExpectedStr[] = "x\xEF\xBF\xBD\xEF\xBF\xBDy\xF0\x9F\x98\x81\xEF\xBF\xBD";
+
+    TCCUnicode_Context Context;
+    ccunicode_InitContext(&Context, CCUNICODE_ERROR_POLICY_REPLACE, NULL);
+
+    uint16_t *WStr = NULL;
+    int Count = ccunicode_Utf8ToUtf16_c(&Context, (const uint8_t*)Utf8Str, &WStr);
+    if (Count+1 != sizeof(ExpectedWStr)/sizeof(*ExpectedWStr) || memcmp(ExpectedWStr, WStr, (Count+1)*sizeof(*WStr)) || Context.replacement_count != 5)
+    {
+        fprintf(stderr, "Bad replacement of invalid UTF8 (%d shorts, %d replacements)", Count, Context.replacement_count);
+        ccunicode_DestroyContext(&Context);
+        return -1;
+    }
+
+    uint8_t *Str = NULL;
+    Count = ccunicode_Utf16ToUtf8_c(&Context, Utf16Str, &Str);
+    if (Count != (int)strlen(ExpectedStr) || memcmp(ExpectedStr, Str, Count+1) || Context.replacement_count != 3)
+    {
+        fprintf(stderr, "Bad replacement of invalid UTF16 (%d bytes, %d replacements)", Count, Context.replacement_count);
+        ccunicode_DestroyContext(&Context);
+        return -1;
+    }
+
+    const uint32_t Codepoints[] = {'z', 0x110000, 0xD800, 0x20AC, 0};
+    Count = ccunicode_CodepointsToUtf16_c(&Context, Codepoints, &WStr);
+    if (Count != 4 || WStr[0] != 'z' || WStr[1] != 0xFFFD || WStr[2] != 0xFFFD || WStr[3] != 0x20AC || WStr[4] != 0)
+    {
+        fprintf(stderr, "Bad replacement of invalid codepoints (%d shorts)", Count);
+        ccunicode_DestroyContext(&Context);
+        return -1;
+    }
+
+    // A replacement outside the BMP takes more room than any invalid character it replaces
+    const uint16_t Unpaired[] = {0xDC00, 0xDC00, 0xD800, 0};
+    if (ccunicode_SetContextReplacement(&Context, 0x1F600) != CCUNICODE_NO_ERROR)
+    {
+        fprintf(stderr, "Valid replacement rejected");
+        ccunicode_DestroyContext(&Context);
+        return -1;
+    }
+    Count = ccunicode_Utf8ToUtf16_c(&Context, (const uint8_t*)"\xFF\xFF", &WStr);
+    if (Count != 4 || WStr[0] != 0xD83D || WStr[1] != 0xDE00 || WStr[2] != 0xD83D || WStr[3] != 0xDE00 || WStr[4] != 0)
+    {
+        fprintf(stderr, "Bad replacement outside the BMP in UTF16 (%d shorts)", Count);
+        ccunicode_DestroyContext(&Context);
+        return -1;
+    }
+    Count = ccunicode_Utf16ToUtf8_c(&Context, Unpaired, &Str);
+    if (Count != 12 || memcmp(Str, "\xF0\x9F\x98\x80\xF0\x9F\x98\x80\xF0\x9F\x98\x80", 13))
+    {
+        fprintf(stderr, "Bad replacement outside the BMP in UTF8 (%d bytes)", Count);
+        ccunicode_DestroyContext(&Context);
+        return -1;
+    }
+
+    if (ccunicode_SetContextReplacement(&Context, 0xD800) != CCUNICODE_INVALID_CODEPOINT ||
+        ccunicode_SetContextReplacement(&Context, 0x110000) != CCUNICODE_INVALID_CODEPOINT || Context.replacement != 0x1F600)
+    {
+        fprintf(stderr, "Invalid replacement accepted");
+        ccunicode_DestroyContext(&Context);
+        return -1;
+    }
+    Context.replacement = 0xDFFF;
+    Count = ccunicode_Utf8ToUtf16_c(&Context, (const uint8_t*)Utf8Str, &WStr);
+    if (Count != CCUNICODE_INVALID_CODEPOINT)
+    {
+        fprintf(stderr, "Conversion with an invalid replacement not rejected (%d)", Count);
+        ccunicode_DestroyContext(&Context);
+        return -1;
+    }
+    Context.replacement = 0xFFFD;
+
+    Context.error_policy = CCUNICODE_ERROR_POLICY_STOP;
+    Count = ccunicode_Utf8ToUtf16_c(&Context, (const uint8_t*)Utf8Str, &WStr);
+    if (Count != CCUNICODE_INVALID_UTF8_CHARACTER)
+    {
+        fprintf(stderr, "Stop policy did not stop (%d)", Count);
+        ccunicode_DestroyContext(&Context);
+        return -1;
+    }
+
+    ccunicode_DestroyContext(&Context);
+    return 0;
+}
+
+int TestSteadyStateAllocations(void)
+{
+    const char Utf8Str[] = "\xF0\x9F\x98\x81 \xE2\x82\xAC Hello World ! \xC3\x89t\xC3\xA9";
+
+    TCountingContext Counts = {0, 0};
+    TCCUnicode_CtxMallocPtr Alloc;
+    ccunicode_InitCtxMallocPtr(&Alloc, &Counts, &CountingMalloc, &CountingFree);
+
+    // A result cannot be the input of the same context, so the pipeline alternates between two contexts
+    TCCUnicode_Context Context;
+    TCCUnicode_Context OtherContext;
+    ccunicode_InitContext(&Context, CCUNICODE_ERROR_POLICY_REPLACE, &Alloc.malloc_ptr);
+    ccunicode_InitContext(&OtherContext, CCUNICODE_ERROR_POLICY_REPLACE, &Alloc.malloc_ptr);
+
+    int WarmUpCount = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        uint16_t *WStr = NULL;
+        uint8_t *Str = NULL;
+        uint32_t *Codepoints = NULL;
+        int Count = ccunicode_Utf8ToUtf16_c(&Context, (const uint8_t*)Utf8Str, &WStr);
+        if (Count < 0)
+        {
+            fprintf(stderr, "Error %d in ccunicode_Utf8ToUtf16_c", Count);
+            ccunicode_DestroyContext(&Context);
+            ccunicode_DestroyContext(&OtherContext);
+            return -1;
+        }
+        Count = ccunicode_Utf16ToCodepoints_nc(&OtherContext, WStr, Count, &Codepoints);
+        if (Count < 0)
+        {
+            fprintf(stderr, "Error %d in ccunicode_Utf16ToCodepoints_nc", Count);
+            ccunicode_DestroyContext(&Context);
+            ccunicode_DestroyContext(&OtherContext);
+            return -1;
+        }
+        Count = ccunicode_CodepointsToUtf8_nc(&Context, Codepoints, Count, &Str);
+        if (Count != (int)strlen(Utf8Str))
+        {
+            fprintf(stderr, "Error %d in ccunicode_CodepointsToUtf8_nc", Count);
+            ccunicode_DestroyContext(&Context);
+            ccunicode_DestroyContext(&OtherContext);
+            return -1;
+        }
+        if (i == 0)
+            WarmUpCount = Counts.malloc_count;
+    }
+
+    if (Counts.malloc_count != WarmUpCount)
+    {
+        fprintf(stderr, "Context allocated %d times after warming up", Counts.malloc_count - WarmUpCount);
+        ccunicode_DestroyContext(&Context);
+        ccunicode_DestroyContext(&OtherContext);
+        return -1;
+    }
+
+    ccunicode_DestroyContext(&Context);
+    ccunicode_DestroyContext(&OtherContext);
+    if (Counts.malloc_count != Counts.free_count)
+    {
+        fprintf(stderr, "Context leaked buffers (%d mallocs, %d frees)", Counts.malloc_count, Counts.free_count);
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestArenaBuffers(void)
+{
+    uint32_t Codepoints[200];
+    for (int i = 0; i < 200; ++i)
+        Codepoints[i] = 'a' + i%26;
+
+    TCCUnicode_Arena Arena;
+    TCCUnicode_Context Context;
+    ccunicode_InitArena(&Arena, 0, NULL);
+    ccunicode_InitContext(&Context, CCUNICODE_ERROR_POLICY_STOP, &Arena.allocator.malloc_ptr);
+
+    // The buffers start cache-line aligned and the latest one grows in place
+    uint8_t *Str = NULL;
+    int Count = ccunicode_CodepointsToUtf8_nc(&Context, Codepoints, 4, &Str);
+    uint8_t *First = Str;
+    if (Count != 4 || ((uintptr_t)Str % 64) != 0)
+    {
+        fprintf(stderr, "Context buffer not aligned on an arena (%d)", Count);
+        ccunicode_DestroyArena(&Arena);
+        return -1;
+    }
+    Count = ccunicode_CodepointsToUtf8_nc(&Context, Codepoints, 200, &Str);
+    if (Count != 200 || Str != First || Str[199] != 'a' + 199%26 || Arena.stats.alloc_count != 1)
+    {
+        fprintf(stderr, "Context buffer not grown in place on an arena (%d, %d allocations)", Count, (int)Arena.stats.alloc_count);
+        ccunicode_DestroyArena(&Arena);
+        return -1;
+    }
+
+    ccunicode_DestroyContext(&Context);
+    ccunicode_DestroyArena(&Arena);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int Res = 0;
+
+#define TEST(t) \
+    Res = t(); \
+    if (Res) \
+        return Res;
+
+    TEST(TestSameResults)
+    TEST(TestReplacePolicy)
+    TEST(TestSteadyStateAllocations)
+    TEST(TestArenaBuffers)
+
+    return 0;
+}
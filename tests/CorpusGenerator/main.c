@@ -0,0 +1,178 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CORPUS_SIZE 65536
+
+static void InitMixedGenerator(TCCUnicode_CorpusGenerator *Generator, uint32_t Seed)
+{
+    ccunicode_InitCorpusGenerator(Generator, Seed);
+    Generator->weights[1] = 2;
+    Generator->weights[2] = 3;
+    Generator->weights[3] = 1;
+    Generator->mean_run_length = 4;
+}
+
+int TestDeterminism(void)
+{
+    static uint8_t First[CORPUS_SIZE];
+    static uint8_t Second[CORPUS_SIZE];
+    TCCUnicode_CorpusGenerator Generator;
+
+    InitMixedGenerator(&Generator, 7);
+    int Res = ccunicode_GenerateUtf8(&Generator, First, CORPUS_SIZE);
+    InitMixedGenerator(&Generator, 7);
+    int SecondRes = ccunicode_GenerateUtf8(&Generator, Second, CORPUS_SIZE);
+    if (Res != CORPUS_SIZE || SecondRes != CORPUS_SIZE || memcmp(First, Second, CORPUS_SIZE))
+    {
+        fprintf(stderr, "The same seed gives different outputs (%d, %d)", Res, SecondRes);
+        return -1;
+    }
+
+    InitMixedGenerator(&Generator, 8);
+    ccunicode_GenerateUtf8(&Generator, Second, CORPUS_SIZE);
+    if (!memcmp(First, Second, CORPUS_SIZE))
+    {
+        fprintf(stderr, "Different seeds give the same output");
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestValidOutput(void)
+{
+    static uint8_t Utf8[CORPUS_SIZE];
+    static uint16_t Utf16[CORPUS_SIZE];
+    static uint32_t Codepoints[CORPUS_SIZE];
+    TCCUnicode_CorpusGenerator Generator;
+
+    InitMixedGenerator(&Generator, 1);
+    ccunicode_GenerateUtf8(&Generator, Utf8, CORPUS_SIZE);
+    int64_t ErrorOffset = 0;
+    int Res = ccunicode_ValidateUtf8Data(Utf8, CORPUS_SIZE, &ErrorOffset);
+    if (Res != CCUNICODE_NO_ERROR)
+    {
+        fprintf(stderr, "Invalid UTF8 generated: error %d at offset %lld", Res, (long long)ErrorOffset);
+        return -1;
+    }
+
+    // Every length is drawn, and null characters only appear when asked for
+    int Lengths[5] = {0};
+    for (int Pos = 0; Pos < CORPUS_SIZE;)
+    {
+        uint32_t Codepoint = 0;
+        int Length = ccunicode_DecodeNextUtf8(Utf8, CORPUS_SIZE, Pos, &Codepoint);
+        if (!Codepoint)
+            Lengths[0]++;
+        Lengths[Length]++;
+        Pos += Length;
+    }
+    if (Lengths[0] || !Lengths[1] || !Lengths[2] || !Lengths[3] || !Lengths[4])
+    {
+        fprintf(stderr, "Bad length distribution: %d nulls, %d %d %d %d", Lengths[0], Lengths[1], Lengths[2], Lengths[3], Lengths[4]);
+        return -1;
+    }
+
+    InitMixedGenerator(&Generator, 2);
+    ccunicode_GenerateUtf16(&Generator, Utf16, CORPUS_SIZE);
+    Res = ccunicode_Utf16ToCodepoints_nm(Utf16, CORPUS_SIZE, Codepoints, CORPUS_SIZE+1);
+    if (Res < 0)
+    {
+        fprintf(stderr, "Invalid UTF16 generated: error %d", Res);
+        return -1;
+    }
+
+    InitMixedGenerator(&Generator, 3);
+    Generator.nulls_per_million = 100000;
+    ccunicode_GenerateCodepoints(&Generator, Codepoints, CORPUS_SIZE);
+    int NullCount = 0;
+    for (int i = 0; i < CORPUS_SIZE; ++i)
+    {
+        if (!Codepoints[i])
+            NullCount++;
+    }
+    if (NullCount < CORPUS_SIZE/20 || NullCount > CORPUS_SIZE/5)
+    {
+        fprintf(stderr, "Bad null character count: %d", NullCount);
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestErrors(void)
+{
+    static uint8_t Utf8[CORPUS_SIZE];
+    static uint8_t Out[4*CORPUS_SIZE];
+    TCCUnicode_CorpusGenerator Generator;
+
+    // Each invalid character gives at least one replacement
+    InitMixedGenerator(&Generator, 4);
+    Generator.errors_per_million = 10000;
+    ccunicode_GenerateUtf8(&Generator, Utf8, CORPUS_SIZE);
+
+    TCCUnicode_Transcoder Transcoder;
+    ccunicode_InitTranscoder(&Transcoder, CCUNICODE_ENCODING_UTF8, CCUNICODE_ENCODING_UTF8, CCUNICODE_ERROR_POLICY_REPLACE);
+    int Read = 0;
+    int Written = 0;
+    int Res = ccunicode_Transcode_m(&Transcoder, Utf8, CORPUS_SIZE, 1, Out, sizeof(Out), &Read, &Written);
+    if (Res != CCUNICODE_NO_ERROR || Transcoder.replacement_count < 100 || Transcoder.replacement_count > 1000)
+    {
+        fprintf(stderr, "Bad error density: error %d, %lld replacements", Res, (long long)Transcoder.replacement_count);
+        return -1;
+    }
+
+    ccunicode_InitCorpusGenerator(&Generator, 5);
+    Generator.weights[0] = 0;
+    if (ccunicode_GenerateUtf8(&Generator, Utf8, 16) != CCUNICODE_INVALID_PARAMETER)
+    {
+        fprintf(stderr, "Null weights are accepted");
+        return -1;
+    }
+    Generator.weights[2] = 1;
+    Generator.ranges[2][0] = 0xD800;
+    Generator.ranges[2][1] = 0xDFFF;
+    if (ccunicode_GenerateUtf8(&Generator, Utf8, 16) != CCUNICODE_INVALID_PARAMETER)
+    {
+        fprintf(stderr, "A range of surrogates is accepted");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    int Res;
+#define TEST(t) Res = t(); if (Res) return Res;
+
+    TEST(TestDeterminism)
+    TEST(TestValidOutput)
+    TEST(TestErrors)
+
+    return 0;
+}
@@ -0,0 +1,243 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_CODEPOINT_COUNT 400000
+
+static const uint32_t PatternCodepoints[] = {'H', 'e', 'l', 'l', 'o', ' ', 0xC9, 0x800, 0x4E2D, 0xFFFD, 0x10000, 0x1F600, '\n'};
+
+// Runs the tasks backwards on the calling thread: results must not depend on the order
+static void RunTasksBackwards(void *PoolData, void (*TaskFunc)(void*, int), void *TaskData, int TaskCount)
+{
+    int *CallCount = (int*)PoolData;
+    ++(*CallCount);
+    for (int i = TaskCount-1; i >= 0; --i)
+        TaskFunc(TaskData, i);
+}
+
+static uint32_t *MakeCodepoints(void)
+{
+    uint32_t *Codepoints = malloc((TEST_CODEPOINT_COUNT+1)*sizeof(*Codepoints));
+    if (!Codepoints)
+        return NULL;
+
+    for (int i = 0; i < TEST_CODEPOINT_COUNT; ++i)
+        Codepoints[i] = PatternCodepoints[i % (sizeof(PatternCodepoints)/sizeof(*PatternCodepoints))];
+    Codepoints[TEST_CODEPOINT_COUNT] = 0;
+    return Codepoints;
+}
+
+static int CompareUtf8ToUtf16(const uint8_t *Utf8Str, int Utf8Size, const TCCUnicode_ThreadPool *Pool, const char *Name)
+{
+    uint16_t *Expected = NULL;
+    uint16_t *WStr = NULL;
+    int ExpectedCount = ccunicode_Utf8ToUtf16_n(Utf8Str, Utf8Size, &Expected);
+    int Count = ccunicode_Utf8ToUtf16_np(Utf8Str, Utf8Size, &WStr, Pool);
+
+    int Res = 0;
+    if (Count != ExpectedCount)
+    {
+        fprintf(stderr, "%s: ccunicode_Utf8ToUtf16_np returned %d instead of %d", Name, Count, ExpectedCount);
+        Res = -1;
+    }
+    else if (Count >= 0 && memcmp(Expected, WStr, (Count+1)*sizeof(*WStr)))
+    {
+        fprintf(stderr, "%s: mismatch between serial and parallel outputs", Name);
+        Res = -1;
+    }
+
+    if (ExpectedCount >= 0)
+        free(Expected);
+    if (Count >= 0)
+        free(WStr);
+    return Res;
+}
+
+static int CompareUtf16ToUtf8(const uint16_t *Utf16Str, int Utf16Size, const TCCUnicode_ThreadPool *Pool, const char *Name)
+{
+    uint8_t *Expected = NULL;
+    uint8_t *Str = NULL;
+    int ExpectedCount = ccunicode_Utf16ToUtf8_n(Utf16Str, Utf16Size, &Expected);
+    int Count = ccunicode_Utf16ToUtf8_np(Utf16Str, Utf16Size, &Str, Pool);
+
+    int Res = 0;
+    if (Count != ExpectedCount)
+    {
+        fprintf(stderr, "%s: ccunicode_Utf16ToUtf8_np returned %d instead of %d", Name, Count, ExpectedCount);
+        Res = -1;
+    }
+    else if (Count >= 0 && memcmp(Expected, Str, Count+1))
+    {
+        fprintf(stderr, "%s: mismatch between serial and parallel outputs", Name);
+        Res = -1;
+    }
+
+    if (ExpectedCount >= 0)
+        free(Expected);
+    if (Count >= 0)
+        free(Str);
+    return Res;
+}
+
+int TestUtf8ToUtf16(void)
+{
+    uint32_t *Codepoints = MakeCodepoints();
+    uint8_t *Utf8Str = NULL;
+    int Utf8Size = ccunicode_CodepointsToUtf8(Codepoints, &Utf8Str);
+    free(Codepoints);
+    if (Utf8Size < 0)
+    {
+        fprintf(stderr, "Error %d in ccunicode_CodepointsToUtf8", Utf8Size);
+        return -1;
+    }
+
+    int CallCount = 0;
+    TCCUnicode_ThreadPool BackwardsPool = {8, &RunTasksBackwards, &CallCount};
+    TCCUnicode_ThreadPool ThreadedPool = {4, NULL, NULL};
+
+    int Res = 0;
+    if (!Res)
+        Res = CompareUtf8ToUtf16(Utf8Str, Utf8Size, NULL, "Utf8 no pool");
+    if (!Res)
+        Res = CompareUtf8ToUtf16(Utf8Str, Utf8Size, &BackwardsPool, "Utf8 backwards pool");
+    if (!Res)
+        Res = CompareUtf8ToUtf16(Utf8Str, Utf8Size, &ThreadedPool, "Utf8 threaded pool");
+    if (!Res && CallCount != 2)
+    {
+        fprintf(stderr, "The user-defined pool was called %d times instead of 2", CallCount);
+        Res = -1;
+    }
+
+    // Errors must be the first ones the serial path would report
+    if (!Res)
+    {
+        Utf8Str[Utf8Size/2] = 0xBF;
+        Utf8Str[3*Utf8Size/4] = 0xFF;
+        Res = CompareUtf8ToUtf16(Utf8Str, Utf8Size, &BackwardsPool, "Utf8 invalid characters");
+    }
+    if (!Res)
+    {
+        Utf8Str[Utf8Size/3] = 0;
+        Res = CompareUtf8ToUtf16(Utf8Str, Utf8Size, &BackwardsPool, "Utf8 null character");
+    }
+    if (!Res)
+        Res = CompareUtf8ToUtf16(Utf8Str, Utf8Size-1, &BackwardsPool, "Utf8 truncated");
+
+    free(Utf8Str);
+    return Res;
+}
+
+int TestUtf16ToUtf8(void)
+{
+    uint32_t *Codepoints = MakeCodepoints();
+    uint16_t *Utf16Str = NULL;
+    int Utf16Size = ccunicode_CodepointsToUtf16(Codepoints, &Utf16Str);
+    free(Codepoints);
+    if (Utf16Size < 0)
+    {
+        fprintf(stderr, "Error %d in ccunicode_CodepointsToUtf16", Utf16Size);
+        return -1;
+    }
+
+    int CallCount = 0;
+    TCCUnicode_ThreadPool BackwardsPool = {8, &RunTasksBackwards, &CallCount};
+    TCCUnicode_ThreadPool ThreadedPool = {4, NULL, NULL};
+
+    int Res = 0;
+    if (!Res)
+        Res = CompareUtf16ToUtf8(Utf16Str, Utf16Size, NULL, "Utf16 no pool");
+    if (!Res)
+        Res = CompareUtf16ToUtf8(Utf16Str, Utf16Size, &BackwardsPool, "Utf16 backwards pool");
+    if (!Res)
+        Res = CompareUtf16ToUtf8(Utf16Str, Utf16Size, &ThreadedPool, "Utf16 threaded pool");
+
+    if (!Res)
+    {
+        Utf16Str[Utf16Size/2] = 0xDC00;
+        Utf16Str[3*Utf16Size/4] = 0xD800;
+        Res = CompareUtf16ToUtf8(Utf16Str, Utf16Size, &BackwardsPool, "Utf16 invalid characters");
+    }
+    if (!Res)
+    {
+        Utf16Str[Utf16Size/3] = 0;
+        Res = CompareUtf16ToUtf8(Utf16Str, Utf16Size, &BackwardsPool, "Utf16 null character");
+    }
+
+    free(Utf16Str);
+    return Res;
+}
+
+int TestBufferTooSmall(void)
+{
+    uint32_t *Codepoints = MakeCodepoints();
+    uint8_t *Utf8Str = NULL;
+    int Utf8Size = ccunicode_CodepointsToUtf8(Codepoints, &Utf8Str);
+    free(Codepoints);
+    if (Utf8Size < 0)
+    {
+        fprintf(stderr, "Error %d in ccunicode_CodepointsToUtf8", Utf8Size);
+        return -1;
+    }
+
+    TCCUnicode_ThreadPool ThreadedPool = {4, NULL, NULL};
+    uint16_t *WStr = malloc((Utf8Size+1)*sizeof(*WStr));
+    int Res = 0;
+
+    int Count = ccunicode_Utf8ToUtf16_nmp(Utf8Str, Utf8Size, WStr, Utf8Size, &ThreadedPool);
+    if (Count < 0)
+    {
+        fprintf(stderr, "Error %d in ccunicode_Utf8ToUtf16_nmp", Count);
+        Res = -1;
+    }
+
+    int Expected = ccunicode_Utf8ToUtf16_nm(Utf8Str, Utf8Size, WStr, Count-1);
+    int Result = ccunicode_Utf8ToUtf16_nmp(Utf8Str, Utf8Size, WStr, Count-1, &ThreadedPool);
+    if (!Res && (Expected != CCUNICODE_BUFFER_TOO_SMALL || Result != Expected))
+    {
+        fprintf(stderr, "Expected error not encountered on small buffer. Returned %d", Result);
+        Res = -1;
+    }
+
+    free(WStr);
+    free(Utf8Str);
+    return Res;
+}
+
+int main(int argc, char **argv)
+{
+    int Res = 0;
+
+#define TEST(t) \
+    Res = t(); \
+    if (Res) \
+        return Res;
+
+    TEST(TestUtf8ToUtf16)
+    TEST(TestUtf16ToUtf8)
+    TEST(TestBufferTooSmall)
+
+    return 0;
+}
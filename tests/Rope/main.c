@@ -0,0 +1,298 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int CheckMetrics(const TCCUnicode_Rope *Rope, int Utf8Size, int CodepointCount, int Utf16Size, int LineCount)
+{
+    TCCUnicode_RopeMetrics Metrics;
+    ccunicode_GetRopeMetrics(Rope, &Metrics);
+    if (Metrics.utf8_size != Utf8Size || Metrics.codepoint_count != CodepointCount || Metrics.utf16_size != Utf16Size || Metrics.line_count != LineCount)
+    {
+        fprintf(stderr, "Rope metrics (%d, %d, %d, %d) instead of (%d, %d, %d, %d)", Metrics.utf8_size, Metrics.codepoint_count, Metrics.utf16_size, Metrics.line_count,
+                Utf8Size, CodepointCount, Utf16Size, LineCount);
+        return -1;
+    }
+    return 0;
+}
+
+int TestEdits(void)
+{
+    // "é€😀\n" is 10 bytes, 4 codepoints and 5 shorts
+    const char Line[] = "\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80\n";
+    const int LineCount = 1000;
+
+    TCCUnicode_Rope Rope;
+    ccunicode_InitRope(&Rope, NULL);
+    for (int i = 0; i < LineCount; ++i)
+    {
+        if (ccunicode_InsertIntoRope_n(&Rope, 10*i, (const uint8_t*)Line, 10) != 10)
+        {
+            fprintf(stderr, "Failed to append line %d", i);
+            ccunicode_DestroyRope(&Rope);
+            return -1;
+        }
+    }
+    if (CheckMetrics(&Rope, 10*LineCount, 4*LineCount, 5*LineCount, LineCount))
+    {
+        ccunicode_DestroyRope(&Rope);
+        return -1;
+    }
+
+    // Insert a large block in the middle, then remove it and one more line
+    char *Block = (char*)malloc(10*LineCount + 1);
+    for (int i = 0; i < LineCount; ++i)
+        memcpy(Block + 10*i, Line, 10);
+    Block[10*LineCount] = 0;
+    if (ccunicode_InsertIntoRope_n(&Rope, 5000, (const uint8_t*)Block, 10*LineCount) != 10*LineCount
+        || CheckMetrics(&Rope, 20*LineCount, 8*LineCount, 10*LineCount, 2*LineCount)
+        || ccunicode_DeleteFromRope(&Rope, 4990, 10*LineCount + 10) != CCUNICODE_NO_ERROR
+        || CheckMetrics(&Rope, 10*LineCount - 10, 4*LineCount - 4, 5*LineCount - 5, LineCount - 1))
+    {
+        fprintf(stderr, "Large edit failed");
+        free(Block);
+        ccunicode_DestroyRope(&Rope);
+        return -1;
+    }
+
+    uint8_t *Copy = (uint8_t*)malloc(10*LineCount);
+    int Copied = ccunicode_CopyFromRope_m(&Rope, 0, 10*LineCount - 10, Copy, 10*LineCount);
+    if (Copied != 10*LineCount - 10 || memcmp(Copy, Block, Copied))
+    {
+        fprintf(stderr, "Rope content differs after edits");
+        free(Copy);
+        free(Block);
+        ccunicode_DestroyRope(&Rope);
+        return -1;
+    }
+    free(Copy);
+    free(Block);
+
+    // Edits must be between characters and only the inserted text is validated
+    const uint8_t BadUtf8Str[] = {'a', 0xE2, 0x82, 'b'};
+    if (ccunicode_InsertIntoRope_n(&Rope, 1, (const uint8_t*)"a", 1) != CCUNICODE_STRING_ENDED_IN_CHARACTER
+        || ccunicode_DeleteFromRope(&Rope, 0, 3) != CCUNICODE_STRING_ENDED_IN_CHARACTER
+        || ccunicode_InsertIntoRope_n(&Rope, 0, BadUtf8Str, sizeof(BadUtf8Str)) != CCUNICODE_INVALID_UTF8_CHARACTER
+        || CheckMetrics(&Rope, 10*LineCount - 10, 4*LineCount - 4, 5*LineCount - 5, LineCount - 1))
+    {
+        fprintf(stderr, "Expected edit error not encountered");
+        ccunicode_DestroyRope(&Rope);
+        return -1;
+    }
+
+    ccunicode_DestroyRope(&Rope);
+    if (Rope.node_count != 0)
+    {
+        fprintf(stderr, "Rope leaked %d nodes", Rope.node_count);
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestConversions(void)
+{
+    const char Line[] = "\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80\n";
+    const int LineCount = 300;
+
+    TCCUnicode_Rope Rope;
+    ccunicode_InitRope(&Rope, NULL);
+    for (int i = 0; i < LineCount; ++i)
+        ccunicode_InsertIntoRope_n(&Rope, 0, (const uint8_t*)Line, 10);
+
+    for (int i = 0; i < LineCount; ++i)
+    {
+        if (ccunicode_ConvertRopeOffset(&Rope, CCUNICODE_UNIT_UTF8, 10*i + 5, CCUNICODE_UNIT_UTF16) != 5*i + 2
+            || ccunicode_ConvertRopeOffset(&Rope, CCUNICODE_UNIT_UTF16, 5*i + 4, CCUNICODE_UNIT_CODEPOINT) != 4*i + 3
+            || ccunicode_ConvertRopeOffset(&Rope, CCUNICODE_UNIT_CODEPOINT, 4*i + 3, CCUNICODE_UNIT_UTF8) != 10*i + 9
+            || ccunicode_GetRopeLineStart(&Rope, i, CCUNICODE_UNIT_UTF16) != 5*i
+            || ccunicode_GetRopeLineOfOffset(&Rope, CCUNICODE_UNIT_CODEPOINT, 4*i + 3) != i)
+        {
+            fprintf(stderr, "Conversion mismatch on line %d", i);
+            ccunicode_DestroyRope(&Rope);
+            return -1;
+        }
+    }
+
+    if (ccunicode_ConvertRopeOffset(&Rope, CCUNICODE_UNIT_UTF16, 3, CCUNICODE_UNIT_UTF8) != CCUNICODE_STRING_ENDED_IN_CHARACTER
+        || ccunicode_ConvertRopeOffset(&Rope, CCUNICODE_UNIT_UTF8, 10*LineCount + 1, CCUNICODE_UNIT_UTF16) != CCUNICODE_INVALID_PARAMETER
+        || ccunicode_GetRopeLineStart(&Rope, LineCount, CCUNICODE_UNIT_UTF8) != 10*LineCount
+        || ccunicode_GetRopeLineStart(&Rope, LineCount + 1, CCUNICODE_UNIT_UTF8) != CCUNICODE_INVALID_PARAMETER)
+    {
+        fprintf(stderr, "Expected conversion error not encountered");
+        ccunicode_DestroyRope(&Rope);
+        return -1;
+    }
+
+    ccunicode_DestroyRope(&Rope);
+    return 0;
+}
+
+// Checks the line functions of the rope against a line table of the same text
+static int CheckLines(const TCCUnicode_Rope *Rope, const char *Text, int Size)
+{
+    TCCUnicode_LineTable Table;
+    if (ccunicode_BuildLineTable_n(&Table, (const uint8_t*)Text, Size, NULL) < 0)
+        return -1;
+
+    int Res = 0;
+    TCCUnicode_RopeMetrics Metrics;
+    ccunicode_GetRopeMetrics(Rope, &Metrics);
+    if (Metrics.utf8_size != Size || Metrics.line_count != Table.line_count - 1)
+    {
+        fprintf(stderr, "Rope has %d line ends instead of %d", Metrics.line_count, Table.line_count - 1);
+        Res = -1;
+    }
+    for (int i = 0; i < Table.line_count && !Res; ++i)
+    {
+        if (ccunicode_GetRopeLineStart(Rope, i, CCUNICODE_UNIT_UTF8) != Table.line_starts[i])
+        {
+            fprintf(stderr, "Line %d starts at %d instead of %d", i, ccunicode_GetRopeLineStart(Rope, i, CCUNICODE_UNIT_UTF8), Table.line_starts[i]);
+            Res = -1;
+        }
+    }
+    int Line = 0;
+    for (int i = 0; i <= Size && !Res; ++i)
+    {
+        while (Line + 1 < Table.line_count && Table.line_starts[Line+1] <= i)
+            ++Line;
+        if (ccunicode_GetRopeLineOfOffset(Rope, CCUNICODE_UNIT_UTF8, i) != Line)
+        {
+            fprintf(stderr, "Offset %d is on line %d instead of %d", i, ccunicode_GetRopeLineOfOffset(Rope, CCUNICODE_UNIT_UTF8, i), Line);
+            Res = -1;
+        }
+    }
+
+    ccunicode_DestroyLineTable(&Table);
+    return Res;
+}
+
+int TestLineEnds(void)
+{
+    // "\r\n", "\r" and "\n" all end lines, and the offset between "\r" and "\n" stays on the line they end
+    TCCUnicode_Rope Rope;
+    ccunicode_InitRope(&Rope, NULL);
+    const char Small[] = "a\r\nb\rc\nd";
+    ccunicode_InsertIntoRope_n(&Rope, 0, (const uint8_t*)Small, 8);
+    if (CheckMetrics(&Rope, 8, 8, 8, 3) || ccunicode_GetRopeLineStart(&Rope, 1, CCUNICODE_UNIT_UTF8) != 3 ||
+        ccunicode_GetRopeLineOfOffset(&Rope, CCUNICODE_UNIT_UTF8, 2) != 0 || CheckLines(&Rope, Small, 8))
+    {
+        ccunicode_DestroyRope(&Rope);
+        return -1;
+    }
+    ccunicode_DestroyRope(&Rope);
+
+    // A "\r\n" cut between two chunks
+    static char Text[4096];
+    ccunicode_InitRope(&Rope, NULL);
+    memset(Text, 'a', 2*CCUNICODE_ROPE_CHUNK_SIZE);
+    Text[CCUNICODE_ROPE_CHUNK_SIZE-1] = '\r';
+    Text[CCUNICODE_ROPE_CHUNK_SIZE] = '\n';
+    ccunicode_InsertIntoRope_n(&Rope, 0, (const uint8_t*)Text, 2*CCUNICODE_ROPE_CHUNK_SIZE);
+    if (Rope.node_count < 2 || CheckLines(&Rope, Text, 2*CCUNICODE_ROPE_CHUNK_SIZE))
+    {
+        ccunicode_DestroyRope(&Rope);
+        return -1;
+    }
+    ccunicode_DestroyRope(&Rope);
+
+    // Random edits, which join and split "\r\n" in and between chunks
+    int Size = 0;
+    unsigned int Seed = 1;
+    ccunicode_InitRope(&Rope, NULL);
+    for (int i = 0; i < 1000; ++i)
+    {
+        Seed = Seed*1103515245 + 12345;
+        int Offset = Size ? (int)((Seed >> 8) % (unsigned int)(Size + 1)) : 0;
+        if (Size > 2000 || (Size > 0 && (Seed >> 4) % 3 == 0))
+        {
+            int Length = 1 + (int)((Seed >> 20) % 300);
+            if (Offset + Length > Size)
+                Length = Size - Offset;
+            ccunicode_DeleteFromRope(&Rope, Offset, Length);
+            memmove(Text + Offset, Text + Offset + Length, Size - Offset - Length);
+            Size -= Length;
+        }
+        else
+        {
+            char Inserted[600];
+            int Length = 1 + (int)((Seed >> 20) % ((Seed >> 2) % 4 ? 8 : 600));
+            for (int j = 0; j < Length; ++j)
+                Inserted[j] = "ab\r\n"[(Seed >> (j % 24)) % 4];
+            ccunicode_InsertIntoRope_n(&Rope, Offset, (const uint8_t*)Inserted, Length);
+            memmove(Text + Offset + Length, Text + Offset, Size - Offset);
+            memcpy(Text + Offset, Inserted, Length);
+            Size += Length;
+        }
+        if (i % 8 == 7 && CheckLines(&Rope, Text, Size))
+        {
+            fprintf(stderr, " after edit %d", i);
+            ccunicode_DestroyRope(&Rope);
+            return -1;
+        }
+    }
+    ccunicode_DestroyRope(&Rope);
+    return 0;
+}
+
+int TestSmallChunks(void)
+{
+    // Emptying most of each chunk merges them back into few chunks
+    const int ChunkCount = 64;
+    char *Text = (char*)malloc(ChunkCount*CCUNICODE_ROPE_CHUNK_SIZE);
+    memset(Text, 'a', ChunkCount*CCUNICODE_ROPE_CHUNK_SIZE);
+    TCCUnicode_Rope Rope;
+    ccunicode_InitRope(&Rope, NULL);
+    ccunicode_InsertIntoRope_n(&Rope, 0, (const uint8_t*)Text, ChunkCount*CCUNICODE_ROPE_CHUNK_SIZE);
+    free(Text);
+    for (int i = 0; i < ChunkCount; ++i)
+        ccunicode_DeleteFromRope(&Rope, 12*i, CCUNICODE_ROPE_CHUNK_SIZE - 12);
+
+    int Res = CheckMetrics(&Rope, 12*ChunkCount, 12*ChunkCount, 12*ChunkCount, 0);
+    if (!Res && Rope.node_count > 4)
+    {
+        fprintf(stderr, "%d chunks hold %d bytes", Rope.node_count, 12*ChunkCount);
+        Res = -1;
+    }
+    ccunicode_DestroyRope(&Rope);
+    return Res;
+}
+
+int main(int argc, char **argv)
+{
+    int Res = 0;
+
+#define TEST(t) \
+    Res = t(); \
+    if (Res) \
+        return Res;
+
+    TEST(TestEdits)
+    TEST(TestConversions)
+    TEST(TestLineEnds)
+    TEST(TestSmallChunks)
+
+    return 0;
+}
@@ -0,0 +1,240 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define FUZZ_ITERATIONS 20000
+#define FUZZ_MAX_SIZE 16
+
+int TestDecodeNextUtf8(void)
+{
+    const uint8_t Alphabet[] = {0x00, 0x41, 0x7F, 0x80, 0xBF, 0xC3, 0xA9, 0xE2, 0x82, 0xAC, 0xF0, 0x9F, 0x98, 0x80, 0xF7, 0xF8, 0xFF};
+    uint8_t Utf8Str[FUZZ_MAX_SIZE];
+    uint32_t Expected[FUZZ_MAX_SIZE+1];
+    uint32_t Decoded[FUZZ_MAX_SIZE+1];
+
+    srand(35);
+    for (int i = 0; i < FUZZ_ITERATIONS; ++i)
+    {
+        int Size = rand() % FUZZ_MAX_SIZE;
+        for (int j = 0; j < Size; ++j)
+            Utf8Str[j] = Alphabet[rand() % sizeof(Alphabet)];
+
+        int ExpectedCount = ccunicode_Utf8ToCodepoints_nm(Utf8Str, Size, Expected, FUZZ_MAX_SIZE+1);
+
+        // Decode until the end, the first error or the first null byte (an overlong null codepoint does not stop)
+        int Count = 0;
+        int Pos = 0;
+        int Res;
+        uint32_t Codepoint;
+        while ((Res = ccunicode_DecodeNextUtf8(Utf8Str, Size, Pos, &Codepoint)) > 0 && Utf8Str[Pos] != 0)
+        {
+            Decoded[Count++] = Codepoint;
+            Pos += Res;
+        }
+        if (Res < 0)
+            Count = Res;
+
+        if (Count != ExpectedCount || (Count > 0 && memcmp(Decoded, Expected, Count*sizeof(*Decoded))))
+        {
+            fprintf(stderr, "ccunicode_DecodeNextUtf8 returned %d where ccunicode_Utf8ToCodepoints_nm returned %d", Count, ExpectedCount);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int TestDecodeNextUtf16(void)
+{
+    const uint16_t Alphabet[] = {0x0000, 0x0041, 0x00E9, 0xD7FF, 0xD800, 0xDBFF, 0xDC00, 0xDFFF, 0xE000, 0xFFFF};
+    uint16_t Utf16Str[FUZZ_MAX_SIZE];
+    uint32_t Expected[FUZZ_MAX_SIZE+1];
+    uint32_t Decoded[FUZZ_MAX_SIZE+1];
+
+    srand(35);
+    for (int i = 0; i < FUZZ_ITERATIONS; ++i)
+    {
+        int Size = rand() % FUZZ_MAX_SIZE;
+        for (int j = 0; j < Size; ++j)
+            Utf16Str[j] = Alphabet[rand() % (sizeof(Alphabet)/sizeof(*Alphabet))];
+
+        int ExpectedCount = ccunicode_Utf16ToCodepoints_nm(Utf16Str, Size, Expected, FUZZ_MAX_SIZE+1);
+
+        int Count = 0;
+        int Pos = 0;
+        int Res;
+        uint32_t Codepoint;
+        while ((Res = ccunicode_DecodeNextUtf16(Utf16Str, Size, Pos, &Codepoint)) > 0 && Codepoint != 0)
+        {
+            Decoded[Count++] = Codepoint;
+            Pos += Res;
+        }
+        if (Res < 0)
+            Count = Res;
+
+        if (Count != ExpectedCount || (Count > 0 && memcmp(Decoded, Expected, Count*sizeof(*Decoded))))
+        {
+            fprintf(stderr, "ccunicode_DecodeNextUtf16 returned %d where ccunicode_Utf16ToCodepoints_nm returned %d", Count, ExpectedCount);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int TestDecodePrev(void)
+{
+    const char Utf8Str[] = "aé€\U0001F600z";
+    const uint16_t Utf16Str[] = {'a', 0xE9, 0x20AC, 0xD83D, 0xDE00, 'z'};
+    const uint32_t Reversed[] = {'z', 0x1F600, 0x20AC, 0xE9, 'a'};
+
+    int Pos = (int)strlen(Utf8Str);
+    int Count = 0;
+    int Res;
+    uint32_t Codepoint;
+    while ((Res = ccunicode_DecodePrevUtf8((const uint8_t*)Utf8Str, Pos, &Codepoint)) > 0)
+    {
+        if (Count >= 5 || Codepoint != Reversed[Count])
+        {
+            fprintf(stderr, "Mismatch when stepping backward in UTF8 at position %d", Pos);
+            return -1;
+        }
+        ++Count;
+        Pos -= Res;
+    }
+    if (Res != 0 || Count != 5)
+    {
+        fprintf(stderr, "Stepping backward in UTF8 returned %d after %d codepoints", Res, Count);
+        return -1;
+    }
+
+    Pos = sizeof(Utf16Str)/sizeof(*Utf16Str);
+    Count = 0;
+    while ((Res = ccunicode_DecodePrevUtf16(Utf16Str, Pos, &Codepoint)) > 0)
+    {
+        if (Count >= 5 || Codepoint != Reversed[Count])
+        {
+            fprintf(stderr, "Mismatch when stepping backward in UTF16 at position %d", Pos);
+            return -1;
+        }
+        ++Count;
+        Pos -= Res;
+    }
+    if (Res != 0 || Count != 5)
+    {
+        fprintf(stderr, "Stepping backward in UTF16 returned %d after %d codepoints", Res, Count);
+        return -1;
+    }
+
+    // Stray extensions, a lead announcing too many bytes and lone surrogates are rejected
+    const uint8_t BadUtf8Str1[] = {0x41, 0xA9};
+    const uint8_t BadUtf8Str2[] = {0xC3, 0xA9, 0xA9};
+    const uint8_t BadUtf8Str3[] = {0x41, 0xE2, 0x82};
+    const uint16_t BadUtf16Str1[] = {0x41, 0xDC00};
+    const uint16_t BadUtf16Str2[] = {0x41, 0xD800};
+    if (ccunicode_DecodePrevUtf8(BadUtf8Str1, 2, &Codepoint) != CCUNICODE_INVALID_UTF8_CHARACTER
+        || ccunicode_DecodePrevUtf8(BadUtf8Str2, 3, &Codepoint) != CCUNICODE_INVALID_UTF8_CHARACTER
+        || ccunicode_DecodePrevUtf8(BadUtf8Str3, 3, &Codepoint) != CCUNICODE_STRING_ENDED_IN_CHARACTER
+        || ccunicode_DecodePrevUtf16(BadUtf16Str1, 2, &Codepoint) != CCUNICODE_SURROGATE_PAIR_INVERSION
+        || ccunicode_DecodePrevUtf16(BadUtf16Str2, 2, &Codepoint) != CCUNICODE_INVALID_UTF16_CHARACTER)
+    {
+        fprintf(stderr, "Expected error not encountered when stepping backward");
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestEncode(void)
+{
+    const uint32_t Codepoints[] = {0x1, 0x7F, 0x80, 0x7FF, 0x800, 0xD7FF, 0xE000, 0xFFFF, 0x10000, 0x10FFFF};
+    const int CodepointCount = sizeof(Codepoints)/sizeof(*Codepoints);
+
+    for (int i = 0; i < CodepointCount; ++i)
+    {
+        uint8_t Utf8Str[4];
+        uint16_t Utf16Str[2];
+        uint8_t ExpectedUtf8[5];
+        uint16_t ExpectedUtf16[3];
+        uint32_t Single[2] = {Codepoints[i], 0};
+        int ExpectedUtf8Size = ccunicode_CodepointsToUtf8_nm(Single, 1, ExpectedUtf8, 5);
+        int ExpectedUtf16Size = ccunicode_CodepointsToUtf16_nm(Single, 1, ExpectedUtf16, 3);
+
+        int Utf8Size = ccunicode_EncodeUtf8(Codepoints[i], Utf8Str, 4);
+        int Utf16Size = ccunicode_EncodeUtf16(Codepoints[i], Utf16Str, 2);
+        if (Utf8Size != ExpectedUtf8Size || memcmp(Utf8Str, ExpectedUtf8, Utf8Size)
+            || Utf16Size != ExpectedUtf16Size || memcmp(Utf16Str, ExpectedUtf16, Utf16Size*sizeof(*Utf16Str)))
+        {
+            fprintf(stderr, "Encoding mismatch for codepoint 0x%X", (unsigned)Codepoints[i]);
+            return -1;
+        }
+
+        uint32_t Codepoint;
+        if (ccunicode_DecodeNextUtf8(Utf8Str, Utf8Size, 0, &Codepoint) != Utf8Size || Codepoint != Codepoints[i]
+            || ccunicode_DecodeNextUtf16(Utf16Str, Utf16Size, 0, &Codepoint) != Utf16Size || Codepoint != Codepoints[i])
+        {
+            fprintf(stderr, "Round trip failed for codepoint 0x%X", (unsigned)Codepoints[i]);
+            return -1;
+        }
+
+        if (ccunicode_EncodeUtf8(Codepoints[i], Utf8Str, Utf8Size-1) != CCUNICODE_BUFFER_TOO_SMALL
+            || ccunicode_EncodeUtf16(Codepoints[i], Utf16Str, Utf16Size-1) != CCUNICODE_BUFFER_TOO_SMALL)
+        {
+            fprintf(stderr, "Expected buffer error not encountered for codepoint 0x%X", (unsigned)Codepoints[i]);
+            return -1;
+        }
+    }
+
+    uint8_t Utf8Str[4];
+    uint16_t Utf16Str[2];
+    if (ccunicode_EncodeUtf8(0xD800, Utf8Str, 4) != CCUNICODE_INVALID_CODEPOINT
+        || ccunicode_EncodeUtf8(0x110000, Utf8Str, 4) != CCUNICODE_INVALID_CODEPOINT
+        || ccunicode_EncodeUtf16(0xDFFF, Utf16Str, 2) != CCUNICODE_INVALID_CODEPOINT
+        || ccunicode_EncodeUtf16(0x110000, Utf16Str, 2) != CCUNICODE_INVALID_CODEPOINT)
+    {
+        fprintf(stderr, "Expected invalid codepoint error not encountered");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int Res = 0;
+
+#define TEST(t) \
+    Res = t(); \
+    if (Res) \
+        return Res;
+
+    TEST(TestDecodeNextUtf8)
+    TEST(TestDecodeNextUtf16)
+    TEST(TestDecodePrev)
+    TEST(TestEncode)
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The library target is built without statistics, so this test builds its own copy of the implementation
+#define __CCUNICODE_STATS__
+#define __CCUNICODE_IMPL__
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static TCCUnicode_Stats Stats;
+
+static const TCCUnicode_FunctionStats *GetFunctionStats(int Function)
+{
+    ccunicode_GetStats(&Stats, 0);
+    return &Stats.functions[Function];
+}
+
+static uint64_t GetLatencyCount(const TCCUnicode_FunctionStats *FunctionStats)
+{
+    uint64_t Count = 0;
+    for (int i = 0; i < CCUNICODE_STATS_LATENCY_BUCKETS; ++i)
+        Count += FunctionStats->latency[i];
+    return Count;
+}
+
+int TestCounters(void)
+{
+    ccunicode_ResetStats();
+    if (ccunicode_GetStats(&Stats, 0) != CCUNICODE_NO_ERROR || !Stats.enabled)
+    {
+        fprintf(stderr, "Statistics are not enabled");
+        return -1;
+    }
+
+    // "h\xC3\xA9llo": 6 bytes, 5 codepoints
+    const uint8_t Text[] = "h\xC3\xA9llo";
+    uint16_t *Utf16 = NULL;
+    int Res = ccunicode_Utf8ToUtf16_na(Text, 6, &Utf16, NULL);
+    free(Utf16);
+    const TCCUnicode_FunctionStats *Na = GetFunctionStats(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NA);
+    if (Res != 5 || Na->calls != 1 || Na->input_units != 6 || Na->output_units != 5 || Na->errors[0] != 0 || GetLatencyCount(Na) != 1)
+    {
+        fprintf(stderr, "Bad counters: result %d, %llu calls, %llu input units, %llu output units", Res,
+                (unsigned long long)Na->calls, (unsigned long long)Na->input_units, (unsigned long long)Na->output_units);
+        return -1;
+    }
+
+    // The codepoints and the output are allocated, and the nested calls are not recorded
+    if (Na->alloc_count != 2 || Na->alloc_bytes != 6*sizeof(uint32_t) + 6*sizeof(uint16_t))
+    {
+        fprintf(stderr, "Bad allocation counters: %llu blocks, %llu bytes", (unsigned long long)Na->alloc_count, (unsigned long long)Na->alloc_bytes);
+        return -1;
+    }
+    if (Stats.functions[CCUNICODE_FUNCTION_UTF8_TO_CODEPOINTS_NA].calls || Stats.functions[CCUNICODE_FUNCTION_CODEPOINTS_TO_UTF16_NA].calls)
+    {
+        fprintf(stderr, "Nested calls are recorded");
+        return -1;
+    }
+
+    // Null-terminated versions are recorded as the n version they call
+    Res = ccunicode_Utf8ToUtf16(Text, &Utf16);
+    free(Utf16);
+    if (Res != 5 || GetFunctionStats(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NA)->calls != 2)
+    {
+        fprintf(stderr, "ccunicode_Utf8ToUtf16 is not recorded");
+        return -1;
+    }
+
+    // Short strings do not allocate in the m versions
+    uint16_t Buffer[16];
+    Res = ccunicode_Utf8ToUtf16_nm(Text, 6, Buffer, 16);
+    const TCCUnicode_FunctionStats *Nm = GetFunctionStats(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NM);
+    if (Res != 5 || Nm->calls != 1 || Nm->alloc_count != 0 || Stats.functions[CCUNICODE_FUNCTION_UTF8_TO_UTF16_NMA].calls)
+    {
+        fprintf(stderr, "Bad counters for ccunicode_Utf8ToUtf16_nm: result %d, %llu calls, %llu allocations", Res,
+                (unsigned long long)Nm->calls, (unsigned long long)Nm->alloc_count);
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestErrors(void)
+{
+    ccunicode_ResetStats();
+
+    uint16_t Buffer[16];
+    const uint8_t Invalid[] = "ab\xFF";
+    ccunicode_Utf8ToUtf16_nm(Invalid, 3, Buffer, 16);
+    ccunicode_Utf8ToUtf16_nm(Invalid, 3, Buffer, 16);
+    ccunicode_Utf8ToUtf16_nm((const uint8_t*)"ab", 2, NULL, 16);
+    const TCCUnicode_FunctionStats *Nm = GetFunctionStats(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NM);
+    if (Nm->calls != 3 || Nm->errors[0] != 3 || Nm->errors[-CCUNICODE_INVALID_UTF8_CHARACTER] != 2 || Nm->errors[-CCUNICODE_NULL_POINTER] != 1 || Nm->output_units != 0)
+    {
+        fprintf(stderr, "Bad error counters: %llu calls, %llu errors, %llu invalid characters", (unsigned long long)Nm->calls,
+                (unsigned long long)Nm->errors[0], (unsigned long long)Nm->errors[-CCUNICODE_INVALID_UTF8_CHARACTER]);
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestSnapshot(void)
+{
+    ccunicode_ResetStats();
+
+    uint32_t Codepoints[4];
+    ccunicode_Utf8ToCodepoints_nm((const uint8_t*)"abc", 3, Codepoints, 4);
+    ccunicode_GetStats(&Stats, 1);
+    if (Stats.functions[CCUNICODE_FUNCTION_UTF8_TO_CODEPOINTS_NM].calls != 1)
+    {
+        fprintf(stderr, "The call is missing from the snapshot");
+        return -1;
+    }
+
+    // Reading with Reset leaves the counters to 0
+    ccunicode_GetStats(&Stats, 0);
+    for (int i = 0; i < CCUNICODE_FUNCTION_COUNT; ++i)
+    {
+        if (Stats.functions[i].calls || Stats.functions[i].input_units || Stats.functions[i].total_ns)
+        {
+            fprintf(stderr, "%s is not reset", ccunicode_GetFunctionName(i));
+            return -1;
+        }
+    }
+
+    if (strcmp(ccunicode_GetFunctionName(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NMA), "ccunicode_Utf8ToUtf16_nma") ||
+        ccunicode_GetFunctionName(-1) || ccunicode_GetFunctionName(CCUNICODE_FUNCTION_COUNT))
+    {
+        fprintf(stderr, "Bad function names");
+        return -1;
+    }
+    if (ccunicode_GetStats(NULL, 0) != CCUNICODE_NULL_POINTER)
+    {
+        fprintf(stderr, "NULL snapshot accepted");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    int Res;
+#define TEST(t) Res = t(); if (Res) return Res;
+
+    TEST(TestCounters)
+    TEST(TestErrors)
+    TEST(TestSnapshot)
+
+    return 0;
+}
@@ -0,0 +1,217 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Line 0: "héllo", line 1: "a😀b" ended by "\r\n", line 2: "€" ended by "\r", line 3: empty
+static const char Text[] = "h\xC3\xA9llo\na\xF0\x9F\x98\x80" "b\r\n\xE2\x82\xAC\r";
+
+int TestPositionsToOffsets(void)
+{
+    const TCCUnicode_TextPosition Positions[] = {{0, 0}, {0, 2}, {0, 5}, {0, 42}, {1, 1}, {1, 2}, {1, 3}, {1, 4}, {2, 1}, {3, 0}, {0, 1}};
+    const int Expected[] = {0, 3, 6, 6, 8, 8, 12, 13, 18, 19, 1};
+    const int Count = sizeof(Expected)/sizeof(*Expected);
+    const int Size = (int)strlen(Text);
+
+    TCCUnicode_LineTable Table;
+    if (ccunicode_BuildLineTable_n(&Table, (const uint8_t*)Text, Size, NULL) != 4)
+    {
+        fprintf(stderr, "Line table does not have 4 lines");
+        return -1;
+    }
+
+    for (int t = 0; t < 2; ++t)
+    {
+        int Offsets[sizeof(Expected)/sizeof(*Expected)];
+        int ErrorIndex;
+        int Res = ccunicode_Utf16PositionsToUtf8Offsets_n((const uint8_t*)Text, Size, t ? &Table : NULL, Positions, Count, Offsets, &ErrorIndex);
+        if (Res != CCUNICODE_NO_ERROR || memcmp(Offsets, Expected, sizeof(Expected)))
+        {
+            fprintf(stderr, "Positions to offsets mismatch (error %d at %d, line table %d)", Res, ErrorIndex, t);
+            ccunicode_DestroyLineTable(&Table);
+            return -1;
+        }
+
+        const TCCUnicode_TextPosition BadPosition = {4, 0};
+        Res = ccunicode_Utf16PositionsToUtf8Offsets_n((const uint8_t*)Text, Size, t ? &Table : NULL, &BadPosition, 1, Offsets, &ErrorIndex);
+        if (Res != CCUNICODE_INVALID_PARAMETER || ErrorIndex != 0)
+        {
+            fprintf(stderr, "Expected error not encountered for a line past the end (line table %d)", t);
+            ccunicode_DestroyLineTable(&Table);
+            return -1;
+        }
+    }
+
+    ccunicode_DestroyLineTable(&Table);
+    return 0;
+}
+
+int TestOffsetsToPositions(void)
+{
+    const int Offsets[] = {0, 3, 6, 7, 8, 12, 13, 14, 15, 18, 19, 1};
+    const TCCUnicode_TextPosition Expected[] = {{0, 0}, {0, 2}, {0, 5}, {1, 0}, {1, 1}, {1, 3}, {1, 4}, {1, 5}, {2, 0}, {2, 1}, {3, 0}, {0, 1}};
+    const int Count = sizeof(Offsets)/sizeof(*Offsets);
+    const int Size = (int)strlen(Text);
+
+    TCCUnicode_LineTable Table;
+    if (ccunicode_BuildLineTable_n(&Table, (const uint8_t*)Text, Size, NULL) != 4)
+    {
+        fprintf(stderr, "Line table does not have 4 lines");
+        return -1;
+    }
+
+    for (int t = 0; t < 2; ++t)
+    {
+        TCCUnicode_TextPosition Positions[sizeof(Offsets)/sizeof(*Offsets)];
+        int ErrorIndex;
+        int Res = ccunicode_Utf8OffsetsToUtf16Positions_n((const uint8_t*)Text, Size, t ? &Table : NULL, Offsets, Count, Positions, &ErrorIndex);
+        if (Res != CCUNICODE_NO_ERROR || memcmp(Positions, Expected, sizeof(Expected)))
+        {
+            fprintf(stderr, "Offsets to positions mismatch (error %d at %d, line table %d)", Res, ErrorIndex, t);
+            ccunicode_DestroyLineTable(&Table);
+            return -1;
+        }
+
+        const int BadOffsets[] = {0, 10};
+        Res = ccunicode_Utf8OffsetsToUtf16Positions_n((const uint8_t*)Text, Size, t ? &Table : NULL, BadOffsets, 2, Positions, &ErrorIndex);
+        if (Res != CCUNICODE_STRING_ENDED_IN_CHARACTER || ErrorIndex != 1)
+        {
+            fprintf(stderr, "Expected error not encountered for an offset inside a character (line table %d)", t);
+            ccunicode_DestroyLineTable(&Table);
+            return -1;
+        }
+    }
+
+    ccunicode_DestroyLineTable(&Table);
+    return 0;
+}
+
+// Characters of 1 to 4 bytes on a long middle line, so that walking the line again for each position would take minutes
+#define SORTED_LINE_CHARS (1 << 17)
+
+int TestSortedBatch(void)
+{
+    static const char *Characters[] = {"a", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "b", "c"};
+    uint8_t *Utf8Str = (uint8_t*)malloc(4*SORTED_LINE_CHARS + 4);
+    int *Utf8Offsets = (int*)malloc(2*SORTED_LINE_CHARS*sizeof(int));
+    int *Results = (int*)malloc(2*SORTED_LINE_CHARS*sizeof(int));
+    TCCUnicode_TextPosition *Positions = (TCCUnicode_TextPosition*)malloc(2*SORTED_LINE_CHARS*sizeof(TCCUnicode_TextPosition));
+    TCCUnicode_TextPosition *Expected = (TCCUnicode_TextPosition*)malloc(2*SORTED_LINE_CHARS*sizeof(TCCUnicode_TextPosition));
+
+    // Every character of line 1 gets its position, and a column in the middle of a surrogate pair gives the start of the character
+    int Size = 0;
+    int Count = 0;
+    int Column = 0;
+    Utf8Str[Size++] = '\n';
+    for (int i = 0; i < SORTED_LINE_CHARS; ++i)
+    {
+        const char *Character = Characters[(i*7 + i/5) % 6];
+        int Length = (int)strlen(Character);
+        Utf8Offsets[Count] = Size;
+        Expected[Count].line = 1;
+        Expected[Count].utf16_column = Column;
+        ++Count;
+        if (Length == 4)
+        {
+            Utf8Offsets[Count] = Size;
+            Expected[Count].line = 1;
+            Expected[Count].utf16_column = Column + 1;
+            ++Count;
+        }
+        memcpy(Utf8Str + Size, Character, Length);
+        Size += Length;
+        Column += (Length == 4) ? 2 : 1;
+    }
+    Utf8Str[Size++] = '\r';
+    Utf8Str[Size++] = 'z';
+
+    TCCUnicode_LineTable Table;
+    int Res = ccunicode_BuildLineTable_n(&Table, Utf8Str, Size, NULL);
+    if (Res != 3)
+    {
+        fprintf(stderr, "Line table of the sorted batch does not have 3 lines (%d)", Res);
+        if (Res >= 0)
+            ccunicode_DestroyLineTable(&Table);
+        free(Utf8Str);
+        free(Utf8Offsets);
+        free(Results);
+        free(Positions);
+        free(Expected);
+        return -1;
+    }
+
+    Res = 0;
+    for (int t = 0; t < 2 && !Res; ++t)
+    {
+        int ErrorIndex;
+        int Status = ccunicode_Utf16PositionsToUtf8Offsets_n(Utf8Str, Size, t ? &Table : NULL, Expected, Count, Results, &ErrorIndex);
+        if (Status != CCUNICODE_NO_ERROR || memcmp(Results, Utf8Offsets, Count*sizeof(int)))
+        {
+            fprintf(stderr, "Sorted positions to offsets mismatch (error %d at %d, line table %d)", Status, ErrorIndex, t);
+            Res = -1;
+        }
+
+        // The offsets in the middle of a surrogate pair are repeated and give the column of the character
+        Status = ccunicode_Utf8OffsetsToUtf16Positions_n(Utf8Str, Size, t ? &Table : NULL, Utf8Offsets, Count, Positions, &ErrorIndex);
+        for (int i = 0; i < Count && Status == CCUNICODE_NO_ERROR && !Res; ++i)
+        {
+            int Start = (i && Utf8Offsets[i-1] == Utf8Offsets[i]) ? i-1 : i;
+            if (Positions[i].line != 1 || Positions[i].utf16_column != Expected[Start].utf16_column)
+            {
+                fprintf(stderr, "Sorted offsets to positions mismatch at %d (line table %d)", i, t);
+                Res = -1;
+            }
+        }
+        if (Status != CCUNICODE_NO_ERROR)
+        {
+            fprintf(stderr, "Error %d at %d for sorted offsets to positions (line table %d)", Status, ErrorIndex, t);
+            Res = -1;
+        }
+    }
+
+    ccunicode_DestroyLineTable(&Table);
+    free(Utf8Str);
+    free(Utf8Offsets);
+    free(Results);
+    free(Positions);
+    free(Expected);
+    return Res;
+}
+
+int main(int argc, char **argv)
+{
+    int Res = 0;
+
+#define TEST(t) \
+    Res = t(); \
+    if (Res) \
+        return Res;
+
+    TEST(TestPositionsToOffsets)
+    TEST(TestOffsetsToPositions)
+    TEST(TestSortedBatch)
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <stdint.h>
+
+typedef struct
+{
+    int Exit;
+    int Function;
+    int64_t InputUnits;
+    int64_t OutputUnits;
+    int Variant;
+    int Result;
+} TEvent;
+
+#define MAX_EVENTS 64
+static TEvent Events[MAX_EVENTS];
+static int EventCount;
+
+static void RecordEvent(int Exit, int Function, int64_t InputUnits, int64_t OutputUnits, int Variant, int Result)
+{
+    if (EventCount < MAX_EVENTS)
+    {
+        TEvent Event = {Exit, Function, InputUnits, OutputUnits, Variant, Result};
+        Events[EventCount] = Event;
+    }
+    EventCount++;
+}
+
+// The library target is built without tracepoints, so this test builds its own copy of the implementation with hooks
+#define CCUNICODE_TRACE_ENTRY(Function, InputUnits) RecordEvent(0, Function, InputUnits, 0, 0, 0)
+#define CCUNICODE_TRACE_EXIT(Function, InputUnits, OutputUnits, Variant, Result) RecordEvent(1, Function, InputUnits, OutputUnits, Variant, Result)
+#define __CCUNICODE_IMPL__
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Checks that entries and exits are paired and that the outermost call gave the expected values
+static int CheckEvents(int Function, int64_t InputUnits, int64_t OutputUnits, int Variant, int Result)
+{
+    int Stack[MAX_EVENTS];
+    int Depth = 0;
+    if (EventCount < 2 || EventCount > MAX_EVENTS)
+    {
+        fprintf(stderr, "Bad event count: %d", EventCount);
+        return -1;
+    }
+    for (int i = 0; i < EventCount; ++i)
+    {
+        if (!Events[i].Exit)
+        {
+            Stack[Depth++] = Events[i].Function;
+        }
+        else if (!Depth || Stack[--Depth] != Events[i].Function)
+        {
+            fprintf(stderr, "Unpaired exit of %s", ccunicode_GetFunctionName(Events[i].Function));
+            return -1;
+        }
+    }
+
+    const TEvent *Entry = &Events[0];
+    const TEvent *Exit = &Events[EventCount-1];
+    if (Depth || Entry->Function != Function || Entry->InputUnits != InputUnits || Exit->Function != Function || Exit->InputUnits != InputUnits ||
+        Exit->OutputUnits != OutputUnits || Exit->Variant != Variant || Exit->Result != Result)
+    {
+        fprintf(stderr, "Bad events for %s: %s(%lld) gave %lld units, variant %d, result %d", ccunicode_GetFunctionName(Function),
+                ccunicode_GetFunctionName(Exit->Function), (long long)Exit->InputUnits, (long long)Exit->OutputUnits, Exit->Variant, Exit->Result);
+        return -1;
+    }
+    return 0;
+}
+
+int TestConversions(void)
+{
+    uint16_t Utf16[1024];
+    const uint8_t Text[] = "h\xC3\xA9llo";
+
+    EventCount = 0;
+    int Result = ccunicode_Utf8ToUtf16_nm(Text, 6, Utf16, 1024);
+    if (CheckEvents(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NM, 6, 5, CCUNICODE_VARIANT_STACK_BUFFER, Result))
+        return -1;
+
+    // Above CCUNICODE_SMALL_STRING_CODEPOINTS codepoints, the string is decoded one window at a time
+    uint8_t Long[1000];
+    memset(Long, 'a', sizeof(Long));
+    EventCount = 0;
+    Result = ccunicode_Utf8ToUtf16_nma(Long, 1000, Utf16, 1024, NULL);
+    if (CheckEvents(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NMA, 1000, 1000, CCUNICODE_VARIANT_STACK_WINDOWS, Result))
+        return -1;
+
+    // Errors give no output, and the input is rejected before choosing a buffer
+    EventCount = 0;
+    Result = ccunicode_Utf8ToUtf16_nm((const uint8_t*)"ab\xFF", 3, Utf16, 1024);
+    if (CheckEvents(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NM, 3, 0, CCUNICODE_VARIANT_SCALAR, CCUNICODE_INVALID_UTF8_CHARACTER))
+        return -1;
+    if (Result != CCUNICODE_INVALID_UTF8_CHARACTER)
+    {
+        fprintf(stderr, "Bad result: %d", Result);
+        return -1;
+    }
+
+    EventCount = 0;
+    Result = ccunicode_Utf16ToCodepoints_nm(Utf16, 3, (uint32_t*)Long, 3);
+    if (CheckEvents(CCUNICODE_FUNCTION_UTF16_TO_CODEPOINTS_NM, 3, 3, CCUNICODE_VARIANT_SCALAR, Result))
+        return -1;
+
+    EventCount = 0;
+    Result = ccunicode_ValidateUtf8Data(Text, 6, NULL);
+    if (CheckEvents(CCUNICODE_FUNCTION_VALIDATE_UTF8_DATA, 6, 0, CCUNICODE_VARIANT_ASCII_BLOCKS, Result))
+        return -1;
+
+    return 0;
+}
+
+int TestParallel(void)
+{
+    const int Size = 4*CCUNICODE_PARALLEL_MIN_CHUNK;
+    uint8_t *Utf8 = (uint8_t*)malloc(Size);
+    uint16_t *Utf16 = (uint16_t*)malloc((Size+1)*sizeof(uint16_t));
+    memset(Utf8, 'a', Size);
+
+    // Without a run function the tasks run one after the other on this thread
+    TCCUnicode_ThreadPool Pool = {4, NULL, NULL};
+    EventCount = 0;
+    int Res = ccunicode_Utf8ToUtf16_nmp(Utf8, Size, Utf16, Size+1, &Pool);
+    int Error = CheckEvents(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NMP, Size, Size, CCUNICODE_VARIANT_PARALLEL, Res);
+
+    Pool.thread_count = 1;
+    EventCount = 0;
+    Res = ccunicode_Utf8ToUtf16_nmp(Utf8, Size, Utf16, Size+1, &Pool);
+    if (!Error)
+        Error = CheckEvents(CCUNICODE_FUNCTION_UTF8_TO_UTF16_NMP, Size, Size, CCUNICODE_VARIANT_SCALAR, Res);
+
+    free(Utf8);
+    free(Utf16);
+    return Error;
+}
+
+int main(void)
+{
+    int Res;
+#define TEST(t) Res = t(); if (Res) return Res;
+
+    TEST(TestConversions)
+    TEST(TestParallel)
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// The functions without an allocator parameter are checked through the runtime statistics,
+// so this test builds its own copy of the implementation
+#define __CCUNICODE_STATS__
+#define __CCUNICODE_IMPL__
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEXT_SIZE (4*CCUNICODE_PARALLEL_MIN_CHUNK)
+
+static uint8_t Utf8[TEXT_SIZE+1];
+static uint16_t Utf16[TEXT_SIZE+1];
+static uint32_t Codepoints[TEXT_SIZE+1];
+static uint8_t Utf8Out[TEXT_SIZE+1];
+static uint16_t Utf16Out[TEXT_SIZE+1];
+
+typedef struct
+{
+    int count;
+    size_t size;
+    size_t sequence;
+} TReport;
+
+static void ReportBlock(void *UserData, const void *Ptr, size_t Size, size_t Sequence)
+{
+    TReport *Report = (TReport*)UserData;
+    Report->count++;
+    Report->size = Size;
+    Report->sequence = Sequence;
+    (void)Ptr;
+}
+
+int TestTracking(void)
+{
+    TCCUnicode_TrackingAllocator Tracker;
+    int Res = ccunicode_InitTrackingAllocator(&Tracker, NULL);
+    if (Res != CCUNICODE_NO_ERROR)
+    {
+        fprintf(stderr, "Error %d in ccunicode_InitTrackingAllocator", Res);
+        return -1;
+    }
+
+    // The 24 bytes of codepoints are freed once the 12 bytes of output are allocated
+    const uint8_t Text[] = "h\xC3\xA9llo";
+    uint16_t *Utf16Str = NULL;
+    Res = ccunicode_Utf8ToUtf16_na(Text, 6, &Utf16Str, &Tracker.allocator.malloc_ptr);
+    const TCCUnicode_TrackingStats *Stats = &Tracker.stats;
+    if (Res != 5 || Stats->alloc_count != 2 || Stats->free_count != 1 || Stats->outstanding_count != 1 || Stats->current_bytes != 12 ||
+        Stats->peak_bytes != 36 || Stats->total_bytes != 36 || Stats->size_histogram[3] != 1 || Stats->size_histogram[4] != 1)
+    {
+        fprintf(stderr, "Bad tracking statistics: %zu allocations, %zu frees, %zu current bytes, %zu peak bytes",
+                Stats->alloc_count, Stats->free_count, Stats->current_bytes, Stats->peak_bytes);
+        return -1;
+    }
+
+    TReport Report = {0, 0, 0};
+    Res = ccunicode_ReportTrackedBlocks(&Tracker, &ReportBlock, &Report);
+    if (Res != 1 || Report.count != 1 || Report.size != 12 || Report.sequence != 1)
+    {
+        fprintf(stderr, "Bad report of the outstanding blocks: %d blocks, size %zu, sequence %zu", Res, Report.size, Report.sequence);
+        return -1;
+    }
+
+    Tracker.allocator.ctx_free_func(Tracker.allocator.ctx, Utf16Str);
+    if (Stats->outstanding_count != 0 || Stats->current_bytes != 0 || ccunicode_ReportTrackedBlocks(&Tracker, NULL, NULL) != 0)
+    {
+        fprintf(stderr, "Freed block still outstanding");
+        return -1;
+    }
+
+    ccunicode_ResetTrackingStats(&Tracker);
+    if (Stats->alloc_count != 0 || Stats->peak_bytes != 0 || Stats->size_histogram[3] != 0)
+    {
+        fprintf(stderr, "Statistics not reset");
+        return -1;
+    }
+
+    // Leaked blocks are given back by ccunicode_DestroyTrackingAllocator
+    uint32_t *CodepointsStr = NULL;
+    Res = ccunicode_Utf8ToCodepoints_na(Text, 6, &CodepointsStr, &Tracker.allocator.malloc_ptr);
+    if (Res != 5 || Stats->outstanding_count != 1 || Stats->peak_bytes != 24)
+    {
+        fprintf(stderr, "Bad tracking statistics after reset: %zu blocks, %zu peak bytes", Stats->outstanding_count, Stats->peak_bytes);
+        return -1;
+    }
+    ccunicode_DestroyTrackingAllocator(&Tracker);
+    if (Stats->outstanding_count != 0 || Stats->current_bytes != 0 || Stats->alloc_count != 1 || ccunicode_ReportTrackedBlocks(&Tracker, NULL, NULL) != 0)
+    {
+        fprintf(stderr, "Outstanding blocks not given back");
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestNoAllocation(void)
+{
+    TCCUnicode_CorpusGenerator Generator;
+    ccunicode_InitCorpusGenerator(&Generator, 3);
+    Generator.weights[1] = 2;
+    Generator.weights[2] = 3;
+    Generator.weights[3] = 1;
+    Generator.mean_run_length = 4;
+    ccunicode_GenerateUtf8(&Generator, Utf8, TEXT_SIZE);
+    int Utf16Size = ccunicode_Utf8ToUtf16_nm(Utf8, TEXT_SIZE, Utf16, TEXT_SIZE);
+    int CodepointCount = ccunicode_Utf8ToCodepoints_nm(Utf8, TEXT_SIZE, Codepoints, TEXT_SIZE);
+    if (Utf16Size <= CCUNICODE_SMALL_STRING_CODEPOINTS || CodepointCount <= CCUNICODE_SMALL_STRING_CODEPOINTS)
+    {
+        fprintf(stderr, "Bad corpus: %d shorts, %d codepoints", Utf16Size, CodepointCount);
+        return -1;
+    }
+
+    // The ma suffix functions only take an allocator to decode long strings, which they now do by windows on the stack
+    TCCUnicode_TrackingAllocator Tracker;
+    ccunicode_InitTrackingAllocator(&Tracker, NULL);
+    if (ccunicode_Utf8ToUtf16_ma(Utf8, Utf16Out, TEXT_SIZE, &Tracker.allocator.malloc_ptr) != Utf16Size ||
+        ccunicode_Utf8ToUtf16_nma(Utf8, TEXT_SIZE, Utf16Out, TEXT_SIZE, &Tracker.allocator.malloc_ptr) != Utf16Size ||
+        ccunicode_Utf16ToUtf8_ma(Utf16, Utf8Out, TEXT_SIZE, &Tracker.allocator.malloc_ptr) != TEXT_SIZE ||
+        ccunicode_Utf16ToUtf8_nma(Utf16, Utf16Size, Utf8Out, TEXT_SIZE, &Tracker.allocator.malloc_ptr) != TEXT_SIZE)
+    {
+        fprintf(stderr, "Bad conversion with the tracking allocator");
+        return -1;
+    }
+    if (Tracker.stats.alloc_count != 0)
+    {
+        fprintf(stderr, "%zu blocks (%zu bytes) allocated by the ma suffix functions", Tracker.stats.alloc_count, Tracker.stats.total_bytes);
+        return -1;
+    }
+
+    // Every allocation goes through the statistics, including the ones from the standard library
+    ccunicode_ResetStats();
+    TCCUnicode_ThreadPool Pool = {4, NULL, NULL};
+    TCCUnicode_Utf8Span Span = {Utf8, TEXT_SIZE};
+    int64_t Offsets[2];
+    int Results[1];
+    int32_t Utf8Offsets[2] = {0, TEXT_SIZE};
+    int32_t Utf16Offsets[2];
+    int64_t ErrorRow;
+    TCCUnicode_Transcoder Transcoder;
+    int SourceRead = 0;
+    int TargetWritten = 0;
+    ccunicode_InitTranscoder(&Transcoder, CCUNICODE_ENCODING_UTF8, CCUNICODE_ENCODING_UTF16LE, CCUNICODE_ERROR_POLICY_STOP);
+
+    int Res = 0;
+    Res |= ccunicode_Utf8ToCodepoints_m(Utf8, Codepoints, TEXT_SIZE) != CodepointCount;
+    Res |= ccunicode_Utf16ToCodepoints_nm(Utf16, Utf16Size, Codepoints, TEXT_SIZE) != CodepointCount;
+    Res |= ccunicode_CodepointsToUtf8_nm(Codepoints, CodepointCount, Utf8Out, TEXT_SIZE) != TEXT_SIZE;
+    Res |= ccunicode_CodepointsToUtf16_nm(Codepoints, CodepointCount, Utf16Out, TEXT_SIZE) != Utf16Size;
+    Res |= ccunicode_Utf8ToUtf16_m(Utf8, Utf16Out, TEXT_SIZE) != Utf16Size;
+    Res |= ccunicode_Utf8ToUtf16_nm(Utf8, TEXT_SIZE, Utf16Out, TEXT_SIZE) != Utf16Size;
+    Res |= ccunicode_Utf16ToUtf8_m(Utf16, Utf8Out, TEXT_SIZE) != TEXT_SIZE;
+    Res |= ccunicode_Utf16ToUtf8_nm(Utf16, Utf16Size, Utf8Out, TEXT_SIZE) != TEXT_SIZE;
+    Res |= ccunicode_Utf8ToUtf16_nmp(Utf8, TEXT_SIZE, Utf16Out, TEXT_SIZE, &Pool) != Utf16Size;
+    Res |= ccunicode_Utf16ToUtf8_nmp(Utf16, Utf16Size, Utf8Out, TEXT_SIZE, &Pool) != TEXT_SIZE;
+    Res |= ccunicode_Utf8ToUtf16Batch_nmp(&Span, 1, Utf16Out, TEXT_SIZE, Offsets, Results, &Pool) != CCUNICODE_NO_ERROR;
+    Res |= ccunicode_Utf8ToUtf16Column_m(Utf8, Utf8Offsets, 1, Utf16Out, TEXT_SIZE, Utf16Offsets, &ErrorRow) != CCUNICODE_NO_ERROR;
+    Res |= ccunicode_Transcode_m(&Transcoder, Utf8, TEXT_SIZE, 1, (uint8_t*)Utf16Out, sizeof(Utf16Out), &SourceRead, &TargetWritten) != CCUNICODE_NO_ERROR;
+    if (Res)
+    {
+        fprintf(stderr, "Bad conversion without allocator");
+        return -1;
+    }
+
+    TCCUnicode_Stats Stats;
+    ccunicode_GetStats(&Stats, 0);
+    for (int i = 0; i < CCUNICODE_FUNCTION_COUNT; ++i)
+    {
+        if (Stats.functions[i].alloc_count)
+        {
+            fprintf(stderr, "%llu blocks allocated by %s", (unsigned long long)Stats.functions[i].alloc_count, ccunicode_GetFunctionName(i));
+            Res = -1;
+        }
+    }
+    return Res;
+}
+
+int main(void)
+{
+    int Res;
+#define TEST(t) Res = t(); if (Res) return Res;
+
+    TEST(TestTracking)
+    TEST(TestNoAllocation)
+
+    return 0;
+}
@@ -0,0 +1,275 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#if CCUNICODE_HAS_POSIX_FILES
+#include <unistd.h>
+#endif
+
+// Converts the whole input, giving it PieceSize bytes at a time with an output buffer of TargetSize bytes
+static int TranscodeByPieces(TCCUnicode_Transcoder *Transcoder, const uint8_t *Source, int SourceSize, int PieceSize, int TargetSize, uint8_t *Out, int *OutSize)
+{
+    uint8_t Target[64];
+    int Pos = 0;
+    int Available = 0;
+    *OutSize = 0;
+    for (;;)
+    {
+        Available = (Available + PieceSize > SourceSize) ? SourceSize : Available + PieceSize;
+        int IsLast = (Available == SourceSize);
+        int Read = 0;
+        int Written = 0;
+        int Res = ccunicode_Transcode_m(Transcoder, Source + Pos, Available - Pos, IsLast, Target, TargetSize, &Read, &Written);
+        memcpy(Out + *OutSize, Target, Written);
+        *OutSize += Written;
+        Pos += Read;
+        if (Res != CCUNICODE_NO_ERROR)
+            return Res;
+        if (IsLast && Pos == SourceSize)
+            return CCUNICODE_NO_ERROR;
+    }
+}
+
+int TestChunkedStreaming(void)
+{
+    const char Str[] = "Hello \xC3\x89t\xC3\xA9 \xE2\x82\xAC\xF0\x9F\x98\x81 end of the stream \xF0\x90\x80\x80!";
+    const int Size = (int)strlen(Str);
+
+    uint16_t *Expected = NULL;
+    int ExpectedCount = ccunicode_Utf8ToUtf16_n((const uint8_t*)Str, Size, &Expected);
+    if (ExpectedCount < 0)
+    {
+        fprintf(stderr, "Error %d in ccunicode_Utf8ToUtf16_n", ExpectedCount);
+        return -1;
+    }
+
+    for (int PieceSize = 1; PieceSize <= 9; ++PieceSize)
+    {
+        for (int TargetSize = 4; TargetSize <= 13; TargetSize += 3)
+        {
+            TCCUnicode_Transcoder Transcoder;
+            ccunicode_InitTranscoder(&Transcoder, CCUNICODE_ENCODING_UTF8, CCUNICODE_ENCODING_UTF16LE, CCUNICODE_ERROR_POLICY_STOP);
+
+            uint8_t Out[256];
+            int OutSize = 0;
+            int Res = TranscodeByPieces(&Transcoder, (const uint8_t*)Str, Size, PieceSize, TargetSize, Out, &OutSize);
+            int Same = (Res == CCUNICODE_NO_ERROR && OutSize == 2*ExpectedCount);
+            for (int i = 0; Same && i < ExpectedCount; ++i)
+                Same = (Out[2*i] | (Out[2*i+1] << 8)) == Expected[i];
+            if (!Same || Transcoder.source_offset != Size || Transcoder.target_offset != OutSize)
+            {
+                fprintf(stderr, "Streaming by %d bytes into %d bytes differs (error %d, %d bytes)", PieceSize, TargetSize, Res, OutSize);
+                free(Expected);
+                return -1;
+            }
+        }
+    }
+
+    free(Expected);
+    return 0;
+}
+
+int TestRoundTrips(void)
+{
+    const char Str[] = "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x81z";
+    const int Size = (int)strlen(Str);
+    const int Encodings[] = {CCUNICODE_ENCODING_UTF16LE, CCUNICODE_ENCODING_UTF16BE, CCUNICODE_ENCODING_UTF32LE, CCUNICODE_ENCODING_UTF32BE};
+    const int Sizes[] = {12, 12, 20, 20};
+    const uint8_t FirstBytes[][4] = {{'a', 0}, {0, 'a'}, {'a', 0, 0, 0}, {0, 0, 0, 'a'}};
+
+    for (int i = 0; i < 4; ++i)
+    {
+        TCCUnicode_Transcoder Transcoder;
+        uint8_t Encoded[64];
+        uint8_t Decoded[64];
+        int EncodedSize = 0;
+        int DecodedSize = 0;
+
+        ccunicode_InitTranscoder(&Transcoder, CCUNICODE_ENCODING_UTF8, Encodings[i], CCUNICODE_ERROR_POLICY_STOP);
+        int Res = TranscodeByPieces(&Transcoder, (const uint8_t*)Str, Size, 3, 64, Encoded, &EncodedSize);
+        if (Res != CCUNICODE_NO_ERROR || EncodedSize != Sizes[i] || memcmp(Encoded, FirstBytes[i], Sizes[i] / 6))
+        {
+            fprintf(stderr, "Bad encoding %d (error %d, %d bytes)", Encodings[i], Res, EncodedSize);
+            return -1;
+        }
+
+        ccunicode_InitTranscoder(&Transcoder, Encodings[i], CCUNICODE_ENCODING_UTF8, CCUNICODE_ERROR_POLICY_STOP);
+        Res = TranscodeByPieces(&Transcoder, Encoded, EncodedSize, 5, 64, Decoded, &DecodedSize);
+        if (Res != CCUNICODE_NO_ERROR || DecodedSize != Size || memcmp(Decoded, Str, Size))
+        {
+            fprintf(stderr, "Bad decoding %d (error %d, %d bytes)", Encodings[i], Res, DecodedSize);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int TestInvalidInput(void)
+{
+    const uint8_t Utf8Str[] = "ab\xE2\x82" "c\x80\xF0\x9F\x98";
+    const uint8_t Utf16Str[] = {'x', 0, 0x00, 0xDC, 0x00, 0xD8, 'y', 0, 0x3D, 0xD8};
+
+    TCCUnicode_Transcoder Transcoder;
+    uint8_t Out[64];
+    int OutSize = 0;
+
+    ccunicode_InitTranscoder(&Transcoder, CCUNICODE_ENCODING_UTF8, CCUNICODE_ENCODING_UTF8, CCUNICODE_ERROR_POLICY_STOP);
+    int Res = TranscodeByPieces(&Transcoder, Utf8Str, 9, 2, 16, Out, &OutSize);
+    if (Res != CCUNICODE_INVALID_UTF8_CHARACTER || Transcoder.source_offset != 2 || OutSize != 2 || memcmp(Out, "ab", 2))
+    {
+        fprintf(stderr, "Bad stop on invalid UTF8 (error %d at offset %d)", Res, (int)Transcoder.source_offset);
+        return -1;
+    }
+
+    // The truncated character at the end is only an error once the end of the stream is known
+    ccunicode_InitTranscoder(&Transcoder, CCUNICODE_ENCODING_UTF8, CCUNICODE_ENCODING_UTF8, CCUNICODE_ERROR_POLICY_STOP);
+    int Read = 0;
+    int Written = 0;
+    Res = ccunicode_Transcode_m(&Transcoder, Utf8Str + 5, 4, 0, Out, 64, &Read, &Written);
+    if (Res != CCUNICODE_INVALID_UTF8_CHARACTER || Read != 0)
+    {
+        fprintf(stderr, "Bad stop on an invalid extension (error %d, %d bytes read)", Res, Read);
+        return -1;
+    }
+    Res = ccunicode_Transcode_m(&Transcoder, Utf8Str + 6, 3, 0, Out, 64, &Read, &Written);
+    if (Res != CCUNICODE_NO_ERROR || Read != 0 || Written != 0)
+    {
+        fprintf(stderr, "A truncated character is consumed before the end of the stream (error %d)", Res);
+        return -1;
+    }
+    Res = ccunicode_Transcode_m(&Transcoder, Utf8Str + 6, 3, 1, Out, 64, &Read, &Written);
+    if (Res != CCUNICODE_STRING_ENDED_IN_CHARACTER || Read != 0)
+    {
+        fprintf(stderr, "Bad stop on a truncated character (error %d)", Res);
+        return -1;
+    }
+
+    ccunicode_InitTranscoder(&Transcoder, CCUNICODE_ENCODING_UTF8, CCUNICODE_ENCODING_UTF8, CCUNICODE_ERROR_POLICY_REPLACE);
+    Res = TranscodeByPieces(&Transcoder, Utf8Str, 9, 4, 16, Out, &OutSize);
+    const char ExpectedStr[] = "ab\xEF\xBF\xBD" "c\xEF\xBF\xBD\xEF\xBF\xBD";
+    if (Res != CCUNICODE_NO_ERROR || OutSize != (int)strlen(ExpectedStr) || memcmp(Out, ExpectedStr, OutSize) || Transcoder.replacement_count != 3)
+    {
+        fprintf(stderr, "Bad replacement of invalid UTF8 (error %d, %d bytes)", Res, OutSize);
+        return -1;
+    }
+
+    ccunicode_InitTranscoder(&Transcoder, CCUNICODE_ENCODING_UTF16LE, CCUNICODE_ENCODING_UTF16BE, CCUNICODE_ERROR_POLICY_STOP);
+    Res = TranscodeByPieces(&Transcoder, Utf16Str, 10, 3, 16, Out, &OutSize);
+    if (Res != CCUNICODE_SURROGATE_PAIR_INVERSION || Transcoder.source_offset != 2 || OutSize != 2 || Out[0] != 0 || Out[1] != 'x')
+    {
+        fprintf(stderr, "Bad stop on invalid UTF16 (error %d at offset %d)", Res, (int)Transcoder.source_offset);
+        return -1;
+    }
+
+    ccunicode_InitTranscoder(&Transcoder, CCUNICODE_ENCODING_UTF16LE, CCUNICODE_ENCODING_UTF32LE, CCUNICODE_ERROR_POLICY_REPLACE);
+    Res = TranscodeByPieces(&Transcoder, Utf16Str, 10, 1, 16, Out, &OutSize);
+    const uint32_t ExpectedCodepoints[] = {'x', 0xFFFD, 0xFFFD, 'y', 0xFFFD};
+    int Same = (Res == CCUNICODE_NO_ERROR && OutSize == 20 && Transcoder.replacement_count == 3);
+    for (int i = 0; Same && i < 5; ++i)
+        Same = (Out[4*i] | (Out[4*i+1] << 8) | (Out[4*i+2] << 16) | ((uint32_t)Out[4*i+3] << 24)) == ExpectedCodepoints[i];
+    if (!Same)
+    {
+        fprintf(stderr, "Bad replacement of invalid UTF16 (error %d, %d bytes)", Res, OutSize);
+        return -1;
+    }
+
+    const uint8_t Utf32Str[] = {0x00, 0x11, 0x00, 0x00, 'o', 'k'};
+    ccunicode_InitTranscoder(&Transcoder, CCUNICODE_ENCODING_UTF32BE, CCUNICODE_ENCODING_UTF8, CCUNICODE_ERROR_POLICY_STOP);
+    Res = TranscodeByPieces(&Transcoder, Utf32Str, 6, 6, 16, Out, &OutSize);
+    if (Res != CCUNICODE_INVALID_CODEPOINT || Transcoder.source_offset != 0 || OutSize != 0)
+    {
+        fprintf(stderr, "Bad stop on an invalid codepoint (error %d)", Res);
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestTranscodeFile(void)
+{
+#if CCUNICODE_HAS_POSIX_FILES
+    // Larger than the output window, so that the window is written several times
+    const char Pattern[] = "line \xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x81\n";
+    const int PatternSize = (int)strlen(Pattern);
+    const int Repeat = 3*CCUNICODE_TRANSCODE_WINDOW/PatternSize;
+
+    char SourcePath[] = "/tmp/ccunicode_sourceXXXXXX";
+    char TargetPath[] = "/tmp/ccunicode_targetXXXXXX";
+    int SourceFd = mkstemp(SourcePath);
+    int TargetFd = mkstemp(TargetPath);
+    if (SourceFd < 0 || TargetFd < 0)
+    {
+        fprintf(stderr, "Could not create temporary files");
+        return -1;
+    }
+
+    FILE *Source = fdopen(SourceFd, "wb");
+    for (int i = 0; i < Repeat; ++i)
+        fwrite(Pattern, 1, PatternSize, Source);
+    fclose(Source);
+
+    TCCUnicode_Transcoder Transcoder;
+    ccunicode_InitTranscoder(&Transcoder, CCUNICODE_ENCODING_UTF8, CCUNICODE_ENCODING_UTF16BE, CCUNICODE_ERROR_POLICY_STOP);
+    int Res = ccunicode_TranscodeFile(&Transcoder, SourcePath, TargetFd, NULL);
+    close(TargetFd);
+
+    uint16_t *Expected = NULL;
+    int ExpectedCount = ccunicode_Utf8ToUtf16((const uint8_t*)Pattern, &Expected);
+    uint8_t Unit[2];
+    int Same = (Res == CCUNICODE_NO_ERROR && Transcoder.source_offset == (int64_t)Repeat*PatternSize && Transcoder.target_offset == (int64_t)Repeat*ExpectedCount*2);
+    FILE *Target = fopen(TargetPath, "rb");
+    for (int i = 0; Same && i < Repeat*ExpectedCount; ++i)
+        Same = fread(Unit, 1, 2, Target) == 2 && ((Unit[0] << 8) | Unit[1]) == Expected[i % ExpectedCount];
+    Same = Same && fread(Unit, 1, 2, Target) == 0;
+    fclose(Target);
+    free(Expected);
+
+    if (!Same || ccunicode_TranscodeFile(&Transcoder, "/nonexistent/ccunicode", 1, NULL) != CCUNICODE_IO_ERROR)
+    {
+        fprintf(stderr, "Bad file transcoding (error %d, %d bytes)", Res, (int)Transcoder.target_offset);
+        remove(SourcePath);
+        remove(TargetPath);
+        return -1;
+    }
+
+    remove(SourcePath);
+    remove(TargetPath);
+#endif
+    return 0;
+}
+
+int main(void)
+{
+    int Res;
+#define TEST(t) Res = t(); if (Res) return Res;
+
+    TEST(TestChunkedStreaming)
+    TEST(TestRoundTrips)
+    TEST(TestInvalidInput)
+    TEST(TestTranscodeFile)
+
+    return 0;
+}
@@ -25,6 +25,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+typedef struct
+{
+    int malloc_count;
+    int free_count;
+} TCountingContext;
+
+static void *CountingMalloc(void *Ctx, size_t Size)
+{
+    ((TCountingContext*)Ctx)->malloc_count++;
+    return malloc(Size);
+}
+
+static void CountingFree(void *Ctx, void *Ptr)
+{
+    ((TCountingContext*)Ctx)->free_count++;
+    free(Ptr);
+}
+
 int TestEmptyString(void)
 {
     const char EmptyStr[] = "";
@@ -112,6 +130,91 @@ int TestTrueUtf16String(void)
     return 0;
 }
 
+int TestSmallStringScratch(void)
+{
+    TCountingContext Ctx = {0, 0};
+    TCCUnicode_CtxMallocPtr Alloc;
+    ccunicode_InitCtxMallocPtr(&Alloc, &Ctx, &CountingMalloc, &CountingFree);
+
+    // 2 shorts and 4 bytes per character
+    uint16_t WStr[2*CCUNICODE_SMALL_STRING_CODEPOINTS+3];
+    uint8_t Str[4*CCUNICODE_SMALL_STRING_CODEPOINTS+5];
+    for (int i = 0; i < CCUNICODE_SMALL_STRING_CODEPOINTS+1; ++i)
+    {
+        WStr[2*i] = 0xD83D;
+        WStr[2*i+1] = 0xDE01;
+    }
+    WStr[2*CCUNICODE_SMALL_STRING_CODEPOINTS+2] = 0;
+
+    int Count = ccunicode_Utf16ToUtf8_nma(WStr, 2*CCUNICODE_SMALL_STRING_CODEPOINTS, Str, 4*CCUNICODE_SMALL_STRING_CODEPOINTS+4, &Alloc.malloc_ptr);
+    if (Count != 4*CCUNICODE_SMALL_STRING_CODEPOINTS || Str[0] != 0xF0 || Str[Count-1] != 0x81 || Str[Count] != 0 || Ctx.malloc_count != 0)
+    {
+        fprintf(stderr, "Short string not converted on the stack (%d bytes, %d allocations)", Count, Ctx.malloc_count);
+        return -1;
+    }
+
+    // Longer strings are converted by windows, which must not cut the surrogate pairs
+    Count = ccunicode_Utf16ToUtf8_ma(WStr, Str, 4*CCUNICODE_SMALL_STRING_CODEPOINTS+4, &Alloc.malloc_ptr);
+    if (Count != 4*CCUNICODE_SMALL_STRING_CODEPOINTS+4 || Str[Count-1] != 0x81 || Str[Count] != 0 || Ctx.malloc_count != 0)
+    {
+        fprintf(stderr, "Long string not converted on the stack (%d bytes, %d allocations)", Count, Ctx.malloc_count);
+        return -1;
+    }
+    Count = ccunicode_Utf16ToUtf8_nma(WStr+1, 2*CCUNICODE_SMALL_STRING_CODEPOINTS, Str, 4*CCUNICODE_SMALL_STRING_CODEPOINTS+4, &Alloc.malloc_ptr);
+    if (Count != CCUNICODE_SURROGATE_PAIR_INVERSION)
+    {
+        fprintf(stderr, "Unexpected result for a string starting with a low surrogate (%d)", Count);
+        return -1;
+    }
+    uint16_t Shifted[2*CCUNICODE_SMALL_STRING_CODEPOINTS+4];
+    Shifted[0] = 'a';
+    memcpy(Shifted+1, WStr, sizeof(WStr));
+    Count = ccunicode_Utf16ToUtf8_nma(Shifted, 2*CCUNICODE_SMALL_STRING_CODEPOINTS+1, Str, 4*CCUNICODE_SMALL_STRING_CODEPOINTS+4, &Alloc.malloc_ptr);
+    if (Count != 4*CCUNICODE_SMALL_STRING_CODEPOINTS+1 || Str[0] != 'a' || Str[1] != 0xF0 || Str[Count-1] != 0x81 || Ctx.malloc_count != 0)
+    {
+        fprintf(stderr, "Surrogate pair cut between two windows (%d bytes)", Count);
+        return -1;
+    }
+    Count = ccunicode_Utf16ToUtf8_nma(Shifted, 2*CCUNICODE_SMALL_STRING_CODEPOINTS+1, Str, 4*CCUNICODE_SMALL_STRING_CODEPOINTS, &Alloc.malloc_ptr);
+    if (Count != CCUNICODE_BUFFER_TOO_SMALL)
+    {
+        fprintf(stderr, "Unexpected result for a too small buffer (%d)", Count);
+        return -1;
+    }
+
+    WStr[1] = 0xD83D;
+    Count = ccunicode_Utf16ToUtf8_ma(WStr, Str, 4*CCUNICODE_SMALL_STRING_CODEPOINTS+4, &Alloc.malloc_ptr);
+    if (Count != CCUNICODE_INVALID_UTF16_CHARACTER)
+    {
+        fprintf(stderr, "Unexpected result for an invalid string (%d)", Count);
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestNullBeforeMaxSize(void)
+{
+    // The string ends in its last window, long before the maximum size: nothing after its null character may be read
+    const int Length = CCUNICODE_SMALL_STRING_CODEPOINTS + 44;
+    uint16_t *WStr = (uint16_t*)malloc((Length+1)*sizeof(uint16_t));
+    uint8_t *Str = (uint8_t*)malloc((Length+1)*sizeof(uint8_t));
+    for (int i = 0; i < Length; ++i)
+        WStr[i] = 'a';
+    WStr[Length] = 0;
+
+    int Count = ccunicode_Utf16ToUtf8_nma(WStr, 2*Length, Str, Length+1, NULL);
+    int Res = 0;
+    if (Count != Length || Str[Length-1] != 'a' || Str[Length] != 0)
+    {
+        fprintf(stderr, "UTF16 string shorter than its maximum size: returned %d", Count);
+        Res = -1;
+    }
+    free(WStr);
+    free(Str);
+    return Res;
+}
+
 int main(int argc, char **argv)
 {
     int Res = 0;
@@ -124,6 +227,8 @@ int main(int argc, char **argv)
     TEST(TestEmptyString)
     TEST(TestHelloWorldString)
     TEST(TestTrueUtf16String)
+    TEST(TestSmallStringScratch)
+    TEST(TestNullBeforeMaxSize)
 
     return 0;
 }
@@ -112,6 +112,177 @@ int TestTrueUtf8String(void)
     return 0;
 }
 
+typedef struct
+{
+    int malloc_count;
+    int free_count;
+} TCountingContext;
+
+static void *CountingMalloc(void *Ctx, size_t Size)
+{
+    ((TCountingContext*)Ctx)->malloc_count++;
+    return malloc(Size);
+}
+
+static void CountingFree(void *Ctx, void *Ptr)
+{
+    ((TCountingContext*)Ctx)->free_count++;
+    free(Ptr);
+}
+
+int TestContextAllocator(void)
+{
+    const char TrueUtf8Str[] = "\xF0\x9F\x98\x81 \xE2\x82\xAC";
+    const uint16_t TrueUtf8WStr[] = {0xD83D, 0xDE01, ' ', 0x20AC, 0};
+
+    TCountingContext Ctx = {0, 0};
+    TCCUnicode_CtxMallocPtr Alloc;
+    ccunicode_InitCtxMallocPtr(&Alloc, &Ctx, &CountingMalloc, &CountingFree);
+
+    uint16_t *WStr;
+    int Count = ccunicode_Utf8ToUtf16_a((const uint8_t*)TrueUtf8Str, &WStr, &Alloc.malloc_ptr);
+    if (Count < 0)
+    {
+        fprintf(stderr, "Error %d in ccunicode_Utf8ToUtf16_a", Count);
+        return -1;
+    }
+    if (Count+1 != sizeof(TrueUtf8WStr)/sizeof(*TrueUtf8WStr) || memcmp(TrueUtf8WStr, WStr, (Count+1)*sizeof(*WStr)))
+    {
+        fprintf(stderr, "Mismatch for wide chars with context allocator");
+        CountingFree(&Ctx, WStr);
+        return -1;
+    }
+    CountingFree(&Ctx, WStr);
+
+    if (Ctx.malloc_count == 0 || Ctx.malloc_count != Ctx.free_count)
+    {
+        fprintf(stderr, "Context allocator not used consistently (%d mallocs, %d frees)", Ctx.malloc_count, Ctx.free_count);
+        return -1;
+    }
+
+    Alloc.ctx_free_func = NULL;
+    Count = ccunicode_Utf8ToUtf16_a((const uint8_t*)TrueUtf8Str, &WStr, &Alloc.malloc_ptr);
+    if (Count != CCUNICODE_INVALID_ALLOCATOR)
+    {
+        fprintf(stderr, "Incomplete context allocator accepted (%d)", Count);
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestSmallStringScratch(void)
+{
+    TCountingContext Ctx = {0, 0};
+    TCCUnicode_CtxMallocPtr Alloc;
+    ccunicode_InitCtxMallocPtr(&Alloc, &Ctx, &CountingMalloc, &CountingFree);
+
+    // 2 bytes and 1 short per character
+    uint8_t Str[2*CCUNICODE_SMALL_STRING_CODEPOINTS+3];
+    uint16_t WStr[CCUNICODE_SMALL_STRING_CODEPOINTS+2];
+    for (int i = 0; i < CCUNICODE_SMALL_STRING_CODEPOINTS+1; ++i)
+    {
+        Str[2*i] = 0xC3;
+        Str[2*i+1] = 0xA9;
+    }
+    Str[2*CCUNICODE_SMALL_STRING_CODEPOINTS+2] = 0;
+
+    int Count = ccunicode_Utf8ToUtf16_nma(Str, 2*CCUNICODE_SMALL_STRING_CODEPOINTS, WStr, CCUNICODE_SMALL_STRING_CODEPOINTS+1, &Alloc.malloc_ptr);
+    if (Count != CCUNICODE_SMALL_STRING_CODEPOINTS || WStr[0] != 0xE9 || WStr[Count-1] != 0xE9 || WStr[Count] != 0 || Ctx.malloc_count != 0)
+    {
+        fprintf(stderr, "Short string not converted on the stack (%d shorts, %d allocations)", Count, Ctx.malloc_count);
+        return -1;
+    }
+
+    // Longer strings are converted by windows, which must not cut the characters
+    Count = ccunicode_Utf8ToUtf16_ma(Str, WStr, CCUNICODE_SMALL_STRING_CODEPOINTS+1, &Alloc.malloc_ptr);
+    if (Count != CCUNICODE_SMALL_STRING_CODEPOINTS+1 || WStr[Count-1] != 0xE9 || WStr[Count] != 0 || Ctx.malloc_count != 0)
+    {
+        fprintf(stderr, "Long string not converted on the stack (%d shorts, %d allocations)", Count, Ctx.malloc_count);
+        return -1;
+    }
+    Str[0] = 'a';
+    Count = ccunicode_Utf8ToUtf16_nma(Str, 2*CCUNICODE_SMALL_STRING_CODEPOINTS+1, WStr, CCUNICODE_SMALL_STRING_CODEPOINTS+1, &Alloc.malloc_ptr);
+    if (Count != CCUNICODE_INVALID_UTF8_CHARACTER)
+    {
+        fprintf(stderr, "Unexpected result for a stray continuation byte (%d)", Count);
+        return -1;
+    }
+    Count = ccunicode_Utf8ToUtf16_nma(Str+1, 2*CCUNICODE_SMALL_STRING_CODEPOINTS+1, WStr, CCUNICODE_SMALL_STRING_CODEPOINTS+1, &Alloc.malloc_ptr);
+    if (Count != CCUNICODE_INVALID_UTF8_CHARACTER)
+    {
+        fprintf(stderr, "Unexpected result for a string starting with a continuation byte (%d)", Count);
+        return -1;
+    }
+    Str[1] = 'b';
+    Count = ccunicode_Utf8ToUtf16_nma(Str+1, 2*CCUNICODE_SMALL_STRING_CODEPOINTS+1, WStr, CCUNICODE_SMALL_STRING_CODEPOINTS+1, &Alloc.malloc_ptr);
+    if (Count != CCUNICODE_SMALL_STRING_CODEPOINTS+1 || WStr[0] != 'b' || WStr[1] != 0xE9 || WStr[Count-1] != 0xE9 || Ctx.malloc_count != 0)
+    {
+        fprintf(stderr, "Character cut between two windows (%d shorts)", Count);
+        return -1;
+    }
+    Count = ccunicode_Utf8ToUtf16_nma(Str+1, 2*CCUNICODE_SMALL_STRING_CODEPOINTS+1, WStr, CCUNICODE_SMALL_STRING_CODEPOINTS, &Alloc.malloc_ptr);
+    if (Count != CCUNICODE_BUFFER_TOO_SMALL)
+    {
+        fprintf(stderr, "Unexpected result for a too small buffer (%d)", Count);
+        return -1;
+    }
+    Str[0] = 0xC3;
+    Str[1] = 0xA9;
+
+    // An overlong null character ends the output but the input after it is still validated
+    Str[0] = 0xC0;
+    Str[1] = 0x80;
+    Count = ccunicode_Utf8ToUtf16_nma(Str, 2*CCUNICODE_SMALL_STRING_CODEPOINTS+2, WStr, CCUNICODE_SMALL_STRING_CODEPOINTS+1, &Alloc.malloc_ptr);
+    if (Count != 0 || WStr[0] != 0)
+    {
+        fprintf(stderr, "Unexpected result for a long string starting with an overlong null (%d)", Count);
+        return -1;
+    }
+    Str[2*CCUNICODE_SMALL_STRING_CODEPOINTS] = 0xFF;
+    Count = ccunicode_Utf8ToUtf16_nma(Str, 2*CCUNICODE_SMALL_STRING_CODEPOINTS+2, WStr, CCUNICODE_SMALL_STRING_CODEPOINTS+1, &Alloc.malloc_ptr);
+    if (Count != CCUNICODE_INVALID_UTF8_CHARACTER)
+    {
+        fprintf(stderr, "Invalid byte after an overlong null not reported (%d)", Count);
+        return -1;
+    }
+    Str[0] = 0xC3;
+    Str[1] = 0xA9;
+    Str[2*CCUNICODE_SMALL_STRING_CODEPOINTS] = 0xC3;
+
+    Str[2*CCUNICODE_SMALL_STRING_CODEPOINTS+1] = 0;
+    Count = ccunicode_Utf8ToUtf16_ma(Str, WStr, CCUNICODE_SMALL_STRING_CODEPOINTS+1, &Alloc.malloc_ptr);
+    if (Count != CCUNICODE_STRING_ENDED_IN_CHARACTER)
+    {
+        fprintf(stderr, "Unexpected result for a string ending in a character (%d)", Count);
+        return -1;
+    }
+
+    return 0;
+}
+
+int TestNullBeforeMaxSize(void)
+{
+    // The string ends in its last window, long before the maximum size: nothing after its null character may be read
+    const int Length = CCUNICODE_SMALL_STRING_CODEPOINTS + 44;
+    uint8_t *Str = (uint8_t*)malloc((Length+1)*sizeof(uint8_t));
+    uint16_t *WStr = (uint16_t*)malloc((Length+1)*sizeof(uint16_t));
+    for (int i = 0; i < Length; ++i)
+        Str[i] = 'a';
+    Str[Length] = 0;
+
+    int Count = ccunicode_Utf8ToUtf16_nma(Str, 2*Length, WStr, Length+1, NULL);
+    int Res = 0;
+    if (Count != Length || WStr[Length-1] != 'a' || WStr[Length] != 0)
+    {
+        fprintf(stderr, "UTF8 string shorter than its maximum size: returned %d", Count);
+        Res = -1;
+    }
+    free(Str);
+    free(WStr);
+    return Res;
+}
+
 int main(int argc, char **argv)
 {
     int Res = 0;
@@ -124,6 +295,9 @@ int main(int argc, char **argv)
     TEST(TestEmptyString)
     TEST(TestHelloWorldString)
     TEST(TestTrueUtf8String)
+    TEST(TestContextAllocator)
+    TEST(TestSmallStringScratch)
+    TEST(TestNullBeforeMaxSize)
 
     return 0;
 }
@@ -0,0 +1,71 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "../../include/ccunicode.h"
+#include <stdio.h>
+
+int TestValidateUtf8Data(void)
+{
+    // Validating split parts gives the same result as validating the whole buffer
+    const uint8_t Data[] = "0123456789abcdef\xC3\xA9\0\xE2\x82\xAC\xF0\x9F\x98\x81ghijklmnopqrstuv\xE2\x82zz";
+    const int64_t Size = sizeof(Data) - 1;
+    int64_t ErrorOffset = 0;
+    int Res = ccunicode_ValidateUtf8Data(Data, Size, &ErrorOffset);
+    if (Res != CCUNICODE_INVALID_UTF8_CHARACTER || ErrorOffset != 42)
+    {
+        fprintf(stderr, "Invalid data: returned %d at offset %lld", Res, (long long)ErrorOffset);
+        return -1;
+    }
+
+    Res = ccunicode_ValidateUtf8Data(Data, 42, &ErrorOffset);
+    int FirstRes = ccunicode_ValidateUtf8Data(Data, 19, NULL);
+    int SecondRes = ccunicode_ValidateUtf8Data(Data + 19, 23, NULL);
+    if (Res != CCUNICODE_NO_ERROR || ErrorOffset != -1 || FirstRes != CCUNICODE_NO_ERROR || SecondRes != CCUNICODE_NO_ERROR)
+    {
+        fprintf(stderr, "Valid data: returned %d, %d and %d", Res, FirstRes, SecondRes);
+        return -1;
+    }
+
+    Res = ccunicode_ValidateUtf8Data(Data, 44, &ErrorOffset);
+    int SurrogateRes = ccunicode_ValidateUtf8Data((const uint8_t*)"ab\xED\xA0\x80", 5, &ErrorOffset);
+    if (Res != CCUNICODE_STRING_ENDED_IN_CHARACTER || SurrogateRes != CCUNICODE_INVALID_CODEPOINT || ErrorOffset != 2)
+    {
+        fprintf(stderr, "Truncated data: returned %d, surrogate: returned %d", Res, SurrogateRes);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int Res = 0;
+
+#define TEST(t) \
+    Res = t(); \
+    if (Res) \
+        return Res;
+
+    TEST(TestValidateUtf8Data)
+
+    return 0;
+}
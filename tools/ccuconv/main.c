@@ -0,0 +1,285 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// ccuconv: converts text between UTF8, UTF16 and UTF32 from files or the standard input to the standard output or a file.
+// The input is read by large blocks given to ccunicode_Transcode_m, so the memory used does not depend on the size of the input.
+
+#include "../../include/ccunicode.h"
+#include <ctype.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+#ifndef CCUCONV_BLOCK_SIZE
+#   define CCUCONV_BLOCK_SIZE (1 << 20)
+#endif
+
+typedef struct
+{
+    const char *name;
+    int encoding;
+} TEncodingName;
+
+// UTF-16 and UTF-32 without a byte order are little endian
+static const TEncodingName EncodingNames[] =
+{
+    {"UTF-8", CCUNICODE_ENCODING_UTF8},
+    {"UTF8", CCUNICODE_ENCODING_UTF8},
+    {"UTF-16LE", CCUNICODE_ENCODING_UTF16LE},
+    {"UTF16LE", CCUNICODE_ENCODING_UTF16LE},
+    {"UTF-16", CCUNICODE_ENCODING_UTF16LE},
+    {"UTF16", CCUNICODE_ENCODING_UTF16LE},
+    {"UTF-16BE", CCUNICODE_ENCODING_UTF16BE},
+    {"UTF16BE", CCUNICODE_ENCODING_UTF16BE},
+    {"UTF-32LE", CCUNICODE_ENCODING_UTF32LE},
+    {"UTF32LE", CCUNICODE_ENCODING_UTF32LE},
+    {"UTF-32", CCUNICODE_ENCODING_UTF32LE},
+    {"UTF32", CCUNICODE_ENCODING_UTF32LE},
+    {"UTF-32BE", CCUNICODE_ENCODING_UTF32BE},
+    {"UTF32BE", CCUNICODE_ENCODING_UTF32BE}
+};
+
+static void PrintUsage(FILE *Out)
+{
+    fprintf(Out,
+            "Usage: ccuconv [-f ENCODING] [-t ENCODING] [-e stop|replace] [-o OUTPUT] [FILE...]\n"
+            "Converts each FILE (or the standard input) and writes the result to OUTPUT (or the standard output).\n"
+            "\n"
+            "  -f ENCODING  encoding of the input (default UTF-8)\n"
+            "  -t ENCODING  encoding of the output (default UTF-8)\n"
+            "  -e POLICY    stop at the first invalid character (default), or replace invalid characters by U+FFFD\n"
+            "  -c           same as -e replace\n"
+            "  -o OUTPUT    output file\n"
+            "  -l           list the encodings (UTF-16 and UTF-32 are little endian, no byte order mark is read or written)\n"
+            "  -h           show this help\n"
+            "\n"
+            "Exit status: 0 on success, 1 on invalid input, 2 on usage or I/O error.\n");
+}
+
+static int ParseEncoding(const char *Name)
+{
+    for (size_t i = 0; i < sizeof(EncodingNames)/sizeof(*EncodingNames); ++i)
+    {
+        const char *Expected = EncodingNames[i].name;
+        size_t j = 0;
+        while (Name[j] && Expected[j] && toupper((unsigned char)Name[j]) == Expected[j])
+            ++j;
+        if (!Name[j] && !Expected[j])
+            return EncodingNames[i].encoding;
+    }
+    return -1;
+}
+
+// Converts one input, returns 0 on success, 1 on invalid input and 2 on I/O error
+static int ConvertStream(TCCUnicode_Transcoder *Transcoder, FILE *In, const char *InName, FILE *Out, uint8_t *Source, uint8_t *Target)
+{
+    int Pending = 0;
+    for (;;)
+    {
+        size_t Read = fread(Source + Pending, 1, CCUCONV_BLOCK_SIZE, In);
+        if (ferror(In))
+        {
+            fprintf(stderr, "ccuconv: %s: read error\n", InName);
+            return 2;
+        }
+        int IsLast = feof(In) != 0;
+        int Available = Pending + (int)Read;
+
+        int Pos = 0;
+        for (;;)
+        {
+            int SourceRead = 0;
+            int TargetWritten = 0;
+            int Res = ccunicode_Transcode_m(Transcoder, Source + Pos, Available - Pos, IsLast, Target, CCUCONV_BLOCK_SIZE, &SourceRead, &TargetWritten);
+            if (TargetWritten > 0 && fwrite(Target, 1, TargetWritten, Out) != (size_t)TargetWritten)
+            {
+                fprintf(stderr, "ccuconv: write error\n");
+                return 2;
+            }
+            Pos += SourceRead;
+            if (Res != CCUNICODE_NO_ERROR)
+            {
+                fprintf(stderr, "ccuconv: %s: invalid input at byte %lld (error %d)\n", InName, (long long)Transcoder->source_offset, Res);
+                return 1;
+            }
+            // The conversion stops either on a full output or on a character cut by the end of the block
+            if (Pos == Available || TargetWritten == 0)
+                break;
+        }
+
+        if (IsLast)
+            return 0;
+        Pending = Available - Pos;
+        memmove(Source, Source + Pos, Pending);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int SourceEncoding = CCUNICODE_ENCODING_UTF8;
+    int TargetEncoding = CCUNICODE_ENCODING_UTF8;
+    int ErrorPolicy = CCUNICODE_ERROR_POLICY_STOP;
+    const char *OutputPath = NULL;
+    int FirstFile = argc;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *Arg = argv[i];
+        if (Arg[0] != '-' || !Arg[1])
+        {
+            FirstFile = i;
+            break;
+        }
+        if (!strcmp(Arg, "--"))
+        {
+            FirstFile = i + 1;
+            break;
+        }
+
+        if (!strcmp(Arg, "-h") || !strcmp(Arg, "--help"))
+        {
+            PrintUsage(stdout);
+            return 0;
+        }
+        else if (!strcmp(Arg, "-l"))
+        {
+            for (size_t j = 0; j < sizeof(EncodingNames)/sizeof(*EncodingNames); ++j)
+                printf("%s\n", EncodingNames[j].name);
+            return 0;
+        }
+        else if (!strcmp(Arg, "-c"))
+        {
+            ErrorPolicy = CCUNICODE_ERROR_POLICY_REPLACE;
+        }
+        else if ((!strcmp(Arg, "-f") || !strcmp(Arg, "-t") || !strcmp(Arg, "-e") || !strcmp(Arg, "-o")) && i + 1 < argc)
+        {
+            const char *Value = argv[++i];
+            if (Arg[1] == 'o')
+            {
+                OutputPath = Value;
+            }
+            else if (Arg[1] == 'e')
+            {
+                if (!strcmp(Value, "stop"))
+                    ErrorPolicy = CCUNICODE_ERROR_POLICY_STOP;
+                else if (!strcmp(Value, "replace"))
+                    ErrorPolicy = CCUNICODE_ERROR_POLICY_REPLACE;
+                else
+                {
+                    fprintf(stderr, "ccuconv: unknown error policy '%s'\n", Value);
+                    return 2;
+                }
+            }
+            else
+            {
+                int Encoding = ParseEncoding(Value);
+                if (Encoding < 0)
+                {
+                    fprintf(stderr, "ccuconv: unknown encoding '%s' (see ccuconv -l)\n", Value);
+                    return 2;
+                }
+                if (Arg[1] == 'f')
+                    SourceEncoding = Encoding;
+                else
+                    TargetEncoding = Encoding;
+            }
+        }
+        else
+        {
+            PrintUsage(stderr);
+            return 2;
+        }
+    }
+
+    FILE *Out = stdout;
+    if (OutputPath)
+    {
+        Out = fopen(OutputPath, "wb");
+        if (!Out)
+        {
+            fprintf(stderr, "ccuconv: cannot open %s\n", OutputPath);
+            return 2;
+        }
+    }
+#ifdef _WIN32
+    else
+    {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+
+    // The source block keeps room for a character cut by the end of the previous block
+    uint8_t *Source = (uint8_t*)malloc(CCUCONV_BLOCK_SIZE + 4);
+    uint8_t *Target = (uint8_t*)malloc(CCUCONV_BLOCK_SIZE);
+    if (!Source || !Target)
+    {
+        fprintf(stderr, "ccuconv: out of memory\n");
+        return 2;
+    }
+
+    int Status = 0;
+    // Without file arguments, the standard input is converted
+    int InputCount = (FirstFile < argc) ? argc - FirstFile : 1;
+    for (int i = 0; i < InputCount && !Status; ++i)
+    {
+        TCCUnicode_Transcoder Transcoder;
+        ccunicode_InitTranscoder(&Transcoder, SourceEncoding, TargetEncoding, ErrorPolicy);
+
+        const char *InName = (FirstFile < argc) ? argv[FirstFile + i] : "-";
+        FILE *In = stdin;
+        if (strcmp(InName, "-"))
+        {
+            In = fopen(InName, "rb");
+            if (!In)
+            {
+                fprintf(stderr, "ccuconv: cannot open %s\n", InName);
+                Status = 2;
+                break;
+            }
+        }
+#ifdef _WIN32
+        else
+        {
+            _setmode(_fileno(stdin), _O_BINARY);
+        }
+#endif
+
+        Status = ConvertStream(&Transcoder, In, InName, Out, Source, Target);
+        if (In != stdin)
+            fclose(In);
+    }
+
+    if (fflush(Out) != 0 && !Status)
+    {
+        fprintf(stderr, "ccuconv: write error\n");
+        Status = 2;
+    }
+    if (Out != stdout)
+        fclose(Out);
+    free(Source);
+    free(Target);
+    return Status;
+}
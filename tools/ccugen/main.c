@@ -0,0 +1,201 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// ccugen: writes synthetic text made by a TCCUnicode_CorpusGenerator, for benchmarks and fuzzers.
+// The output is generated by blocks, so any size can be written with constant memory.
+
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// Number of code units generated at once
+#define CCUGEN_BLOCK_SIZE (1 << 18)
+
+static void PrintUsage(FILE *Out)
+{
+    fprintf(Out,
+            "Usage: ccugen [options]\n"
+            "Writes SIZE code units of synthetic text to the standard output or to OUTPUT.\n"
+            "\n"
+            "  -f FORMAT      utf8 (default), utf16le, utf16be or codepoints (32 bits little endian)\n"
+            "  -s SIZE        number of code units to write (default 1048576)\n"
+            "  -w W1,W2,W3,W4 relative frequencies of the 1, 2, 3 and 4 bytes characters (default 1,0,0,0)\n"
+            "  -r LENGTH      mean run length of characters of the same length (default 1)\n"
+            "  -e RATE        invalid characters per million characters (default 0)\n"
+            "  -n RATE        null characters per million characters (default 0)\n"
+            "  -S SEED        seed of the generator (default 1)\n"
+            "  -o OUTPUT      output file\n"
+            "  -h             show this help\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *Format = "utf8";
+    const char *OutputPath = NULL;
+    long long Size = 1 << 20;
+    uint32_t Seed = 1;
+    int Weights[4] = {1, 0, 0, 0};
+    int MeanRunLength = 1;
+    int ErrorRate = 0;
+    int NullRate = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *Arg = argv[i];
+        if (!strcmp(Arg, "-h") || !strcmp(Arg, "--help"))
+        {
+            PrintUsage(stdout);
+            return 0;
+        }
+        if (Arg[0] != '-' || !Arg[1] || Arg[2] || i + 1 == argc)
+        {
+            PrintUsage(stderr);
+            return 2;
+        }
+
+        const char *Value = argv[++i];
+        switch (Arg[1])
+        {
+        case 'f': Format = Value; break;
+        case 's': Size = atoll(Value); break;
+        case 'r': MeanRunLength = atoi(Value); break;
+        case 'e': ErrorRate = atoi(Value); break;
+        case 'n': NullRate = atoi(Value); break;
+        case 'S': Seed = (uint32_t)strtoul(Value, NULL, 0); break;
+        case 'o': OutputPath = Value; break;
+        case 'w':
+            if (sscanf(Value, "%d,%d,%d,%d", &Weights[0], &Weights[1], &Weights[2], &Weights[3]) != 4)
+            {
+                fprintf(stderr, "ccugen: expected four weights, got '%s'\n", Value);
+                return 2;
+            }
+            break;
+        default:
+            PrintUsage(stderr);
+            return 2;
+        }
+    }
+
+    int Unit = !strcmp(Format, "utf8") ? 1 : !strcmp(Format, "utf16le") ? 2 : !strcmp(Format, "utf16be") ? -2 : !strcmp(Format, "codepoints") ? 4 : 0;
+    if (!Unit || Size < 0)
+    {
+        fprintf(stderr, "ccugen: bad format or size\n");
+        return 2;
+    }
+
+    TCCUnicode_CorpusGenerator Generator;
+    ccunicode_InitCorpusGenerator(&Generator, Seed);
+    memcpy(Generator.weights, Weights, sizeof(Weights));
+    Generator.mean_run_length = MeanRunLength;
+    Generator.errors_per_million = ErrorRate;
+    Generator.nulls_per_million = NullRate;
+
+    FILE *Out = stdout;
+    if (OutputPath)
+    {
+        Out = fopen(OutputPath, "wb");
+        if (!Out)
+        {
+            fprintf(stderr, "ccugen: cannot open %s\n", OutputPath);
+            return 2;
+        }
+    }
+#ifdef _WIN32
+    else
+    {
+        _setmode(_fileno(stdout), _O_BINARY);
+    }
+#endif
+
+    uint32_t *Block = (uint32_t*)malloc(CCUGEN_BLOCK_SIZE * sizeof(uint32_t));
+    uint8_t *Bytes = (uint8_t*)malloc(CCUGEN_BLOCK_SIZE * sizeof(uint32_t));
+    if (!Block || !Bytes)
+    {
+        fprintf(stderr, "ccugen: out of memory\n");
+        return 2;
+    }
+
+    int Status = 0;
+    while (Size > 0 && !Status)
+    {
+        int Count = (Size > CCUGEN_BLOCK_SIZE) ? CCUGEN_BLOCK_SIZE : (int)Size;
+        int Res;
+        size_t ByteCount = 0;
+        if (Unit == 1)
+        {
+            Res = ccunicode_GenerateUtf8(&Generator, Bytes, Count);
+            ByteCount = (size_t)Count;
+        }
+        else if (Unit == 4)
+        {
+            Res = ccunicode_GenerateCodepoints(&Generator, Block, Count);
+            for (int i = 0; i < Count; ++i)
+            {
+                Bytes[4*i] = (uint8_t)Block[i];
+                Bytes[4*i+1] = (uint8_t)(Block[i] >> 8);
+                Bytes[4*i+2] = (uint8_t)(Block[i] >> 16);
+                Bytes[4*i+3] = (uint8_t)(Block[i] >> 24);
+            }
+            ByteCount = 4*(size_t)Count;
+        }
+        else
+        {
+            uint16_t *Units = (uint16_t*)Block;
+            Res = ccunicode_GenerateUtf16(&Generator, Units, Count);
+            int High = (Unit < 0) ? 0 : 1;
+            for (int i = 0; i < Count; ++i)
+            {
+                Bytes[2*i+High] = (uint8_t)(Units[i] >> 8);
+                Bytes[2*i+1-High] = (uint8_t)Units[i];
+            }
+            ByteCount = 2*(size_t)Count;
+        }
+
+        if (Res < 0)
+        {
+            fprintf(stderr, "ccugen: bad generator parameters (error %d)\n", Res);
+            Status = 2;
+        }
+        else if (fwrite(Bytes, 1, ByteCount, Out) != ByteCount)
+        {
+            fprintf(stderr, "ccugen: write error\n");
+            Status = 2;
+        }
+        Size -= Count;
+    }
+
+    if (fflush(Out) != 0 && !Status)
+    {
+        fprintf(stderr, "ccugen: write error\n");
+        Status = 2;
+    }
+    if (Out != stdout)
+        fclose(Out);
+    free(Block);
+    free(Bytes);
+    return Status;
+}
@@ -0,0 +1,225 @@
+// MIT License
+//
+// Copyright (c) 2018 Christoph Charles
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+// ccuvalidate: checks that a file is valid UTF8, splitting the work between threads.
+// The file is memory-mapped and cut into one slice per thread just before bytes that can not be extensions,
+// so each slice is validated on its own by ccunicode_ValidateUtf8Data with 64 bits offsets.
+
+#include "../../include/ccunicode.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CCUVALIDATE_MAX_THREADS 256
+
+// Slices smaller than this are not worth a thread
+#define CCUVALIDATE_MIN_SLICE (1 << 20)
+
+typedef struct
+{
+    const uint8_t *data;
+    int64_t begin;        // Offset of the first byte of the slice in the file
+    int64_t end;          // Offset one past the last byte of the slice
+    int result;           // Result of the validation
+    int64_t error_offset; // Offset of the first invalid character in the file
+    double seconds;       // Time spent validating the slice
+} TSlice;
+
+static double GetTime(void)
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return (double)Time.tv_sec + (double)Time.tv_nsec * 1e-9;
+}
+
+static void *ValidateSlice(void *Arg)
+{
+    TSlice *Slice = (TSlice*)Arg;
+    double Start = GetTime();
+    Slice->result = ccunicode_ValidateUtf8Data(Slice->data + Slice->begin, Slice->end - Slice->begin, &Slice->error_offset);
+    Slice->seconds = GetTime() - Start;
+    if (Slice->result != CCUNICODE_NO_ERROR)
+        Slice->error_offset += Slice->begin;
+    return NULL;
+}
+
+static void PrintUsage(FILE *Out)
+{
+    fprintf(Out,
+            "Usage: ccuvalidate [-j THREADS] [-q] FILE\n"
+            "Checks that FILE is valid UTF8 and reports the offset of the first invalid character.\n"
+            "\n"
+            "  -j THREADS  number of threads (default: number of online processors)\n"
+            "  -q          only report errors\n"
+            "  -h          show this help\n"
+            "\n"
+            "Exit status: 0 if the file is valid, 1 if it is not, 2 on usage or I/O error.\n");
+}
+
+int main(int argc, char **argv)
+{
+    long ThreadCount = sysconf(_SC_NPROCESSORS_ONLN);
+    int Quiet = 0;
+    const char *Path = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+        {
+            PrintUsage(stdout);
+            return 0;
+        }
+        else if (!strcmp(argv[i], "-q"))
+        {
+            Quiet = 1;
+        }
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+        {
+            char *End = NULL;
+            ThreadCount = strtol(argv[++i], &End, 10);
+            if (*End || ThreadCount < 1)
+            {
+                fprintf(stderr, "ccuvalidate: bad thread count '%s'\n", argv[i]);
+                return 2;
+            }
+        }
+        else if (!Path && (argv[i][0] != '-' || !argv[i][1]))
+        {
+            Path = argv[i];
+        }
+        else
+        {
+            PrintUsage(stderr);
+            return 2;
+        }
+    }
+    if (!Path)
+    {
+        PrintUsage(stderr);
+        return 2;
+    }
+    if (ThreadCount < 1)
+        ThreadCount = 1;
+    if (ThreadCount > CCUVALIDATE_MAX_THREADS)
+        ThreadCount = CCUVALIDATE_MAX_THREADS;
+
+    int Fd = open(Path, O_RDONLY);
+    struct stat Stat;
+    if (Fd < 0 || fstat(Fd, &Stat) != 0)
+    {
+        fprintf(stderr, "ccuvalidate: cannot open %s: %s\n", Path, strerror(errno));
+        return 2;
+    }
+
+    int64_t Size = (int64_t)Stat.st_size;
+    const uint8_t *Data = (const uint8_t*)"";
+    if (Size > 0)
+    {
+        void *Map = mmap(NULL, (size_t)Size, PROT_READ, MAP_PRIVATE, Fd, 0);
+        if (Map == MAP_FAILED)
+        {
+            fprintf(stderr, "ccuvalidate: cannot map %s: %s\n", Path, strerror(errno));
+            close(Fd);
+            return 2;
+        }
+#ifdef MADV_SEQUENTIAL
+        madvise(Map, (size_t)Size, MADV_SEQUENTIAL);
+#endif
+        Data = (const uint8_t*)Map;
+    }
+    close(Fd);
+
+    if (ThreadCount > Size / CCUVALIDATE_MIN_SLICE)
+        ThreadCount = (Size / CCUVALIDATE_MIN_SLICE > 0) ? Size / CCUVALIDATE_MIN_SLICE : 1;
+
+    // Slices are cut just before a byte that can not be an extension (at most 3 bytes after the even split)
+    static TSlice Slices[CCUVALIDATE_MAX_THREADS];
+    int64_t Begin = 0;
+    for (int i = 0; i < ThreadCount; ++i)
+    {
+        int64_t End = (i + 1 == ThreadCount) ? Size : Size / ThreadCount * (i + 1);
+        if (End < Begin)
+            End = Begin;
+        for (int j = 0; j < 3 && End < Size && Data[End] >= 0x80 && Data[End] <= 0xBF; ++j)
+            ++End;
+
+        Slices[i].data = Data;
+        Slices[i].begin = Begin;
+        Slices[i].end = End;
+        Begin = End;
+    }
+
+    double Start = GetTime();
+    pthread_t Threads[CCUVALIDATE_MAX_THREADS];
+    int Started[CCUVALIDATE_MAX_THREADS];
+    for (int i = 1; i < ThreadCount; ++i)
+        Started[i] = !pthread_create(&Threads[i], NULL, &ValidateSlice, &Slices[i]);
+    ValidateSlice(&Slices[0]);
+    for (int i = 1; i < ThreadCount; ++i)
+    {
+        // If a thread could not be created, its slice is validated here
+        if (Started[i])
+            pthread_join(Threads[i], NULL);
+        else
+            ValidateSlice(&Slices[i]);
+    }
+    double Seconds = GetTime() - Start;
+
+    int Status = 0;
+    for (int i = 0; i < ThreadCount; ++i)
+    {
+        TSlice *Slice = &Slices[i];
+        if (!Quiet)
+        {
+            double Bytes = (double)(Slice->end - Slice->begin);
+            printf("thread %d: bytes %lld-%lld, %.3f s, %.2f GB/s\n", i, (long long)Slice->begin, (long long)Slice->end,
+                   Slice->seconds, Slice->seconds > 0 ? Bytes / Slice->seconds * 1e-9 : 0.0);
+        }
+
+        // The first slice in the file with an error holds the first invalid character
+        if (Slice->result != CCUNICODE_NO_ERROR && !Status)
+        {
+            // A character cut by the end of a slice is followed by a byte that is not an extension
+            int Result = Slice->result;
+            if (Result == CCUNICODE_STRING_ENDED_IN_CHARACTER && Slice->end < Size)
+                Result = CCUNICODE_INVALID_UTF8_CHARACTER;
+            fprintf(stderr, "ccuvalidate: %s: invalid UTF8 at byte %lld (error %d)\n", Path, (long long)Slice->error_offset, Result);
+            Status = 1;
+        }
+    }
+    if (!Quiet)
+    {
+        printf("%s: %lld bytes, %s, %.3f s, %.2f GB/s with %ld threads\n", Path, (long long)Size, Status ? "invalid" : "valid",
+               Seconds, Seconds > 0 ? (double)Size / Seconds * 1e-9 : 0.0, ThreadCount);
+    }
+
+    if (Size > 0)
+        munmap((void*)Data, (size_t)Size);
+    return Status;
+}